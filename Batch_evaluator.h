@@ -0,0 +1,74 @@
+#pragma once
+#include "Compiled_expression.h"
+#include <cstdint>
+#include <vector>
+
+/*------Batch_evaluator.h------------------------------------------------------
+	The BatchEvaluator runs one CompiledExpression over many rows of input at
+	once. Inputs are laid out column by column (structure of arrays): every
+	variable slot of the expression gets its own contiguous array of values,
+	and row i of the result is the expression evaluated with the i-th value
+	of every column.
+
+	Key functionalities include:
+		- Constructor: Binds the evaluator to a compiled expression.
+		- evaluate: Fills an output array, one value per row, together with a
+		  per-row status. Rows are processed in cache-sized blocks so the
+		  intermediate values of a block stay in L1/L2.
+		- get_kernel_name: Reports which arithmetic kernels were picked.
+
+	The arithmetic kernels for + - * /, sqrt and integer powers come in
+	AVX-512, AVX2 and scalar flavours. The best one the CPU supports is picked
+	once at runtime through CPUID.
+
+	Errors do not abort the batch. A row that divides by zero or takes the
+	square root of a negative number gets a non-Ok RowStatus (the first error
+	on that row wins) and NaN as its output, and every other row still
+	produces its value.
+
+	Powers whose exponent is an integer constant (x^2, y^-3, ...) are computed
+	by repeated squaring. This can differ from std::pow in the last bit for
+	exponents other than 0, 1 and 2. All other powers go through std::pow.
+
+	evaluate is a template over the scalar type (see Scalar_traits.h), with
+	the error rules of that type: a complex batch has no NegativeSqrt rows.
+	float has its own AVX2 and AVX-512 kernels with twice as many rows per
+	instruction as double; long double, complex and interval rows use the
+	scalar kernels.
+----------------------------------------------------------------------------*/
+
+/* Input for one variable slot: a column of per-row values, or one value shared by every row. */
+template <typename Scalar>
+struct BasicBatchColumn {
+	const Scalar* rows;   // Contiguous per-row values, or nullptr to use `uniform` for every row.
+	Scalar uniform;       // Value of the variable on every row when rows is nullptr.
+};
+
+/* Input column of a double evaluation. */
+using BatchColumn = BasicBatchColumn<double>;
+
+class BatchEvaluator {
+
+private:
+	const CompiledExpression& program;   // Expression evaluated for every row.
+
+public:
+	/* Number of rows evaluated together. Sized so a block of intermediates fits in cache. */
+	static const size_t BLOCK_SIZE = 512;
+
+	/* Constructor: Binds the evaluator to an already compiled expression. */
+	explicit BatchEvaluator(const CompiledExpression& program);
+
+	/* Evaluates the expression for each of the given rows.
+	   columns[i] supplies variable slot i of the program (see
+	   CompiledExpression::get_variable_names); a per-row column must hold `rows`
+	   values. output and status must each hold `rows` entries. Returns the
+	   number of rows whose status is not Ok. Instantiated for the scalar
+	   types of Scalar_traits.h. */
+	template <typename Scalar>
+	size_t evaluate(const std::vector<BasicBatchColumn<Scalar>>& columns, size_t rows, Scalar* output, RowStatus* status) const;
+
+	/* Returns the name of the kernel set chosen for this CPU and scalar type ("avx512", "avx2" or "scalar"). */
+	template <typename Scalar = double>
+	static const char* get_kernel_name();
+};
@@ -0,0 +1,115 @@
+#pragma once
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "Session.h"
+#include "Thread_pool.h"
+
+/*-------Batch_runner.h-----------------------------------------------------
+	The BatchRunner feeds a whole stream of expressions, one per line, through
+	a Session without any prompt or banner. It is used by the non-interactive
+	mode of the calculator (`calculator --batch [file]`).
+
+	Output is meant for pipelines:
+		- stdout receives exactly one line per input line: the value of an
+		  expression, "name = value" for an assignment, an empty line for an
+		  empty input line, or "error" when the line failed. When the session
+		  computes in another scalar type (`--scalar complex`, ...),
+		  expressions print that type's value (Session::evaluate_text) while
+		  assignments still store and print a double.
+		- stderr receives one tab-separated record per failed line,
+		  "<line number>\t<error text>", followed by a throughput and cache summary.
+		  A line over the session's limits fails like any other ("Limit
+		  exceeded: ..."), is counted apart in the summary, and does not hold
+		  up the lines after it.
+
+	Input is read in large chunks and results are collected in a large
+	output buffer that is written out only when full, so there is no flush
+	per line. run() reports how many lines failed so the caller can set the
+	exit code.
+
+	With more than one thread, lines are grouped into tasks of up to
+	TASK_LINES consecutive lines and evaluated on a work-stealing ThreadPool.
+	Finished tasks wait in a reorder buffer until every earlier task has been
+	written, so the output keeps the input order. An assignment line changes
+	the variables later lines see, so it acts as a barrier: every earlier
+	task is finished and written, then the assignment runs on the calling
+	thread, and only then do later lines start.
+----------------------------------------------------------------------------*/
+
+/* Totals gathered while running a batch. */
+struct BatchSummary {
+	size_t lines;      // Number of input lines processed.
+	size_t failed;     // Number of lines that produced an error.
+	size_t limited;    // Number of those that ran out of their budget (see Resource_governor.h).
+	size_t bytes;      // Number of input bytes consumed.
+	double seconds;    // Wall-clock time spent in run().
+};
+
+/* A run of consecutive assignment-free lines evaluated by one pool task. */
+struct BatchTask {
+	size_t first_line;       // Line number of the first line of the task.
+	size_t line_count;       // Number of lines in the task.
+	std::string text;        // The lines themselves, each terminated by '\n'.
+	std::string output;      // Results, one line per input line.
+	std::string errors;      // Error records of the failed lines.
+	size_t failed;           // Number of failed lines.
+	size_t limited;          // Number of those that ran out of their budget.
+	bool done;               // Set once a worker has finished the task (guarded by the reorder mutex).
+};
+
+class BatchRunner {
+private:
+	Session& session;            // Session every line is executed in.
+	std::FILE* output;           // Destination of the per-line results.
+	std::FILE* errors;           // Destination of the per-line error records and the summary.
+	std::string output_buffer;   // Results waiting to be written.
+	std::string error_buffer;    // Error records waiting to be written.
+	std::string line;            // Current line, lowercased; reused to avoid reallocating.
+
+	size_t thread_count;                                // Number of worker threads (1 runs everything inline).
+	std::unique_ptr<ThreadPool> pool;                   // Workers, created by run() when thread_count > 1.
+	std::shared_ptr<BatchTask> open_task;               // Task still collecting lines.
+	std::deque<std::shared_ptr<BatchTask>> in_flight;   // Reorder buffer: submitted tasks in input order.
+	std::mutex reorder_mutex;                           // Guards BatchTask::done.
+	std::condition_variable task_finished;              // Signalled whenever a task is done.
+
+	/* Routes one line to the inline path or, in parallel mode, to a task. */
+	void handle_line(const char* text, size_t length, size_t line_number, BatchSummary& summary);
+
+	/* Executes one line and appends its result (or error record) to the buffers. */
+	void process_line(const char* text, size_t length, size_t line_number, BatchSummary& summary);
+
+	/* Hands the open task to the pool and places it at the back of the reorder buffer. */
+	void submit_open_task();
+
+	/* Writes every finished task at the front of the reorder buffer. Waits for tasks when
+	   the buffer is full, or until it is empty when wait_for_all is set. */
+	void drain_tasks(bool wait_for_all, BatchSummary& summary);
+
+	/* Evaluates every line of a task against a read-only session (runs on a worker). */
+	static void run_task(const Session& session, BatchTask& task);
+
+	/* Writes both buffers out if they have grown past the flush threshold (or unconditionally). */
+	void flush_buffers(bool force);
+
+public:
+	/* Size of the input chunks and the threshold at which the output buffers are written. */
+	static const size_t BUFFER_SIZE = 1 << 20;
+
+	/* Number of lines grouped into one parallel task. */
+	static const size_t TASK_LINES = 1024;
+
+	/* Constructor: Binds the runner to a session and its output streams. With thread_count
+	   greater than one, assignment-free lines are evaluated in parallel. */
+	BatchRunner(Session& session, std::FILE* output, std::FILE* errors, size_t thread_count = 1);
+
+	/* Executes every line of the input stream and returns the totals. */
+	BatchSummary run(std::FILE* input);
+
+	/* Writes a human-readable throughput summary to the error stream. */
+	void print_summary(const BatchSummary& summary);
+};
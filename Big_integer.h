@@ -0,0 +1,107 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*------Big_integer.h----------------------------------------------------------
+	A BigInteger is a signed integer of any size, used by exact arithmetic
+	(see Exact_number.h) once a value no longer fits in 64 bits.
+
+	The magnitude is kept as 32-bit limbs, least significant first, so every
+	limb product fits in a 64-bit integer on any compiler.
+
+	Key functionalities include:
+		- +, -, *, /, %: The usual arithmetic; / and % truncate toward zero
+		  like the built-in integers and throw on a zero divisor.
+		- power: Exponentiation by squaring.
+		- sqrt: The integer square root (rounded down).
+		- gcd: The greatest common divisor, for reducing fractions.
+		- parse / to_string: Conversion from and to decimal digits.
+
+	Multiplication is schoolbook below KARATSUBA_THRESHOLD limbs and
+	Karatsuba above it (three half-size products instead of four), which is
+	what makes powers like 2^100000 and long products fast. Division is
+	Knuth's algorithm D.
+----------------------------------------------------------------------------*/
+
+/* Operands of at least this many limbs (32 bits each) on both sides are multiplied with Karatsuba. */
+const size_t KARATSUBA_THRESHOLD = 32;
+
+class BigInteger {
+private:
+	std::vector<std::uint32_t> limbs;   // Magnitude, least significant limb first, without leading zero limbs.
+	bool negative;                      // Sign; zero is never negative.
+
+	/* Drops leading zero limbs and clears the sign of zero. */
+	void trim();
+
+public:
+	/* Constructor: Zero. */
+	BigInteger();
+
+	/* Constructor: The value of a built-in integer. */
+	BigInteger(std::int64_t value);
+
+	/* Returns the value of an unsigned 64-bit integer. */
+	static BigInteger from_unsigned(std::uint64_t value);
+
+	/* Reads an optional '-' followed by decimal digits. Throws on anything else. */
+	static BigInteger parse(std::string_view text);
+
+	bool is_zero() const;
+	bool is_negative() const;
+
+	/* Returns -1, 0 or 1. */
+	int sign() const;
+
+	/* Returns the number of bits of the magnitude (0 for zero). */
+	size_t bit_length() const;
+
+	/* Returns the number of zero bits below the lowest set bit (0 for zero). */
+	size_t trailing_zero_bits() const;
+
+	/* Reports whether the value lies within [-INT64_MAX, INT64_MAX]. */
+	bool fits_int64() const;
+
+	/* Returns the value as a built-in integer. Only meaningful when fits_int64(). */
+	std::int64_t to_int64() const;
+
+	/* Returns the nearest double (within one unit in the last place), or an infinity if too large. */
+	double to_double() const;
+
+	/* Returns the decimal digits, with a leading '-' when negative. */
+	std::string to_string() const;
+
+	BigInteger operator-() const;
+	BigInteger abs() const;
+
+	/* Shifts the magnitude by a number of bits, keeping the sign. */
+	BigInteger shifted_left(size_t bits) const;
+	BigInteger shifted_right(size_t bits) const;
+
+	friend BigInteger operator+(const BigInteger& a, const BigInteger& b);
+	friend BigInteger operator-(const BigInteger& a, const BigInteger& b);
+	friend BigInteger operator*(const BigInteger& a, const BigInteger& b);
+	friend BigInteger operator/(const BigInteger& a, const BigInteger& b);
+	friend BigInteger operator%(const BigInteger& a, const BigInteger& b);
+	friend bool operator==(const BigInteger& a, const BigInteger& b);
+	friend bool operator!=(const BigInteger& a, const BigInteger& b);
+	friend bool operator<(const BigInteger& a, const BigInteger& b);
+
+	/* Computes the truncated quotient and the remainder (which takes the sign of a) together. Throws on a zero divisor. */
+	static void divide(const BigInteger& a, const BigInteger& b, BigInteger& quotient, BigInteger& remainder);
+
+	/* Divides by a small positive number in place and returns the remainder of the magnitude. */
+	std::uint32_t divide_small(std::uint32_t divisor);
+
+	/* Returns base^exponent, by repeated squaring. */
+	static BigInteger power(const BigInteger& base, std::uint64_t exponent);
+
+	/* Returns the largest integer whose square does not exceed the value. Throws on a negative value. */
+	static BigInteger sqrt(const BigInteger& value);
+
+	/* Returns the greatest common divisor of the magnitudes (gcd(0, 0) is 0). */
+	static BigInteger gcd(const BigInteger& a, const BigInteger& b);
+};
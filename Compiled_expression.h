@@ -0,0 +1,204 @@
+#pragma once
+#include "Expression_node.h"
+#include "Result.h"
+#include "Scalar_traits.h"
+#include "Symbol_table.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class NativeExpression;
+
+/*------Compiled_expression.h--------------------------------------------------
+	The CompiledExpression class lowers an expression tree produced by the
+	Parser into a flat sequence of bytecode instructions that a small stack
+	machine can run over and over without walking the tree again.
+
+	Key functionalities include:
+		- Constructor: Compiles the given expression tree once. Number literals
+		  are decoded into a constant pool and every distinct variable name is
+		  given a numbered slot.
+		- evaluate: Runs the bytecode against an array of slot values, or
+		  against a SymbolTable (gathering the values of its symbols).
+		- get_variable_names: Lists the variable names in slot order so callers
+		  can lay out the value array.
+		- bind: Copies the program with its variables resolved in another
+		  symbol table, so one compilation serves several sessions.
+
+	For instance, "2x + 3" compiles to:
+		push_const 2, push_var x, mul, push_const 3, add
+	and evaluate({5}) returns 13.
+
+	A node shared by several parents (see Subexpression_eliminator.h) is
+	compiled once: its value is stored in a temporary after it is computed,
+	and later uses load the temporary instead of recomputing it.
+
+	evaluate_as runs the same program in another scalar type (float, long
+	double, complex or interval, see Scalar_traits.h); evaluate is
+	evaluate_as<double>.
+
+	try_evaluate and try_evaluate_as return a division by zero, an invalid
+	square root or an undefined variable as an Error (see Result.h) instead
+	of throwing it. The bytecode keeps no source offsets, so these errors
+	have position 0.
+
+	Errors come in the Evaluator's order, so a line reports the same one
+	whichever of the two runs it:
+		- A division computes its divisor first and checks it
+		  (CheckDivisor) before the dividend runs, then divides
+		  (DivideSwapped).
+		- A variable without a value fails when it is pushed, not before
+		  the program starts.
+		- A malformed node compiles to a Fail instruction, which fails when
+		  the run reaches it; compiling never throws.
+
+	attach_native gives the program x86-64 machine code (see
+	Native_expression.h); evaluations in double then call it and only run
+	the bytecode when it returns NaN, to report the error or the exact NaN.
+	The results are the same bit for bit. bind keeps the machine code,
+	which reads the same slots.
+
+	Evaluator::evaluate remains the reference implementation; the compiled
+	form produces the same results and the same error messages.
+	tests/error_parity_test.cpp checks both on random expressions.
+----------------------------------------------------------------------------*/
+
+/* Enumerates the instructions understood by the stack machine. New instructions go at the end, since
+   snapshots store the numbers. */
+enum class OpCode : std::uint8_t {
+	PushConstant,   // Pushes constants[operand].
+	PushVariable,   // Pushes values[operand] (fails if the variable has no value).
+	Add,            // Pops b, a and pushes a + b.
+	Subtract,       // Pops b, a and pushes a - b.
+	Multiply,       // Pops b, a and pushes a * b.
+	Divide,         // Pops b, a and pushes a / b (b must not be zero). Only in programs of version 1 snapshots.
+	Power,          // Pops b, a and pushes pow(a, b).
+	Sqrt,           // Pops a and pushes sqrt(a) (a must not be negative).
+	Negate,         // Pops a and pushes -a.
+	PowerInteger,   // Pops a and pushes a raised to the signed integer held in the operand.
+	StoreTemp,      // Copies the top of the stack into temps[operand], leaving it on the stack.
+	LoadTemp,       // Pushes temps[operand].
+	CheckDivisor,   // Fails if the top of the stack is a zero divisor, leaving it there.
+	DivideSwapped,  // Pops a, b and pushes a / b: the divisor b was computed first.
+	Fail            // Fails with the error of a malformed node, whose token type is the operand (or NO_NODE_TYPE).
+};
+
+/* A single bytecode instruction. The operand is only meaningful for the push and temp
+   instructions, PowerInteger (where it holds the exponent's two's complement bits) and Fail. */
+struct Instruction {
+	OpCode op;
+	std::uint32_t operand;
+};
+
+/* Operand of a Fail instruction standing for a missing node. */
+const std::uint32_t NO_NODE_TYPE = 0xFFFFFFFFu;
+
+class CompiledExpression {
+
+private:
+	std::vector<Instruction> code;              // Instructions in execution (post-order) order.
+	std::vector<double> constants;              // Pre-decoded number literals.
+	std::vector<std::string> variable_names;    // Variable name of each slot.
+	std::vector<SymbolId> variable_symbols;     // Symbol table slot of each variable, when the tokenizer assigned one.
+	size_t max_stack_depth;                     // Deepest stack the program needs.
+	size_t temp_count;                          // Number of temporaries holding shared subexpressions.
+	std::vector<std::uint32_t> node_temps;      // Temporary of each shared node, while compiling.
+	std::unordered_map<std::string_view, std::uint32_t> name_slots;  // Slot of each variable name, while compiling.
+	std::shared_ptr<const NativeExpression> native;  // Machine code of the program (see attach_native), or null.
+	double (*native_function)(const double*);   // Its entry point, or nullptr to interpret.
+
+	/* Emits the instructions for the whole tree, tracking the stack depth. */
+	void compile(const ExpressionTree& tree, NodeIndex root);
+
+	/* Checks a node the way the evaluator does. Returns false for a malformed node, setting
+	   failure to the operand of its Fail instruction, else sets operands to the number it takes. */
+	static bool check_node(const ExpressionTree& tree, NodeIndex index, std::uint32_t& operands, std::uint32_t& failure);
+
+	/* Emits the instruction computing one node from its operands. */
+	void emit_operation(const ExpressionTree& tree, const ExpressionNode& node);
+
+	/* Returns the slot assigned to a variable, assigning a new one if needed. */
+	std::uint32_t slot_for(const Token& token);
+
+	/* Runs the program into result, stopping at the first operation that fails and setting
+	   operand to the operand of the failing instruction. When Checked, defined[i] tells whether
+	   slot i has a value, and pushing one that has none fails. */
+	template <typename Scalar, bool Checked = false>
+	RowStatus run(const Scalar* values, Scalar& result, std::uint32_t& operand, const std::uint8_t* defined = nullptr) const;
+
+	/* Returns the Error of a run that stopped with the given status at an instruction with the given operand. */
+	Error run_error(RowStatus status, std::uint32_t operand) const;
+
+	/* Runs the program with the values held by the symbol table. */
+	template <typename Scalar>
+	Error run_with(const SymbolTable& symbols, Scalar& result) const;
+
+public:
+	/* Constructor: Compiles the expression tree rooted at the given node. */
+	CompiledExpression(const ExpressionTree& tree, NodeIndex root);
+
+	/* Constructor: Rebuilds a compiled program from its parts, as stored in a snapshot (see
+	   Snapshot.h). The arrays are copied in bulk; nothing is parsed or compiled again. */
+	CompiledExpression(const Instruction* code, size_t code_size, const double* constants, size_t constant_count,
+		std::vector<std::string> variable_names, std::vector<SymbolId> variable_symbols,
+		size_t max_stack_depth, size_t temp_count);
+
+	/* Runs the program. values[i] holds the value of the variable in slot i. */
+	double evaluate(const double* values) const;
+
+	/* Runs the program with the values held by the given symbol table. */
+	double evaluate(const SymbolTable& symbols) const;
+
+	/* Runs the program in the given scalar type. values[i] holds the value of the variable in
+	   slot i. Instantiated for float, double, long double, std::complex<double> and Interval. */
+	template <typename Scalar>
+	Scalar evaluate_as(const Scalar* values) const;
+
+	/* Runs the program in the given scalar type with the values held by the symbol table. */
+	template <typename Scalar>
+	Scalar evaluate_as(const SymbolTable& symbols) const;
+
+	/* Same as evaluate, but returns a failure as an Error instead of throwing it. */
+	Result<double> try_evaluate(const double* values) const;
+	Result<double> try_evaluate(const SymbolTable& symbols) const;
+
+	/* Same as evaluate_as, but returns a failure as an Error instead of throwing it. */
+	template <typename Scalar>
+	Result<Scalar> try_evaluate_as(const Scalar* values) const;
+
+	template <typename Scalar>
+	Result<Scalar> try_evaluate_as(const SymbolTable& symbols) const;
+
+	/* Generates machine code that double evaluations run from now on. Returns false, leaving the
+	   program interpreted, where native code is not supported or the program cannot be translated.
+	   Call it before the program is shared between threads. */
+	bool attach_native();
+
+	/* Reports whether double evaluations run machine code. */
+	bool is_native() const;
+
+	/* Returns a copy whose variables have slots in the given symbol table (new names are
+	   interned), so a program compiled for one session can run in another. */
+	std::shared_ptr<const CompiledExpression> bind(SymbolTable& symbols) const;
+
+	/* Returns the variable names in slot order. */
+	const std::vector<std::string>& get_variable_names() const;
+
+	/* Returns the instruction listing, mainly for inspection and debugging. */
+	const std::vector<Instruction>& get_code() const;
+
+	/* Returns the constant pool referenced by PushConstant instructions. */
+	const std::vector<double>& get_constants() const;
+
+	/* Returns the deepest stack the program needs while running. */
+	size_t get_max_stack_depth() const;
+
+	/* Returns the number of temporaries referenced by StoreTemp and LoadTemp instructions. */
+	size_t get_temp_count() const;
+
+	/* Returns an estimate of the heap memory held by the program, in bytes. */
+	size_t get_memory_usage() const;
+};
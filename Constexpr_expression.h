@@ -0,0 +1,572 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+
+/*------Constexpr_expression.h-------------------------------------------------
+	calc::expr parses a formula that is known when the program is built, at
+	compile time, into a type whose evaluation is plain inline arithmetic:
+
+		using Distance = calc::expr<"sqrt(x^2 + y^2)">;
+		double d = Distance{}(3.0, 4.0);   // 5, no Tokenizer, Parser or tree
+
+	The formula follows exactly the grammar of the runtime Tokenizer and
+	Parser: numbers (with optional exponent), variables, + - * / ^, sqrt,
+	parentheses, implicit multiplication ("2x", "3(x + 1)"), right-associative
+	powers and the Parser's unary minus, which multiplies the next primary by
+	-1 (so "-x^2" is (-x)^2, as at runtime). Anything the runtime would reject
+	while tokenizing or parsing, such as an invalid character or mismatched
+	parentheses, is a compile error here; the error names the failing check.
+
+	Variables take slots in order of first appearance, so "2x + y^2" reads
+	values[0] as x and values[1] as y. operator() takes the values as
+	arguments in that order; evaluate() takes an array.
+
+	Evaluation matches Evaluator::evaluate on the parsed tree bit for bit:
+	the operations happen in the same order on the same doubles, divisions
+	check the divisor first, and division by zero or the square root of a
+	negative number throw the same std::runtime_error messages.
+
+	Number literals are converted at compile time only when the conversion
+	is provably exact (at most 15 or so significant digits and a decimal
+	exponent within 22, which covers ordinary literals); other literals are
+	rejected rather than risk a result that differs from std::from_chars.
+
+	The formula text stays available as expr::text, so the same source can
+	be handed to the runtime Tokenizer as well.
+----------------------------------------------------------------------------*/
+
+namespace calc {
+
+/* A string literal usable as a template argument. */
+template <std::size_t N>
+struct fixed_string {
+	char text[N] = {};
+
+	constexpr fixed_string(const char (&literal)[N]) {
+		for (std::size_t i = 0; i < N; i++) {
+			text[i] = literal[i];
+		}
+	}
+
+	/* Returns the characters without the terminating null. */
+	constexpr std::string_view view() const {
+		return std::string_view(text, N - 1);
+	}
+};
+
+namespace detail {
+
+/* grammar_error: Not constexpr on purpose, so reaching it while parsing at compile time is a compile error naming the message */
+inline void grammar_error(const char* message) {
+	throw std::logic_error(message);
+}
+
+/* Kind of a parsed node. */
+enum class Kind : std::uint8_t {
+	Number,
+	Variable,
+	Add,
+	Subtract,
+	Multiply,
+	Divide,
+	Power,
+	Sqrt
+};
+
+const std::size_t NO_CHILD = static_cast<std::size_t>(-1);
+
+/* One node of the compile-time tree; children are indices into the node array. */
+struct Node {
+	Kind kind = Kind::Number;
+	double value = 0;               // Value of a Number.
+	std::size_t slot = 0;           // Slot of a Variable.
+	std::size_t left = NO_CHILD;
+	std::size_t right = NO_CHILD;
+};
+
+/* Result of parsing a formula of at most Capacity nodes. */
+template <std::size_t Capacity>
+struct Tree {
+	std::array<Node, Capacity> nodes = {};
+	std::size_t count = 0;
+	std::size_t root = NO_CHILD;
+	std::array<std::size_t, Capacity> name_start = {};    // Position of each variable name in the text.
+	std::array<std::size_t, Capacity> name_length = {};   // Length of each variable name.
+	std::size_t variable_count = 0;
+};
+
+/* Token kinds, as produced by the runtime Tokenizer. */
+enum class Lexeme : std::uint8_t {
+	Number,
+	Variable,
+	Sqrt,
+	Plus,
+	Minus,
+	Star,
+	Slash,
+	Caret,
+	Open,
+	Close,
+	End
+};
+
+struct Lexeme_token {
+	Lexeme type = Lexeme::End;
+	double value = 0;
+	std::size_t start = 0;
+	std::size_t length = 0;
+};
+
+constexpr bool is_space(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+constexpr bool is_digit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+constexpr bool is_alpha(char c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+/* decode: Converts the longest valid prefix of a literal, as std::from_chars would, when the conversion is exact */
+constexpr double decode(std::string_view text) {
+	const std::uint64_t MAX_EXACT = std::uint64_t(1) << 53;
+	std::uint64_t mantissa = 0;
+	int exponent = 0;
+	std::size_t i = 0;
+	bool fraction = false;
+
+	while (i < text.size() && (is_digit(text[i]) || (text[i] == '.' && !fraction))) {
+		if (text[i] == '.') {
+			fraction = true;
+		}
+		else if (mantissa != 0 || text[i] != '0') {
+			if (mantissa > (MAX_EXACT - 9) / 10) {
+				grammar_error("Number literal has too many digits to convert exactly at compile time");
+			}
+			mantissa = mantissa * 10 + static_cast<std::uint64_t>(text[i] - '0');
+			exponent -= fraction ? 1 : 0;
+		}
+		else if (fraction) {  // Leading zeros after the point still scale the value
+			exponent--;
+		}
+		i++;
+	}
+
+	if (i < text.size() && (text[i] == 'e' || text[i] == 'E')) {
+		std::size_t digits = i + 1;
+		bool negative = false;
+		if (digits < text.size() && (text[digits] == '+' || text[digits] == '-')) {
+			negative = text[digits] == '-';
+			digits++;
+		}
+		if (digits < text.size() && is_digit(text[digits])) {
+			int power = 0;
+			while (digits < text.size() && is_digit(text[digits])) {
+				power = power < 10000 ? power * 10 + (text[digits] - '0') : power;
+				digits++;
+			}
+			exponent += negative ? -power : power;
+		}
+	}
+
+	if (mantissa == 0) {
+		return 0.0;
+	}
+	if (exponent < -22 || exponent > 22) {
+		grammar_error("Number literal cannot be converted exactly at compile time");
+	}
+
+	// Both operands are exact, so the single multiplication or division rounds correctly
+	double scale = 1.0;
+	for (int k = 0; k < (exponent < 0 ? -exponent : exponent); k++) {
+		scale *= 10.0;
+	}
+	double value = static_cast<double>(mantissa);
+	return exponent < 0 ? value / scale : value * scale;
+}
+
+/* Recursive-descent parser mirroring Parser, reading tokens the way Tokenizer produces them. */
+template <std::size_t Capacity>
+class Compile_time_parser {
+private:
+	std::string_view text;
+	std::size_t position = 0;
+	Lexeme_token current;
+	Tree<Capacity> tree;
+
+	/* next_token: Same character classes, keyword and number rules as Tokenizer::next_token */
+	constexpr Lexeme_token next_token() {
+		while (position < text.size()) {
+			char c = text[position];
+			std::size_t start = position;
+
+			if (is_space(c)) {
+				position++;
+				continue;
+			}
+			if (is_digit(c)) {
+				while (position < text.size() && (is_digit(text[position]) || text[position] == '.')) {
+					position++;
+				}
+				std::size_t digits = position + 1;
+				if (digits < text.size() && (text[digits] == '+' || text[digits] == '-')) {
+					digits++;
+				}
+				if (position < text.size() && (text[position] == 'e' || text[position] == 'E') && digits < text.size() && is_digit(text[digits])) {
+					position = digits;
+					while (position < text.size() && is_digit(text[position])) {
+						position++;
+					}
+				}
+				return { Lexeme::Number, decode(text.substr(start, position - start)), start, position - start };
+			}
+			if (is_alpha(c)) {
+				while (position < text.size() && is_alpha(text[position])) {
+					position++;
+				}
+				Lexeme type = text.substr(start, position - start) == "sqrt" ? Lexeme::Sqrt : Lexeme::Variable;
+				return { type, 0, start, position - start };
+			}
+
+			position++;
+			switch (c) {
+				case '+': return { Lexeme::Plus, 0, start, 1 };
+				case '-': return { Lexeme::Minus, 0, start, 1 };
+				case '*': return { Lexeme::Star, 0, start, 1 };
+				case '/': return { Lexeme::Slash, 0, start, 1 };
+				case '^': return { Lexeme::Caret, 0, start, 1 };
+				case '(': return { Lexeme::Open, 0, start, 1 };
+				case ')': return { Lexeme::Close, 0, start, 1 };
+				default: grammar_error("Invalid character encountered");
+			}
+		}
+		return { Lexeme::End, 0, position, 0 };
+	}
+
+	constexpr void advance() {
+		if (current.type == Lexeme::End) {
+			grammar_error("Unexpected end of input");
+		}
+		current = next_token();
+	}
+
+	constexpr std::size_t make_node(Kind kind, std::size_t left, std::size_t right) {
+		Node& node = tree.nodes[tree.count];
+		node.kind = kind;
+		node.left = left;
+		node.right = right;
+		return tree.count++;
+	}
+
+	constexpr std::size_t make_number(double value) {
+		std::size_t index = make_node(Kind::Number, NO_CHILD, NO_CHILD);
+		tree.nodes[index].value = value;
+		return index;
+	}
+
+	/* make_variable: Reuses the slot of a name seen before, like CompiledExpression::slot_for */
+	constexpr std::size_t make_variable(std::size_t start, std::size_t length) {
+		std::string_view name = text.substr(start, length);
+		std::size_t slot = 0;
+
+		while (slot < tree.variable_count && text.substr(tree.name_start[slot], tree.name_length[slot]) != name) {
+			slot++;
+		}
+		if (slot == tree.variable_count) {
+			tree.name_start[slot] = start;
+			tree.name_length[slot] = length;
+			tree.variable_count++;
+		}
+
+		std::size_t index = make_node(Kind::Variable, NO_CHILD, NO_CHILD);
+		tree.nodes[index].slot = slot;
+		return index;
+	}
+
+	static constexpr bool is_primary(Lexeme type) {
+		return type == Lexeme::Number || type == Lexeme::Open || type == Lexeme::Variable || type == Lexeme::Sqrt;
+	}
+
+	constexpr void check_parentheses_balance() {
+		int count = 0;
+
+		for (char c : text) {
+			if (c == '(') {
+				count++;
+			}
+			else if (c == ')') {
+				count--;
+			}
+			if (count < 0) {
+				grammar_error("Expected ')' before matching '('");
+			}
+		}
+		if (count != 0) {
+			grammar_error("Mismatched parentheses");
+		}
+	}
+
+	constexpr std::size_t parse_primary() {
+		Lexeme_token token = current;
+		advance();
+
+		switch (token.type) {
+			case Lexeme::Number:
+				return make_number(token.value);
+
+			case Lexeme::Open: {
+				std::size_t node = parse_expression();
+				if (current.type != Lexeme::Close) {
+					grammar_error("Expected ')'");
+				}
+				advance();
+				return node;
+			}
+
+			case Lexeme::Sqrt:
+				return make_node(Kind::Sqrt, parse_primary(), NO_CHILD);
+
+			case Lexeme::Variable:
+				return make_variable(token.start, token.length);
+
+			case Lexeme::Minus:  // The runtime Parser builds a subtraction without right operand, which can never be evaluated
+				grammar_error("Invalid nodes for subtraction operation");
+				return NO_CHILD;
+
+			default:
+				grammar_error("Unexpected token");
+				return NO_CHILD;
+		}
+	}
+
+	constexpr std::size_t parse_unary() {
+		if (current.type == Lexeme::Minus) {
+			advance();
+			std::size_t operand = parse_primary();
+			std::size_t minus_one = make_number(-1.0);
+			return make_node(Kind::Multiply, minus_one, operand);
+		}
+		return parse_primary();
+	}
+
+	constexpr std::size_t parse_factor() {
+		std::size_t left = parse_unary();
+
+		if (current.type == Lexeme::Caret) {
+			advance();
+			std::size_t right = parse_factor();  // Right-associative, like Parser::parse_factor
+			return make_node(Kind::Power, left, right);
+		}
+		return left;
+	}
+
+	constexpr std::size_t parse_term() {
+		std::size_t left = parse_factor();
+
+		while (current.type == Lexeme::Star || current.type == Lexeme::Slash || is_primary(current.type)) {
+			Kind kind = Kind::Multiply;  // Implicit multiplication when a primary follows directly
+
+			if (!is_primary(current.type)) {
+				kind = current.type == Lexeme::Star ? Kind::Multiply : Kind::Divide;
+				advance();
+			}
+			std::size_t right = parse_factor();
+			left = make_node(kind, left, right);
+		}
+		return left;
+	}
+
+	constexpr std::size_t parse_expression() {
+		std::size_t left = parse_term();
+
+		while (current.type == Lexeme::Plus || current.type == Lexeme::Minus) {
+			Kind kind = current.type == Lexeme::Plus ? Kind::Add : Kind::Subtract;
+			advance();
+			std::size_t right = parse_term();
+			left = make_node(kind, left, right);
+		}
+		return left;
+	}
+
+public:
+	constexpr explicit Compile_time_parser(std::string_view text) : text(text) {}
+
+	/* parse: Same checks, in the same order, as Parser::parse */
+	constexpr Tree<Capacity> parse() {
+		current = next_token();
+
+		if (!is_primary(current.type) && current.type != Lexeme::Minus) {
+			grammar_error("Unexpected token at the start");
+		}
+		check_parentheses_balance();
+
+		tree.root = parse_expression();
+		if (current.type != Lexeme::End) {
+			grammar_error("Unexpected token at the end of input");
+		}
+		return tree;
+	}
+};
+
+/* parse: Every character adds at most two nodes (a unary minus adds a -1 and a multiplication) */
+template <std::size_t N>
+consteval Tree<2 * N + 2> parse(const fixed_string<N>& text) {
+	return Compile_time_parser<2 * N + 2>(text.view()).parse();
+}
+
+/* Holds the parsed tree of a formula, so it can be referred to from template arguments. */
+template <fixed_string Text>
+struct parsed {
+	static constexpr auto tree = parse(Text);
+};
+
+/*------Expression templates---------------------------------------------------*/
+
+template <double Value>
+struct constant {
+	static double evaluate(const double*) {
+		return Value;
+	}
+};
+
+template <std::size_t Slot>
+struct variable {
+	static double evaluate(const double* values) {
+		return values[Slot];
+	}
+};
+
+template <class Left, class Right>
+struct add {
+	static double evaluate(const double* values) {
+		double left = Left::evaluate(values);
+		return left + Right::evaluate(values);
+	}
+};
+
+template <class Left, class Right>
+struct subtract {
+	static double evaluate(const double* values) {
+		double left = Left::evaluate(values);
+		return left - Right::evaluate(values);
+	}
+};
+
+template <class Left, class Right>
+struct multiply {
+	static double evaluate(const double* values) {
+		double left = Left::evaluate(values);
+		return left * Right::evaluate(values);
+	}
+};
+
+template <class Left, class Right>
+struct divide {
+	static double evaluate(const double* values) {
+		double divisor = Right::evaluate(values);  // The divisor is checked first, as in Evaluator
+		if (divisor == 0) {
+			throw std::runtime_error("Division by zero");
+		}
+		return Left::evaluate(values) / divisor;
+	}
+};
+
+template <class Left, class Right>
+struct power {
+	static double evaluate(const double* values) {
+		double base = Left::evaluate(values);
+		return std::pow(base, Right::evaluate(values));
+	}
+};
+
+template <class Operand>
+struct square_root {
+	static double evaluate(const double* values) {
+		double value = Operand::evaluate(values);
+		if (value < 0) {
+			throw std::runtime_error("Invalid input for square root");
+		}
+		return std::sqrt(value);
+	}
+};
+
+/* build: Maps the node at Index, and its children, to the matching expression template */
+template <const auto& Parsed, std::size_t Index>
+constexpr auto build() {
+	constexpr Node node = Parsed.nodes[Index];
+
+	if constexpr (node.kind == Kind::Number) {
+		return constant<node.value>{};
+	}
+	else if constexpr (node.kind == Kind::Variable) {
+		return variable<node.slot>{};
+	}
+	else if constexpr (node.kind == Kind::Sqrt) {
+		return square_root<decltype(build<Parsed, node.left>())>{};
+	}
+	else {
+		using Left = decltype(build<Parsed, node.left>());
+		using Right = decltype(build<Parsed, node.right>());
+
+		if constexpr (node.kind == Kind::Add) {
+			return add<Left, Right>{};
+		}
+		else if constexpr (node.kind == Kind::Subtract) {
+			return subtract<Left, Right>{};
+		}
+		else if constexpr (node.kind == Kind::Multiply) {
+			return multiply<Left, Right>{};
+		}
+		else if constexpr (node.kind == Kind::Divide) {
+			return divide<Left, Right>{};
+		}
+		else {
+			return power<Left, Right>{};
+		}
+	}
+}
+
+} // namespace detail
+
+/* A formula parsed at compile time. */
+template <fixed_string Text>
+struct expr {
+	/* The formula as written. */
+	static constexpr std::string_view text = Text.view();
+
+	/* Expression template type the formula was parsed into. */
+	using type = decltype(detail::build<detail::parsed<Text>::tree, detail::parsed<Text>::tree.root>());
+
+	/* Number of distinct variables, i.e. of values evaluate() reads. */
+	static constexpr std::size_t variable_count = detail::parsed<Text>::tree.variable_count;
+
+	/* Variable names in slot order. */
+	static constexpr std::array<std::string_view, variable_count> variable_names = [] {
+		std::array<std::string_view, variable_count> names = {};
+		for (std::size_t i = 0; i < variable_count; i++) {
+			names[i] = Text.view().substr(detail::parsed<Text>::tree.name_start[i], detail::parsed<Text>::tree.name_length[i]);
+		}
+		return names;
+	}();
+
+	/* Evaluates the formula. values[i] holds the value of the variable in slot i. */
+	static double evaluate(const double* values) {
+		return type::evaluate(values);
+	}
+
+	/* Evaluates the formula with the variable values given in slot order. */
+	template <class... Values>
+	double operator()(Values... arguments) const {
+		static_assert(sizeof...(Values) == variable_count, "calc::expr expects one argument per variable, in order of first appearance");
+		const double values[sizeof...(Values) + 1] = { static_cast<double>(arguments)... };
+		return type::evaluate(values);
+	}
+};
+
+} // namespace calc
@@ -0,0 +1,124 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Compiled_expression.h"
+#include "Result.h"
+#include "Symbol_table.h"
+
+/*-------Dependency_graph.h-------------------------------------------------
+	The DependencyGraph gives a session spreadsheet-style variables: an
+	assignment keeps its expression, and the variable is recomputed whenever
+	a variable it reads changes.
+
+		x = 4
+		y = sqrt(x)      -> 2
+		x = 9            -> y becomes 3 without re-entering it
+
+	Every variable defined through the graph holds a formula (its compiled
+	expression) and the list of variables the formula reads (its inputs).
+	Together they form a DAG; a definition that would close a cycle, such as
+	"x = y + 1" while y depends on x, is rejected.
+
+	When a variable changes, only the variables that depend on it, directly
+	or through others, are visited, in topological order so every formula
+	sees up-to-date inputs. A formula whose inputs all kept their values is
+	skipped, so an update stops spreading as soon as nothing changes.
+
+	A formula that fails (for instance a division by zero), whether when it
+	is defined or during an update, is kept: its variable becomes undefined
+	and remembers the error, and it recovers on the next update that makes
+	it valid again.
+
+		x = 16
+		w = 1/(x-16)     -> Division by zero, w is undefined
+		x = 17           -> w becomes 1
+
+	Only a definition that would close a cycle is rejected; syntax errors
+	never reach the graph.
+
+	take_changed reports every variable whose value changed (or became
+	undefined) since the previous call, so a caller can refresh only what
+	moved.
+----------------------------------------------------------------------------*/
+
+class DependencyGraph {
+private:
+	/* The expression a variable is computed from. */
+	struct Formula {
+		std::shared_ptr<const CompiledExpression> program;   // Compiled right-hand side, or nullptr.
+		std::vector<SymbolId> inputs;                        // Variables the formula reads.
+		std::string error;                                   // Error of the last failed evaluation.
+	};
+
+	SymbolTable& symbols;                          // Variables the formulas read and write.
+	std::vector<Formula> formulas;                 // Formula of each slot (program is nullptr for plain variables).
+	std::vector<std::vector<SymbolId>> dependents; // Formulas reading each slot.
+
+	std::vector<std::uint8_t> changed_flags;       // Whether each slot is already listed in changed.
+	std::vector<SymbolId> changed;                 // Slots that changed since the last take_changed().
+	std::vector<std::uint8_t> dirty;               // Slots whose value changed during the current update.
+
+	std::vector<std::uint32_t> visited;            // Traversal that last reached each slot.
+	std::uint32_t traversal;                       // Number of the current traversal.
+	std::vector<SymbolId> order;                   // Scratch: affected slots in topological order.
+	size_t recomputed;                             // Formulas evaluated by the last define().
+
+	/* Grows the per-slot vectors to cover every interned symbol. */
+	void reserve_slots();
+
+	/* Starts a new traversal, so every slot counts as unvisited. */
+	void begin_traversal();
+
+	/* Throws if making target read the given inputs would close a cycle. */
+	void check_cycle(SymbolId target, const std::vector<SymbolId>& inputs);
+
+	/* Lists the variables depending on source, each after everything it reads. */
+	void collect_dependents(SymbolId source);
+
+	/* Records that a slot's value changed during the current update. */
+	void mark_changed(SymbolId id);
+
+	/* Recomputes every variable affected by a change of source. */
+	void propagate(SymbolId source);
+
+public:
+	/* Constructor: Binds the graph to the symbol table holding the values. */
+	explicit DependencyGraph(SymbolTable& symbols);
+
+	/* Makes target follow the given formula: checks for cycles, evaluates it, stores the
+	   value and recomputes the variables that depend on target. Returns the new value, or
+	   the error of the formula, which is kept with target left undefined (see get_error).
+	   Throws, leaving everything unchanged, on a cycle. */
+	Result<double> define(SymbolId target, std::shared_ptr<const CompiledExpression> program);
+
+	/* Installs a formula restored from a snapshot without evaluating it: the value of target
+	   is already in the symbol table and nothing is recomputed. inputs are the slots of the
+	   program's variables, already interned. A null program (with no inputs) turns target
+	   back into a plain variable. Cycles are not checked here: Snapshot::load checks all the
+	   formulas of a file together, before it restores any. */
+	void restore(SymbolId target, std::shared_ptr<const CompiledExpression> program, std::vector<SymbolId> inputs);
+
+	/* Recomputes the variables depending on source after its value was set directly. */
+	void refresh(SymbolId source);
+
+	/* Returns the formula of a slot, or nullptr for a plain variable. */
+	std::shared_ptr<const CompiledExpression> get_formula(SymbolId id) const;
+
+	/* Reports whether any slot has a formula. */
+	bool has_formulas() const;
+
+	/* Returns the variables read by the formula of a slot. */
+	const std::vector<SymbolId>& get_inputs(SymbolId id) const;
+
+	/* Returns the error of a slot whose formula failed when last evaluated, or an empty string. */
+	const std::string& get_error(SymbolId id) const;
+
+	/* Returns the number of formulas evaluated by the last define(), its own included. */
+	size_t get_recomputed() const;
+
+	/* Returns the variables whose value changed since the previous call, and forgets them. */
+	std::vector<SymbolId> take_changed();
+};
@@ -0,0 +1,106 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Expression_node.h"
+#include "Symbol_table.h"
+
+/*------Differentiator.h-------------------------------------------------------
+	The Differentiator computes exact derivatives of an expression tree by
+	automatic differentiation, instead of estimating them from nearby values.
+
+	Key functionalities include:
+		- derivative: Forward mode. Evaluates the tree on dual numbers (a value
+		  together with its derivative) and returns the value and the
+		  derivative with respect to one variable in a single pass. Best for
+		  few variables.
+		- gradient: Reverse mode. Records every operation on a tape while
+		  evaluating the tree once, then walks the tape backwards propagating
+		  adjoints, giving the derivative with respect to every variable in
+		  one forward and one backward pass whatever their number.
+
+	For instance, for "2x*y + y^2" with x = 3 and y = 4, gradient returns the
+	value 40 with d/dx = 8 and d/dy = 14.
+
+	Values are computed exactly as the Evaluator computes them, including its
+	errors: a division by zero, the square root of a negative number or an
+	undefined variable throw the same std::runtime_error. Points where the
+	value exists but the derivative does not are reported the same way,
+	when the derivative is actually needed:
+		- sqrt at 0, e.g. sqrt(x) at x = 0;
+		- a power with a zero base and an exponent below 1, e.g. x^0.5 at x = 0;
+		- a power whose exponent varies and whose base is not positive,
+		  e.g. 2^x is fine but (x - 3)^x at x = 2 is not.
+	Forward mode checks whether the operand's derivative is non-zero, reverse
+	mode whether the operand depends on any variable at all, so a degenerate
+	expression like sqrt(x - x) is accepted by the first and rejected by the
+	second.
+----------------------------------------------------------------------------*/
+
+/* A value together with its derivative with respect to one variable. */
+struct Dual {
+	double value;
+	double derivative;
+};
+
+/* Value of an expression and its partial derivatives. */
+struct Gradient {
+	double value;                      // Value of the expression.
+	std::vector<SymbolId> variables;   // Variables of the expression, in order of first appearance.
+	std::vector<double> partials;      // Derivative with respect to each of those variables.
+};
+
+class Differentiator {
+private:
+	/* Derivatives of one operation with respect to its operands, and why they might not exist. */
+	struct LocalPartials {
+		double left;               // d(node)/d(left operand).
+		double right;              // d(node)/d(right operand).
+		const char* left_error;    // Set when the derivative through the left operand does not exist.
+		const char* right_error;   // Same for the right operand.
+	};
+
+	/* One operation recorded on the reverse-mode tape. */
+	struct TapeEntry {
+		std::uint32_t left;        // Tape position of the left operand, or NO_ENTRY.
+		std::uint32_t right;       // Tape position of the right operand, or NO_ENTRY.
+		SymbolId variable;         // Slot of a variable leaf, or NO_SYMBOL.
+		bool varying;              // Whether the value depends on any variable.
+		LocalPartials partials;
+	};
+
+	const SymbolTable& symbols;              // Values of the variables.
+	std::vector<TapeEntry> tape;             // Operations of the current gradient, operands first.
+	std::vector<double> values;              // Value of each tape entry.
+	std::vector<double> adjoints;            // d(result)/d(entry) for each tape entry.
+	std::vector<std::uint32_t> recorded;     // Tape position of each tree node already recorded.
+	const char* derivative_error;            // First missing derivative met by the current forward pass.
+	std::vector<NodeFrame> frames;           // Nodes being evaluated, innermost last.
+	std::vector<Dual> duals;                 // Operand values of the forward pass not consumed yet.
+	std::vector<std::uint32_t> positions;    // Tape positions of the operands not consumed yet.
+
+	/* Returns the value of a variable leaf, throwing if it is undefined. */
+	double variable_value(const ExpressionNode& node, SymbolId& slot) const;
+
+	/* Computes a node from its operand values, filling in its local partial derivatives. */
+	static double apply(const ExpressionTree& tree, const ExpressionNode& node, double left, double right, LocalPartials& partials);
+
+	/* Returns, through operand, the child an operator node evaluates once `stage` of them are done, or false
+	   when all are. newest is the value of the last operand evaluated. */
+	static bool next_operand(const ExpressionNode& node, std::uint32_t stage, double newest, NodeIndex& operand);
+
+	/* Evaluates a subtree on dual numbers. */
+	Dual forward_node(const ExpressionTree& tree, NodeIndex root, SymbolId variable);
+
+	/* Evaluates a subtree, appending its operations to the tape. Returns its tape position. */
+	std::uint32_t record_node(const ExpressionTree& tree, NodeIndex root);
+
+public:
+	/* Constructor: Reads variable values from the given symbol table. */
+	explicit Differentiator(const SymbolTable& symbols);
+
+	/* Forward mode: returns the value of the expression and its derivative with respect to one variable. */
+	Dual derivative(const ExpressionTree& tree, NodeIndex root, SymbolId variable);
+
+	/* Reverse mode: returns the value of the expression and its derivative with respect to every variable. */
+	Gradient gradient(const ExpressionTree& tree, NodeIndex root);
+};
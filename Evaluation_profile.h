@@ -0,0 +1,87 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Expression_node.h"
+
+/*------Evaluation_profile.h---------------------------------------------------
+	An EvaluationProfile records where the time of Evaluator::evaluate_profiled
+	goes, node by node, like an EXPLAIN ANALYZE for one expression.
+
+	For every node of the tree it keeps:
+		- visits: how often the node was reached, and how many of those visits
+		  reused the remembered value of a shared node (memo hits);
+		- total time: time spent computing the node, children included;
+		- self time: total time minus the total time of its children;
+		- whether the node takes the general std::pow path (a power whose
+		  exponent is not a small integer constant; those become IntegerPower
+		  nodes in the optimizer and are computed by repeated squaring).
+	Several profiled evaluations of the same tree add up in the same profile.
+
+	Key functionalities include:
+		- format_tree: The tree, one node per line, annotated with its numbers.
+		- format_folded: Folded stacks ("root;child;leaf <self ns>" per line),
+		  the input format of flamegraph.pl, speedscope and similar tools.
+
+	Reading the clock costs time of its own. It is measured once per process
+	and taken off every node, so a node that does nearly nothing shows close
+	to zero rather than the cost of being measured.
+
+	Both reports print every level of the tree and are meant for expressions
+	a person reads; the profile command refuses trees more than 1000 levels
+	deep.
+
+	After subexpression elimination a node may have several parents. Its
+	numbers cover all of its visits and are shown at its first place in the
+	tree; the other places only name it.
+----------------------------------------------------------------------------*/
+
+/* Measurements of one node of the profiled tree. */
+struct NodeProfile {
+	std::uint64_t visits;      // Times the node was reached.
+	std::uint64_t memo_hits;   // Visits that reused the value of a shared node.
+	std::uint64_t total_ns;    // Time computing the node and its children.
+	std::uint64_t self_ns;     // Time computing the node itself.
+	bool uses_pow;             // Computed through std::pow.
+};
+
+class EvaluationProfile {
+private:
+	std::vector<NodeProfile> nodes;   // Indexed like the nodes of the tree.
+	std::uint64_t evaluations;        // Profiled evaluations so far.
+
+	/* Appends the lines of one subtree to the annotated tree. */
+	void format_node(const ExpressionTree& tree, NodeIndex index, size_t depth, std::uint64_t root_ns, std::vector<bool>& listed, std::string& out) const;
+
+	/* Appends the folded stacks of one subtree. */
+	void fold_node(const ExpressionTree& tree, NodeIndex index, const std::string& stack, std::vector<bool>& listed, std::string& out) const;
+
+public:
+	/* Constructor: Creates an empty profile. */
+	EvaluationProfile();
+
+	/* Prepares the profile for a tree with the given number of nodes, keeping what was already recorded. */
+	void prepare(size_t node_count);
+
+	/* Returns the measurements of one node. */
+	NodeProfile& node(NodeIndex index);
+	const NodeProfile& node(NodeIndex index) const;
+
+	/* Counts one more profiled evaluation. */
+	void add_evaluation();
+
+	/* Returns the number of profiled evaluations. */
+	std::uint64_t get_evaluations() const;
+
+	/* Returns the estimated cost of timing one node, which is subtracted from every node. */
+	static std::uint64_t timer_overhead_ns();
+
+	/* Returns a printable name for a node ("+", "x", "2.5", "sqrt", "^", ...). */
+	static std::string node_label(const ExpressionTree& tree, NodeIndex index);
+
+	/* Renders the tree with the measurements of each node, averaged per evaluation. */
+	std::string format_tree(const ExpressionTree& tree, NodeIndex root) const;
+
+	/* Renders the self time of each node as folded stacks, in nanoseconds over all evaluations. */
+	std::string format_folded(const ExpressionTree& tree, NodeIndex root) const;
+};
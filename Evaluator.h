@@ -1,10 +1,19 @@
 #pragma once
 #include "Expression_node.h" 
 #include "Utility.h"
+#include "Batch_evaluator.h"
+#include "Symbol_table.h"
+#include "Resource_governor.h"
+#include "Result.h"
+#include <chrono>
+#include <cstdint>
 #include <string>
 #include <unordered_map>
+#include <vector>
 #include <iostream> 
 
+class EvaluationProfile;
+
 /* Enumerates the sides of an equation for better clarity and readability. */
 enum class EquationSide {
 	Left,
@@ -16,40 +25,135 @@ enum class EquationSide {
 	expressions, which are internally represented as trees of ExpressionNodes.
 
 	In cases where expressions contain variable terms, the Evaluator will refer to
-	a provided map (variableMap) to retrieve their corresponding numeric values.
+	a provided SymbolTable to retrieve their corresponding numeric values. Variable
+	nodes carry the slot assigned by the Tokenizer, so the lookup is a plain array
+	access rather than a search by name.
 
 	Key functionalities and operations include:
-		- Constructor: Facilitates instantiation with or without a given variable map.
+		- Constructor: Facilitates instantiation with a given symbol table.
 		- evaluate: Computes the value of the given expression tree.
-		- setVariable: Incorporates or updates a variable's value within the internal map.
+		- evaluate_profiled: Evaluates like evaluate while recording per-node visit
+		  counts and timings in an EvaluationProfile (see Evaluation_profile.h).
+		- evaluate_batch: Computes the value of an expression tree for many rows of
+		  variable values at once (see Batch_evaluator.h).
+		- setVariable: Incorporates or updates a variable's value within the symbol table.
 
-	For instance, given an expression like "x + 3" and a map {x: 2}, the evaluator
+	For instance, given an expression like "x + 3" and a table {x: 2}, the evaluator
 	would compute the result as 5.
 
+	An assignment node (Equal, as built by Parser::parse_assignment) evaluates its
+	right-hand side, stores it in the variable on its left and yields the value.
+
+	Trees whose identical subtrees were merged by the SubexpressionEliminator are
+	evaluated with each shared node computed once: its value is remembered for the
+	rest of the evaluation.
+
+	The tree is walked with explicit stacks of pending nodes and operand values
+	instead of recursion, so deeply nested expressions cannot overflow the call
+	stack.
+
+	Errors stop the walk and are recorded rather than thrown on the spot:
+	evaluate throws them once the walk has stopped, try_evaluate returns
+	them (see Result.h).
+
+	Given a ResourceGovernor (set_governor), every node visited counts as one
+	step of its budget.
+
 ----------------------------------------------------------------------------*/
 
 class Evaluator {
 
 private:
-	/* This map serves as a repository of variable names (as strings) and their
-	   corresponding numeric values. When an expression evaluation encounters a
-	   variable, this map is consulted to retrieve the variable's value. */
-	std::unordered_map<std::string, double>& variables;
+	/* This table serves as a repository of variable slots and their corresponding
+	   numeric values. When an expression evaluation encounters a variable, the
+	   value stored in the variable's slot is used. */
+	SymbolTable& symbols;
+
+	std::vector<double> memo;               // Value of each shared node during the current evaluation.
+	std::vector<std::uint32_t> memo_stamp;  // Evaluation that filled each memo entry.
+	std::uint32_t stamp = 0;                // Number of the current evaluation.
+
+	std::vector<NodeFrame> frames;          // Nodes being evaluated, innermost last.
+	std::vector<double> operands;           // Values of the operands not consumed yet.
+
+	/* Clock reading and parent accumulators of a node being profiled. */
+	struct ProfileTimer {
+		std::chrono::steady_clock::time_point start;
+		std::uint64_t children_ns;
+		std::uint64_t children_timed;
+	};
+
+	EvaluationProfile* profile = nullptr;   // Receives the measurements of evaluate_profiled.
+	std::vector<ProfileTimer> timers;       // One per node being profiled, innermost last.
+	std::uint64_t children_ns = 0;          // Total time of the children of the node being timed, so far.
+	std::uint64_t children_timed = 0;       // Nodes timed so far under that node, at any depth.
+
+	ResourceGovernor* governor = nullptr;   // Budget every node visit is counted against, or nullptr.
+	Error failure;                          // Why the current evaluation stopped, if it did.
+
+	/* Prepares the memo for a new evaluation. */
+	void begin_evaluation(const ExpressionTree& tree);
+
+	/* Evaluates a tree without recursion, reusing the remembered value of a shared node. The
+	   profiled instantiation also records every node; the plain one is the normal, unmeasured path. */
+	template <bool Profiled>
+	double run(const ExpressionTree& tree, NodeIndex root);
+
+	/* Checks a node and returns, through operand, the child to evaluate once `stage` of them are done.
+	   Returns false when every operand has been evaluated, or when the node fails (see failure). */
+	bool next_operand(const ExpressionTree& tree, const ExpressionNode& node, std::uint32_t stage, NodeIndex& operand);
+
+	/* Applies the operation of a node to the values of its operands. */
+	double compute_node(const ExpressionTree& tree, const ExpressionNode& node);
+
+	/* Records the error that stops the current evaluation and returns false. */
+	bool fail(ErrorCode code, std::string_view detail = std::string_view());
+
+	/* Removes and returns the newest operand value. */
+	double pop_operand();
+
+	/* Starts and stops the measurement of one node for the profile. */
+	void start_timer(NodeIndex index, const ExpressionNode& node);
+	void stop_timer(NodeIndex index);
+
+	/* Returns the slot of a variable node, resolving it by name if the tokenizer did not assign one. */
+	SymbolId resolve_slot(const Token& token) const;
 
 public:
 
-	/* Default constructor. Useful when no variable map is provided initially. */
+	/* Default constructor. Useful when no symbol table is provided initially. */
 	Evaluator() = default;
 
-	/* Primary constructor: Accepts a map of variables, enabling their reference
+	/* Primary constructor: Accepts a table of variables, enabling their reference
 	   during expression evaluation. */
-	Evaluator(std::unordered_map<std::string, double>& variables) : variables(variables) {};
+	Evaluator(SymbolTable& symbols) : symbols(symbols) {};
 
 	/* Conducts the evaluation of a given expression tree, starting from its root node.
-	   If the evaluation stumbles upon a variable, its value is sourced from the variableMap.
+	   If the evaluation stumbles upon a variable, its value is sourced from the symbol table.
 	   Finally, the resultant value of the entire expression is returned. */
-	double evaluate(const ExpressionNodePtr& root);
+	double evaluate(const ExpressionTree& tree, NodeIndex root);
+
+	/* Same as evaluate, but returns a division by zero, an invalid square root or an undefined
+	   variable as an Error (see Result.h) instead of throwing it. */
+	Result<double> try_evaluate(const ExpressionTree& tree, NodeIndex root);
+
+	/* Evaluates like evaluate, adding the visits and timings of every node to the given
+	   profile. Measuring slows the evaluation down; evaluate itself is not affected. */
+	double evaluate_profiled(const ExpressionTree& tree, NodeIndex root, EvaluationProfile& profile);
+
+	/* Evaluates the expression once per row. columns maps a variable name to a contiguous
+	   array of `rows` values; variables without a column use their value from the symbol
+	   table on every row. output and status must each hold `rows` entries. Rows that divide by
+	   zero or take the square root of a negative number are reported through status instead
+	   of throwing. Returns the number of failed rows. */
+	size_t evaluate_batch(const ExpressionTree& tree, NodeIndex root,
+		const std::unordered_map<std::string, const double*>& columns,
+		size_t rows, double* output, RowStatus* status);
+
+	/* Counts every node visited by evaluate and evaluate_profiled against the budget of the
+	   line, which stops the evaluation with LimitExceeded when it runs out (nullptr to stop counting). */
+	void set_governor(ResourceGovernor* governor);
 
-	/* Assigns or updates a variable's value within the internal map. */
+	/* Assigns or updates a variable's value within the symbol table. */
 	void setVariable(const std::string& name, double value);
 };
\ No newline at end of file
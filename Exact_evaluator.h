@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "Exact_number.h"
+#include "Expression_node.h"
+#include "Symbol_table.h"
+
+/*------Exact_evaluator.h------------------------------------------------------
+	The ExactEvaluator computes an expression tree with ExactNumbers instead
+	of doubles (see Exact_number.h), so that integers and fractions come out
+	exactly: 3^40 = 12157665459056928801, 0.1 + 0.2 = 0.3, 1/3 + 1/6 = 0.5.
+
+	Literals are read from their text, so 0.1 is exactly one tenth rather
+	than the nearest double. It evaluates the tree the Parser built: the
+	Optimizer folds constants in double arithmetic, which would round them
+	before the exact arithmetic sees them.
+
+	Variables read their exact value from an ExactVariables map when the
+	value there is still the one in the symbol table (an ordinary assignment
+	since then replaces it), and otherwise the exact value of the double in
+	the symbol table.
+
+	Errors are those of the Evaluator: an undefined variable, a division by
+	zero or the square root of a negative number throw std::runtime_error.
+
+	The tree is walked with explicit stacks like the Evaluator's, so deeply
+	nested expressions cannot overflow the call stack.
+----------------------------------------------------------------------------*/
+
+/* Exact value of a variable, together with the double that was stored for it in the symbol table. */
+struct ExactVariable {
+	ExactNumber value;
+	double stored;
+};
+
+/* Exact values of variables by slot. */
+using ExactVariables = std::unordered_map<SymbolId, ExactVariable>;
+
+class ExactEvaluator {
+private:
+	const SymbolTable& symbols;         // Values and names of the variables.
+	const ExactVariables& variables;    // Exact values of some of them.
+	ExactOptions options;               // Behaviour where no exact result exists.
+
+	std::vector<NodeFrame> frames;      // Nodes being evaluated, innermost last.
+	std::vector<ExactNumber> operands;  // Values of the operands not consumed yet.
+
+	/* Checks a node and returns, through operand, the child to evaluate once `stage` of them are done.
+	   Returns false when every operand has been evaluated. */
+	bool next_operand(const ExpressionNode& node, std::uint32_t stage, NodeIndex& operand);
+
+	/* Applies the operation of a node to the values of its operands. */
+	ExactNumber compute_node(const ExpressionNode& node);
+
+	/* Removes and returns the newest operand value. */
+	ExactNumber pop_operand();
+
+	/* Returns the exact value of a variable node. */
+	ExactNumber variable_value(const Token& token) const;
+
+public:
+	/* Constructor: Binds the evaluator to the variables it reads. */
+	ExactEvaluator(const SymbolTable& symbols, const ExactVariables& variables, const ExactOptions& options = ExactOptions());
+
+	/* Computes the value of the tree below root. */
+	ExactNumber evaluate(const ExpressionTree& tree, NodeIndex root);
+};
@@ -0,0 +1,134 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "Big_integer.h"
+
+/*------Exact_number.h---------------------------------------------------------
+	An ExactNumber is the value type of exact arithmetic (see
+	Exact_evaluator.h): a fraction that is always kept in lowest terms, or,
+	where no exact answer is available, a double.
+
+	Representations, from fastest to most general:
+		- small: numerator and denominator are 64-bit integers. Every
+		  operation checks for overflow and, if one happens, redoes the
+		  operation on BigIntegers.
+		- big: numerator and denominator are BigIntegers. A result that fits
+		  in 64 bits again goes back to the small form.
+		- double: the result of something with no exact answer, such as the
+		  square root of 2 or 2^0.5. Anything computed from a double is a
+		  double.
+	0.1 + 0.2 is exactly 3/10, 3^40 keeps all of its 20 digits and 2^100000
+	all of its 30103.
+
+	Key functionalities include:
+		- from_decimal: The exact value of a literal such as "0.1" or "2.5e-3".
+		- add, subtract, multiply, divide, negate: Exact on fractions.
+		- power: Exact for an integer exponent, through repeated squaring.
+		- sqrt: Exact when numerator and denominator are perfect squares.
+		- to_string: Integers in full, fractions with a finite decimal
+		  expansion as decimals ("0.3"), other fractions as "1/3".
+
+	ExactOptions decides what happens where no exact answer exists. With a
+	precision of 0 such square roots are doubles; otherwise they are
+	fractions cut (not rounded) after that many decimal places, and marked
+	as approximate, so that the rest of the expression keeps that
+	precision too. Powers whose result would exceed max_bits are doubles as
+	well, which stops a typo like 10^10^10 from filling the memory.
+----------------------------------------------------------------------------*/
+
+/* Behaviour of exact arithmetic where no exact result exists. */
+struct ExactOptions {
+	size_t precision = 0;           // Decimal places of inexact square roots; 0 computes them as doubles.
+	size_t max_bits = size_t(1) << 24;  // Largest numerator or denominator a power may produce, in bits.
+};
+
+class ExactNumber {
+private:
+	/* Which fields hold the value. */
+	enum class Kind : std::uint8_t {
+		Small,   // numerator / denominator
+		Big,     // big_numerator / big_denominator
+		Double   // approximation
+	};
+
+	Kind kind;
+	bool exact;                   // False once the value went through an approximation.
+	std::int64_t numerator;       // Small: in lowest terms, denominator > 0, neither is INT64_MIN.
+	std::int64_t denominator;
+	BigInteger big_numerator;     // Big: in lowest terms, denominator > 0, too large for the small form.
+	BigInteger big_denominator;
+	double approximation;         // Double: the value.
+
+	/* Builds a fraction from 64-bit parts, reducing it; the parts must not be INT64_MIN. */
+	static ExactNumber small_fraction(std::int64_t numerator, std::int64_t denominator, bool exact);
+
+	/* Builds a fraction from big parts, reducing it and moving it to the small form when it fits. */
+	static ExactNumber big_fraction(BigInteger numerator, BigInteger denominator, bool exact);
+
+	/* Returns the numerator or denominator as a BigInteger, whatever the form. */
+	BigInteger get_numerator() const;
+	BigInteger get_denominator() const;
+
+	/* Formats the fraction as a decimal with the given number of places, cut rather than rounded. */
+	std::string format_decimal(size_t places) const;
+
+	/* Returns the decimal places needed to write the fraction exactly, or false when it never ends. */
+	bool terminating_places(size_t& places) const;
+
+public:
+	/* Constructor: Exactly zero. */
+	ExactNumber();
+
+	/* Returns an exact integer. */
+	static ExactNumber integer(std::int64_t value);
+
+	/* Returns the exact fraction numerator / denominator. Throws on a zero denominator. */
+	static ExactNumber fraction(const BigInteger& numerator, const BigInteger& denominator);
+
+	/* Returns the exact value of a decimal literal: optional '-', digits with an optional '.',
+	   and an optional exponent ("e-3"). Throws on anything else. */
+	static ExactNumber from_decimal(std::string_view text);
+
+	/* Returns the exact value of a double (every finite double is a fraction with a power of two below). */
+	static ExactNumber from_double(double value);
+
+	/* Returns a double, marked as inexact. */
+	static ExactNumber approximate(double value);
+
+	/* Reports whether no approximation went into the value. */
+	bool is_exact() const;
+
+	/* Reports whether the value is held as a fraction rather than as a double. */
+	bool is_rational() const;
+
+	/* Reports whether the value is a fraction with denominator 1. */
+	bool is_integer() const;
+
+	/* Returns -1, 0 or 1 (0 for NaN). */
+	int sign() const;
+
+	/* Returns the nearest double. */
+	double to_double() const;
+
+	/* Renders the value: integers in full, fractions as exact decimals where they end and as
+	   "p/q" otherwise; approximate fractions with `places` decimal places, doubles with 17 digits. */
+	std::string to_string(size_t places = 0) const;
+
+	static ExactNumber negate(const ExactNumber& value);
+	static ExactNumber add(const ExactNumber& a, const ExactNumber& b);
+	static ExactNumber subtract(const ExactNumber& a, const ExactNumber& b);
+	static ExactNumber multiply(const ExactNumber& a, const ExactNumber& b);
+
+	/* Returns a / b. Throws "Division by zero" when b is zero. */
+	static ExactNumber divide(const ExactNumber& a, const ExactNumber& b);
+
+	/* Returns base^exponent: exact for an integer exponent unless the result would be larger
+	   than options.max_bits, a double otherwise. */
+	static ExactNumber power(const ExactNumber& base, const ExactNumber& exponent, const ExactOptions& options);
+
+	/* Returns the square root: exact for perfect squares, otherwise as described by options.
+	   Throws on a negative value. */
+	static ExactNumber sqrt(const ExactNumber& value, const ExactOptions& options);
+};
@@ -0,0 +1,118 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Compiled_expression.h"
+
+/*-------Expression_cache.h-------------------------------------------------
+	The ExpressionCache remembers the compiled form of recently seen
+	expressions so that a formula typed (or streamed) again skips the
+	Tokenizer, the Parser and the compiler entirely.
+
+	Entries are keyed by the normalized expression text: whitespace is
+	dropped except where it separates two numbers or names ("2 3" and "23"
+	stay different) or would turn a sum into an exponent ("2e + 3" and
+	"2e+3" stay different), so "2x + y" and "2x+y" share an entry. Variable names
+	stay in the key; their values are bound when the compiled expression is
+	evaluated, so one entry serves every value of its variables.
+
+	The cache is bounded both by entry count and by an estimate of the
+	memory held; the least recently used entries are evicted first. Hits,
+	misses and evictions are counted. All members are safe to call from
+	several threads at once.
+
+	Every batch worker looks its lines up here, so a hit only reads shared
+	state. The entries are split by hash into shards, each behind a
+	shared_mutex that lookups take in shared mode. Recency is approximate
+	(the CLOCK algorithm): a hit sets the entry's referenced flag unless it
+	is already set, so a hot entry is not written at all, and eviction
+	walks the shard's queue in insertion order, giving referenced entries a
+	second chance at the back instead of dropping them. The entry limit is
+	split between the shards; the memory limit holds for the whole cache.
+	The hit and miss counters are striped by thread.
+----------------------------------------------------------------------------*/
+
+/* Counters describing the cache's effectiveness and footprint. */
+struct CacheStats {
+	size_t hits;        // Lookups that found an entry.
+	size_t misses;      // Lookups that found nothing.
+	size_t evictions;   // Entries dropped to respect the limits.
+	size_t entries;     // Entries currently held.
+	size_t bytes;       // Estimated memory held by the entries.
+};
+
+class ExpressionCache {
+private:
+	static const size_t SHARD_COUNT = 16;      // Most shards a cache is split into.
+	static const size_t COUNTER_STRIPES = 16;  // Copies of the hit and miss counters.
+
+	/* One cached expression. */
+	struct Entry {
+		std::string key;                                   // Normalized expression text.
+		std::shared_ptr<const CompiledExpression> program; // Its compiled form.
+		size_t bytes;                                      // Estimated footprint of the entry.
+		std::uint64_t stamp;                               // Clock value when it was queued.
+		std::atomic<bool> referenced;                      // Hit since it was queued.
+
+		Entry(const std::string& key, std::shared_ptr<const CompiledExpression> program, size_t bytes, std::uint64_t stamp)
+			: key(key), program(std::move(program)), bytes(bytes), stamp(stamp), referenced(false) {}
+	};
+
+	/* Entries whose key hashes to the same shard, with their own lock and queue. */
+	struct alignas(64) Shard {
+		std::list<Entry> queue;                                              // Oldest first.
+		std::unordered_map<std::string, std::list<Entry>::iterator> index;  // Key to entry.
+		size_t evictions = 0;                                                // Entries dropped from this shard.
+		mutable std::shared_mutex mutex;                                     // Shared for lookups, exclusive for changes.
+	};
+
+	/* Hit and miss counts of the threads mapped to one stripe. */
+	struct alignas(64) Counters {
+		std::atomic<size_t> hits{ 0 };
+		std::atomic<size_t> misses{ 0 };
+	};
+
+	Shard shards[SHARD_COUNT];
+	Counters counters[COUNTER_STRIPES];
+	alignas(64) std::atomic<std::uint64_t> clock;  // Advanced by every insert, orders get_entries.
+	std::atomic<size_t> bytes;  // Estimated memory held by the entries of every shard.
+	size_t shard_count;        // Shards in use (fewer than SHARD_COUNT for a tiny cache).
+	size_t max_entries;        // Entry limit of each shard.
+	size_t max_bytes;          // Memory limit of the whole cache, in estimated bytes.
+
+	/* Returns the shard a key belongs to. */
+	Shard& shard_for(const std::string& key);
+
+	/* Returns the counters of the calling thread. */
+	Counters& thread_counters();
+
+	/* Drops entries of a shard, oldest unreferenced first, until it is within its entry limit and the
+	   cache within the memory limit, or the shard is empty. The shard must be locked exclusively. */
+	void evict(Shard& shard);
+
+public:
+	/* Constructor: Sets the entry and memory limits; the entry limit is split evenly between the shards. */
+	explicit ExpressionCache(size_t max_entries = 4096, size_t max_bytes = 16u << 20);
+
+	/* Returns the cache key of an expression: its text without insignificant whitespace. */
+	static std::string normalize(const std::string& expression);
+
+	/* Returns the compiled form stored under the key, or nullptr, and marks it as recently used. */
+	std::shared_ptr<const CompiledExpression> find(const std::string& key);
+
+	/* Stores a compiled form under the key, evicting older entries if a limit is exceeded. */
+	void insert(const std::string& key, std::shared_ptr<const CompiledExpression> program);
+
+	/* Returns every entry as (key, compiled form), roughly most recently used first. */
+	std::vector<std::pair<std::string, std::shared_ptr<const CompiledExpression>>> get_entries() const;
+
+	/* Returns a snapshot of the counters. */
+	CacheStats get_stats() const;
+};
@@ -1,33 +1,82 @@
 #pragma once
-#include <memory>
+#include <cstdint>
+#include <vector>
 #include "Token.h"
 /*-------ExpressionNode.h-------------------------------------------------
     This header file defines the building blocks for the expression tree.
     It describes an expression node, which consists of a token (representing
-    a value or operation) and points to child nodes for binary operations.      
+    a value or operation) and refers to child nodes for binary operations.
 
     Key functionalities include:
         - A constructor: Initializes an expression node with a specific token.
         - Token: Holds the value or operation this node represents.
-        - Left and Right: Pointers to left and right child nodes.
-        - Parent: Pointer to the parent node. This can be useful for certain
+        - Left and Right: Indices of the left and right child nodes.
+        - Parent: Index of the parent node. This can be useful for certain
                   tree-manipulation algorithms.
+        - Shared: Set on nodes that several parents refer to once identical
+                  subtrees have been merged (see Subexpression_eliminator.h).
+                  Such a node has one recorded parent, the first one.
 
-    The ExpressionNodePtr is a typedef for a shared pointer to an ExpressionNode.
-    Using shared pointers simplifies memory management for the tree structure.
+    Nodes do not own each other. Every node of a parse lives in one
+    ExpressionTree, a contiguous arena that refers to nodes by 32-bit index.
+    Links are plain indices, so parent links cannot keep a tree alive, and
+    the whole tree is released in one shot when the ExpressionTree goes away
+    (or is cleared for reuse).
 
 ----------------------------------------------------------------------------*/
 
-class ExpressionNode; 
-using ExpressionNodePtr = std::shared_ptr<ExpressionNode>;  // Define a shared pointer to ExpressionNode for easier management.
+using NodeIndex = std::uint32_t;             // Position of a node inside its ExpressionTree.
+const NodeIndex NO_NODE = 0xFFFFFFFFu;       // Marks a missing child or parent.
+
+/* Entry of the explicit stacks that passes over a tree use instead of recursion, so that
+   deeply nested expressions cannot exhaust the call stack. */
+struct NodeFrame {
+    NodeIndex index;       // Node being visited.
+    std::uint32_t stage;   // Number of its operands visited so far.
+};
 
 class ExpressionNode {
-public: 
+public:
     Token token;                   // The value or operation this node represents.
-    ExpressionNodePtr left;        // Pointer to the left child node.
-    ExpressionNodePtr right;       // Pointer to the right child node.
-    ExpressionNodePtr parent;      // Pointer to the parent node.
+    NodeIndex left;                // Index of the left child node.
+    NodeIndex right;               // Index of the right child node.
+    NodeIndex parent;              // Index of the parent node.
+    bool shared;                   // True when more than one parent refers to this node.
 
     /* Constructor: Initializes an expression node with a specific token. */
     explicit ExpressionNode(const Token& token);
-};
\ No newline at end of file
+};
+
+/*-------ExpressionTree----------------------------------------------------
+    Arena holding every node produced by one parse, together with the
+    roots of the parsed expressions (one per statement, in input order).
+----------------------------------------------------------------------------*/
+
+class ExpressionTree {
+private:
+    std::vector<ExpressionNode> nodes;   // Contiguous node storage, addressed by NodeIndex.
+    std::vector<NodeIndex> roots;        // Root node of each parsed expression.
+
+public:
+    /* Appends a childless node holding the given token and returns its index. */
+    NodeIndex add_node(const Token& token);
+
+    /* Records the root of a fully parsed expression. */
+    void add_root(NodeIndex index);
+
+    /* Accessors for individual nodes. Indices stay valid as nodes are added; references do not. */
+    ExpressionNode& operator[](NodeIndex index);
+    const ExpressionNode& operator[](NodeIndex index) const;
+
+    /* Returns the roots of every parsed expression, in input order. */
+    const std::vector<NodeIndex>& get_roots() const;
+
+    /* Returns the root of the last parsed expression, or NO_NODE when nothing was parsed. */
+    NodeIndex root() const;
+
+    /* Returns the number of nodes in the arena. */
+    size_t size() const;
+
+    /* Releases every node at once while keeping the storage for the next parse. */
+    void clear();
+};
@@ -0,0 +1,134 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*------Metrics.h--------------------------------------------------------------
+	Runtime metrics for each stage a line goes through: how often it ran,
+	how long it took and how much heap memory it requested.
+
+	Stages (see Session):
+		- line:      a whole line, from Session::execute or evaluate_readonly.
+		- lookup:    normalizing the text and looking it up in the expression cache.
+		- parse:     tokenizing and parsing (the Parser pulls tokens as it goes,
+		             so the two cannot be told apart).
+		- optimize / eliminate / compile: the rest of a cache miss.
+		- evaluate:  running the compiled expression.
+	line includes the stages it runs, so its numbers are not a separate share.
+
+	Key functionalities include:
+		- CALC_MEASURE_STAGE(stage): Times the rest of the enclosing scope and
+		  counts the heap allocations made in it.
+		- Metrics::snapshot: Adds up the counters of every thread.
+		- Metrics::format_table / format_json: Render a snapshot for the
+		  stats command and for the dump written at exit.
+		- Metrics::reset: Zeroes every counter.
+
+	Each thread writes its own counters (thread_local, registered once per
+	thread), so recording never takes a lock and threads never share a cache
+	line; snapshot only reads them. A measured stage costs two steady_clock
+	reads and a few counter updates. Latencies go into a histogram with 8
+	buckets per power of two of nanoseconds, so p50 and p99 are accurate to
+	about 6%, and the exact maximum is kept.
+
+	Heap allocations are counted by the replacement operator new in
+	allocation_counter.cpp, in every program that links it. The counters are
+	per thread and cost one increment per allocation.
+
+	Building with CALC_NO_METRICS turns CALC_MEASURE_STAGE into nothing,
+	leaves operator new alone and makes snapshot return zeros.
+----------------------------------------------------------------------------*/
+
+/* Pipeline stages that are measured. */
+enum class Stage : std::uint8_t {
+	Line,
+	Lookup,
+	Parse,
+	Optimize,
+	Eliminate,
+	Compile,
+	Evaluate
+};
+
+const size_t STAGE_COUNT = 7;
+
+/* Totals of one stage over every thread. */
+struct StageMetrics {
+	const char* name;            // Stage name, as printed.
+	std::uint64_t calls;         // Times the stage ran.
+	std::uint64_t total_ns;      // Time spent in the stage.
+	std::uint64_t p50_ns;        // Median latency.
+	std::uint64_t p99_ns;        // 99th percentile latency.
+	std::uint64_t max_ns;        // Longest single call.
+	std::uint64_t allocations;   // Heap allocations made while in the stage.
+	std::uint64_t bytes;         // Heap bytes requested while in the stage.
+};
+
+/* Heap allocations counted on one thread by operator new. */
+struct AllocationCount {
+	std::uint64_t allocations;
+	std::uint64_t bytes;
+};
+
+/* Counts of the calling thread. Constant-initialized, so reading them is a plain memory access. */
+inline thread_local AllocationCount thread_allocation_count = { 0, 0 };
+
+class Metrics {
+public:
+	/* Returns the name of a stage ("line", "parse", ...). */
+	static const char* stage_name(Stage stage);
+
+	/* Records one call of a stage. */
+	static void record(Stage stage, std::uint64_t ns, std::uint64_t allocations, std::uint64_t bytes);
+
+	/* Returns the totals of every stage, over every thread. */
+	static std::vector<StageMetrics> snapshot();
+
+	/* Zeroes every counter. Only exact while no other thread is recording. */
+	static void reset();
+
+	/* Renders a snapshot as an aligned table. */
+	static std::string format_table(const std::vector<StageMetrics>& stages);
+
+	/* Renders a snapshot as a JSON object. */
+	static std::string format_json(const std::vector<StageMetrics>& stages);
+
+	/* Reports whether metrics were compiled in. */
+	static bool is_enabled();
+};
+
+#ifndef CALC_NO_METRICS
+
+/* Measures the time and allocations from its construction to its destruction. */
+class StageTimer {
+private:
+	Stage stage;
+	std::chrono::steady_clock::time_point start;
+	std::uint64_t allocations;
+	std::uint64_t bytes;
+
+public:
+	explicit StageTimer(Stage stage)
+		: stage(stage), start(std::chrono::steady_clock::now()),
+		  allocations(thread_allocation_count.allocations), bytes(thread_allocation_count.bytes) {}
+
+	~StageTimer() {
+		std::uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		Metrics::record(stage, ns, thread_allocation_count.allocations - allocations, thread_allocation_count.bytes - bytes);
+	}
+
+	StageTimer(const StageTimer&) = delete;
+	StageTimer& operator=(const StageTimer&) = delete;
+};
+
+#define CALC_MEASURE_CONCAT2(a, b) a##b
+#define CALC_MEASURE_CONCAT(a, b) CALC_MEASURE_CONCAT2(a, b)
+#define CALC_MEASURE_STAGE(stage) StageTimer CALC_MEASURE_CONCAT(stage_timer_, __LINE__)(stage)
+
+#else
+
+#define CALC_MEASURE_STAGE(stage) ((void)0)
+
+#endif
@@ -0,0 +1,92 @@
+#pragma once
+#include "Compiled_expression.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/*------Native_expression.h----------------------------------------------------
+	The NativeExpression turns the bytecode of a CompiledExpression into
+	x86-64 machine code, so evaluating it is a direct call instead of a loop
+	dispatching one instruction at a time.
+
+	Key functionalities include:
+		- Constructor: Translates the program, or keeps only the interpreter
+		  when the JIT is disabled or the machine is not supported.
+		- get_function: Exposes the generated code as a plain function pointer,
+		  double (*)(const double* values), taking one value per variable slot.
+		- evaluate: Runs the generated code, falling back to the interpreter
+		  whenever an exact answer or an error message is needed.
+
+	The code works on scalar SSE2 registers and keeps the top of the value
+	stack in xmm0, the rest in its stack frame. Constants are embedded in the
+	instructions, variables are read straight from the values array, and
+	general powers call std::pow. Integer powers repeat the interpreter's
+	squaring steps, so every result is bit-for-bit what the CompiledExpression
+	computes.
+
+	Errors cannot be thrown from generated code. A division by zero or the
+	square root of a negative number makes the function return NaN instead;
+	evaluate() then re-runs the interpreter, which produces either the same
+	NaN (when the expression really evaluates to NaN) or the usual exception.
+	Callers of the raw function pointer must treat NaN the same way.
+
+	The code is written into pages obtained from mmap (VirtualAlloc on
+	Windows), which are made executable, and no longer writable, before the
+	first call. Only x86-64 with the System V or Windows calling convention
+	is supported; anywhere else, or when built with CALC_NO_JIT, evaluate()
+	simply runs the interpreter.
+
+	Sessions started with --jit attach a NativeExpression to every program
+	they compile (see CompiledExpression::attach_native), so their double
+	evaluations run the generated code.
+----------------------------------------------------------------------------*/
+
+/* Signature of the generated code. values[i] holds the value of the variable in slot i. */
+using NativeFunction = double (*)(const double* values);
+
+class NativeExpression {
+
+private:
+	std::shared_ptr<const CompiledExpression> owner;     // Keeps the program alive, unless the program owns this.
+	const CompiledExpression* program;                   // Interpreted form, used as the fallback.
+	void* memory;                                        // Executable pages holding the code, or nullptr.
+	size_t memory_size;                                  // Size of the mapping in bytes.
+	size_t code_size;                                    // Bytes of machine code generated.
+	NativeFunction function;                             // Entry point inside memory, or nullptr.
+
+	/* Generates the machine code for the program, or returns an empty buffer if it cannot be translated. */
+	std::vector<std::uint8_t> generate() const;
+
+	/* Copies the code into fresh pages and makes them executable. Returns false on failure. */
+	bool install(const std::vector<std::uint8_t>& code);
+
+public:
+	/* Constructor: Translates the program to native code when enabled and supported. */
+	explicit NativeExpression(std::shared_ptr<const CompiledExpression> program, bool enabled = true);
+
+	/* Constructor: Same, without sharing ownership of the program, which must outlive evaluate()
+	   calls (CompiledExpression::attach_native keeps its own native form this way). */
+	explicit NativeExpression(const CompiledExpression& program, bool enabled = true);
+
+	/* Destructor: Releases the executable pages. */
+	~NativeExpression();
+
+	NativeExpression(const NativeExpression&) = delete;
+	NativeExpression& operator=(const NativeExpression&) = delete;
+
+	/* Reports whether this build and machine can generate native code at all. */
+	static bool is_supported();
+
+	/* Reports whether the program runs as native code (rather than interpreted). */
+	bool is_native() const;
+
+	/* Returns the generated function, or nullptr when the program is interpreted. */
+	NativeFunction get_function() const;
+
+	/* Evaluates the program, with the same results and errors as CompiledExpression::evaluate. */
+	double evaluate(const double* values) const;
+
+	/* Returns the number of bytes of machine code generated (0 when interpreted). */
+	size_t get_code_size() const;
+};
@@ -0,0 +1,78 @@
+#pragma once
+#include <cstddef>
+#include "Expression_node.h"
+
+/*-------Optimizer.h--------------------------------------------------------
+	The Optimizer rewrites a parsed expression tree into a cheaper one that
+	computes the same value. It runs between the Parser and the evaluation
+	stage (Evaluator or CompiledExpression).
+
+	Rewrites applied in every mode, all of which give bit-identical results:
+		- Constant folding: "sqrt(16)" and "2^10" become number literals.
+		  Subtrees that would raise an error (division by zero, square root
+		  of a negative number) are left alone so the error still surfaces.
+		- "-1 * x", which the Parser produces for a unary minus, becomes a
+		  Negation node.
+		- Identities: x*1, 1*x, x/1, x-0 and x^1 become x; x*-1 and x/-1
+		  become a Negation.
+		- Strength reduction: x^2 becomes an IntegerPower node, evaluated as
+		  one multiplication instead of a call to std::pow.
+
+	Rewrites applied only in fast-math mode, since they can change the last
+	bit of a result or the sign of a zero, or drop a subtree (and any error
+	it would have raised):
+		- x+0 and 0+x become x, 0-x becomes a Negation, x^0 becomes 1.
+		- x^n for any other integer |n| <= 64 becomes an IntegerPower node,
+		  evaluated by repeated squaring.
+
+	The input tree is not modified; optimize() builds a new tree holding
+	one optimized root per input root.
+----------------------------------------------------------------------------*/
+
+/* Counts of the rewrites applied by the last call to optimize(). */
+struct OptimizerStats {
+	size_t folded;            // Subtrees replaced by a number literal.
+	size_t simplified;        // Identities and '-1 *' wrappers removed.
+	size_t strength_reduced;  // Powers turned into IntegerPower nodes.
+};
+
+class Optimizer {
+private:
+	bool fast_math;          // Allows rewrites that are not bit-exact.
+	ExpressionTree output;   // Arena receiving the optimized nodes.
+	OptimizerStats stats;    // Rewrites applied so far.
+
+	std::vector<NodeFrame> frames;     // Nodes being optimized, innermost last.
+	std::vector<NodeIndex> results;    // Optimized children waiting for their parent.
+
+	/* Returns the optimized copy of the given subtree inside the output arena. */
+	NodeIndex optimize_node(const ExpressionTree& tree, NodeIndex root);
+
+	/* Returns the rewritten form of a node from its optimized children. */
+	NodeIndex rewrite_node(const Token& token, NodeIndex left, NodeIndex right);
+
+	/* Adds a node to the output arena and links its children back to it. */
+	NodeIndex make_node(const Token& token, NodeIndex left, NodeIndex right);
+
+	/* Adds a number literal holding exactly the given value. */
+	NodeIndex make_number(double value);
+
+	/* Adds the negation of an output node, folding literals and cancelling -(-x). */
+	NodeIndex make_negation(NodeIndex operand);
+
+	/* Reports whether an output node is a number literal, and its value. */
+	bool is_number(NodeIndex index, double& value) const;
+
+public:
+	/* Largest exponent magnitude turned into repeated squaring in fast-math mode. */
+	static const int MAX_SQUARING_EXPONENT = 64;
+
+	/* Constructor: fast_math enables the rewrites that are not bit-identical. */
+	explicit Optimizer(bool fast_math = false);
+
+	/* Returns an optimized copy of every expression in the tree. */
+	ExpressionTree optimize(const ExpressionTree& tree);
+
+	/* Returns the counts of the rewrites applied by the last call to optimize(). */
+	const OptimizerStats& get_stats() const;
+};
@@ -1,8 +1,13 @@
 #pragma once
 
+#include <cstdint>
+#include <string>
 #include <vector> 
 #include "Token.h"
+#include "Tokenizer.h"
 #include "Expression_node.h"
+#include "Resource_governor.h"
+#include "Result.h"
 #include "Utility.h"
 
 /*-----Parser.h------------------------------------------------
@@ -10,47 +15,131 @@
     an Abstract Syntax Tree (AST), which represents the structure and
     hierarchy of the parsed mathematical expression.
 
+    Tokens are pulled from a Tokenizer one at a time as the parse goes, so
+    no token list is ever built.
+
+    Expressions are parsed by operator precedence with explicit stacks of
+    operands and pending operators, in time linear in the input, so the
+    nesting depth of the input is limited by memory rather than by the call
+    stack. Trees deeper than the parser's depth limit (MAX_PARSE_DEPTH by
+    default) are rejected with a LimitExceeded error, which keeps every
+    later pass within known bounds. Given a ResourceGovernor, the parser
+    also counts its nodes against the node limit and applies the
+    governor's depth limit when it is lower.
+
     Core features and functions include:
-        - Constructing an AST from a token list.
+        - Constructing an AST from the tokens of a Tokenizer.
         - Producing a visual string representation of the AST.
         - Handling errors arising from unexpected tokens and unbalanced parentheses.
 
     Typical usage entails:
-        1. Initializing the Parser with a list of tokens:
-            std::vector<Token> tokens = {...}
+        1. Initializing the Parser with a tokenizer:
+            Tokenizer tokenizer(expression);
+            Parser parser(tokenizer);
         2. Generating the AST:
-            auto root = parser.parse();
+            ExpressionTree tree = parser.parse();
+           or, to reuse the storage of a previous tree:
+            parser.parse(tree);
         3. Optionally, converting the AST to a visual string form:
-            std::string treeView = parser.visualize_tree(root);
+            std::string treeView = parser.visualize_tree(tree, tree.root());
 
     A few considerations:
-        - Parsing respects the inherent precedence of mathematical operations.
-        - Any encountered unbalanced parentheses or unexpected tokens will trigger runtime exceptions.
+        - Parsing respects the inherent precedence of mathematical operations:
+          '^' binds tighter than '*', '/' and implicit multiplication, which bind
+          tighter than '+' and '-'. '^' is right-associative, the others are
+          left-associative. A leading '-' applies to the operand right after it,
+          before any '^' ("-2^2" is 4).
+        - All nodes of one parse are stored in the returned ExpressionTree arena
+          and are released together with it. Node tokens point into the
+          tokenized text, which must outlive the tree.
+        - Any encountered unbalanced parentheses or unexpected tokens will trigger runtime exceptions,
+          or, through try_parse, come back as an Error with the offset of the offending token
+          (see Result.h). parse is try_parse followed by a throw.
 
 ----------------------------------------------------------------*/
 
+const size_t MAX_PARSE_DEPTH = 1000000;   // Default limit on the operator levels of a parsed tree.
+
 class Parser {
 private:
-    std::vector<Token> tokens;  // Queue of tokens awaiting parsing.
-    size_t position;            // Current index within the token queue.
+    /* Kinds of entries on the stack of pending operators. */
+    enum class PendingKind : std::uint8_t {
+        Binary,   // Binary operator waiting for its right operand.
+        Group,    // Opening parenthesis.
+        Negate,   // '-' at the start of a factor, which becomes -1 * operand.
+        Minus,    // '-' directly in front of an operand, kept as a one-operand Subtraction node.
+        Sqrt      // Square root of the next operand.
+    };
+
+    /* Operator waiting on the stack for its operands. */
+    struct Pending {
+        PendingKind kind;
+        int precedence;   // Binding strength of a binary operator.
+        Token token;
+    };
+
+    /* Subtree waiting on the stack for its operator. */
+    struct Operand {
+        NodeIndex node;
+        std::uint32_t depth;   // Operator levels of the subtree.
+    };
+
+    /* Stacks of parse_expression (defined in parser.cpp). */
+    struct ParseStacks;
+
+    Tokenizer& tokenizer;       // Source of the tokens awaiting parsing.
+    Token current;              // Token under examination (End once the input is exhausted).
+    ExpressionTree tree;        // Arena receiving the nodes of the current parse.
+    size_t max_depth;           // Deepest tree accepted, in operator levels.
+    size_t deepest;             // Deepest subtree built by the current parse.
+    ResourceGovernor* governor; // Budget the nodes are counted against, or nullptr.
+    Error error;                // Why the current parse failed.
+
+    /* Returns the stacks of the calling thread, which every parse on it reuses. */
+    static ParseStacks& thread_stacks();
+
+    /* Fetches the current token. */
+    const Token& current_token() const;
+
+    /* The steps of a parse below return false once they have recorded an error in `error`. */
+
+    /* Reads the statements of the input into the arena. */
+    bool read_statements();
+
+    /* Records an error found at the given token. */
+    bool fail(ErrorCode code, const Token& token);
 
-    /* Fetches the current token, based on the parser's position. */
-    Token current_token() const;
+    /* Returns the offset of a token in the expression text. */
+    size_t position_of(const Token& token) const;
 
-    /* Advances the internal counter to the subsequent token. */
-    void advance();
+    /* Pulls the subsequent token from the tokenizer. */
+    bool advance();
 
-    /* Various parsing functions, each handling different precedence levels and token structures. */
-    ExpressionNodePtr parse_primary();
-    ExpressionNodePtr parse_expression();
-    ExpressionNodePtr parse_unary();
-    ExpressionNodePtr parse_term();
-    ExpressionNodePtr parse_sqrt();
-    ExpressionNodePtr parse_factor();
-    ExpressionNodePtr parse_assignment();
+    /* Adds a node with the given children to the arena and links the children back to it.
+       Fails if the new node is deeper than the depth limit. */
+    bool make_node(const Token& token, Operand left, Operand right, Operand& out);
 
-    /* Ensures parentheses are symmetrically balanced within the token sequence. */
-    void check_parentheses_balance();
+    /* Parses one expression with explicit stacks, up to the first token that cannot continue it. */
+    bool parse_expression(Operand& out);
+
+    /* Parses an expression, followed by '=' and a second expression for an assignment. */
+    bool parse_assignment(NodeIndex& out);
+
+    /* Applies the prefixes ('-', sqrt) stacked right before the operand on top of the operand stack. */
+    bool apply_prefixes(ParseStacks& stacks);
+
+    /* Builds the pending binary operators that bind at least as tightly as the given precedence
+       (strictly more tightly for a right-associative operator). */
+    bool reduce(ParseStacks& stacks, int precedence, bool right_associative);
+
+    /* Returns the binding strength of a binary operator. */
+    static int precedence(TokenType type);
+
+    /* Returns the printed text of a node. */
+    static std::string label(const ExpressionTree& tree, NodeIndex node);
+
+    /* Ensures parentheses are symmetrically balanced within the expression text. */
+    bool check_parentheses_balance();
 
     /* Determines if a given token signifies a primary expression. */
     bool is_primary(const Token& token);
@@ -59,12 +148,28 @@ private:
     bool peek(TokenType type) const;
 
 public:
-    /* Constructor: Sets up the parser using a given list of tokens. */
-    explicit Parser(const std::vector<Token>& tokens);
+    /* Constructor: Sets up the parser to read the tokens of the given tokenizer. */
+    explicit Parser(Tokenizer& tokenizer);
+
+    /* Transforms the tokens into a corresponding AST. Each parsed expression is one root of the tree. */
+    ExpressionTree parse();
+
+    /* Same as parse(), but builds the AST in the given tree, reusing the storage it already has. */
+    void parse(ExpressionTree& out);
+
+    /* Same as parse(out), but reports malformed input as an Error instead of throwing; the
+       tree is left empty then. */
+    Result<void> try_parse(ExpressionTree& out);
+
+    /* Constructor: Same, with a limit on the operator levels of the parsed trees. */
+    Parser(Tokenizer& tokenizer, size_t max_depth);
+
+    /* Counts the nodes of later parses against the governor's budget (nullptr to stop). */
+    void set_governor(ResourceGovernor* governor);
 
-    /* Transforms the token list into a corresponding AST. */
-    std::vector<ExpressionNodePtr> parse();
+    /* Returns the operator levels of the deepest tree built by the last parse. */
+    size_t get_depth() const;
 
     /* Generates a visual string depiction of the given AST node and its descendants. */
-    std::string visualize_tree(ExpressionNodePtr node);
+    std::string visualize_tree(const ExpressionTree& tree, NodeIndex node);
 };
\ No newline at end of file
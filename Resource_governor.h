@@ -0,0 +1,147 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+/*-------Resource_governor.h-------------------------------------------------
+	The ResourceGovernor keeps one line of input within its budget, so a
+	single bad input (a generated expression with millions of nodes, a
+	runaway solve) cannot stall the thread running it.
+
+	ResourceLimits name the budget of a line:
+		- max_nodes: nodes the Parser may build;
+		- max_depth: operator levels of a parsed tree (the Parser's own
+		  limit, MAX_PARSE_DEPTH, applies as well);
+		- max_steps: evaluation work, counted as tree nodes visited by the
+		  Evaluator or bytecode instructions run by a CompiledExpression;
+		- timeout: wall-clock time from the start of the line;
+		- cancel: a CancellationToken another thread (or a signal handler)
+		  may trigger at any time.
+
+	A governor is created per line and handed to the Tokenizer, the Parser,
+	the Evaluator and the Solver (set_governor), which report their work as
+	they go. Counting is a few integer operations; the clock and the token
+	are only read every CHECK_INTERVAL units of work, so cancellation is
+	cooperative and takes effect within microseconds.
+
+	Exceeding a limit throws LimitExceeded. It derives from
+	std::runtime_error, so existing handlers still catch it, but batch and
+	server modes can tell it from an ordinary error (a syntax error, a
+	division by zero) and count it separately.
+----------------------------------------------------------------------------*/
+
+const size_t NO_LIMIT = SIZE_MAX;   // A limit that is never reached.
+
+/* The limit a line ran into. */
+enum class LimitKind : std::uint8_t {
+	Nodes,       // Too many nodes in the parsed tree.
+	Depth,       // Tree nested too deeply.
+	Steps,       // Too much evaluation work.
+	Deadline,    // Out of time.
+	Cancelled    // Cancelled through its token.
+};
+
+/* Returns the printed name of a limit ("nodes", "deadline", ...). */
+const char* limit_kind_name(LimitKind kind);
+
+/* Error thrown when a line exceeds one of its limits. */
+class LimitExceeded : public std::runtime_error {
+private:
+	LimitKind kind;
+
+public:
+	/* Constructor: Records which limit was hit, with a message for the user. */
+	LimitExceeded(LimitKind kind, const std::string& message);
+
+	/* Returns the limit that was hit. */
+	LimitKind get_kind() const;
+};
+
+/* A flag one thread sets to stop the work another thread is doing. */
+class CancellationToken {
+private:
+	std::atomic<bool> cancelled;
+
+public:
+	/* Constructor: Starts untriggered. */
+	CancellationToken();
+
+	/* Asks the work watching the token to stop. Safe to call from a signal handler. */
+	void cancel();
+
+	/* Clears the request, so the token can watch the next piece of work. */
+	void reset();
+
+	/* Reports whether cancel() was called since the last reset(). */
+	bool is_cancelled() const;
+};
+
+/* The budget of one line. */
+struct ResourceLimits {
+	size_t max_nodes = NO_LIMIT;                    // Nodes of the parsed tree.
+	size_t max_depth = NO_LIMIT;                    // Operator levels of the parsed tree.
+	size_t max_steps = NO_LIMIT;                    // Nodes visited or instructions run while evaluating.
+	std::chrono::milliseconds timeout{ 0 };         // Wall-clock budget; zero means none.
+	const CancellationToken* cancel = nullptr;      // Token that stops the line early, or nullptr.
+
+	/* Reports whether any limit is set, so callers can skip creating a governor. */
+	bool any() const;
+};
+
+class ResourceGovernor {
+private:
+	ResourceLimits limits;
+	std::chrono::steady_clock::time_point deadline;   // Start of the line plus the timeout.
+	size_t nodes;       // Nodes built so far.
+	size_t steps;       // Evaluation work done so far.
+	size_t unchecked;   // Work since the clock and the token were last read.
+
+	/* Throws the error of a limit. */
+	[[noreturn]] void fail(LimitKind kind) const;
+
+public:
+	/* Work done between two readings of the clock and the cancellation token. */
+	static const size_t CHECK_INTERVAL = 256;
+
+	/* Constructor: Starts the clock of a line with the given limits. */
+	explicit ResourceGovernor(const ResourceLimits& limits);
+
+	/* Reads the token and the clock now; throws if the line was cancelled or is out of time. */
+	void check();
+
+	/* Counts one unit of work that has no budget of its own (a token read). */
+	void tick() {
+		if (++unchecked >= CHECK_INTERVAL) {
+			check();
+		}
+	}
+
+	/* Counts one node built by the Parser. */
+	void add_node() {
+		if (++nodes > limits.max_nodes) {
+			fail(LimitKind::Nodes);
+		}
+		tick();
+	}
+
+	/* Counts evaluation work: nodes visited or instructions about to run. */
+	void add_steps(size_t count) {
+		steps += count;
+		if (steps > limits.max_steps) {
+			fail(LimitKind::Steps);
+		}
+		unchecked += count;
+		if (unchecked >= CHECK_INTERVAL) {
+			check();
+		}
+	}
+
+	/* Returns the limits in force. */
+	const ResourceLimits& get_limits() const;
+
+	/* Returns the evaluation work counted so far. */
+	size_t get_steps() const;
+};
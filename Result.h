@@ -0,0 +1,156 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+/*-------Result.h-----------------------------------------------------------
+	Error and Result carry the failure of a line as a value instead of an
+	exception, for callers that expect many invalid lines (a batch feed
+	where one line in ten is malformed, a server answering any client).
+
+	An Error is a compact record: an ErrorCode naming what went wrong, the
+	offset in the tokenized text where it was noticed, and a short detail
+	(the offending token, the undefined name) copied into a fixed buffer.
+	Building one never allocates. The message the throwing API would have
+	used ("Unexpected token: )", "Division by zero", ...) is only put
+	together when asked for, by message() or append_message().
+
+	Result<T> holds either a value or an Error, like std::expected.
+	Result<void> only reports success or the Error.
+
+	The non-throwing entry points are Tokenizer::scan_token,
+	Parser::try_parse, CompiledExpression::try_evaluate(_as),
+	Evaluator::try_evaluate and Session::try_execute, try_evaluate_readonly
+	and try_evaluate_text. Their throwing counterparts call them and raise
+	the Error, so both report the same messages. A line that runs out of
+	its ResourceLimits still throws LimitExceeded (see
+	Resource_governor.h): limits are rare and stop the whole line. The
+	depth limit is the exception, as the parser checks it itself: it comes
+	back as NestedTooDeeply, which is_limit() tells apart.
+----------------------------------------------------------------------------*/
+
+/* What went wrong in a line. */
+enum class ErrorCode : std::uint8_t {
+	None,                    // No error.
+	InvalidCharacter,        // A character no token starts with (detail: the character).
+	NumberOutOfRange,        // A literal beyond the range of a double (detail: the literal).
+	InvalidOperator,         // An operator the tokenizer does not know.
+	InvalidParenthesis,      // A parenthesis the tokenizer does not know.
+	UnexpectedStart,         // A token that cannot start an expression (detail: the token).
+	UnexpectedToken,         // A token where an operand was expected (detail: the token).
+	UnexpectedEnd,           // The input ended in the middle of an expression.
+	ExpectedParenthesis,     // Something other than ')' closing a group (detail: the token).
+	UnopenedParenthesis,     // A ')' before its matching '('.
+	MismatchedParentheses,   // More '(' than ')'.
+	InvalidAssignment,       // Something other than a variable left of '='.
+	NestedTooDeeply,         // A tree deeper than the parser's limit (detail: the limit).
+	DivisionByZero,          // A zero divisor.
+	NegativeSqrt,            // The square root of a negative number.
+	UndefinedVariable,       // A variable without a value (detail: the name).
+	InvalidTree              // A malformed expression tree (detail: the operation, if any).
+};
+
+class Error {
+public:
+	/* Longest detail kept in the inline buffer; longer ones go to the overflow string. */
+	static const size_t DETAIL_CAPACITY = 40;
+
+private:
+	ErrorCode code;
+	std::uint8_t detail_size;
+	std::uint32_t position;
+	char detail[DETAIL_CAPACITY];
+	std::shared_ptr<const std::string> overflow;   // The whole detail when it does not fit, else nullptr.
+
+public:
+	/* Constructor: No error. */
+	Error() : code(ErrorCode::None), detail_size(0), position(0), detail() {}
+
+	/* Constructor: An error noticed at the given offset of the tokenized text. */
+	Error(ErrorCode code, size_t position, std::string_view detail = std::string_view());
+
+	/* Returns what went wrong (None for no error). */
+	ErrorCode get_code() const { return code; }
+
+	/* Returns the offset in the tokenized text where the error was noticed. */
+	size_t get_position() const { return position; }
+
+	/* Returns the detail of the message (the offending token, the undefined name, ...). */
+	std::string_view get_detail() const { return overflow ? std::string_view(*overflow) : std::string_view(detail, detail_size); }
+
+	/* Reports whether the error is a limit on the line (NestedTooDeeply), which raise throws as LimitExceeded. */
+	bool is_limit() const { return code == ErrorCode::NestedTooDeeply; }
+
+	/* Builds the message the throwing API reports for this error. */
+	std::string message() const;
+
+	/* Appends the message to the given text, so a caller collecting many does not allocate one per error. */
+	void append_message(std::string& out) const;
+
+	/* Throws the error the way the throwing API does: LimitExceeded for NestedTooDeeply,
+	   std::runtime_error otherwise. */
+	[[noreturn]] void raise() const;
+};
+
+/* Either a value or the Error that prevented it. */
+template <typename T>
+class Result {
+private:
+	T result;        // Meaningful only when ok().
+	Error failure;   // ErrorCode::None when ok().
+
+public:
+	/* Constructor: A value. */
+	Result(T value) : result(std::move(value)), failure() {}
+
+	/* Constructor: A failure. */
+	Result(const Error& error) : result(), failure(error) {}
+
+	/* Reports whether the result holds a value. */
+	bool ok() const { return failure.get_code() == ErrorCode::None; }
+	explicit operator bool() const { return ok(); }
+
+	/* Returns the value (only meaningful when ok()). */
+	const T& value() const { return result; }
+	T& value() { return result; }
+
+	/* Returns the error (ErrorCode::None when ok()). */
+	const Error& error() const { return failure; }
+
+	/* Returns the value, or throws the error like the throwing API. */
+	T value_or_throw() && {
+		if (!ok()) {
+			failure.raise();
+		}
+		return std::move(result);
+	}
+};
+
+/* Success, or the Error of a step that produces no value. */
+template <>
+class Result<void> {
+private:
+	Error failure;
+
+public:
+	/* Constructor: Success. */
+	Result() : failure() {}
+
+	/* Constructor: A failure. */
+	Result(const Error& error) : failure(error) {}
+
+	bool ok() const { return failure.get_code() == ErrorCode::None; }
+	explicit operator bool() const { return ok(); }
+
+	const Error& error() const { return failure; }
+
+	/* Throws the error like the throwing API, if there is one. */
+	void throw_if_failed() const {
+		if (!ok()) {
+			failure.raise();
+		}
+	}
+};
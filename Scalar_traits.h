@@ -0,0 +1,246 @@
+#pragma once
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <limits>
+#include <string>
+
+/*------Scalar_traits.h--------------------------------------------------------
+	The number types a compiled expression can be evaluated in, and the
+	rules each of them follows. CompiledExpression::evaluate_as and
+	BatchEvaluator::evaluate are templates over the scalar type; everything
+	that differs between types goes through ScalarTraits<Scalar>, so each
+	type is its own compile-time specialization with no runtime dispatch
+	inside the evaluation loop.
+
+	Types (ScalarType names them at runtime, for the REPL and --scalar):
+		- float: half the memory and twice the SIMD width of double, with
+		  about 7 significant digits.
+		- double: the calculator's own type.
+		- long double: 80-bit extended precision on x86 with GCC and Clang
+		  (the same as double with MSVC).
+		- complex: std::complex<double>. sqrt(-4) is 2i instead of an error,
+		  and powers of negative numbers are defined.
+		- interval: a pair [low, high] that surely contains the exact result
+		  of the operations. A bound moves one unit in the last place outward
+		  only when its rounding error (TwoSum or fma) shows it was rounded
+		  inward, so exact results stay points; general powers, whose
+		  std::pow is only within an ulp, are widened by two.
+
+	Error policy: every operation that can fail returns a RowStatus, which
+	CompiledExpression throws (with the Evaluator's message) and
+	BatchEvaluator records per row. check_divisor applies the divide rule
+	to the divisor alone, so a zero divisor can be reported before the
+	dividend is computed, as the Evaluator does.
+		- real types: division by zero and the square root of a negative
+		  number fail, as with double.
+		- complex: only division by zero fails.
+		- interval: division by an interval that contains zero fails, and so
+		  does the square root of an interval that is entirely negative; the
+		  square root of an interval reaching below zero covers its
+		  non-negative part.
+	A power that has no value (a negative base to a fractional exponent)
+	gives NaN without failing in every type, like std::pow.
+
+	Literals and variables enter every type as the double they hold.
+	Constant subexpressions are folded by the Optimizer in double before any
+	of this runs, so for an interval they are points.
+----------------------------------------------------------------------------*/
+
+/* Number types an expression can be evaluated in. */
+enum class ScalarType : std::uint8_t {
+	Float,
+	Double,
+	LongDouble,
+	Complex,
+	Interval
+};
+
+/* Outcome of one operation, or of one row of a batch evaluation. */
+enum class RowStatus : std::uint8_t {
+	Ok,                 // The row produced a value.
+	DivisionByZero,     // A divisor on this row was zero.
+	NegativeSqrt,       // A square root on this row received a negative value.
+	UndefinedVariable,  // A variable had no value (only reported by CompiledExpression).
+	InvalidTree         // The program holds a malformed node of its expression tree.
+};
+
+/* Returns the error text Evaluator::evaluate would have thrown for the given status. */
+const char* row_status_message(RowStatus status);
+
+/* Returns the name of a scalar type ("float", "double", "long double", "complex", "interval"). */
+const char* scalar_type_name(ScalarType type);
+
+/* Reads a scalar type name (as returned by scalar_type_name, or "long" for long double). Returns false if unknown. */
+bool parse_scalar_type(const std::string& name, ScalarType& type);
+
+/* A closed interval of doubles. */
+struct Interval {
+	double low;
+	double high;
+};
+
+Interval operator+(const Interval& a, const Interval& b);
+Interval operator-(const Interval& a, const Interval& b);
+Interval operator*(const Interval& a, const Interval& b);
+Interval operator-(const Interval& a);
+
+/* Raises a value to an integer power by repeated squaring. An exponent of 2 is a single
+   multiplication; larger ones round differently from std::pow. */
+template <typename Scalar>
+inline Scalar power_by_squaring(Scalar base, int exponent) {
+	unsigned remaining = exponent < 0 ? 0u - static_cast<unsigned>(exponent) : static_cast<unsigned>(exponent);
+	Scalar result = Scalar(1);
+
+	while (remaining != 0) {
+		if (remaining & 1u) {
+			result = result * base;
+		}
+		remaining >>= 1;
+		if (remaining != 0) {
+			base = base * base;
+		}
+	}
+	return exponent < 0 ? Scalar(1) / result : result;
+}
+
+/* Integer exponents up to this magnitude are computed by repeated squaring */
+const double MAX_SQUARING_EXPONENT = 64;
+
+/* Operations whose behaviour depends on the scalar type. Specialized for each ScalarType. */
+template <typename Scalar>
+struct ScalarTraits;
+
+/* Policy shared by float, double and long double. */
+template <typename Real>
+struct RealScalarTraits {
+	static Real from_double(double value) {
+		return static_cast<Real>(value);
+	}
+
+	static Real not_a_number() {
+		return std::numeric_limits<Real>::quiet_NaN();
+	}
+
+	static RowStatus check_divisor(Real b) {
+		return b == 0 ? RowStatus::DivisionByZero : RowStatus::Ok;
+	}
+
+	static RowStatus divide(Real a, Real b, Real& out) {
+		if (b == 0) {
+			return RowStatus::DivisionByZero;
+		}
+		out = a / b;
+		return RowStatus::Ok;
+	}
+
+	static RowStatus sqrt(Real a, Real& out) {
+		if (a < 0) {
+			return RowStatus::NegativeSqrt;
+		}
+		out = std::sqrt(a);
+		return RowStatus::Ok;
+	}
+
+	static Real power(Real a, Real b) {
+		return std::pow(a, b);
+	}
+
+	static Real power_integer(Real a, int exponent) {
+		return power_by_squaring(a, exponent);
+	}
+
+	/* Reports whether the value is an integer small enough for repeated squaring. */
+	static bool as_small_integer(Real value, int& exponent) {
+		if (std::floor(value) != value || std::fabs(value) > MAX_SQUARING_EXPONENT) {
+			return false;
+		}
+		exponent = static_cast<int>(value);
+		return true;
+	}
+};
+
+template <>
+struct ScalarTraits<float> : RealScalarTraits<float> {
+	static constexpr ScalarType type = ScalarType::Float;
+	static std::string format(float value);
+};
+
+template <>
+struct ScalarTraits<double> : RealScalarTraits<double> {
+	static constexpr ScalarType type = ScalarType::Double;
+	static std::string format(double value);
+};
+
+template <>
+struct ScalarTraits<long double> : RealScalarTraits<long double> {
+	static constexpr ScalarType type = ScalarType::LongDouble;
+	static std::string format(long double value);
+};
+
+template <>
+struct ScalarTraits<std::complex<double>> {
+	using Complex = std::complex<double>;
+	static constexpr ScalarType type = ScalarType::Complex;
+
+	static Complex from_double(double value) {
+		return Complex(value, 0.0);
+	}
+
+	static Complex not_a_number() {
+		return Complex(std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::quiet_NaN());
+	}
+
+	static RowStatus check_divisor(const Complex& b) {
+		return b.real() == 0 && b.imag() == 0 ? RowStatus::DivisionByZero : RowStatus::Ok;
+	}
+
+	static RowStatus divide(const Complex& a, const Complex& b, Complex& out) {
+		if (check_divisor(b) != RowStatus::Ok) {
+			return RowStatus::DivisionByZero;
+		}
+		out = a / b;
+		return RowStatus::Ok;
+	}
+
+	static RowStatus sqrt(const Complex& a, Complex& out);
+	static Complex power(const Complex& a, const Complex& b);
+
+	static Complex power_integer(const Complex& a, int exponent) {
+		return power_by_squaring(a, exponent);
+	}
+
+	static bool as_small_integer(const Complex& value, int& exponent) {
+		return value.imag() == 0 && RealScalarTraits<double>::as_small_integer(value.real(), exponent);
+	}
+
+	static std::string format(const Complex& value);
+};
+
+template <>
+struct ScalarTraits<Interval> {
+	static constexpr ScalarType type = ScalarType::Interval;
+
+	static Interval from_double(double value) {
+		return { value, value };
+	}
+
+	static Interval not_a_number() {
+		return { std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::quiet_NaN() };
+	}
+
+	static RowStatus check_divisor(const Interval& b) {
+		return b.low <= 0 && b.high >= 0 ? RowStatus::DivisionByZero : RowStatus::Ok;
+	}
+
+	static RowStatus divide(const Interval& a, const Interval& b, Interval& out);
+	static RowStatus sqrt(const Interval& a, Interval& out);
+	static Interval power(const Interval& a, const Interval& b);
+	static Interval power_integer(const Interval& a, int exponent);
+
+	static bool as_small_integer(const Interval& value, int& exponent) {
+		return value.low == value.high && RealScalarTraits<double>::as_small_integer(value.low, exponent);
+	}
+
+	static std::string format(const Interval& value);
+};
@@ -0,0 +1,102 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include "Expression_cache.h"
+#include "Session.h"
+
+/*-------Server.h-----------------------------------------------------------
+	The Server answers calculator requests from other processes over a Unix
+	domain socket or a TCP port (`calculator --serve unix:/tmp/calc.sock`,
+	`--serve 127.0.0.1:7070` or `--serve 7070`), so a service pays neither
+	a process start nor the interactive prompt per request.
+
+	Protocol: newline-delimited text, one request per line and exactly one
+	response line per request, in order:
+		- the value of an expression, as the shortest text that reads back
+		  as the same double ("0.1", "2e+05");
+		- "name = value" for an assignment;
+		- "error: <message>" when the line failed, "error: Limit exceeded:
+		  ..." or "error: Evaluation cancelled" when it ran out of the budget
+		  set by the session options (see Resource_governor.h); such a line
+		  is abandoned without delaying the others;
+		- an empty line for an empty request.
+	Requests are pipelined: a client may send any number of lines without
+	waiting, and the responses to every complete line read in one go are
+	sent back with one write.
+
+	Each connection has its own Session, so its variables are private to
+	it, while all sessions share one ExpressionCache: an expression is
+	tokenized, parsed and compiled once for every connection that sends it
+	(see Session.h).
+
+	Each event loop is a thread running epoll over non-blocking sockets;
+	the listening socket is registered in every loop with EPOLLEXCLUSIVE,
+	so a new connection wakes one loop and stays on it. A connection whose
+	responses pile up (a client that sends without reading) stops being
+	read until they drain. Lines longer than MAX_LINE close the connection.
+
+	Server mode needs epoll and is only available on Linux; elsewhere the
+	constructor throws std::runtime_error.
+----------------------------------------------------------------------------*/
+
+/* Where and how the server listens. */
+struct ServerOptions {
+	std::string address;        // "unix:<path>", "<host>:<port>" or "<port>" (on 127.0.0.1); port 0 picks a free one.
+	size_t threads = 1;         // Event loops, each on its own thread.
+	SessionOptions session;     // Options of every connection's session.
+};
+
+/* Counters of a running server. */
+struct ServerStats {
+	size_t connections;   // Connections accepted.
+	size_t requests;      // Lines answered.
+	size_t failed;        // Lines answered with an error.
+	size_t limited;       // Those of them that ran out of their budget.
+};
+
+class Server {
+private:
+	ServerOptions options;
+	std::string bound_address;                 // Address actually listened on (with the chosen port).
+	std::string socket_path;                   // Path of the Unix socket, removed on destruction.
+	int listen_fd;                             // Listening socket.
+	int stop_fd;                               // eventfd that wakes every loop when stop() is called.
+	std::shared_ptr<ExpressionCache> cache;    // Compiled expressions shared by every connection.
+	std::atomic<size_t> connections;
+	std::atomic<size_t> requests;
+	std::atomic<size_t> failed;
+	std::atomic<size_t> limited;
+
+	/* Runs one event loop until stop() is called. */
+	void run_loop();
+
+public:
+	/* Longest request line accepted, in bytes. */
+	static const size_t MAX_LINE = 1 << 20;
+
+	/* Pending response bytes above which a connection is no longer read. */
+	static const size_t MAX_PENDING_OUTPUT = 4 << 20;
+
+	/* Constructor: Binds and listens on the address. Throws std::runtime_error if it cannot. */
+	explicit Server(const ServerOptions& options);
+
+	/* Destructor: Closes the socket and removes the Unix socket file. */
+	~Server();
+
+	Server(const Server&) = delete;
+	Server& operator=(const Server&) = delete;
+
+	/* Serves connections until stop() is called. */
+	void run();
+
+	/* Makes run() return. Safe to call from another thread or a signal handler. */
+	void stop();
+
+	/* Returns the address listened on, in the form the options take. */
+	const std::string& get_address() const;
+
+	/* Returns a snapshot of the counters. */
+	ServerStats get_stats() const;
+};
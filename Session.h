@@ -0,0 +1,211 @@
+#pragma once
+#include <memory>
+#include <string>
+#include "Compiled_expression.h"
+#include "Dependency_graph.h"
+#include "Exact_evaluator.h"
+#include "Expression_cache.h"
+#include "Resource_governor.h"
+#include "Result.h"
+#include "Snapshot.h"
+#include "Symbol_table.h"
+#include "Utility.h"
+
+/*-------Session.h----------------------------------------------------------
+	This header file defines the Session class, which runs single lines of
+	calculator input against one set of variables.
+
+	A line is either an expression ("2x + 3"), whose value is returned, or
+	an assignment ("x = 2 + 5^2"), whose value is stored in the variable
+	named on the left-hand side. Every expression goes through the same
+	pipeline: Tokenizer -> Parser -> Optimizer -> SubexpressionEliminator ->
+	CompiledExpression. The optimizer keeps results bit-identical unless the
+	session was created in fast-math mode. The compiled form is
+	kept in an ExpressionCache keyed by the normalized text, so a repeated
+	expression (or the right-hand side of a repeated assignment) is only
+	evaluated, never re-parsed.
+
+	Key functionalities include:
+		- execute: Runs one line and reports what it produced.
+		- get_symbols: Exposes the variables of the session.
+		- get_cache_stats: Reports the hits, misses and evictions of the cache.
+
+	In reactive mode an assignment keeps its expression instead of only its
+	value: "y = sqrt(x)" makes y follow x, and a later "x = 9" recomputes y
+	and everything else that depends on x (see Dependency_graph.h). An
+	assignment whose formula fails returns the error but keeps the formula,
+	so the variable is undefined until a change of its inputs fixes it.
+
+	execute_exact runs a line in exact arithmetic instead (see
+	Exact_evaluator.h): "2^100" keeps all of its digits and "x = 1/3" keeps
+	x as a fraction for later exact lines, while ordinary lines see the
+	nearest double. Exact lines skip the optimizer and the cache.
+
+	Errors in a line (syntax errors, undefined variables, division by zero,
+	...) are thrown as std::runtime_error and leave the session unchanged.
+	Both the interactive prompt and the batch mode drive a Session.
+	try_execute, try_evaluate_readonly and try_evaluate_text return them as
+	an Error instead (see Result.h), which costs nothing like an exception
+	when many lines are invalid; the throwing functions are these plus a
+	throw. Node, step and time limits, formula cycles and exact lines still
+	throw. Lines run as compiled expressions, which fail with the message
+	the Evaluator would give (tests/error_parity_test.cpp).
+
+	evaluate_readonly runs an expression without touching the session at
+	all, so any number of threads may call it at once, provided no thread
+	is calling execute at the same time.
+
+	evaluate_text runs an expression the same way in the session's scalar
+	type (float, double, long double, complex or interval, see
+	Scalar_traits.h) and returns the value as text, so "sqrt(-4)" is "2i"
+	in complex mode. Expressions in a type other than double skip the
+	optimizer, whose constant folding rounds in double, and are cached
+	separately. Assignments always store a double.
+
+	Sessions created with a shared cache (the server gives one to every
+	connection) compile a missed expression with unbound variable names,
+	store it there, and keep a copy bound to their own variables: an
+	expression one connection sent is never parsed again for another.
+
+	With limits in the options, every line gets its own ResourceGovernor:
+	tokenizing and parsing count against its node, depth and time budget,
+	and evaluating counts the instructions of the program as steps. A line
+	over budget throws LimitExceeded and, like any other error, leaves the
+	session unchanged. An expression found in the cache was already within
+	the node and depth limits when it was compiled.
+
+	With jit in the options, every expression the session compiles also
+	gets x86-64 machine code (CompiledExpression::attach_native), which its
+	double evaluations run; the results and errors are the same. Programs
+	loaded from a snapshot and those of other scalar types stay
+	interpreted, as does everything in a build with CALC_NO_JIT.
+
+	save and load write the variables, the formulas and the cached compiled
+	expressions to a snapshot file and read them back (see Snapshot.h), so a
+	session with many predefined formulas starts without parsing them.
+----------------------------------------------------------------------------*/
+
+/* Options fixed for the lifetime of a session. */
+struct SessionOptions {
+	bool fast_math = false;   // Lets the optimizer apply rewrites that may change the last bit of a result.
+	bool reactive = false;    // Assignments keep their expressions and are recomputed when their inputs change.
+	ExactOptions exact;       // Square roots and huge powers in exact lines.
+	ScalarType scalar = ScalarType::Double;  // Type evaluate_text computes in.
+	ResourceLimits limits;    // Budget of every line (none by default).
+	bool jit = false;         // Runs the compiled expressions as native code where supported (see Native_expression.h).
+};
+
+/* Describes the outcome of one successfully executed line. */
+struct LineResult {
+	bool is_assignment;      // True when the line assigned a variable.
+	std::string variable;    // Name of the assigned variable (assignments only).
+	double value;            // Value of the expression, or the value assigned.
+};
+
+/* Describes the outcome of one line run in exact arithmetic. */
+struct ExactLineResult {
+	bool is_assignment;      // True when the line assigned a variable.
+	std::string variable;    // Name of the assigned variable (assignments only).
+	ExactNumber value;       // Value of the expression, or the value assigned.
+};
+
+/* Compiled form of an expression, or why it could not be compiled. */
+using CompileResult = Result<std::shared_ptr<const CompiledExpression>>;
+
+class Session {
+private:
+	SymbolTable symbols;     // Variables defined so far in this session.
+	SessionOptions options;  // Optimizer and assignment behaviour.
+	DependencyGraph dependencies;  // Formulas of the variables (reactive mode only).
+	Utility utilities;       // Helpers for splitting assignments.
+	ExactVariables exact_values;  // Exact values assigned by exact lines.
+	mutable ExpressionCache cache;  // Compiled expressions by normalized text (internally synchronized).
+	mutable ExpressionCache unfolded_cache;  // The same without the optimizer, for the other scalar types.
+	std::shared_ptr<ExpressionCache> shared_cache;  // Programs with unbound names, shared with other sessions (may be null).
+
+	/* Returns the compiled form of an expression, interning its variable names on a cache miss.
+	   A miss is parsed within the budget of the governor (which may be null). */
+	CompileResult compile(const std::string& expression, ResourceGovernor* governor);
+
+	/* Returns the compiled form of an expression without writing to the symbol table. */
+	CompileResult compile_readonly(const std::string& expression, ResourceGovernor* governor) const;
+
+	/* Returns the compiled form of an expression as written, without constant folding. */
+	CompileResult compile_unfolded(const std::string& expression, ResourceGovernor* governor) const;
+
+	/* Runs an expression line and returns its value. */
+	Result<double> evaluate_expression(const std::string& expression, ResourceGovernor* governor);
+
+	/* Runs an assignment line, stores the value and returns it together with the variable name. */
+	Result<LineResult> assign_variable(const std::string& input, ResourceGovernor* governor);
+
+public:
+	/* Constructor: Creates an empty session with the given options. */
+	explicit Session(const SessionOptions& options = SessionOptions());
+
+	/* Constructor: Creates an empty session whose cache misses are first looked up in a cache
+	   shared with other sessions of the same options, so each expression is parsed only once
+	   among them. */
+	Session(const SessionOptions& options, std::shared_ptr<ExpressionCache> shared_cache);
+
+	/* Runs one line of input. Lines containing '=' are assignments, anything else is an expression. */
+	LineResult execute(const std::string& input);
+
+	/* Same as execute, but returns an error in the line as an Error instead of throwing it. */
+	Result<LineResult> try_execute(const std::string& input);
+
+	/* Runs one line in exact arithmetic. An assignment also stores the nearest double, so
+	   ordinary lines can use the variable. */
+	ExactLineResult execute_exact(const std::string& input);
+
+	/* Evaluates an expression line (no assignment) without modifying the session. Safe to call
+	   from several threads at once while no line is being executed. */
+	double evaluate_readonly(const std::string& expression) const;
+
+	/* Same as evaluate_readonly, returning an error in the expression as an Error. */
+	Result<double> try_evaluate_readonly(const std::string& expression) const;
+
+	/* Evaluates an expression line (no assignment) in the session's scalar type and formats
+	   the value. Safe to call from several threads like evaluate_readonly. */
+	std::string evaluate_text(const std::string& expression) const;
+
+	/* Same as evaluate_text, returning an error in the expression as an Error. */
+	Result<std::string> try_evaluate_text(const std::string& expression) const;
+
+	/* Returns the symbol table holding the session's variables. */
+	SymbolTable& get_symbols();
+
+	/* Reports whether the session was created in fast-math mode. */
+	bool is_fast_math() const;
+
+	/* Reports whether compiled expressions run as native code. */
+	bool is_jit() const;
+
+	/* Reports whether assignments keep their expressions. */
+	bool is_reactive() const;
+
+	/* Sets the scalar type of evaluate_text. */
+	void set_scalar_type(ScalarType type);
+
+	/* Returns the scalar type of evaluate_text. */
+	ScalarType get_scalar_type() const;
+
+	/* Returns the budget every line runs with. */
+	const ResourceLimits& get_limits() const;
+
+	/* Returns the options of exact lines. */
+	const ExactOptions& get_exact_options() const;
+
+	/* Returns the formulas of the variables and the list of changed values (reactive mode). */
+	DependencyGraph& get_dependencies();
+
+	/* Returns the counters of the expression caches (both scalar-type paths together). */
+	CacheStats get_cache_stats() const;
+
+	/* Writes the variables, formulas and cached expressions to a snapshot file. */
+	SnapshotStats save(const std::string& path) const;
+
+	/* Adds the contents of a snapshot file to the session. Formulas are only restored in
+	   reactive mode. A damaged file throws std::runtime_error and changes nothing. */
+	SnapshotStats load(const std::string& path);
+};
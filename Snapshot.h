@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "Dependency_graph.h"
+#include "Expression_cache.h"
+#include "Symbol_table.h"
+
+/*------Snapshot.h-------------------------------------------------------------
+	A snapshot is a binary file holding the state of a session: every
+	variable with its value, the formulas of reactive variables, and the
+	compiled expressions of the expression cache. Loading one restores that
+	state without tokenizing, parsing, compiling or evaluating anything, so
+	a calculator with 100k predefined formulas starts about ten times sooner
+	(see benchmarks/snapshot_benchmark.cpp).
+
+	Format (version 2, little-endian, every section 8-byte aligned):
+		- SnapshotHeader: magic "CALCSNAP", version, sizes and counts, and an
+		  XXH64 checksum of everything after the header.
+		- symbols:      one SymbolRecord per variable (value, name, formula).
+		- programs:     one ProgramRecord per compiled expression, naming its
+		                ranges in the three arrays below.
+		- expressions:  one ExpressionRecord per cache entry (key, program).
+		- instructions: the bytecode of every program, laid out exactly like
+		                Instruction in memory.
+		- constants:    the constant pools, as doubles.
+		- slots:        the variable slots of every program, as symbol numbers.
+		- strings:      names and cache keys, back to back.
+	A program shared by a formula and a cache entry is stored once.
+
+	save writes the file under a temporary name, flushes it to disk and
+	renames it over the target, so a reader sees either the old snapshot or
+	the new one, never a partial file. On POSIX systems it then flushes the
+	directory too, so the rename itself survives a crash (Windows makes it
+	durable with MOVEFILE_WRITE_THROUGH).
+
+	load maps the file (mmap, or MapViewOfFile on Windows), checks the
+	checksum, that every record and every instruction stays within its
+	bounds and that its formulas, together with those of the session, form
+	no cycle, and only then changes the session: a damaged file is rejected
+	with a std::runtime_error and leaves the session as it was. Programs are
+	rebuilt by copying their arrays out of the mapping in one piece each.
+
+	Compiled expressions depend on whether the optimizer ran in fast-math
+	mode, which the header records; cache entries saved in the other mode
+	are not loaded (formulas are, since their values are stored).
+
+	Variables from the file replace those of the same name. Formulas that
+	were already in the session and read a loaded variable are recomputed.
+	Exact values (see Exact_evaluator.h) are not stored: a variable assigned
+	by an exact line comes back as its nearest double.
+----------------------------------------------------------------------------*/
+
+/* What a snapshot held or received. */
+struct SnapshotStats {
+	size_t variables;     // Variables stored (defined or not).
+	size_t formulas;      // Reactive formulas stored.
+	size_t expressions;   // Cached compiled expressions stored.
+	size_t bytes;         // Size of the file.
+};
+
+class Snapshot {
+public:
+	/* Current version of the file format. Version 2 programs compute the divisor of a division
+	   before its dividend; version 1 files still load, their programs dividing the old way. */
+	static const std::uint32_t VERSION = 2;
+
+	/* Writes the variables, formulas and cached expressions to path, replacing it atomically. */
+	static SnapshotStats save(const std::string& path, const SymbolTable& symbols, const DependencyGraph& dependencies,
+		const ExpressionCache& cache, bool fast_math);
+
+	/* Checks the snapshot at path and adds its contents to the session. Formulas are only
+	   restored when dependencies is not null, cached expressions only when they were compiled
+	   in the same fast-math mode. Throws std::runtime_error if the file cannot be
+	   read, is not a snapshot of this version, is damaged, or its formulas would
+	   depend on each other in a cycle. */
+	static SnapshotStats load(const std::string& path, SymbolTable& symbols, DependencyGraph* dependencies,
+		ExpressionCache& cache, bool fast_math);
+};
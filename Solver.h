@@ -0,0 +1,139 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Compiled_expression.h"
+#include "Differentiator.h"
+#include "Expression_node.h"
+#include "Resource_governor.h"
+#include "Symbol_table.h"
+
+/*------Solver.h---------------------------------------------------------------
+	The Solver finds the values of one unknown that satisfy an equation such
+	as "2x + 3 = sqrt(x) + 10", by looking for the roots of
+	f(x) = (lhs) - (rhs) in a given interval. An expression without '=' is
+	solved as expression = 0.
+
+	Key functionalities include:
+		- solve: Returns every root found in [low, high], in increasing order.
+		- get_intervals: Returns the ranges where f is zero throughout.
+		- get_stats: Reports how many evaluations the last solve took.
+
+	How roots are found:
+		1. Scanning: f is evaluated at evenly spaced points of the interval,
+		   all in one BatchEvaluator call. Two neighbouring points where f has
+		   opposite signs bracket a root.
+		2. Newton: inside each bracket, Newton's method runs with the exact
+		   derivative given by forward-mode automatic differentiation (see
+		   Differentiator.h). Every step shrinks the bracket, and a step that
+		   would leave it, a zero or missing derivative, or |f| failing to
+		   halve hands the bracket over to Brent's method.
+		3. Brent: combines bisection, secant and inverse quadratic steps, so it
+		   always converges on a bracket and is fast near the root.
+		4. Refining: a point where |f| is smaller than at both neighbours
+		   without a sign change may hide two roots closer together than the
+		   scan spacing, like 0.1 and 0.2 in (x - 0.1)(x - 0.2) scanned over
+		   [-100, 100]. The two intervals around it are scanned again with 64
+		   points, which turns such roots into brackets, up to three times.
+		A root where f touches zero without changing sign (like x = 1 in
+		(x - 1)^2) has no bracket; it is looked for by an unbracketed Newton
+		search from the local minimum of |f| left after refining. Roots
+		closer together than the finest spacing (about 3e-5 of the scan
+		spacing) can still be missed; more scan_points resolve them.
+
+	For instance, "2x + 3 = sqrt(x) + 10" solved for x in [0, 100] returns
+	4.56873...
+
+	Where f is exactly zero at two or more neighbouring scan points, as for
+	"t - t" or "sqrt(t^2) = t", every value in between is a solution: the
+	run is reported once by get_intervals, from its first to its last zero
+	point, instead of as one root per point.
+
+	A sign change around a pole (like 1/x at 0) is not a root: a bracket
+	whose limit has a larger |f| than either of its ends is discarded. Points
+	where f cannot be evaluated (division by zero, square root of a negative
+	number) count as having no sign. Other variables of the equation take
+	their values from the symbol table given to the constructor, which the
+	Solver never modifies; an undefined one is an error.
+
+	Given a ResourceGovernor (set_governor), each evaluation of f counts its
+	instructions (or tree nodes, for a derivative) as steps, so a deadline or
+	a cancellation stops a solve between two evaluations.
+----------------------------------------------------------------------------*/
+
+/* Tuning of the root search. */
+struct SolverOptions {
+	double tolerance = 1e-12;       // A root is accurate to tolerance * max(1, |root|).
+	size_t max_iterations = 100;    // Newton and Brent steps allowed per root.
+	size_t scan_points = 200;       // Intervals the range is cut into while looking for sign changes.
+	bool newton = true;             // Set to false to use Brent's method alone.
+};
+
+/* Work done by one solve. */
+struct SolverStats {
+	size_t scan_evaluations;       // Evaluations of f while scanning for brackets and checking roots.
+	size_t newton_evaluations;     // Forward-mode passes, each giving f and its derivative.
+	size_t brent_evaluations;      // Evaluations of f by Brent's method.
+	size_t brackets;               // Sign changes found by the scan.
+	size_t fallbacks;              // Brackets Newton handed over to Brent's method.
+};
+
+class Solver {
+private:
+	const SymbolTable& symbols;                      // Values of the other variables.
+	SolverOptions options;                           // Tolerance and limits.
+	SolverStats stats;                               // Work done by the last solve.
+	std::vector<std::pair<double, double>> intervals;  // Ranges where f was zero at every scan point.
+
+	SymbolTable working;                             // Copy of symbols holding the trial value of the unknown.
+	SymbolId unknown;                                // Slot of the unknown in working.
+	ExpressionTree function;                         // f = (lhs) - (rhs), optimized.
+	std::unique_ptr<CompiledExpression> compiled;    // Compiled f, used when only its value is needed.
+	std::vector<double> slot_values;                 // Variable values in the slot order of compiled.
+	size_t unknown_index;                            // Position of the unknown in slot_values.
+	Differentiator differentiator;                   // Computes f and f' on working.
+	ResourceGovernor* governor;                      // Budget every evaluation of f is counted against, or nullptr.
+
+	/* Parses the equation into f and prepares both ways of evaluating it. */
+	void prepare(const std::string& text, const std::string& variable);
+
+	/* Returns f(x), or NaN where f cannot be evaluated. */
+	double value_at(double x);
+
+	/* Returns the accuracy asked of a root near x. */
+	double tolerance_at(double x) const;
+
+	/* Runs safeguarded Newton on the bracket [a, b]. Returns the root, or NaN if none was found. */
+	double newton_bracketed(double a, double b, double fa, double fb);
+
+	/* Runs unbracketed Newton from x, staying within [low, high]. Returns the root, or NaN if none was found. */
+	double newton_touching(double x, double low, double high);
+
+	/* Runs Brent's method on the bracket [a, b]. Returns the root, or NaN if none was found. */
+	double brent(double a, double b, double fa, double fb);
+
+	/* Looks for roots at count + 1 evenly spaced points of [low, high], adding them to roots. Windows
+	   around local minima of |f| are scanned again, finer, up to three levels below depth 0. */
+	void scan(double low, double high, size_t count, size_t depth, std::vector<double>& roots);
+
+public:
+	/* Constructor: Reads the other variables of an equation from the given symbol table. */
+	explicit Solver(const SymbolTable& symbols, const SolverOptions& options = SolverOptions());
+
+	/* Returns the roots of "lhs = rhs" (or of "expression = 0") for the given variable in [low, high].
+	   Ranges where every value is a solution are left out and listed by get_intervals. */
+	std::vector<double> solve(const std::string& equation, const std::string& variable, double low, double high);
+
+	/* Counts parsing f and every evaluation of it against the budget of the line; a solve
+	   that runs out throws LimitExceeded instead of returning the roots found so far. */
+	void set_governor(ResourceGovernor* governor);
+
+	/* Returns the ranges, in increasing order, where the last solve found f to be zero at
+	   every scan point; a single range from low to high means f is zero everywhere. */
+	const std::vector<std::pair<double, double>>& get_intervals() const;
+
+	/* Returns the work done by the last solve. */
+	const SolverStats& get_stats() const;
+};
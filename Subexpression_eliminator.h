@@ -0,0 +1,80 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "Expression_node.h"
+
+/*-------Subexpression_eliminator.h-----------------------------------------
+	The SubexpressionEliminator merges identical subtrees of an expression
+	tree, so that a formula such as
+
+		sqrt(x^2 + y^2) * 2 + sqrt(x^2 + y^2) / 3
+
+	computes "sqrt(x^2 + y^2)" only once per evaluation.
+
+	It hash-conses the nodes: the tree is rebuilt bottom-up and a node is
+	only created when no node with the same token type, the same token text
+	(the same value, for numbers) and the same (already merged) children
+	exists yet. Identical subtrees
+	therefore end up as the very same node, and the result is a DAG rather
+	than a tree.
+
+	Operator nodes referred to by more than one parent are flagged as
+	shared. The Evaluator remembers the value of a shared node during one
+	evaluation, and CompiledExpression stores it in a temporary on first use
+	and reloads it afterwards. Numbers and variables are merged too but never
+	flagged, since reading them again is as cheap as reading a temporary.
+
+	Merging does not change any result: the shared subtree computes exactly
+	what each copy did, and an error it raises surfaces the first time it is
+	evaluated, as the first copy's would have.
+----------------------------------------------------------------------------*/
+
+class SubexpressionEliminator {
+private:
+	/* Structural identity of a node: token type, token text or value, and merged children. */
+	struct NodeKey {
+		TokenType type;
+		std::string_view value;   // Token text (empty for numbers).
+		std::uint64_t bits;       // Bit pattern of a number's value.
+		NodeIndex left;
+		NodeIndex right;
+
+		bool operator==(const NodeKey& other) const;
+	};
+
+	/* Hashes a NodeKey. */
+	struct NodeKeyHash {
+		size_t operator()(const NodeKey& key) const;
+	};
+
+	ExpressionTree output;                                        // Arena receiving the merged nodes.
+	std::unordered_map<NodeKey, NodeIndex, NodeKeyHash> nodes;    // Every distinct node created so far.
+	std::vector<NodeIndex> merged;                                // Output node of each input node already visited.
+	size_t deduplicated;                                          // Input nodes that reused an existing node.
+
+	std::vector<NodeFrame> frames;                                // Nodes being merged, innermost last.
+	std::vector<NodeIndex> results;                               // Merged children waiting for their parent.
+
+	/* Returns the merged copy of the given subtree inside the output arena. */
+	NodeIndex merge_node(const ExpressionTree& tree, NodeIndex root);
+
+	/* Returns the merged copy of one node whose children are already merged. */
+	NodeIndex merge_operation(const ExpressionTree& tree, NodeIndex index, NodeIndex left, NodeIndex right);
+
+	/* Flags the operator nodes that end up with more than one parent. */
+	void mark_shared_nodes();
+
+public:
+	/* Constructor. */
+	SubexpressionEliminator();
+
+	/* Returns a copy of the tree in which identical subtrees are one shared node. */
+	ExpressionTree eliminate(const ExpressionTree& tree);
+
+	/* Returns how many nodes the last call to eliminate() merged into an existing one. */
+	size_t get_deduplicated() const;
+};
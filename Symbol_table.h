@@ -0,0 +1,78 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/*-------Symbol_table.h-----------------------------------------------------
+	This header file defines the SymbolTable, which holds the variables of a
+	calculator session.
+
+	Every variable name is interned once, when the Tokenizer first meets it,
+	and receives a dense integer id (its slot). Names are looked up as
+	std::string_view straight from the input text; a std::string is only
+	built the first time a name is interned. Tokens and expression nodes
+	carry that slot, and the values of all variables live side by side in a
+	flat array indexed by it. Evaluating a variable is therefore a single
+	array access, and assigning one never rewrites any input text.
+
+	Key functionalities include:
+		- intern: Returns the slot of a name, creating it if needed.
+		- find: Looks a name up without creating it.
+		- set_value / get_value / is_defined / clear_value: Access the value held by a slot.
+		- get_values: Exposes the flat value array, indexed by slot.
+
+	A slot exists as soon as its name has been seen, but it only has a value
+	once something has been assigned to it.
+----------------------------------------------------------------------------*/
+
+using SymbolId = std::uint32_t;             // Dense index of an interned variable name.
+const SymbolId NO_SYMBOL = 0xFFFFFFFFu;     // Marks a variable that has no slot.
+
+class SymbolTable {
+private:
+	/* Hashes and compares std::string keys and std::string_view probes alike, so a lookup copies nothing. */
+	struct NameHash {
+		using is_transparent = void;
+		size_t operator()(std::string_view name) const { return std::hash<std::string_view>()(name); }
+	};
+
+	std::unordered_map<std::string, SymbolId, NameHash, std::equal_to<>> ids;   // Name to slot, consulted only while tokenizing.
+	std::vector<std::string> names;                  // Name of each slot.
+	std::vector<double> values;                      // Value of each slot.
+	std::vector<std::uint8_t> defined;               // Whether each slot has been assigned.
+
+public:
+	/* Returns the slot of the given name, creating an (undefined) slot the first time. */
+	SymbolId intern(std::string_view name);
+
+	/* Makes room for count slots in total, so that interning that many names does not reallocate. */
+	void reserve(size_t count);
+
+	/* Returns the slot of the given name, or NO_SYMBOL if it was never interned. */
+	SymbolId find(std::string_view name) const;
+
+	/* Returns the name held by a slot. */
+	const std::string& get_name(SymbolId id) const;
+
+	/* Reports whether a value has been assigned to the slot. */
+	bool is_defined(SymbolId id) const;
+
+	/* Returns the value of a slot. Only meaningful when the slot is defined. */
+	double get_value(SymbolId id) const;
+
+	/* Assigns a value to a slot and marks it as defined. */
+	void set_value(SymbolId id, double value);
+
+	/* Marks a slot as undefined again, as if nothing had been assigned to it. */
+	void clear_value(SymbolId id);
+
+	/* Returns the flat array of values, indexed by slot. */
+	const double* get_values() const;
+
+	/* Returns the number of interned names. */
+	size_t size() const;
+};
@@ -0,0 +1,67 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*-------Thread_pool.h------------------------------------------------------
+	The ThreadPool runs independent tasks on a fixed set of worker threads,
+	one per hardware thread by default.
+
+	Each worker owns a queue of tasks. Submitted tasks are dealt round-robin
+	onto the worker queues; a worker takes tasks from the front of its own
+	queue (oldest first) and, once that is empty, steals from the back of
+	the other workers' queues. Uneven tasks therefore never leave a core
+	idle while work is waiting elsewhere.
+
+	Key functionalities include:
+		- Constructor: Starts the workers.
+		- submit: Queues a task for execution.
+		- get_thread_count: Reports the number of workers.
+
+	The destructor finishes every queued task before joining the workers.
+	Tasks must not throw; completion is signalled by the tasks themselves.
+----------------------------------------------------------------------------*/
+
+class ThreadPool {
+private:
+	/* Task queue owned by one worker. */
+	struct WorkerQueue {
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	std::vector<std::unique_ptr<WorkerQueue>> queues;   // One queue per worker.
+	std::vector<std::thread> threads;                   // The workers themselves.
+	std::mutex wake_mutex;                              // Guards sleeping and waking workers.
+	std::condition_variable wake;                       // Signalled when work arrives or the pool stops.
+	std::atomic<size_t> pending;                        // Tasks queued but not yet taken.
+	std::atomic<size_t> next_queue;                     // Round-robin cursor for submit().
+	bool stopping;                                      // Set by the destructor.
+
+	/* Takes a task from the worker's own queue, or steals one from another queue. */
+	bool take_task(size_t worker, std::function<void()>& task);
+
+	/* Main loop of a worker thread. */
+	void work(size_t worker);
+
+public:
+	/* Constructor: Starts the given number of workers (at least one). */
+	explicit ThreadPool(size_t thread_count = std::thread::hardware_concurrency());
+
+	/* Destructor: Runs the remaining tasks and joins the workers. */
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/* Queues a task to be run by one of the workers. */
+	void submit(std::function<void()> task);
+
+	/* Returns the number of worker threads. */
+	size_t get_thread_count() const;
+};
@@ -1,5 +1,6 @@
 #pragma once
-#include <string>
+#include <string_view>
+#include "Symbol_table.h"
 
 /*------Token.h----------------------------------------------------------
     This header file introduces the Token entity, a foundational unit
@@ -14,6 +15,15 @@
         - Initialization: Constructs a token with a specified type and value.
         - Type Retrieval: Offers insight into the category or kind of a token.
         - Value Access: Yields the precise textual representation or content of the token.
+        - Number Access: Yields the value of a number literal, decoded once by the Tokenizer.
+        - Slot Access: Yields the symbol table slot of a variable token.
+
+    A Token is a small trivially-copyable record. Its text is a view, not a
+    copy: tokens read from an expression point into that expression's text,
+    and tokens made up by the Parser or Optimizer point at string literals.
+    The text an expression was tokenized from must therefore outlive every
+    token (and expression tree) built from it. Number literals made up by
+    the Optimizer have no text at all, only their value.
 
     The Token plays an instrumental role in stages of lexical analysis and parsing,
     providing a structured way to comprehend and manipulate expressions.
@@ -32,20 +42,29 @@ enum class TokenType
     Sqrt,              // Square root function/operator.
     Equal,             // Equality operator ('=').
     Variable,          // Variable identifiers.
+    Negation,          // Unary minus, produced by the Optimizer in place of '-1 *'.
+    IntegerPower,      // Power with a small constant integer exponent, produced by the Optimizer.
     Error,             // Signifier for tokenization anomalies.
     End                // Termination symbol in input.
 };
 
 class Token {
 public:
-    // Constructor: Initializes a token with designated type and value.
-    Token(TokenType type, const std::string& value);
+    // Constructor: Initializes a token with designated type, text and (for variables) symbol slot.
+    Token(TokenType type, std::string_view text, SymbolId slot = NO_SYMBOL);
+
+    // Factory: Creates a number literal holding the given value, with optional source text.
+    static Token number(double value, std::string_view text = std::string_view());
 
     // Accessor methods to glean token attributes.
     TokenType getType() const;           // Fetches the token's type.
-    const std::string& getValue() const; // Retrieves the token's value.
+    std::string_view getValue() const;   // Retrieves the token's text.
+    double getNumber() const;            // Retrieves the value of a number literal.
+    SymbolId getSlot() const;            // Retrieves the variable's slot, or NO_SYMBOL.
 
 private:
-    TokenType type;      // Categorization of the token.
-    std::string value;   // Textual representation or content of the token.
+    TokenType type;           // Categorization of the token.
+    SymbolId slot;            // Symbol table slot of a variable token.
+    double value;             // Decoded value of a number literal.
+    std::string_view text;    // Textual representation of the token (a view, see above).
 };
@@ -1,7 +1,10 @@
 #include <string>
-#include <vector>
+#include <string_view>
 #include "Token.h"
 #include "Utility.h"
+#include "Symbol_table.h"
+#include "Resource_governor.h"
+#include "Result.h"
 #pragma once
 
 /*-------Tokenizer.h-----------------------------------------------------
@@ -11,12 +14,28 @@
 
     Principal features encompass:
         - Initialization: Constructs the Tokenizer with a specific input expression.
-        - Token Generation: Decomposes the input expression into individual tokens.
+        - Token Generation: Hands out the tokens of the expression one at a time
+          (next_token), so the Parser pulls them as it goes instead of working
+          from a separate list.
         - Character Reading: Recognizes individual characters or tokens from the expression.
 
     Specifically, the Tokenizer:
         - Derives numbers, operators, keywords (like sqrt), variables, and parenthesis tokens.
+        - Decodes number literals once, with std::from_chars, including scientific
+          notation such as 1.5e-9.
+        - Never copies the expression: it reads the caller's text through a
+          string_view, and tokens point back into it (see Token.h). Producing
+          tokens does not allocate.
         - Keeps a running tab on its position within the expression string.
+        - Interns every variable name into the session's SymbolTable, so that
+          variable tokens carry their slot from the start. Given a read-only
+          table, it only looks names up, which is safe while other threads
+          read the same table.
+        - Reports each token to a ResourceGovernor when given one, so the
+          deadline and cancellation of a line also apply to reading it.
+        - Reports malformed input without throwing through scan_token, which
+          returns an Error token and keeps the details in get_error() (see
+          Result.h); next_token throws them instead.
 
     Generally used in the preliminary stages of an expression evaluation pipeline to
     prepare the input for further processing.
@@ -24,25 +43,66 @@
 
 class Tokenizer {
 private:
-    std::string expression;      // The mathematical expression to be tokenized.
+    std::string_view expression; // The mathematical expression to be tokenized (not owned).
     size_t position;             // Tracker of the current position within the expression.
+    SymbolTable* symbols;        // Table receiving variable names, or nullptr to leave tokens without slots.
+    const SymbolTable* lookup;   // Table consulted for slots without adding names, or nullptr.
+    bool wide_numbers;           // Whether numbers beyond the range of a double are let through.
+    ResourceGovernor* governor;  // Budget every token is counted against, or nullptr.
+    Error error;                 // What the last Error token stands for.
 
     /* Helper functions for internal operation. */ 
-    char current_char();         // Retrieves the character at the current index.
+    char current_char() const;   // Retrieves the character at the current index ('\0' past the end).
+    char char_at(size_t index) const;  // Retrieves any character of the expression ('\0' past the end).
     void advance();              // Steps forward to the subsequent character.
 
     /* Dedicated functions for identifying different types of tokens. */
-    Token next_token();          // Fetches the subsequent token from the expression.
     Token read_number();         // Isolates and returns a numeric token.
     Token read_operator();       // Isolates and returns an operator token.
     Token read_keyword();        // Isolates and returns a keyword token.
     Token read_variable();       // Isolates and returns a variable token.
     Token read_parenthesis();    // Isolates and returns a parenthesis token.
 
+    /* Records an error found at the given offset and returns the Error token standing for it. */
+    Token fail(ErrorCode code, size_t start, std::string_view text);
+
+    /* Returns the slot a variable token should carry. */
+    SymbolId slot_for(std::string_view name);
+
 public:
-    /* Constructor : Preps the tokenizer with a designated expression string. */ 
-    explicit Tokenizer(const std::string& expression);
+    /* Constructor : Preps the tokenizer with a designated expression string. The text must
+       outlive the tokenizer and every token it produces. */ 
+    explicit Tokenizer(std::string_view expression);
+
+    /* Constructor : Preps the tokenizer and interns variable names into the given table. */
+    Tokenizer(std::string_view expression, SymbolTable& symbols);
+
+    /* Constructor : Preps the tokenizer to look variable names up in the given table without
+       adding to it. Names the table does not know are left without a slot. */
+    Tokenizer(std::string_view expression, const SymbolTable& symbols);
+
+    /* Main function : Returns the next token of the expression, or an End token once the
+       whole expression has been read (and on every call after that). */
+    Token next_token();
+
+    /* Same as next_token, but malformed input yields a token of type TokenType::Error instead
+       of an exception; get_error() then tells what is wrong and where. */
+    Token scan_token();
+
+    /* Returns the error behind the last Error token. */
+    const Error& get_error() const;
+
+    /* Lets numbers too large or too small for a double through instead of throwing, with the
+       value rounded to infinity or zero; their text still holds them exactly. */
+    void allow_wide_numbers(bool allow);
+
+    /* Counts every token against the governor, so a cancelled or timed-out line stops even
+       while it is being tokenized (nullptr to stop counting). */
+    void set_governor(ResourceGovernor* governor);
+
+    /* Starts over on a new expression, keeping the symbol table. */
+    void reset(std::string_view expression);
 
-    /* Main function : Decomposes the expression into a list of tokens. */
-    std::vector<Token> tokenize();
+    /* Returns the whole expression being tokenized. */
+    std::string_view get_expression() const;
 };
\ No newline at end of file
@@ -0,0 +1,28 @@
+#include "Metrics.h"
+#include <cstdlib>
+#include <new>
+
+/* Replaces the global operator new so each thread counts its heap allocations (see Metrics.h).
+   The array and nothrow forms call this one. Kept alone in this file so that a program
+   with its own replacement simply does not link it; the benchmark suite reads these counters. */
+
+#ifndef CALC_NO_METRICS
+
+void* operator new(std::size_t size) {
+	thread_allocation_count.allocations++;
+	thread_allocation_count.bytes += size;
+	if (void* memory = std::malloc(size ? size : 1)) {
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+	std::free(memory);
+}
+
+#endif
@@ -0,0 +1,819 @@
+#include "Batch_evaluator.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CALC_BATCH_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#else
+#define CALC_BATCH_X86 0
+#endif
+
+/* GCC and Clang need the instruction set enabled per function; MSVC accepts the intrinsics as is */
+#if CALC_BATCH_X86 && (defined(__GNUC__) || defined(__clang__))
+#define CALC_TARGET_AVX2 __attribute__((target("avx2")))
+#define CALC_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define CALC_TARGET_AVX2
+#define CALC_TARGET_AVX512
+#endif
+
+static const double NOT_A_NUMBER = std::numeric_limits<double>::quiet_NaN();
+static const float FLOAT_NOT_A_NUMBER = std::numeric_limits<float>::quiet_NaN();
+
+/* Most intermediate values held at once (32 MB); programs needing a deeper stack use smaller blocks */
+static const size_t SCRATCH_LIMIT = size_t(1) << 22;
+
+/* Set of arithmetic kernels for one instruction set and scalar type. Every kernel handles any row count. */
+template <typename Scalar>
+struct BatchKernels {
+	const char* name;
+	void (*add)(const Scalar* a, const Scalar* b, Scalar* out, size_t n);
+	void (*subtract)(const Scalar* a, const Scalar* b, Scalar* out, size_t n);
+	void (*multiply)(const Scalar* a, const Scalar* b, Scalar* out, size_t n);
+	void (*divide)(const Scalar* a, const Scalar* b, Scalar* out, RowStatus* status, size_t n);
+	void (*sqrt)(const Scalar* a, Scalar* out, RowStatus* status, size_t n);
+	void (*power_int)(const Scalar* a, int exponent, Scalar* out, size_t n);
+};
+
+/* flag_row: Records an error on a row unless an earlier error is already recorded */
+static inline void flag_row(RowStatus& status, RowStatus error) {
+	if (status == RowStatus::Ok) {
+		status = error;
+	}
+}
+
+/* flag_lanes: Records an error on every row whose bit is set in a vector comparison mask */
+static inline void flag_lanes(RowStatus* status, unsigned mask, RowStatus error) {
+	for (int lane = 0; mask != 0; lane++, mask >>= 1) {
+		if (mask & 1u) {
+			flag_row(status[lane], error);
+		}
+	}
+}
+
+/*------Scalar kernels (any scalar type, through its traits)--------------------*/
+
+template <typename Scalar>
+static void add_scalar(const Scalar* a, const Scalar* b, Scalar* out, size_t n) {
+	for (size_t i = 0; i < n; i++) out[i] = a[i] + b[i];
+}
+
+template <typename Scalar>
+static void subtract_scalar(const Scalar* a, const Scalar* b, Scalar* out, size_t n) {
+	for (size_t i = 0; i < n; i++) out[i] = a[i] - b[i];
+}
+
+template <typename Scalar>
+static void multiply_scalar(const Scalar* a, const Scalar* b, Scalar* out, size_t n) {
+	for (size_t i = 0; i < n; i++) out[i] = a[i] * b[i];
+}
+
+template <typename Scalar>
+static void divide_scalar(const Scalar* a, const Scalar* b, Scalar* out, RowStatus* status, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		RowStatus error = ScalarTraits<Scalar>::divide(a[i], b[i], out[i]);
+		if (error != RowStatus::Ok) {
+			flag_row(status[i], error);
+			out[i] = ScalarTraits<Scalar>::not_a_number();
+		}
+	}
+}
+
+template <typename Scalar>
+static void sqrt_scalar(const Scalar* a, Scalar* out, RowStatus* status, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		RowStatus error = ScalarTraits<Scalar>::sqrt(a[i], out[i]);
+		if (error != RowStatus::Ok) {
+			flag_row(status[i], error);
+			out[i] = ScalarTraits<Scalar>::not_a_number();
+		}
+	}
+}
+
+template <typename Scalar>
+static void power_int_scalar(const Scalar* a, int exponent, Scalar* out, size_t n) {
+	for (size_t i = 0; i < n; i++) out[i] = ScalarTraits<Scalar>::power_integer(a[i], exponent);
+}
+
+template <typename Scalar>
+static const BatchKernels<Scalar> SCALAR_KERNELS = {
+	"scalar", add_scalar<Scalar>, subtract_scalar<Scalar>, multiply_scalar<Scalar>, divide_scalar<Scalar>,
+	sqrt_scalar<Scalar>, power_int_scalar<Scalar>
+};
+
+#if CALC_BATCH_X86
+
+/*------AVX2 kernels (4 rows per instruction)----------------------------------*/
+
+CALC_TARGET_AVX2 static void add_avx2(const double* a, const double* b, double* out, size_t n) {
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		_mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+	}
+	add_scalar<double>(a + i, b + i, out + i, n - i);
+}
+
+CALC_TARGET_AVX2 static void subtract_avx2(const double* a, const double* b, double* out, size_t n) {
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		_mm256_storeu_pd(out + i, _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+	}
+	subtract_scalar<double>(a + i, b + i, out + i, n - i);
+}
+
+CALC_TARGET_AVX2 static void multiply_avx2(const double* a, const double* b, double* out, size_t n) {
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		_mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+	}
+	multiply_scalar<double>(a + i, b + i, out + i, n - i);
+}
+
+CALC_TARGET_AVX2 static void divide_avx2(const double* a, const double* b, double* out, RowStatus* status, size_t n) {
+	const __m256d zero = _mm256_setzero_pd();
+	const __m256d nan = _mm256_set1_pd(NOT_A_NUMBER);
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4) {
+		__m256d divisor = _mm256_loadu_pd(b + i);
+		__m256d is_zero = _mm256_cmp_pd(divisor, zero, _CMP_EQ_OQ);
+		__m256d quotient = _mm256_div_pd(_mm256_loadu_pd(a + i), divisor);
+		_mm256_storeu_pd(out + i, _mm256_blendv_pd(quotient, nan, is_zero));
+
+		unsigned mask = static_cast<unsigned>(_mm256_movemask_pd(is_zero));
+		if (mask != 0) {  // Rare: only rows that actually divide by zero pay for the bookkeeping
+			flag_lanes(status + i, mask, RowStatus::DivisionByZero);
+		}
+	}
+	divide_scalar<double>(a + i, b + i, out + i, status + i, n - i);
+}
+
+CALC_TARGET_AVX2 static void sqrt_avx2(const double* a, double* out, RowStatus* status, size_t n) {
+	const __m256d zero = _mm256_setzero_pd();
+	const __m256d nan = _mm256_set1_pd(NOT_A_NUMBER);
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4) {
+		__m256d value = _mm256_loadu_pd(a + i);
+		__m256d is_negative = _mm256_cmp_pd(value, zero, _CMP_LT_OQ);
+		_mm256_storeu_pd(out + i, _mm256_blendv_pd(_mm256_sqrt_pd(value), nan, is_negative));
+
+		unsigned mask = static_cast<unsigned>(_mm256_movemask_pd(is_negative));
+		if (mask != 0) {
+			flag_lanes(status + i, mask, RowStatus::NegativeSqrt);
+		}
+	}
+	sqrt_scalar<double>(a + i, out + i, status + i, n - i);
+}
+
+CALC_TARGET_AVX2 static void power_int_avx2(const double* a, int exponent, double* out, size_t n) {
+	const unsigned magnitude = exponent < 0 ? 0u - static_cast<unsigned>(exponent) : static_cast<unsigned>(exponent);
+	const __m256d one = _mm256_set1_pd(1.0);
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4) {
+		__m256d base = _mm256_loadu_pd(a + i);
+		__m256d result = one;
+
+		for (unsigned remaining = magnitude; remaining != 0;) {
+			if (remaining & 1u) {
+				result = _mm256_mul_pd(result, base);
+			}
+			remaining >>= 1;
+			if (remaining != 0) {
+				base = _mm256_mul_pd(base, base);
+			}
+		}
+		_mm256_storeu_pd(out + i, exponent < 0 ? _mm256_div_pd(one, result) : result);
+	}
+	power_int_scalar<double>(a + i, exponent, out + i, n - i);
+}
+
+static const BatchKernels<double> AVX2_KERNELS = {
+	"avx2", add_avx2, subtract_avx2, multiply_avx2, divide_avx2, sqrt_avx2, power_int_avx2
+};
+
+/*------AVX-512 kernels (8 rows per instruction)-------------------------------*/
+
+CALC_TARGET_AVX512 static void add_avx512(const double* a, const double* b, double* out, size_t n) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		_mm512_storeu_pd(out + i, _mm512_add_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+	}
+	add_scalar<double>(a + i, b + i, out + i, n - i);
+}
+
+CALC_TARGET_AVX512 static void subtract_avx512(const double* a, const double* b, double* out, size_t n) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		_mm512_storeu_pd(out + i, _mm512_sub_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+	}
+	subtract_scalar<double>(a + i, b + i, out + i, n - i);
+}
+
+CALC_TARGET_AVX512 static void multiply_avx512(const double* a, const double* b, double* out, size_t n) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		_mm512_storeu_pd(out + i, _mm512_mul_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+	}
+	multiply_scalar<double>(a + i, b + i, out + i, n - i);
+}
+
+CALC_TARGET_AVX512 static void divide_avx512(const double* a, const double* b, double* out, RowStatus* status, size_t n) {
+	const __m512d zero = _mm512_setzero_pd();
+	const __m512d nan = _mm512_set1_pd(NOT_A_NUMBER);
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		__m512d divisor = _mm512_loadu_pd(b + i);
+		__mmask8 is_zero = _mm512_cmp_pd_mask(divisor, zero, _CMP_EQ_OQ);
+		__m512d quotient = _mm512_div_pd(_mm512_loadu_pd(a + i), divisor);
+		_mm512_storeu_pd(out + i, _mm512_mask_blend_pd(is_zero, quotient, nan));
+
+		if (is_zero != 0) {
+			flag_lanes(status + i, is_zero, RowStatus::DivisionByZero);
+		}
+	}
+	divide_scalar<double>(a + i, b + i, out + i, status + i, n - i);
+}
+
+CALC_TARGET_AVX512 static void sqrt_avx512(const double* a, double* out, RowStatus* status, size_t n) {
+	const __m512d zero = _mm512_setzero_pd();
+	const __m512d nan = _mm512_set1_pd(NOT_A_NUMBER);
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		__m512d value = _mm512_loadu_pd(a + i);
+		__mmask8 is_negative = _mm512_cmp_pd_mask(value, zero, _CMP_LT_OQ);
+		__m512d root = _mm512_maskz_sqrt_pd(static_cast<__mmask8>(~is_negative), value);
+		_mm512_storeu_pd(out + i, _mm512_mask_blend_pd(is_negative, root, nan));
+
+		if (is_negative != 0) {
+			flag_lanes(status + i, is_negative, RowStatus::NegativeSqrt);
+		}
+	}
+	sqrt_scalar<double>(a + i, out + i, status + i, n - i);
+}
+
+CALC_TARGET_AVX512 static void power_int_avx512(const double* a, int exponent, double* out, size_t n) {
+	const unsigned magnitude = exponent < 0 ? 0u - static_cast<unsigned>(exponent) : static_cast<unsigned>(exponent);
+	const __m512d one = _mm512_set1_pd(1.0);
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		__m512d base = _mm512_loadu_pd(a + i);
+		__m512d result = one;
+
+		for (unsigned remaining = magnitude; remaining != 0;) {
+			if (remaining & 1u) {
+				result = _mm512_mul_pd(result, base);
+			}
+			remaining >>= 1;
+			if (remaining != 0) {
+				base = _mm512_mul_pd(base, base);
+			}
+		}
+		_mm512_storeu_pd(out + i, exponent < 0 ? _mm512_div_pd(one, result) : result);
+	}
+	power_int_scalar<double>(a + i, exponent, out + i, n - i);
+}
+
+static const BatchKernels<double> AVX512_KERNELS = {
+	"avx512", add_avx512, subtract_avx512, multiply_avx512, divide_avx512, sqrt_avx512, power_int_avx512
+};
+
+/*------float AVX2 kernels (8 rows per instruction)----------------------------*/
+
+CALC_TARGET_AVX2 static void add_float_avx2(const float* a, const float* b, float* out, size_t n) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		_mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+	}
+	add_scalar<float>(a + i, b + i, out + i, n - i);
+}
+
+CALC_TARGET_AVX2 static void subtract_float_avx2(const float* a, const float* b, float* out, size_t n) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		_mm256_storeu_ps(out + i, _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+	}
+	subtract_scalar<float>(a + i, b + i, out + i, n - i);
+}
+
+CALC_TARGET_AVX2 static void multiply_float_avx2(const float* a, const float* b, float* out, size_t n) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+	}
+	multiply_scalar<float>(a + i, b + i, out + i, n - i);
+}
+
+CALC_TARGET_AVX2 static void divide_float_avx2(const float* a, const float* b, float* out, RowStatus* status, size_t n) {
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 nan = _mm256_set1_ps(FLOAT_NOT_A_NUMBER);
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		__m256 divisor = _mm256_loadu_ps(b + i);
+		__m256 is_zero = _mm256_cmp_ps(divisor, zero, _CMP_EQ_OQ);
+		__m256 quotient = _mm256_div_ps(_mm256_loadu_ps(a + i), divisor);
+		_mm256_storeu_ps(out + i, _mm256_blendv_ps(quotient, nan, is_zero));
+
+		unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(is_zero));
+		if (mask != 0) {
+			flag_lanes(status + i, mask, RowStatus::DivisionByZero);
+		}
+	}
+	divide_scalar<float>(a + i, b + i, out + i, status + i, n - i);
+}
+
+CALC_TARGET_AVX2 static void sqrt_float_avx2(const float* a, float* out, RowStatus* status, size_t n) {
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 nan = _mm256_set1_ps(FLOAT_NOT_A_NUMBER);
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		__m256 value = _mm256_loadu_ps(a + i);
+		__m256 is_negative = _mm256_cmp_ps(value, zero, _CMP_LT_OQ);
+		_mm256_storeu_ps(out + i, _mm256_blendv_ps(_mm256_sqrt_ps(value), nan, is_negative));
+
+		unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(is_negative));
+		if (mask != 0) {
+			flag_lanes(status + i, mask, RowStatus::NegativeSqrt);
+		}
+	}
+	sqrt_scalar<float>(a + i, out + i, status + i, n - i);
+}
+
+CALC_TARGET_AVX2 static void power_int_float_avx2(const float* a, int exponent, float* out, size_t n) {
+	const unsigned magnitude = exponent < 0 ? 0u - static_cast<unsigned>(exponent) : static_cast<unsigned>(exponent);
+	const __m256 one = _mm256_set1_ps(1.0f);
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		__m256 base = _mm256_loadu_ps(a + i);
+		__m256 result = one;
+
+		for (unsigned remaining = magnitude; remaining != 0;) {
+			if (remaining & 1u) {
+				result = _mm256_mul_ps(result, base);
+			}
+			remaining >>= 1;
+			if (remaining != 0) {
+				base = _mm256_mul_ps(base, base);
+			}
+		}
+		_mm256_storeu_ps(out + i, exponent < 0 ? _mm256_div_ps(one, result) : result);
+	}
+	power_int_scalar<float>(a + i, exponent, out + i, n - i);
+}
+
+static const BatchKernels<float> FLOAT_AVX2_KERNELS = {
+	"avx2", add_float_avx2, subtract_float_avx2, multiply_float_avx2, divide_float_avx2, sqrt_float_avx2, power_int_float_avx2
+};
+
+/*------float AVX-512 kernels (16 rows per instruction)------------------------*/
+
+CALC_TARGET_AVX512 static void add_float_avx512(const float* a, const float* b, float* out, size_t n) {
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		_mm512_storeu_ps(out + i, _mm512_add_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)));
+	}
+	add_scalar<float>(a + i, b + i, out + i, n - i);
+}
+
+CALC_TARGET_AVX512 static void subtract_float_avx512(const float* a, const float* b, float* out, size_t n) {
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		_mm512_storeu_ps(out + i, _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)));
+	}
+	subtract_scalar<float>(a + i, b + i, out + i, n - i);
+}
+
+CALC_TARGET_AVX512 static void multiply_float_avx512(const float* a, const float* b, float* out, size_t n) {
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		_mm512_storeu_ps(out + i, _mm512_mul_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)));
+	}
+	multiply_scalar<float>(a + i, b + i, out + i, n - i);
+}
+
+CALC_TARGET_AVX512 static void divide_float_avx512(const float* a, const float* b, float* out, RowStatus* status, size_t n) {
+	const __m512 zero = _mm512_setzero_ps();
+	const __m512 nan = _mm512_set1_ps(FLOAT_NOT_A_NUMBER);
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		__m512 divisor = _mm512_loadu_ps(b + i);
+		__mmask16 is_zero = _mm512_cmp_ps_mask(divisor, zero, _CMP_EQ_OQ);
+		__m512 quotient = _mm512_div_ps(_mm512_loadu_ps(a + i), divisor);
+		_mm512_storeu_ps(out + i, _mm512_mask_blend_ps(is_zero, quotient, nan));
+
+		if (is_zero != 0) {
+			flag_lanes(status + i, is_zero, RowStatus::DivisionByZero);
+		}
+	}
+	divide_scalar<float>(a + i, b + i, out + i, status + i, n - i);
+}
+
+CALC_TARGET_AVX512 static void sqrt_float_avx512(const float* a, float* out, RowStatus* status, size_t n) {
+	const __m512 zero = _mm512_setzero_ps();
+	const __m512 nan = _mm512_set1_ps(FLOAT_NOT_A_NUMBER);
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		__m512 value = _mm512_loadu_ps(a + i);
+		__mmask16 is_negative = _mm512_cmp_ps_mask(value, zero, _CMP_LT_OQ);
+		__m512 root = _mm512_maskz_sqrt_ps(static_cast<__mmask16>(~is_negative), value);
+		_mm512_storeu_ps(out + i, _mm512_mask_blend_ps(is_negative, root, nan));
+
+		if (is_negative != 0) {
+			flag_lanes(status + i, is_negative, RowStatus::NegativeSqrt);
+		}
+	}
+	sqrt_scalar<float>(a + i, out + i, status + i, n - i);
+}
+
+CALC_TARGET_AVX512 static void power_int_float_avx512(const float* a, int exponent, float* out, size_t n) {
+	const unsigned magnitude = exponent < 0 ? 0u - static_cast<unsigned>(exponent) : static_cast<unsigned>(exponent);
+	const __m512 one = _mm512_set1_ps(1.0f);
+	size_t i = 0;
+
+	for (; i + 16 <= n; i += 16) {
+		__m512 base = _mm512_loadu_ps(a + i);
+		__m512 result = one;
+
+		for (unsigned remaining = magnitude; remaining != 0;) {
+			if (remaining & 1u) {
+				result = _mm512_mul_ps(result, base);
+			}
+			remaining >>= 1;
+			if (remaining != 0) {
+				base = _mm512_mul_ps(base, base);
+			}
+		}
+		_mm512_storeu_ps(out + i, exponent < 0 ? _mm512_div_ps(one, result) : result);
+	}
+	power_int_scalar<float>(a + i, exponent, out + i, n - i);
+}
+
+static const BatchKernels<float> FLOAT_AVX512_KERNELS = {
+	"avx512", add_float_avx512, subtract_float_avx512, multiply_float_avx512, divide_float_avx512, sqrt_float_avx512,
+	power_int_float_avx512
+};
+
+#endif
+
+/* Widest vector instructions usable on this machine. */
+enum class InstructionSet {
+	Scalar,
+	Avx2,
+	Avx512
+};
+
+/* detect_instruction_set: Finds the widest instruction set that both the CPU and the operating system support */
+static InstructionSet detect_instruction_set() {
+#if CALC_BATCH_X86
+#if defined(__GNUC__) || defined(__clang__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		return InstructionSet::Avx512;
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		return InstructionSet::Avx2;
+	}
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int highest_leaf = info[0];
+
+	__cpuid(info, 1);
+	bool os_saves_ymm = false;
+	bool os_saves_zmm = false;
+	if ((info[2] & (1 << 27)) && (info[2] & (1 << 28))) {  // OSXSAVE and AVX
+		unsigned long long xcr0 = _xgetbv(0);
+		os_saves_ymm = (xcr0 & 0x6) == 0x6;
+		os_saves_zmm = (xcr0 & 0xE6) == 0xE6;
+	}
+
+	if (highest_leaf >= 7) {
+		__cpuidex(info, 7, 0);
+		if (os_saves_zmm && (info[1] & (1 << 16))) {  // AVX512F
+			return InstructionSet::Avx512;
+		}
+		if (os_saves_ymm && (info[1] & (1 << 5))) {   // AVX2
+			return InstructionSet::Avx2;
+		}
+	}
+#endif
+#endif
+	return InstructionSet::Scalar;
+}
+
+/* instruction_set: Returns the instruction set of this machine, detecting it on first use */
+static InstructionSet instruction_set() {
+	static const InstructionSet detected = detect_instruction_set();
+	return detected;
+}
+
+/* kernels: Returns the kernel set for a scalar type; types without vector kernels use the scalar ones */
+template <typename Scalar>
+static const BatchKernels<Scalar>& kernels() {
+	return SCALAR_KERNELS<Scalar>;
+}
+
+template <>
+const BatchKernels<double>& kernels<double>() {
+#if CALC_BATCH_X86
+	switch (instruction_set()) {
+		case InstructionSet::Avx512: return AVX512_KERNELS;
+		case InstructionSet::Avx2: return AVX2_KERNELS;
+		default: break;
+	}
+#endif
+	return SCALAR_KERNELS<double>;
+}
+
+template <>
+const BatchKernels<float>& kernels<float>() {
+#if CALC_BATCH_X86
+	switch (instruction_set()) {
+		case InstructionSet::Avx512: return FLOAT_AVX512_KERNELS;
+		case InstructionSet::Avx2: return FLOAT_AVX2_KERNELS;
+		default: break;
+	}
+#endif
+	return SCALAR_KERNELS<float>;
+}
+
+/* An entry of the evaluation stack: either one value shared by every row, or one value per row. */
+template <typename Scalar>
+struct BatchOperand {
+	const Scalar* rows;   // Per-row values, or nullptr when the operand is uniform.
+	Scalar uniform;       // The shared value when rows is nullptr.
+};
+
+/* fill: Writes the same value into every row of a buffer */
+template <typename Scalar>
+static void fill(Scalar* buffer, const Scalar& value, size_t n) {
+	std::fill(buffer, buffer + n, value);
+}
+
+/* as_rows: Returns per-row values for an operand, expanding a uniform value into the given buffer */
+template <typename Scalar>
+static const Scalar* as_rows(const BatchOperand<Scalar>& operand, Scalar* buffer, size_t n) {
+	if (operand.rows) {
+		return operand.rows;
+	}
+	fill(buffer, operand.uniform, n);
+	return buffer;
+}
+
+/* flag_all: Records the same error on every row of the block */
+static void flag_all(RowStatus* status, RowStatus error, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+		flag_row(status[i], error);
+	}
+}
+
+/* as_small_integer: Reports whether a uniform exponent can be handled by repeated squaring */
+template <typename Scalar>
+static bool as_small_integer(const BatchOperand<Scalar>& operand, int& exponent) {
+	return !operand.rows && ScalarTraits<Scalar>::as_small_integer(operand.uniform, exponent);
+}
+
+/* constructor */
+BatchEvaluator::BatchEvaluator(const CompiledExpression& program) : program(program) {}
+
+/* get_kernel_name: Names the kernel set chosen for this CPU and scalar type */
+template <typename Scalar>
+const char* BatchEvaluator::get_kernel_name() {
+	return kernels<Scalar>().name;
+}
+
+/* evaluate: Runs the program block by block over every row */
+template <typename Scalar>
+size_t BatchEvaluator::evaluate(const std::vector<BasicBatchColumn<Scalar>>& columns, size_t rows, Scalar* output, RowStatus* status) const {
+	using Traits = ScalarTraits<Scalar>;
+
+	if (columns.size() < program.get_variable_names().size()) {
+		throw std::runtime_error("Missing input column for variable: " + program.get_variable_names()[columns.size()]);
+	}
+
+	const BatchKernels<Scalar>& k = kernels<Scalar>();
+	const std::vector<Instruction>& code = program.get_code();
+	const std::vector<double>& constants = program.get_constants();
+	const size_t depth = program.get_max_stack_depth();
+
+	// Deeply nested programs run in smaller blocks, so the buffers stay within SCRATCH_LIMIT values
+	const size_t levels = std::max<size_t>(depth + program.get_temp_count(), 1);
+	const size_t block = std::clamp<size_t>(SCRATCH_LIMIT / levels, 1, BLOCK_SIZE);
+
+	std::vector<Scalar> scratch(depth * block);   // One block-sized buffer per stack level
+	std::vector<BatchOperand<Scalar>> stack(depth);
+	std::vector<Scalar> temp_scratch(program.get_temp_count() * block);  // One block per shared subexpression
+	std::vector<BatchOperand<Scalar>> temps(program.get_temp_count());
+	size_t failed = 0;
+
+	for (size_t start = 0; start < rows; start += block) {
+		const size_t n = std::min(block, rows - start);
+		RowStatus* block_status = status + start;
+		std::fill(block_status, block_status + n, RowStatus::Ok);
+
+		size_t top = 0;  // Number of operands currently on the stack
+		for (const Instruction& instruction : code) {
+
+			if (instruction.op == OpCode::PushConstant) {
+				stack[top++] = { nullptr, Traits::from_double(constants[instruction.operand]) };
+				continue;
+			}
+			if (instruction.op == OpCode::PushVariable) {
+				const BasicBatchColumn<Scalar>& column = columns[instruction.operand];
+				if (column.rows) {
+					stack[top++] = { column.rows + start, Scalar() };  // Read straight from the input column
+				}
+				else {
+					stack[top++] = { nullptr, column.uniform };
+				}
+				continue;
+			}
+
+			if (instruction.op == OpCode::StoreTemp) {
+				BatchOperand<Scalar> saved = stack[top - 1];
+				if (saved.rows) {  // Stack buffers are reused by later instructions, so keep a copy
+					Scalar* copy = &temp_scratch[instruction.operand * block];
+					std::copy(saved.rows, saved.rows + n, copy);
+					saved.rows = copy;
+				}
+				temps[instruction.operand] = saved;
+				continue;
+			}
+			if (instruction.op == OpCode::LoadTemp) {
+				stack[top++] = temps[instruction.operand];
+				continue;
+			}
+			if (instruction.op == OpCode::Fail) {  // A malformed tree fails on every row
+				flag_all(block_status, RowStatus::InvalidTree, n);
+				stack[top++] = { nullptr, Traits::not_a_number() };
+				continue;
+			}
+
+			if (instruction.op == OpCode::CheckDivisor) {  // Flags zero divisors before the dividend can flag anything else
+				const BatchOperand<Scalar>& a = stack[top - 1];
+				if (!a.rows) {
+					RowStatus error = Traits::check_divisor(a.uniform);
+					if (error != RowStatus::Ok) {
+						flag_all(block_status, error, n);
+					}
+				}
+				else {
+					for (size_t i = 0; i < n; i++) {
+						RowStatus error = Traits::check_divisor(a.rows[i]);
+						if (error != RowStatus::Ok) {
+							flag_row(block_status[i], error);
+						}
+					}
+				}
+				continue;
+			}
+
+			if (instruction.op == OpCode::Sqrt) {
+				BatchOperand<Scalar>& a = stack[top - 1];
+				Scalar* out = &scratch[(top - 1) * block];
+
+				if (!a.rows) {
+					RowStatus error = Traits::sqrt(a.uniform, a.uniform);
+					if (error != RowStatus::Ok) {
+						flag_all(block_status, error, n);
+						a.uniform = Traits::not_a_number();
+					}
+				}
+				else {
+					k.sqrt(a.rows, out, block_status, n);
+					a.rows = out;
+				}
+				continue;
+			}
+
+			if (instruction.op == OpCode::Negate || instruction.op == OpCode::PowerInteger) {
+				BatchOperand<Scalar>& a = stack[top - 1];
+				Scalar* out = &scratch[(top - 1) * block];
+				const int exponent = static_cast<std::int32_t>(instruction.operand);
+
+				if (!a.rows) {
+					a.uniform = instruction.op == OpCode::Negate ? -a.uniform : Traits::power_integer(a.uniform, exponent);
+				}
+				else if (instruction.op == OpCode::Negate) {
+					for (size_t i = 0; i < n; i++) {  // A sign flip; compilers vectorize this on their own
+						out[i] = -a.rows[i];
+					}
+					a.rows = out;
+				}
+				else {
+					k.power_int(a.rows, exponent, out, n);
+					a.rows = out;
+				}
+				continue;
+			}
+
+			// Binary operation: the result replaces the left operand, and is written into its level's buffer
+			top--;
+			BatchOperand<Scalar>& a = stack[top - 1];
+			const BatchOperand<Scalar>& b = stack[top];
+			Scalar* out = &scratch[(top - 1) * block];
+			Scalar* spare = &scratch[top * block];
+			int exponent;
+
+			if (!a.rows && !b.rows) {  // Both operands are uniform, so is the result
+				switch (instruction.op) {
+					case OpCode::DivideSwapped: {
+						RowStatus error = Traits::divide(b.uniform, a.uniform, a.uniform);
+						if (error != RowStatus::Ok) {
+							flag_all(block_status, error, n);
+							a.uniform = Traits::not_a_number();
+						}
+						break;
+					}
+					case OpCode::Add: a.uniform = a.uniform + b.uniform; break;
+					case OpCode::Subtract: a.uniform = a.uniform - b.uniform; break;
+					case OpCode::Multiply: a.uniform = a.uniform * b.uniform; break;
+					case OpCode::Divide: {
+						RowStatus error = Traits::divide(a.uniform, b.uniform, a.uniform);
+						if (error != RowStatus::Ok) {
+							flag_all(block_status, error, n);
+							a.uniform = Traits::not_a_number();
+						}
+						break;
+					}
+					case OpCode::Power:
+						a.uniform = as_small_integer(b, exponent) ? Traits::power_integer(a.uniform, exponent)
+																  : Traits::power(a.uniform, b.uniform);
+						break;
+					default: break;
+				}
+				continue;
+			}
+
+			if (instruction.op == OpCode::Power && as_small_integer(b, exponent)) {
+				k.power_int(a.rows, exponent, out, n);
+				a.rows = out;
+				continue;
+			}
+
+			const Scalar* left = as_rows(a, out, n);
+			const Scalar* right = as_rows(b, spare, n);
+
+			switch (instruction.op) {
+				case OpCode::Add: k.add(left, right, out, n); break;
+				case OpCode::Subtract: k.subtract(left, right, out, n); break;
+				case OpCode::Multiply: k.multiply(left, right, out, n); break;
+				case OpCode::Divide: k.divide(left, right, out, block_status, n); break;
+				case OpCode::DivideSwapped: k.divide(right, left, out, block_status, n); break;
+				case OpCode::Power:
+					for (size_t i = 0; i < n; i++) {
+						out[i] = Traits::power(left[i], right[i]);
+					}
+					break;
+				default: break;
+			}
+			a.rows = out;
+		}
+
+		const BatchOperand<Scalar>& result = stack[0];
+		Scalar* block_output = output + start;
+		if (result.rows) {
+			std::copy(result.rows, result.rows + n, block_output);
+		}
+		else {
+			fill(block_output, result.uniform, n);
+		}
+
+		for (size_t i = 0; i < n; i++) {  // A failed row never reports a value, even if later steps masked the NaN
+			if (block_status[i] != RowStatus::Ok) {
+				block_output[i] = Traits::not_a_number();
+				failed++;
+			}
+		}
+	}
+
+	return failed;
+}
+
+template size_t BatchEvaluator::evaluate<float>(const std::vector<BasicBatchColumn<float>>&, size_t, float*, RowStatus*) const;
+template size_t BatchEvaluator::evaluate<double>(const std::vector<BasicBatchColumn<double>>&, size_t, double*, RowStatus*) const;
+template size_t BatchEvaluator::evaluate<long double>(const std::vector<BasicBatchColumn<long double>>&, size_t, long double*, RowStatus*) const;
+template size_t BatchEvaluator::evaluate<std::complex<double>>(const std::vector<BasicBatchColumn<std::complex<double>>>&, size_t,
+	std::complex<double>*, RowStatus*) const;
+template size_t BatchEvaluator::evaluate<Interval>(const std::vector<BasicBatchColumn<Interval>>&, size_t, Interval*, RowStatus*) const;
+
+template const char* BatchEvaluator::get_kernel_name<float>();
+template const char* BatchEvaluator::get_kernel_name<double>();
+template const char* BatchEvaluator::get_kernel_name<long double>();
+template const char* BatchEvaluator::get_kernel_name<std::complex<double>>();
+template const char* BatchEvaluator::get_kernel_name<Interval>();
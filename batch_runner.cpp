@@ -0,0 +1,330 @@
+#include "Batch_runner.h"
+#include <chrono>
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+/* normalize_line: Copies a line without its '\r', lowercased like the interactive prompt; returns false for blank lines */
+static bool normalize_line(const char* text, size_t length, std::string& line) {
+	if (length > 0 && text[length - 1] == '\r') {  // Accept files with Windows line endings
+		length--;
+	}
+
+	line.assign(text, length);
+	for (char& c : line) {
+		c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+	}
+
+	return line.find_first_not_of(" \t") != std::string::npos;
+}
+
+/* append_result: Formats the outcome of a successful line */
+static void append_result(std::string& output, const LineResult& result) {
+	char number[64];
+	std::snprintf(number, sizeof(number), "%g", result.value);  // Same format as the interactive prompt
+
+	if (result.is_assignment) {
+		output.append(result.variable);
+		output.append(" = ");
+	}
+	output.append(number);
+	output.push_back('\n');
+}
+
+/* append_value: Formats the value of an expression run in a scalar type other than double */
+static void append_value(std::string& output, const std::string& value) {
+	output.append(value);
+	output.push_back('\n');
+}
+
+/* append_error: Formats the outcome of a failed line */
+static void append_error(std::string& output, std::string& errors, size_t line_number, const char* message) {
+	char number[32];
+	std::snprintf(number, sizeof(number), "%zu\t", line_number);
+
+	output.append("error\n");
+	errors.append(number);
+	errors.append(message);
+	errors.push_back('\n');
+}
+
+/* append_error: Same, building the message of an Error straight into the error buffer */
+static void append_error(std::string& output, std::string& errors, size_t line_number, const Error& error) {
+	char number[32];
+	std::snprintf(number, sizeof(number), "%zu\t", line_number);
+
+	output.append("error\n");
+	errors.append(number);
+	error.append_message(errors);
+	errors.push_back('\n');
+}
+
+/* constructor */
+BatchRunner::BatchRunner(Session& session, std::FILE* output, std::FILE* errors, size_t thread_count)
+	: session(session), output(output), errors(errors), thread_count(thread_count) {
+	output_buffer.reserve(BUFFER_SIZE + 256);
+	error_buffer.reserve(4096);
+}
+
+/* run: Reads the input in large chunks and executes it line by line */
+BatchSummary BatchRunner::run(std::FILE* input) {
+	BatchSummary summary = { 0, 0, 0, 0, 0.0 };
+	auto start = std::chrono::steady_clock::now();
+
+	if (thread_count > 1) {
+		pool.reset(new ThreadPool(thread_count));
+	}
+
+	std::vector<char> chunk(BUFFER_SIZE);
+	std::string carry;  // Start of a line that continues into the next chunk
+	size_t read;
+
+	while ((read = std::fread(chunk.data(), 1, chunk.size(), input)) > 0) {
+		summary.bytes += read;
+		const char* begin = chunk.data();
+		const char* end = begin + read;
+
+		while (begin < end) {
+			const char* newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+
+			if (!newline) {  // The rest of the chunk is an unfinished line
+				carry.append(begin, end);
+				break;
+			}
+
+			if (carry.empty()) {
+				handle_line(begin, newline - begin, ++summary.lines, summary);
+			}
+			else {
+				carry.append(begin, newline);
+				handle_line(carry.data(), carry.size(), ++summary.lines, summary);
+				carry.clear();
+			}
+			begin = newline + 1;
+		}
+	}
+
+	if (!carry.empty()) {  // Last line without a trailing newline
+		handle_line(carry.data(), carry.size(), ++summary.lines, summary);
+	}
+
+	if (pool) {
+		submit_open_task();
+		drain_tasks(true, summary);
+		pool.reset();
+	}
+
+	flush_buffers(true);
+	summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return summary;
+}
+
+/* handle_line: Runs the line inline, or collects it into the open task when running in parallel */
+void BatchRunner::handle_line(const char* text, size_t length, size_t line_number, BatchSummary& summary) {
+	if (!pool) {
+		process_line(text, length, line_number, summary);
+		return;
+	}
+
+	if (std::memchr(text, '=', length)) {  // Assignment: a barrier for every line after it
+		submit_open_task();
+		drain_tasks(true, summary);
+		process_line(text, length, line_number, summary);
+		return;
+	}
+
+	if (!open_task) {
+		open_task = std::make_shared<BatchTask>();
+		open_task->first_line = line_number;
+		open_task->line_count = 0;
+		open_task->failed = 0;
+		open_task->limited = 0;
+		open_task->done = false;
+	}
+
+	open_task->text.append(text, length);
+	open_task->text.push_back('\n');
+
+	if (++open_task->line_count == TASK_LINES) {
+		submit_open_task();
+		drain_tasks(false, summary);
+	}
+}
+
+/* process_line: Executes one line on the calling thread and records its result */
+void BatchRunner::process_line(const char* text, size_t length, size_t line_number, BatchSummary& summary) {
+	if (!normalize_line(text, length, line)) {
+		output_buffer.push_back('\n');
+		return;
+	}
+
+	// Malformed lines come back as an Error; only limits and formula cycles are thrown
+	try {
+		if (session.get_scalar_type() != ScalarType::Double && line.find('=') == std::string::npos) {
+			Result<std::string> value = session.try_evaluate_text(line);
+			if (value) {
+				append_value(output_buffer, value.value());
+			}
+			else {
+				summary.failed++;
+				summary.limited += value.error().is_limit();
+				append_error(output_buffer, error_buffer, line_number, value.error());
+			}
+		}
+		else {
+			Result<LineResult> result = session.try_execute(line);
+			if (result) {
+				append_result(output_buffer, result.value());
+			}
+			else {
+				summary.failed++;
+				summary.limited += result.error().is_limit();
+				append_error(output_buffer, error_buffer, line_number, result.error());
+			}
+		}
+	}
+	catch (const LimitExceeded& e) {
+		summary.failed++;
+		summary.limited++;
+		append_error(output_buffer, error_buffer, line_number, e.what());
+	}
+	catch (const std::exception& e) {
+		summary.failed++;
+		append_error(output_buffer, error_buffer, line_number, e.what());
+	}
+
+	flush_buffers(false);
+}
+
+/* submit_open_task: Queues the open task on the pool and records it in the reorder buffer */
+void BatchRunner::submit_open_task() {
+	if (!open_task) {
+		return;
+	}
+
+	std::shared_ptr<BatchTask> task = std::move(open_task);
+	open_task = nullptr;
+	in_flight.push_back(task);
+
+	const Session& shared_session = session;
+	pool->submit([this, task, &shared_session] {
+		run_task(shared_session, *task);
+		{
+			std::lock_guard<std::mutex> lock(reorder_mutex);
+			task->done = true;
+		}
+		task_finished.notify_one();
+	});
+}
+
+/* drain_tasks: Writes finished tasks in input order, waiting on the oldest one when required */
+void BatchRunner::drain_tasks(bool wait_for_all, BatchSummary& summary) {
+	const size_t max_in_flight = 4 * thread_count;  // Bounds the memory held by finished-but-unwritten tasks
+
+	while (!in_flight.empty()) {
+		std::shared_ptr<BatchTask> task = in_flight.front();
+		{
+			std::unique_lock<std::mutex> lock(reorder_mutex);
+			if (!task->done) {
+				if (!wait_for_all && in_flight.size() < max_in_flight) {
+					return;
+				}
+				task_finished.wait(lock, [&task] { return task->done; });
+			}
+		}
+
+		output_buffer.append(task->output);
+		error_buffer.append(task->errors);
+		summary.failed += task->failed;
+		summary.limited += task->limited;
+		in_flight.pop_front();
+		flush_buffers(false);
+	}
+}
+
+/* run_task: Evaluates the lines of a task; the session is only read, so tasks can run side by side */
+void BatchRunner::run_task(const Session& session, BatchTask& task) {
+	std::string line;
+	const char* begin = task.text.data();
+	const char* end = begin + task.text.size();
+	size_t line_number = task.first_line;
+
+	task.output.reserve(task.line_count * 16);
+
+	while (begin < end) {
+		const char* newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+
+		if (!normalize_line(begin, newline - begin, line)) {
+			task.output.push_back('\n');
+		}
+		else {
+			try {
+				if (session.get_scalar_type() != ScalarType::Double) {  // Tasks never hold assignments
+					Result<std::string> value = session.try_evaluate_text(line);
+					if (value) {
+						append_value(task.output, value.value());
+					}
+					else {
+						task.failed++;
+						task.limited += value.error().is_limit();
+						append_error(task.output, task.errors, line_number, value.error());
+					}
+				}
+				else {
+					Result<double> value = session.try_evaluate_readonly(line);
+					if (value) {
+						append_result(task.output, { false, "", value.value() });
+					}
+					else {
+						task.failed++;
+						task.limited += value.error().is_limit();
+						append_error(task.output, task.errors, line_number, value.error());
+					}
+				}
+			}
+			catch (const LimitExceeded& e) {
+				task.failed++;
+				task.limited++;
+				append_error(task.output, task.errors, line_number, e.what());
+			}
+			catch (const std::exception& e) {
+				task.failed++;
+				append_error(task.output, task.errors, line_number, e.what());
+			}
+		}
+
+		begin = newline + 1;
+		line_number++;
+	}
+}
+
+/* flush_buffers: Writes out the buffered results once they are large enough */
+void BatchRunner::flush_buffers(bool force) {
+	if (force || output_buffer.size() >= BUFFER_SIZE) {
+		std::fwrite(output_buffer.data(), 1, output_buffer.size(), output);
+		output_buffer.clear();
+	}
+	if (force || error_buffer.size() >= BUFFER_SIZE) {
+		std::fwrite(error_buffer.data(), 1, error_buffer.size(), errors);
+		error_buffer.clear();
+	}
+	if (force) {
+		std::fflush(output);
+		std::fflush(errors);
+	}
+}
+
+/* print_summary: Reports the totals and throughput of a batch */
+void BatchRunner::print_summary(const BatchSummary& summary) {
+	double seconds = summary.seconds > 0 ? summary.seconds : 1e-9;
+
+	std::fprintf(errors, "batch: %zu lines, %zu failed (%zu over limits), %.3f s, %.0f lines/s, %.1f MB/s\n",
+		summary.lines, summary.failed, summary.limited, summary.seconds,
+		summary.lines / seconds, summary.bytes / seconds / (1024.0 * 1024.0));
+
+	CacheStats cache = session.get_cache_stats();
+	std::fprintf(errors, "cache: %zu hits, %zu misses, %zu evictions, %zu entries, %.1f KB\n",
+		cache.hits, cache.misses, cache.evictions, cache.entries, cache.bytes / 1024.0);
+	std::fflush(errors);
+}
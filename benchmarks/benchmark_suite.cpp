@@ -0,0 +1,350 @@
+/*------benchmark_suite.cpp----------------------------------------------------
+	Measures every stage of the calculator on generated input, so throughput
+	can be tracked from one revision to the next.
+
+	Corpora (each generated at several sizes, to draw scaling curves):
+		- flat_sum:        "x + 1.25 - y + 0.5 ..." with `size` terms.
+		- nested_parens:   "((((x + 1) * 0.5 + 1) * 0.5 + 1) ...)", `size` levels deep.
+		- exponent_tower:  "x^1.0001^1.0001^...", `size` exponents.
+		- implicit_mult:   "2x(3y)(0.5x)(1.5y)2x(3y)...", `size` factors.
+		- many_variables:  a session with `size` assigned variables and a line
+		                   adding all of them.
+
+	Stages:
+		- tokenize:     pulling every token of the line from the Tokenizer.
+		- parse:        tokenizing and parsing into a reused ExpressionTree.
+		- evaluate:     walking the parsed tree with the Evaluator.
+		- line_cold:    the whole pipeline of a line the session has never
+		                seen: parse, optimize, merge subexpressions, compile
+		                and evaluate.
+		- line_cached:  Session::execute on a line already in its cache.
+
+	For each corpus, size and stage the suite prints the time per operation,
+	the heap bytes and allocations per operation (the calling thread's
+	counters of allocation_counter.cpp, see Metrics.h; zero in a
+	CALC_NO_METRICS build) and, per corpus and stage, the scaling exponent
+	between the smallest and largest size (1.0 is linear). With --json the same
+	numbers are written to a file, one result per line, so two revisions
+	can be compared with any diff or JSON tool.
+
+	Usage:
+		calculator_bench [--json file] [--label text] [--min-time seconds]
+		                 [--filter text] [--quick]
+	--filter keeps the corpora and stages whose name contains the text, and
+	--quick only runs the two smallest sizes.
+
+	Built as the calculator_bench target of CMakeLists.txt.
+----------------------------------------------------------------------------*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Tokenizer.h"
+#include "Parser.h"
+#include "Evaluator.h"
+#include "Optimizer.h"
+#include "Subexpression_eliminator.h"
+#include "Compiled_expression.h"
+#include "Session.h"
+#include "Metrics.h"
+
+/* Keeps the optimizer from discarding the benchmarked work */
+static volatile double sink;
+
+/* One generated input: assignments that set up the session, then the measured line. */
+struct Corpus {
+	std::string name;
+	size_t size;
+	std::vector<std::string> setup;
+	std::string line;
+};
+
+/* Cost of one operation of one stage. */
+struct Measurement {
+	std::string corpus;
+	size_t size;
+	size_t characters;
+	std::string stage;
+	double ns_per_op;
+	double bytes_per_op;
+	double allocations_per_op;
+};
+
+/* Command-line settings of a run. */
+struct SuiteOptions {
+	std::string json_path;
+	std::string label;
+	std::string filter;
+	double min_time = 0.2;
+	bool quick = false;
+};
+
+/* variable_name: Letters-only name for variable i ("va", "vb", ..., "vba", ...), since digits end a name */
+static std::string variable_name(size_t i) {
+	std::string suffix;
+	do {
+		suffix.insert(suffix.begin(), static_cast<char>('a' + i % 26));
+		i /= 26;
+	} while (i != 0);
+	return "v" + suffix;
+}
+
+/* make_corpora: Generates every corpus at the given size */
+static std::vector<Corpus> make_corpora(size_t size) {
+	std::vector<Corpus> corpora;
+	const std::vector<std::string> xy = { "x = 0.5", "y = 0.8" };
+
+	std::string sum = "x";
+	const char* terms[] = { "1.25", "y", "0.5", "x" };
+	for (size_t i = 1; i < size; i++) {
+		sum += (i % 2 ? " + " : " - ") + std::string(terms[i % 4]);
+	}
+	corpora.push_back({ "flat_sum", size, xy, sum });
+
+	std::string nested = "x";
+	for (size_t i = 0; i < size; i++) {
+		nested = "(" + nested + (i % 2 ? " * 0.5" : " + 1") + ")";
+	}
+	corpora.push_back({ "nested_parens", size, xy, nested });
+
+	std::string tower = "x";
+	for (size_t i = 0; i < size; i++) {
+		tower += "^1.0001";
+	}
+	corpora.push_back({ "exponent_tower", size, xy, tower });
+
+	std::string product;
+	const char* factors[] = { "2x", "(3y)", "(0.5x)", "(1.5y)" };
+	for (size_t i = 0; i < size; i++) {
+		product += factors[i % 4];
+	}
+	corpora.push_back({ "implicit_mult", size, xy, product });
+
+	Corpus variables = { "many_variables", size, {}, "" };
+	for (size_t i = 0; i < size; i++) {
+		variables.setup.push_back(variable_name(i) + " = " + std::to_string(i % 7) + ".5");
+		variables.line += (i ? " + " : "") + variable_name(i);
+	}
+	corpora.push_back(variables);
+
+	return corpora;
+}
+
+/* measure: Repeats an operation, doubling the count until it runs for min_time, and reports its average cost */
+static Measurement measure(const std::function<void()>& operation, double min_time) {
+	using clock = std::chrono::steady_clock;
+	operation();  // Warms caches and grows any reused buffers outside the measurement
+
+	for (size_t iterations = 1;; iterations *= 2) {
+		AllocationCount before = thread_allocation_count;  // Operations run on this thread
+		auto start = clock::now();
+
+		for (size_t i = 0; i < iterations; i++) {
+			operation();
+		}
+
+		double seconds = std::chrono::duration<double>(clock::now() - start).count();
+		if (seconds >= min_time || iterations >= (size_t(1) << 40)) {
+			Measurement result = {};
+			result.ns_per_op = seconds * 1e9 / iterations;
+			result.bytes_per_op = static_cast<double>(thread_allocation_count.bytes - before.bytes) / iterations;
+			result.allocations_per_op = static_cast<double>(thread_allocation_count.allocations - before.allocations) / iterations;
+			return result;
+		}
+	}
+}
+
+/* run_corpus: Measures every selected stage on one corpus */
+static void run_corpus(const Corpus& corpus, const SuiteOptions& options, std::vector<Measurement>& results) {
+	Session session;
+	for (const std::string& assignment : corpus.setup) {
+		session.execute(assignment);
+	}
+	SymbolTable& symbols = session.get_symbols();
+	const std::string& line = corpus.line;
+
+	Tokenizer tokenizer(line, symbols);
+	ExpressionTree tree;
+	Evaluator evaluator(symbols);
+	double total = 0;
+
+	tokenizer.reset(line);
+	Parser(tokenizer).parse(tree);  // The evaluate stage walks this tree
+
+	const std::vector<std::pair<std::string, std::function<void()>>> stages = {
+		{ "tokenize", [&]() {
+			tokenizer.reset(line);
+			while (tokenizer.next_token().getType() != TokenType::End) {
+				total += 1;
+			}
+		} },
+		{ "parse", [&]() {
+			tokenizer.reset(line);
+			Parser parser(tokenizer);
+			parser.parse(tree);
+			total += tree.size();
+		} },
+		{ "evaluate", [&]() {
+			total += evaluator.evaluate(tree, tree.root());
+		} },
+		{ "line_cold", [&]() {
+			Tokenizer cold(line, symbols);
+			Parser parser(cold);
+			ExpressionTree parsed = parser.parse();
+			ExpressionTree optimized = Optimizer().optimize(parsed);
+			ExpressionTree merged = SubexpressionEliminator().eliminate(optimized);
+			CompiledExpression program(merged, merged.root());
+			total += program.evaluate(symbols);
+		} },
+		{ "line_cached", [&]() {
+			total += session.execute(line).value;
+		} },
+	};
+
+	for (const auto& stage : stages) {
+		if (!options.filter.empty() && corpus.name.find(options.filter) == std::string::npos &&
+			stage.first.find(options.filter) == std::string::npos) {
+			continue;
+		}
+
+		Measurement result = measure(stage.second, options.min_time);
+		result.corpus = corpus.name;
+		result.size = corpus.size;
+		result.characters = line.size();
+		result.stage = stage.first;
+		results.push_back(result);
+
+		std::printf("%-16s %6zu %-12s %12.1f ns/op %10.1f B/op %8.2f allocs/op\n", corpus.name.c_str(), corpus.size,
+			stage.first.c_str(), result.ns_per_op, result.bytes_per_op, result.allocations_per_op);
+		std::fflush(stdout);
+	}
+	sink = total;
+}
+
+/* scaling_exponent: Slope of log(time) against log(size) between the smallest and largest size of a series */
+static double scaling_exponent(const Measurement& smallest, const Measurement& largest) {
+	return std::log(largest.ns_per_op / smallest.ns_per_op) / std::log(static_cast<double>(largest.size) / smallest.size);
+}
+
+/* json_string: Quotes a string for JSON, escaping the characters that need it */
+static std::string json_string(const std::string& text) {
+	std::string quoted = "\"";
+	for (char c : text) {
+		if (c == '"' || c == '\\') {
+			quoted += '\\';
+		}
+		if (static_cast<unsigned char>(c) < 0x20) {
+			char escaped[8];
+			std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+			quoted += escaped;
+			continue;
+		}
+		quoted += c;
+	}
+	return quoted + "\"";
+}
+
+/* write_json: Writes the results and scaling exponents, one entry per line */
+static void write_json(const std::string& path, const SuiteOptions& options, const std::vector<Measurement>& results,
+	const std::vector<std::pair<const Measurement*, double>>& scaling) {
+	std::FILE* file = std::fopen(path.c_str(), "w");
+	if (!file) {
+		throw std::runtime_error("cannot write " + path);
+	}
+
+	std::fprintf(file, "{\n  \"format\": 1,\n  \"label\": %s,\n  \"min_time\": %g,\n  \"results\": [\n",
+		json_string(options.label).c_str(), options.min_time);
+	for (size_t i = 0; i < results.size(); i++) {
+		const Measurement& r = results[i];
+		std::fprintf(file, "    {\"corpus\": %s, \"size\": %zu, \"stage\": %s, \"characters\": %zu, "
+			"\"ns_per_op\": %.1f, \"bytes_per_op\": %.1f, \"allocations_per_op\": %.2f}%s\n",
+			json_string(r.corpus).c_str(), r.size, json_string(r.stage).c_str(), r.characters,
+			r.ns_per_op, r.bytes_per_op, r.allocations_per_op, i + 1 < results.size() ? "," : "");
+	}
+
+	std::fprintf(file, "  ],\n  \"scaling\": [\n");
+	for (size_t i = 0; i < scaling.size(); i++) {
+		std::fprintf(file, "    {\"corpus\": %s, \"stage\": %s, \"exponent\": %.3f}%s\n",
+			json_string(scaling[i].first->corpus).c_str(), json_string(scaling[i].first->stage).c_str(),
+			scaling[i].second, i + 1 < scaling.size() ? "," : "");
+	}
+	std::fprintf(file, "  ]\n}\n");
+	std::fclose(file);
+}
+
+int main(int argc, char* argv[]) {
+	SuiteOptions options;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+
+		if (arg == "--json" && i + 1 < argc) {
+			options.json_path = argv[++i];
+		}
+		else if (arg == "--label" && i + 1 < argc) {
+			options.label = argv[++i];
+		}
+		else if (arg == "--filter" && i + 1 < argc) {
+			options.filter = argv[++i];
+		}
+		else if (arg == "--min-time" && i + 1 < argc) {
+			options.min_time = std::strtod(argv[++i], nullptr);
+		}
+		else if (arg == "--quick") {
+			options.quick = true;
+		}
+		else {
+			std::fprintf(stderr, "Usage: %s [--json file] [--label text] [--min-time seconds] [--filter text] [--quick]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	std::vector<size_t> sizes = { 16, 64, 256, 1024 };
+	if (options.quick) {
+		sizes.resize(2);
+	}
+
+	std::vector<Measurement> results;
+	try {
+		for (size_t size : sizes) {
+			for (const Corpus& corpus : make_corpora(size)) {
+				run_corpus(corpus, options, results);
+			}
+		}
+	}
+	catch (const std::runtime_error& e) {
+		std::fprintf(stderr, "Error: %s\n", e.what());
+		return 1;
+	}
+
+	// Pairs the smallest and largest size of every corpus and stage
+	std::vector<std::pair<const Measurement*, double>> scaling;
+	std::printf("\nScaling exponent from size %zu to %zu (1.0 = linear):\n", sizes.front(), sizes.back());
+	for (const Measurement& smallest : results) {
+		if (smallest.size != sizes.front()) continue;
+
+		for (const Measurement& largest : results) {
+			if (largest.size == sizes.back() && largest.corpus == smallest.corpus && largest.stage == smallest.stage) {
+				scaling.push_back({ &smallest, scaling_exponent(smallest, largest) });
+				std::printf("%-16s %-12s %6.2f\n", smallest.corpus.c_str(), smallest.stage.c_str(), scaling.back().second);
+			}
+		}
+	}
+
+	if (!options.json_path.empty()) {
+		try {
+			write_json(options.json_path, options, results, scaling);
+		}
+		catch (const std::runtime_error& e) {
+			std::fprintf(stderr, "Error: %s\n", e.what());
+			return 1;
+		}
+		std::printf("\nResults written to %s\n", options.json_path.c_str());
+	}
+	return 0;
+}
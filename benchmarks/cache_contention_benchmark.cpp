@@ -0,0 +1,165 @@
+/*------cache_contention_benchmark.cpp-----------------------------------------
+	Measures how lookups in the expression cache scale with the number of
+	threads, the way the batch workers use it: every thread looks up lines
+	that are all in the cache, so nothing but the hit path is timed.
+
+	Three runs for each thread count:
+		- locked_lru:  a cache behind one mutex that splices every hit to
+		               the front of a list, as ExpressionCache did before it
+		               was sharded (kept here as the reference).
+		- sharded:     ExpressionCache::find.
+		- readonly:    Session::try_evaluate_readonly on one shared session,
+		               which normalizes, finds and evaluates each line.
+
+	Prints the lookups (or lines) per second of all threads together and
+	the speedup over one thread. On a machine with fewer cores than
+	threads the rates level off at the core count.
+
+	Build from the repository root, for example:
+		g++ -O2 -std=c++20 -pthread -I. benchmarks/cache_contention_benchmark.cpp \
+			$(ls *.cpp | grep -v '^main.cpp$') -o cache_contention_benchmark
+	or as the cache_contention_benchmark target of CMakeLists.txt.
+----------------------------------------------------------------------------*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "Expression_cache.h"
+#include "Parser.h"
+#include "Session.h"
+#include "Tokenizer.h"
+
+static const size_t POOL_LINES = 512;
+static const size_t LOOKUPS_PER_THREAD = 200000;
+static const size_t LINES_PER_THREAD = 50000;
+
+/* Keeps the optimizer from discarding the benchmarked work */
+static std::atomic<size_t> sink(0);
+
+/* The single-lock LRU that every lookup used to go through */
+class LockedLruCache {
+private:
+	struct Entry {
+		std::string key;
+		std::shared_ptr<const CompiledExpression> program;
+	};
+
+	std::list<Entry> entries;
+	std::unordered_map<std::string, std::list<Entry>::iterator> index;
+	std::mutex mutex;
+
+public:
+	/* find: Looks the key up and moves a hit to the front, under the lock */
+	std::shared_ptr<const CompiledExpression> find(const std::string& key) {
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = index.find(key);
+		if (it == index.end()) {
+			return nullptr;
+		}
+		entries.splice(entries.begin(), entries, it->second);
+		return it->second->program;
+	}
+
+	/* insert: Adds an entry at the front */
+	void insert(const std::string& key, std::shared_ptr<const CompiledExpression> program) {
+		std::lock_guard<std::mutex> lock(mutex);
+		entries.push_front({ key, std::move(program) });
+		index.emplace(key, entries.begin());
+	}
+};
+
+/* make_line: Builds line i of the pool */
+static std::string make_line(size_t i) {
+	std::string k = std::to_string(i);
+	std::string line;
+	line.append("x * ").append(k).append(" + y / 4 - sqrt(").append(k).append(")");
+	return line;
+}
+
+/* run_threads: Runs the work on the given number of threads and returns the operations per second */
+static double run_threads(size_t threads, size_t operations_per_thread, const std::function<size_t(size_t)>& work) {
+	using clock = std::chrono::steady_clock;
+	std::vector<std::thread> pool;
+
+	auto start = clock::now();
+	for (size_t t = 0; t < threads; t++) {
+		pool.emplace_back([&work, t]() { sink.fetch_add(work(t), std::memory_order_relaxed); });
+	}
+	for (std::thread& thread : pool) {
+		thread.join();
+	}
+	double seconds = std::chrono::duration<double>(clock::now() - start).count();
+	return threads * operations_per_thread / seconds;
+}
+
+/* print_row: Prints one rate with its speedup over the single-thread rate */
+static void print_row(const char* name, size_t threads, double rate, double single) {
+	std::printf("%-11s %3zu threads   %12.0f /s   %5.2fx\n", name, threads, rate, rate / single);
+}
+
+int main() {
+	Session session;
+	session.execute("x = 3");
+	session.execute("y = 4");
+
+	std::vector<std::string> lines;
+	std::vector<std::string> keys;
+	LockedLruCache locked;
+	ExpressionCache sharded;
+	for (size_t i = 0; i < POOL_LINES; i++) {
+		lines.push_back(make_line(i));
+		session.evaluate_readonly(lines.back());  // Now in the session's cache
+		keys.push_back(ExpressionCache::normalize(lines.back()));
+
+		Tokenizer tokenizer(keys.back());
+		Parser parser(tokenizer);
+		ExpressionTree tree = parser.parse();
+		std::shared_ptr<const CompiledExpression> program = std::make_shared<const CompiledExpression>(tree, tree.root());
+		locked.insert(keys.back(), program);
+		sharded.insert(keys.back(), program);
+	}
+
+	const size_t thread_counts[] = { 1, 2, 4, 8, 16, 32 };
+	double single_locked = 0, single_sharded = 0, single_readonly = 0;
+
+	for (size_t threads : thread_counts) {
+		double rate = run_threads(threads, LOOKUPS_PER_THREAD, [&](size_t t) {
+			size_t found = 0;
+			for (size_t i = 0; i < LOOKUPS_PER_THREAD; i++) {
+				found += locked.find(keys[(i * 7 + t * 131) % POOL_LINES]) != nullptr;
+			}
+			return found;
+		});
+		single_locked = threads == 1 ? rate : single_locked;
+		print_row("locked_lru", threads, rate, single_locked);
+
+		rate = run_threads(threads, LOOKUPS_PER_THREAD, [&](size_t t) {
+			size_t found = 0;
+			for (size_t i = 0; i < LOOKUPS_PER_THREAD; i++) {
+				found += sharded.find(keys[(i * 7 + t * 131) % POOL_LINES]) != nullptr;
+			}
+			return found;
+		});
+		single_sharded = threads == 1 ? rate : single_sharded;
+		print_row("sharded", threads, rate, single_sharded);
+
+		rate = run_threads(threads, LINES_PER_THREAD, [&](size_t t) {
+			size_t answered = 0;
+			for (size_t i = 0; i < LINES_PER_THREAD; i++) {
+				answered += session.try_evaluate_readonly(lines[(i * 7 + t * 131) % POOL_LINES]).ok();
+			}
+			return answered;
+		});
+		single_readonly = threads == 1 ? rate : single_readonly;
+		print_row("readonly", threads, rate, single_readonly);
+	}
+	return 0;
+}
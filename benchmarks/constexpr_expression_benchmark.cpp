@@ -0,0 +1,100 @@
+/*------constexpr_expression_benchmark.cpp-------------------------------------
+	Measures formulas parsed at compile time with calc::expr against the same
+	text going through the Tokenizer and Parser at runtime and then evaluated
+	by the tree-walking Evaluator and by a CompiledExpression. Every
+	calc::expr result is checked against Evaluator::evaluate to the last bit.
+
+	Needs C++20. Build from the repository root, for example:
+		g++ -O2 -std=c++20 -I. benchmarks/constexpr_expression_benchmark.cpp \
+			batch_evaluator.cpp compiled_expression.cpp evaluation_profile.cpp \
+			evaluator.cpp expression_node.cpp parser.cpp resource_governor.cpp result.cpp \
+			scalar_traits.cpp symbol_table.cpp token.cpp tokenizer.cpp utility.cpp \
+			-o constexpr_expression_benchmark
+----------------------------------------------------------------------------*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "Constexpr_expression.h"
+#include "Tokenizer.h"
+#include "Parser.h"
+#include "Evaluator.h"
+#include "Compiled_expression.h"
+
+static const int ITERATIONS = 1000000;
+
+/* Keeps the optimizer from discarding the benchmarked work */
+static volatile double sink;
+
+/* benchmark_formula: Times one compile-time formula against its runtime counterparts and prints the results */
+template <class Formula>
+static void benchmark_formula() {
+	const std::string text(Formula::text);
+	std::vector<double> values(Formula::variable_count + 1, 2.5);
+
+	SymbolTable symbols;
+	std::vector<SymbolId> slots;
+	for (std::string_view name : Formula::variable_names) {
+		slots.push_back(symbols.intern(std::string(name)));
+	}
+
+	Tokenizer tokenizer(text, symbols);
+	Parser parser(tokenizer);
+	ExpressionTree tree = parser.parse();
+	Evaluator evaluator(symbols);
+	CompiledExpression compiled(tree, tree.root());
+
+	// x is the first variable of every formula below and the one that changes
+	size_t mismatches = 0;
+	for (int i = 0; i < 1000; i++) {
+		values[0] = i * 0.01;
+		for (size_t k = 0; k < slots.size(); k++) {
+			symbols.set_value(slots[k], values[k]);
+		}
+
+		double expected = evaluator.evaluate(tree, tree.root());
+		double actual = Formula::evaluate(values.data());
+		if (std::memcmp(&expected, &actual, sizeof(double)) != 0) {
+			mismatches++;
+		}
+	}
+
+	using clock = std::chrono::steady_clock;
+	double sum = 0;
+
+	auto start = clock::now();
+	for (int i = 0; i < ITERATIONS; i++) {
+		symbols.set_value(slots[0], i * 0.001);
+		sum += evaluator.evaluate(tree, tree.root());
+	}
+	double tree_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / ITERATIONS;
+
+	start = clock::now();
+	for (int i = 0; i < ITERATIONS; i++) {
+		values[0] = i * 0.001;
+		sum += compiled.evaluate(values.data());
+	}
+	double compiled_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / ITERATIONS;
+
+	start = clock::now();
+	for (int i = 0; i < ITERATIONS; i++) {
+		values[0] = i * 0.001;
+		sum += Formula::evaluate(values.data());
+	}
+	double constexpr_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / ITERATIONS;
+	sink = sum;
+
+	std::printf("%-45s tree %7.1f ns/eval   compiled %7.1f ns/eval   calc::expr %6.1f ns/eval   mismatches %zu\n",
+		text.c_str(), tree_ns, compiled_ns, constexpr_ns, mismatches);
+}
+
+int main() {
+	benchmark_formula<calc::expr<"2x + 3">>();
+	benchmark_formula<calc::expr<"2x + y^2 - sqrt(z)">>();
+	benchmark_formula<calc::expr<"3^2 * (2 - 10 + 3) * (sqrt(4) / 4) + x">>();
+	benchmark_formula<calc::expr<"((x^3 + sqrt(25)) * (10 - 2 * y)) / (3 + 1)">>();
+	benchmark_formula<calc::expr<"sqrt(x^2 + y^2) * (x - 3) / (1 + 0.5) + 3 * z^2 - (6 + 2)">>();
+	return 0;
+}
@@ -0,0 +1,164 @@
+/*------error_path_benchmark.cpp-----------------------------------------------
+	Measures what invalid lines cost through the throwing API of Session
+	(execute and evaluate_readonly inside try/catch) and through the
+	non-throwing one (try_execute and try_evaluate_readonly), with 0%, 10%
+	and 50% of the lines in error. The errors rotate between a syntax
+	error, a division by zero and an undefined variable, and every
+	message is collected into one buffer as the batch mode does.
+
+	Two workloads are timed:
+		- cold:    distinct lines, each tokenized, parsed and compiled.
+		- cached:  a small pool of lines sent again and again, so the valid
+		           ones only evaluate and the failures are all that is left.
+
+	Prints the lines per second of each API and how much faster the
+	non-throwing one is.
+
+	Build from the repository root, for example:
+		g++ -O2 -std=c++20 -pthread -I. benchmarks/error_path_benchmark.cpp \
+			$(ls *.cpp | grep -v '^main.cpp$') -o error_path_benchmark
+	or as the error_path_benchmark target of CMakeLists.txt.
+----------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Session.h"
+
+static const size_t COLD_LINES = 50000;
+static const size_t POOL_LINES = 1000;
+static const size_t CACHED_LINES = 400000;
+static const int REPEATS = 3;
+
+/* Keeps the optimizer from discarding the benchmarked work */
+static volatile double sink;
+
+/* make_line: Builds line i, an error for `rate` lines in every hundred */
+static std::string make_line(size_t i, int rate) {
+	std::string k = std::to_string(i);
+	std::string line;
+	if (static_cast<int>(i * rate % 100) >= rate) {
+		line.append("x * ").append(k).append(" + y / 4 - sqrt(").append(k).append(")");
+		return line;
+	}
+	switch (i % 3) {
+		case 0: line.append("x * ").append(k).append(" + * y"); break;         // Syntax error
+		case 1: line.append(k).append(" / (x - 3) + y"); break;                // Division by zero
+		default: line.append("x * ").append(k).append(" + undefined"); break;  // Undefined variable
+	}
+	return line;
+}
+
+/* define_variables: Assigns the variables the lines use */
+static void define_variables(Session& session) {
+	session.execute("x = 3");
+	session.execute("y = 4");
+}
+
+/* run_throwing: Runs the lines through the throwing API */
+static size_t run_throwing(Session& session, const std::vector<std::string>& lines, size_t count, bool readonly, std::string& errors) {
+	size_t failed = 0;
+	double sum = 0;
+	for (size_t i = 0; i < count; i++) {
+		const std::string& line = lines[i % lines.size()];
+		try {
+			sum += readonly ? session.evaluate_readonly(line) : session.execute(line).value;
+		}
+		catch (const std::exception& e) {
+			failed++;
+			errors.append(e.what());
+			errors.push_back('\n');
+		}
+	}
+	sink = sum;
+	return failed;
+}
+
+/* run_result: Runs the lines through the non-throwing API */
+static size_t run_result(Session& session, const std::vector<std::string>& lines, size_t count, bool readonly, std::string& errors) {
+	size_t failed = 0;
+	double sum = 0;
+	for (size_t i = 0; i < count; i++) {
+		const std::string& line = lines[i % lines.size()];
+		if (readonly) {
+			Result<double> value = session.try_evaluate_readonly(line);
+			if (value) {
+				sum += value.value();
+				continue;
+			}
+			value.error().append_message(errors);
+		}
+		else {
+			Result<LineResult> result = session.try_execute(line);
+			if (result) {
+				sum += result.value().value;
+				continue;
+			}
+			result.error().append_message(errors);
+		}
+		failed++;
+		errors.push_back('\n');
+	}
+	sink = sum;
+	return failed;
+}
+
+/* measure: Returns the best lines per second of a few runs, each in a fresh session */
+template <typename Run>
+static double measure(Run run, const std::vector<std::string>& lines, size_t count, bool readonly, bool warm, size_t& failed) {
+	using clock = std::chrono::steady_clock;
+	double best = 0;
+	std::string errors;
+
+	for (int repeat = 0; repeat < REPEATS; repeat++) {
+		Session session;
+		define_variables(session);
+		if (warm) {
+			run(session, lines, lines.size(), readonly, errors);  // Fill the cache with the pool
+		}
+		errors.clear();
+
+		auto start = clock::now();
+		failed = run(session, lines, count, readonly, errors);
+		double seconds = std::chrono::duration<double>(clock::now() - start).count();
+		best = std::max(best, count / seconds);
+	}
+	return best;
+}
+
+/* benchmark_workload: Times both APIs on one workload at one error rate and prints the results */
+static void benchmark_workload(const char* workload, size_t distinct, size_t count, int rate, bool readonly) {
+	std::vector<std::string> lines;
+	for (size_t i = 0; i < distinct; i++) {
+		lines.push_back(make_line(i, rate));
+	}
+
+	bool warm = distinct < count;
+	size_t throwing_failed = 0;
+	size_t result_failed = 0;
+	double throwing = measure(run_throwing, lines, count, readonly, warm, throwing_failed);
+	double result = measure(run_result, lines, count, readonly, warm, result_failed);
+
+	if (throwing_failed != result_failed) {
+		std::fprintf(stderr, "the two APIs disagree: %zu and %zu failures\n", throwing_failed, result_failed);
+	}
+	std::printf("%-7s %-18s %3d%% errors   throw %10.0f lines/s   result %10.0f lines/s   %5.2fx\n",
+		workload, readonly ? "evaluate_readonly" : "execute", rate, throwing, result, result / throwing);
+}
+
+int main() {
+	const int rates[] = { 0, 10, 50 };
+
+	for (bool readonly : { false, true }) {
+		for (int rate : rates) {
+			benchmark_workload("cold", COLD_LINES, COLD_LINES, rate, readonly);
+		}
+		for (int rate : rates) {
+			benchmark_workload("cached", POOL_LINES, CACHED_LINES, rate, readonly);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,111 @@
+/*------exact_arithmetic_benchmark.cpp-----------------------------------------
+	Measures exact arithmetic (see Exact_evaluator.h) from the 64-bit fast
+	path up to numbers with tens of thousands of digits: the time to parse
+	and evaluate each expression, the time to print its result in decimal,
+	and the number of digits. The last rows compare Karatsuba with schoolbook
+	multiplication on operands of growing size.
+
+	Build from the repository root, for example:
+		g++ -O2 -std=c++20 -I. benchmarks/exact_arithmetic_benchmark.cpp \
+			big_integer.cpp exact_evaluator.cpp exact_number.cpp expression_node.cpp \
+			parser.cpp resource_governor.cpp result.cpp symbol_table.cpp token.cpp \
+			tokenizer.cpp \
+			-o exact_arithmetic_benchmark
+----------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include "Big_integer.h"
+#include "Exact_evaluator.h"
+#include "Parser.h"
+#include "Tokenizer.h"
+
+/* Keeps the optimizer from discarding the benchmarked work */
+static volatile size_t sink;
+
+using benchmark_clock = std::chrono::steady_clock;
+
+/* elapsed_ms: Milliseconds since start */
+static double elapsed_ms(benchmark_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(benchmark_clock::now() - start).count();
+}
+
+/* product_of: "1*2*3*...*n", a factorial written out */
+static std::string product_of(int n) {
+	std::string text = "1";
+	for (int i = 2; i <= n; i++) {
+		text.append("*").append(std::to_string(i));
+	}
+	return text;
+}
+
+/* benchmark_expression: Times parsing and evaluating an expression, then printing its value */
+static void benchmark_expression(const std::string& label, const std::string& expression, int iterations) {
+	SymbolTable symbols;
+	ExactVariables variables;
+	ExactEvaluator evaluator(symbols, variables);
+	ExactNumber value;
+
+	auto start = benchmark_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		Tokenizer tokenizer(expression, symbols);
+		Parser parser(tokenizer);
+		ExpressionTree tree = parser.parse();
+		value = evaluator.evaluate(tree, tree.root());
+	}
+	double evaluate_ms = elapsed_ms(start) / iterations;
+
+	start = benchmark_clock::now();
+	std::string text = value.to_string();
+	double print_ms = elapsed_ms(start);
+	sink = text.size();
+
+	std::printf("%-28s %12.4f ms/evaluation %10.3f ms to print %8zu characters  %.24s%s\n", label.c_str(),
+		evaluate_ms, print_ms, text.size(), text.c_str(), text.size() > 24 ? "..." : "");
+}
+
+/* benchmark_multiply: Squares a number of the given size with the library (Karatsuba) and with a schoolbook loop */
+static void benchmark_multiply(size_t limbs) {
+	// 2^(32 limbs) - 1: every limb is all ones, the worst case for carries
+	BigInteger value = BigInteger(1).shifted_left(32 * limbs) - BigInteger(1);
+
+	int iterations = std::max(1, static_cast<int>(2000000 / (limbs * limbs)));
+	auto start = benchmark_clock::now();
+	BigInteger product;
+	for (int i = 0; i < iterations; i++) {
+		product = value * value;
+	}
+	double karatsuba_ms = elapsed_ms(start) / iterations;
+
+	// Schoolbook for comparison, one 32-bit limb of value at a time
+	start = benchmark_clock::now();
+	BigInteger schoolbook;
+	for (int i = 0; i < iterations; i++) {
+		schoolbook = BigInteger();
+		for (size_t limb = limbs; limb-- > 0;) {
+			BigInteger digit = value.shifted_right(32 * limb) - value.shifted_right(32 * (limb + 1)).shifted_left(32);
+			schoolbook = schoolbook.shifted_left(32) + value * digit;
+		}
+	}
+	double schoolbook_ms = elapsed_ms(start) / iterations;
+	sink = product.bit_length() + (product == schoolbook);
+
+	std::printf("square of %6zu limbs         %12.4f ms Karatsuba %10.4f ms schoolbook\n", limbs, karatsuba_ms, schoolbook_ms);
+}
+
+int main() {
+	benchmark_expression("0.1 + 0.2", "0.1 + 0.2", 100000);
+	benchmark_expression("1/3 + 1/6 - 1/7", "1/3 + 1/6 - 1/7", 100000);
+	benchmark_expression("3^40", "3^40", 100000);
+	benchmark_expression("(2/3)^200", "(2/3)^200", 2000);
+	benchmark_expression("2^100000", "2^100000", 20);
+	benchmark_expression("1*2*3*...*2000", product_of(2000), 20);
+	benchmark_expression("7^20000 * 3^30000", "7^20000 * 3^30000", 20);
+
+	for (size_t limbs : { 16, 64, 256, 1024, 4096 }) {
+		benchmark_multiply(limbs);
+	}
+	return 0;
+}
@@ -0,0 +1,136 @@
+/*------native_expression_benchmark.cpp----------------------------------------
+	Measures the per-evaluation cost of the tree-walking Evaluator, the
+	bytecode of a CompiledExpression and the machine code of a
+	NativeExpression for a handful of formulas. All three run the same
+	optimized tree with a changing variable value, and every native result is
+	checked against Evaluator::evaluate to the last bit.
+
+	Build from the repository root, for example:
+		g++ -O2 -std=c++20 -I. benchmarks/native_expression_benchmark.cpp \
+			batch_evaluator.cpp compiled_expression.cpp evaluation_profile.cpp \
+			evaluator.cpp expression_node.cpp native_expression.cpp optimizer.cpp \
+			parser.cpp resource_governor.cpp result.cpp scalar_traits.cpp \
+			subexpression_eliminator.cpp symbol_table.cpp token.cpp tokenizer.cpp \
+			utility.cpp \
+			-o native_expression_benchmark
+----------------------------------------------------------------------------*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Tokenizer.h"
+#include "Parser.h"
+#include "Evaluator.h"
+#include "Compiled_expression.h"
+#include "Native_expression.h"
+#include "Optimizer.h"
+#include "Subexpression_eliminator.h"
+
+static const int ITERATIONS = 1000000;
+
+/* Keeps the optimizer from discarding the benchmarked work */
+static volatile double sink;
+
+/* fill_values: Lays out the slot values of a program for the given value of x */
+static void fill_values(const CompiledExpression& compiled, const SymbolTable& symbols, double x, std::vector<double>& values) {
+	const std::vector<std::string>& names = compiled.get_variable_names();
+	values.resize(names.size());
+
+	for (size_t i = 0; i < names.size(); i++) {
+		values[i] = names[i] == "x" ? x : symbols.get_value(symbols.find(names[i]));
+	}
+}
+
+/* benchmark_formula: Times the three evaluation strategies on one formula and prints the results */
+static void benchmark_formula(const std::string& formula) {
+	SymbolTable symbols;
+	SymbolId x = symbols.intern("x");
+	symbols.set_value(x, 1.5);
+	symbols.set_value(symbols.intern("y"), 2.5);
+	symbols.set_value(symbols.intern("z"), 9.0);
+
+	Tokenizer tokenizer(formula, symbols);
+	Parser parser(tokenizer);
+	ExpressionTree parsed = parser.parse();
+
+	Optimizer optimizer;
+	SubexpressionEliminator eliminator;
+	ExpressionTree tree = eliminator.eliminate(optimizer.optimize(parsed));
+
+	auto compiled = std::make_shared<const CompiledExpression>(tree, tree.root());
+	NativeExpression native(compiled);
+	Evaluator evaluator(symbols);
+	std::vector<double> values;
+
+	size_t mismatches = 0;
+	for (int i = 0; i < 1000; i++) {
+		double value = i * 0.01;
+		symbols.set_value(x, value);
+		fill_values(*compiled, symbols, value, values);
+
+		double expected = evaluator.evaluate(tree, tree.root());
+		double actual = native.evaluate(values.data());
+		if (std::memcmp(&expected, &actual, sizeof(double)) != 0) {
+			mismatches++;
+		}
+	}
+
+	using clock = std::chrono::steady_clock;
+
+	auto start = clock::now();
+	double sum = 0;
+	for (int i = 0; i < ITERATIONS; i++) {
+		symbols.set_value(x, i * 0.001);
+		sum += evaluator.evaluate(tree, tree.root());
+	}
+	double tree_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / ITERATIONS;
+
+	fill_values(*compiled, symbols, 0, values);
+	size_t x_slot = 0;
+	while (x_slot < values.size() && compiled->get_variable_names()[x_slot] != "x") {
+		x_slot++;
+	}
+	values.push_back(0);  // Spare slot, so formulas without x can be timed the same way
+
+	start = clock::now();
+	for (int i = 0; i < ITERATIONS; i++) {
+		values[x_slot] = i * 0.001;
+		sum += compiled->evaluate(values.data());
+	}
+	double compiled_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / ITERATIONS;
+
+	start = clock::now();
+	for (int i = 0; i < ITERATIONS; i++) {
+		values[x_slot] = i * 0.001;
+		sum += native.evaluate(values.data());
+	}
+	double native_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / ITERATIONS;
+	sink = sum;
+
+	std::printf("%-40s tree %7.1f ns/eval   compiled %7.1f ns/eval   native %7.1f ns/eval (%4zu bytes)   speedup %5.1fx   mismatches %zu\n",
+		formula.c_str(), tree_ns, compiled_ns, native_ns, native.get_code_size(), tree_ns / native_ns, mismatches);
+}
+
+int main() {
+	if (!NativeExpression::is_supported()) {
+		std::printf("Native code generation is not supported here; the native column runs the interpreter.\n");
+	}
+
+	const std::vector<std::string> formulas = {
+		"2x + 3",
+		"2x + y^2 - sqrt(z)",
+		"3^2 * (2 - 10 + 3) * (sqrt(4) / 4) + x",
+		"((x^3 + sqrt(25)) * (10 - 2 * y)) / (3 + 1)",
+		"sqrt(x^2 + y^2) * (x - 3) / (1 + 0.5) + 3 * z^2 - (6 + 2)",
+		"sqrt(x^2 + y^2) * 2 + sqrt(x^2 + y^2) / z - (sqrt(x^2 + y^2) - 1)^2 + sqrt(x^2 + y^2)",
+		"x^y + x^0.5",
+	};
+
+	for (const std::string& formula : formulas) {
+		benchmark_formula(formula);
+	}
+	return 0;
+}
@@ -0,0 +1,106 @@
+/*------parse_benchmark.cpp----------------------------------------------------
+	Measures the front end alone: tokenizing and parsing a mix of input lines,
+	with the Parser pulling tokens straight from the Tokenizer. Every heap
+	allocation made while parsing is counted through a replaced operator new.
+
+	Two columns are printed per line: a fresh ExpressionTree for each parse,
+	and one tree whose storage is reused by every parse. Once the reused tree
+	has grown to fit the largest line, parsing should not allocate at all.
+
+	Build from the repository root, for example:
+		g++ -O2 -std=c++20 -I. benchmarks/parse_benchmark.cpp \
+			expression_node.cpp parser.cpp resource_governor.cpp result.cpp \
+			symbol_table.cpp token.cpp tokenizer.cpp \
+			-o parse_benchmark
+----------------------------------------------------------------------------*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+#include "Tokenizer.h"
+#include "Parser.h"
+
+static const int ITERATIONS = 1000000;
+
+/* Heap allocations made so far by the whole program */
+static size_t allocations = 0;
+
+void* operator new(std::size_t size) {
+	allocations++;
+	if (void* memory = std::malloc(size ? size : 1)) {
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+	std::free(memory);
+}
+
+/* Keeps the optimizer from discarding the benchmarked work */
+static volatile size_t sink;
+
+/* benchmark_line: Parses one line many times, with and without reusing the tree, and prints the results */
+static void benchmark_line(const std::string& line, SymbolTable& symbols) {
+	using clock = std::chrono::steady_clock;
+	Tokenizer tokenizer(line, symbols);
+	size_t nodes = 0;
+
+	size_t before = allocations;
+	auto start = clock::now();
+	for (int i = 0; i < ITERATIONS; i++) {
+		tokenizer.reset(line);
+		Parser parser(tokenizer);
+		ExpressionTree tree = parser.parse();
+		nodes += tree.size();
+	}
+	double fresh_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / ITERATIONS;
+	double fresh_allocations = static_cast<double>(allocations - before) / ITERATIONS;
+
+	ExpressionTree tree;
+	tokenizer.reset(line);
+	Parser(tokenizer).parse(tree);  // Grows the tree once, outside the measurement
+
+	before = allocations;
+	start = clock::now();
+	for (int i = 0; i < ITERATIONS; i++) {
+		tokenizer.reset(line);
+		Parser parser(tokenizer);
+		parser.parse(tree);
+		nodes += tree.size();
+	}
+	double reused_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / ITERATIONS;
+	double reused_allocations = static_cast<double>(allocations - before) / ITERATIONS;
+	sink = nodes;
+
+	std::printf("%-45s fresh %7.1f ns/line %5.1f allocs/line   reused %7.1f ns/line %5.1f allocs/line\n",
+		line.c_str(), fresh_ns, fresh_allocations, reused_ns, reused_allocations);
+}
+
+int main() {
+	const std::vector<std::string> lines = {
+		"2 + 3",
+		"2x + y^2 - sqrt(z)",
+		"1.5e-3 * (x - 4.25) / 0.125",
+		"((x^3 + sqrt(25)) * (10 - 2 * y)) / (3 + 1)",
+		"sqrt(x^2 + y^2) * (x - 3) / (1 + 0.5) + 3 * z^2 - (6 + 2)",
+	};
+
+	// Names are interned on the first parse; later parses only look them up
+	SymbolTable symbols;
+	for (const char* name : { "x", "y", "z" }) {
+		symbols.intern(name);
+	}
+
+	for (const std::string& line : lines) {
+		benchmark_line(line, symbols);
+	}
+	return 0;
+}
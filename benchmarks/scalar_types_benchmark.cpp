@@ -0,0 +1,118 @@
+/*------scalar_types_benchmark.cpp---------------------------------------------
+	Measures one compiled expression run in every scalar type of
+	Scalar_traits.h: evaluations per second of CompiledExpression::evaluate_as
+	(one row at a time) and rows per second of BatchEvaluator::evaluate over
+	a million rows, together with the kernel set each type gets. The value of
+	the first row is printed in each type, so the precision bought by each
+	one can be seen next to its cost.
+
+	Build from the repository root, for example:
+		g++ -O2 -std=c++20 -I. benchmarks/scalar_types_benchmark.cpp \
+			batch_evaluator.cpp compiled_expression.cpp expression_node.cpp parser.cpp \
+			resource_governor.cpp result.cpp scalar_traits.cpp symbol_table.cpp token.cpp \
+			tokenizer.cpp \
+			-o scalar_types_benchmark
+----------------------------------------------------------------------------*/
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Batch_evaluator.h"
+#include "Compiled_expression.h"
+#include "Parser.h"
+#include "Tokenizer.h"
+
+static const size_t ROWS = 1000000;
+
+using benchmark_clock = std::chrono::steady_clock;
+
+/* elapsed_seconds: Seconds since start */
+static double elapsed_seconds(benchmark_clock::time_point start) {
+	return std::chrono::duration<double>(benchmark_clock::now() - start).count();
+}
+
+/* benchmark_type: Times one scalar type on per-row and batch evaluation of the program */
+template <typename Scalar>
+static void benchmark_type(const CompiledExpression& program, const std::vector<std::vector<double>>& inputs) {
+	using Traits = ScalarTraits<Scalar>;
+
+	std::vector<std::vector<Scalar>> columns(inputs.size());
+	for (size_t slot = 0; slot < inputs.size(); slot++) {
+		for (double value : inputs[slot]) {
+			columns[slot].push_back(Traits::from_double(value));
+		}
+	}
+
+	// One evaluation per row, the way the REPL and the batch runner use a program
+	std::vector<Scalar> values(columns.size());
+	std::vector<Scalar> results(ROWS);
+	size_t failed_rows = 0;
+	auto start = benchmark_clock::now();
+	for (size_t row = 0; row < ROWS; row++) {
+		for (size_t slot = 0; slot < columns.size(); slot++) {
+			values[slot] = columns[slot][row];
+		}
+		try {
+			results[row] = program.evaluate_as<Scalar>(values.data());
+		}
+		catch (const std::runtime_error&) {
+			failed_rows++;
+		}
+	}
+	double row_seconds = elapsed_seconds(start);
+
+	std::vector<BasicBatchColumn<Scalar>> batch_columns;
+	for (const std::vector<Scalar>& column : columns) {
+		batch_columns.push_back({ column.data(), Scalar() });
+	}
+	std::vector<Scalar> output(ROWS);
+	std::vector<RowStatus> status(ROWS);
+	BatchEvaluator batch(program);
+
+	start = benchmark_clock::now();
+	size_t failed_batch = batch.evaluate(batch_columns, ROWS, output.data(), status.data());
+	double batch_seconds = elapsed_seconds(start);
+
+	std::printf("%-12s %8.1f M evaluations/s %8.1f M rows/s (%-6s) %7zu failed  first row: %s\n",
+		scalar_type_name(Traits::type), ROWS / row_seconds / 1e6, ROWS / batch_seconds / 1e6,
+		BatchEvaluator::get_kernel_name<Scalar>(), failed_batch, Traits::format(output[0]).c_str());
+
+	if (failed_rows != failed_batch) {
+		std::printf("  mismatch: %zu rows failed one at a time\n", failed_rows);
+	}
+}
+
+/* benchmark_formula: Compiles a formula and runs it in each scalar type */
+static void benchmark_formula(const std::string& formula) {
+	SymbolTable symbols;
+	Tokenizer tokenizer(formula, symbols);
+	Parser parser(tokenizer);
+	ExpressionTree tree = parser.parse();
+	CompiledExpression program(tree, tree.root());
+
+	std::vector<std::vector<double>> inputs;
+	for (const std::string& name : program.get_variable_names()) {
+		std::vector<double> column(ROWS);
+		for (size_t i = 0; i < ROWS; i++) {  // Each variable gets its own pattern; some rows are negative
+			column[i] = static_cast<double>((i * (name[0] - 'a' + 3)) % 1000) * 0.01 - 1.5;
+		}
+		inputs.push_back(column);
+	}
+
+	std::printf("%s\n", formula.c_str());
+	benchmark_type<float>(program, inputs);
+	benchmark_type<double>(program, inputs);
+	benchmark_type<long double>(program, inputs);
+	benchmark_type<std::complex<double>>(program, inputs);
+	benchmark_type<Interval>(program, inputs);
+	std::printf("\n");
+}
+
+int main() {
+	benchmark_formula("x * y + 3 * x - y / 7");
+	benchmark_formula("x^2 + y^2 - 2 * x * y + 1");
+	benchmark_formula("sqrt(x) + sqrt(y)");
+	benchmark_formula("(x + 1) / (y + 2) + x^3");
+	return 0;
+}
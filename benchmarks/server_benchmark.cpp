@@ -0,0 +1,296 @@
+/*------server_benchmark.cpp---------------------------------------------------
+	Load generator for the server mode (see Server.h). It opens several
+	connections, keeps a fixed number of requests in flight on each (the
+	pipeline depth) and measures the throughput and the latency of every
+	request: the time from writing it to reading its response line. Every
+	connection first assigns its own x and y, and every response is checked
+	against the value its formula must have with them.
+
+	With no address it starts a server inside the process, on a temporary
+	Unix socket, and runs several pipeline depths one after the other so the
+	effect of pipelining shows. Given an address (as for --serve) it drives
+	that server instead:
+		server_benchmark [address] [--connections N] [--depth D] [--requests R]
+
+	Linux only, like the server.
+----------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Server.h"
+
+#if defined(__linux__)
+#include <cerrno>
+#include <cstring>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using benchmark_clock = std::chrono::steady_clock;
+
+/* The requests sent round-robin, with the values they have once x = 3 + connection and y = 4 */
+struct Request {
+	const char* text;
+	double (*value)(double x, double y);
+};
+
+static const Request REQUESTS[] = {
+	{ "x * y + 2", [](double x, double y) { return x * y + 2; } },
+	{ "sqrt(x^2 + y^2)", [](double x, double y) { return std::sqrt(x * x + y * y); } },
+	{ "(x + 1) / (y - 2)", [](double x, double y) { return (x + 1) / (y - 2); } },
+	{ "x^3 - 2x + 1", [](double x, double) { return x * x * x - 2 * x + 1; } },
+	{ "2x(3y) - x / y", [](double x, double y) { return 2 * x * (3 * y) - x / y; } },
+};
+static const size_t REQUEST_KINDS = sizeof(REQUESTS) / sizeof(REQUESTS[0]);
+
+/* One client connection and the requests it has in flight. */
+struct Client {
+	int fd;
+	double x;                                          // Its own value of x, so sessions are told apart.
+	std::deque<benchmark_clock::time_point> sent_at;   // Send time of each request awaiting its response, oldest first.
+	std::deque<size_t> kinds;                          // Which request each of them is (or REQUEST_KINDS for setup lines).
+	size_t sent = 0;                                   // Measured requests written.
+	std::string input;                                 // Received bytes after the last complete line.
+};
+
+/* Results of one run. */
+struct RunResult {
+	size_t requests;
+	size_t wrong;
+	double seconds;
+	std::vector<double> latencies_us;
+};
+
+/* connect_to: Opens a blocking connection to an address in the form the server takes */
+static int connect_to(const std::string& address) {
+	int fd;
+	if (address.compare(0, 5, "unix:") == 0) {
+		sockaddr_un remote = {};
+		remote.sun_family = AF_UNIX;
+		std::string path = address.substr(5);
+		std::memcpy(remote.sun_path, path.c_str(), std::min(path.size() + 1, sizeof(remote.sun_path) - 1));
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&remote), sizeof(remote)) != 0) {
+			return -1;
+		}
+	}
+	else {
+		size_t colon = address.rfind(':');
+		std::string host = colon == std::string::npos ? "127.0.0.1" : address.substr(0, colon);
+		sockaddr_in remote = {};
+		remote.sin_family = AF_INET;
+		remote.sin_port = htons(static_cast<std::uint16_t>(std::atoi(address.c_str() + (colon == std::string::npos ? 0 : colon + 1))));
+		inet_pton(AF_INET, host.c_str(), &remote.sin_addr);
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&remote), sizeof(remote)) != 0) {
+			return -1;
+		}
+		int no_delay = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+	}
+	return fd;
+}
+
+/* send_all: Writes the whole text on a blocking socket */
+static bool send_all(int fd, const std::string& text) {
+	size_t done = 0;
+	while (done < text.size()) {
+		ssize_t written = send(fd, text.data() + done, text.size() - done, MSG_NOSIGNAL);
+		if (written <= 0) {
+			return false;
+		}
+		done += static_cast<size_t>(written);
+	}
+	return true;
+}
+
+/* queue_request: Appends the next measured request of a client to its outgoing text */
+static void queue_request(Client& client, std::string& text, benchmark_clock::time_point now) {
+	size_t kind = client.sent % REQUEST_KINDS;
+	text += REQUESTS[kind].text;
+	text += '\n';
+	client.sent_at.push_back(now);
+	client.kinds.push_back(kind);
+	client.sent++;
+}
+
+/* run_load: Drives the given number of connections at a fixed pipeline depth until every request is answered */
+static RunResult run_load(const std::string& address, size_t connections, size_t depth, size_t requests) {
+	RunResult result = { 0, 0, 0.0, {} };
+	result.latencies_us.reserve(requests);
+
+	int epoll_fd = epoll_create1(0);
+	std::vector<Client> clients(connections);
+	size_t per_client = (requests + connections - 1) / connections;
+
+	auto start = benchmark_clock::now();
+	for (size_t i = 0; i < connections; i++) {
+		Client& client = clients[i];
+		client.fd = connect_to(address);
+		if (client.fd < 0) {
+			std::fprintf(stderr, "Cannot connect to %s: %s\n", address.c_str(), std::strerror(errno));
+			std::exit(2);
+		}
+		client.x = 3.0 + static_cast<double>(i);
+
+		std::string text = "x = " + std::to_string(i + 3) + "\ny = 4\n";
+		client.sent_at.assign(2, benchmark_clock::now());
+		client.kinds.assign(2, REQUEST_KINDS);
+		for (size_t d = 0; d < depth && client.sent < per_client; d++) {
+			queue_request(client, text, benchmark_clock::now());
+		}
+		send_all(client.fd, text);
+
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.u32 = static_cast<std::uint32_t>(i);
+		epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client.fd, &event);
+	}
+
+	size_t open = connections;
+	std::vector<epoll_event> events(connections);
+	std::vector<char> buffer(64 << 10);
+	std::string text;
+
+	while (open > 0) {
+		int ready = epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), -1);
+		for (int e = 0; e < ready; e++) {
+			Client& client = clients[events[e].data.u32];
+			ssize_t received = recv(client.fd, buffer.data(), buffer.size(), 0);
+			if (received <= 0) {
+				std::fprintf(stderr, "Connection closed by the server\n");
+				std::exit(2);
+			}
+			client.input.append(buffer.data(), static_cast<size_t>(received));
+
+			auto now = benchmark_clock::now();
+			text.clear();
+			size_t start_of_line = 0;
+			size_t end;
+			while ((end = client.input.find('\n', start_of_line)) != std::string::npos) {
+				size_t kind = client.kinds.front();
+				if (kind < REQUEST_KINDS) {  // Setup lines are neither timed nor checked
+					result.latencies_us.push_back(std::chrono::duration<double, std::micro>(now - client.sent_at.front()).count());
+					result.requests++;
+
+					double value = 0;
+					std::from_chars_result parsed = std::from_chars(client.input.data() + start_of_line, client.input.data() + end, value);
+					if (parsed.ec != std::errc() || value != REQUESTS[kind].value(client.x, 4.0)) {
+						result.wrong++;
+					}
+					if (client.sent < per_client) {
+						queue_request(client, text, now);
+					}
+				}
+				client.sent_at.pop_front();
+				client.kinds.pop_front();
+				start_of_line = end + 1;
+			}
+			client.input.erase(0, start_of_line);
+
+			if (!text.empty()) {
+				send_all(client.fd, text);
+			}
+			if (client.sent_at.empty()) {
+				epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client.fd, nullptr);
+				close(client.fd);
+				open--;
+			}
+		}
+	}
+	result.seconds = std::chrono::duration<double>(benchmark_clock::now() - start).count();
+	close(epoll_fd);
+	return result;
+}
+
+/* percentile: The latency below which the given fraction of requests finished */
+static double percentile(std::vector<double>& sorted, double fraction) {
+	if (sorted.empty()) {
+		return 0;
+	}
+	size_t index = std::min(sorted.size() - 1, static_cast<size_t>(fraction * static_cast<double>(sorted.size())));
+	return sorted[index];
+}
+
+/* report: Prints the throughput and latency distribution of a run */
+static void report(size_t connections, size_t depth, RunResult& result) {
+	std::sort(result.latencies_us.begin(), result.latencies_us.end());
+	std::printf("%4zu connections  depth %3zu  %8.0f requests/s  latency p50 %8.1f us  p99 %8.1f us  p99.9 %8.1f us  %zu wrong\n",
+		connections, depth, static_cast<double>(result.requests) / result.seconds, percentile(result.latencies_us, 0.50),
+		percentile(result.latencies_us, 0.99), percentile(result.latencies_us, 0.999), result.wrong);
+}
+
+int main(int argc, char* argv[]) {
+	std::string address;
+	size_t connections = 8;
+	size_t depth = 0;          // 0: try several
+	size_t requests = 200000;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--connections" && i + 1 < argc) {
+			connections = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (arg == "--depth" && i + 1 < argc) {
+			depth = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+		}
+		else if (arg == "--requests" && i + 1 < argc) {
+			requests = std::strtoul(argv[++i], nullptr, 10);
+		}
+		else if (address.empty() && arg[0] != '-') {
+			address = arg;
+		}
+		else {
+			std::fprintf(stderr, "Usage: %s [address] [--connections N] [--depth D] [--requests R]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	// Without an address, a server in this process answers on a temporary socket
+	std::unique_ptr<Server> server;
+	std::thread server_thread;
+	if (address.empty()) {
+		ServerOptions options;
+		options.address = "unix:/tmp/calculator_server_benchmark." + std::to_string(getpid()) + ".sock";
+		server = std::make_unique<Server>(options);
+		address = server->get_address();
+		server_thread = std::thread([&server]() { server->run(); });
+	}
+
+	std::printf("%s, %zu requests per run\n", address.c_str(), requests);
+	size_t wrong = 0;
+	std::vector<size_t> depths = depth != 0 ? std::vector<size_t>{ depth } : std::vector<size_t>{ 1, 8, 64 };
+	for (size_t d : depths) {
+		RunResult result = run_load(address, connections, d, requests);
+		report(connections, d, result);
+		wrong += result.wrong;
+	}
+
+	if (server) {
+		server->stop();
+		server_thread.join();
+	}
+	return wrong == 0 ? 0 : 1;
+}
+
+#else
+
+int main() {
+	std::printf("The server mode, and so this benchmark, needs Linux (epoll).\n");
+	return 0;
+}
+
+#endif
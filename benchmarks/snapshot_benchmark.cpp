@@ -0,0 +1,112 @@
+/*------snapshot_benchmark.cpp-------------------------------------------------
+	Measures how long a reactive session with 100k formulas takes to get
+	ready: defining every formula from text (tokenize, parse, optimize,
+	compile, evaluate) against loading a snapshot of it. Save time and file
+	size are printed too. The loaded session is then checked: every value
+	must match bit for bit, and changing the base variable must recompute
+	the same values in both sessions, so the formulas came back alive.
+
+	Build from the repository root, for example:
+		g++ -O2 -std=c++20 -pthread -I. benchmarks/snapshot_benchmark.cpp \
+			$(ls *.cpp | grep -v '^main.cpp$') -o snapshot_benchmark
+	(excluding main.cpp), or build the snapshot_benchmark target with CMake.
+----------------------------------------------------------------------------*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "Session.h"
+
+static const size_t FORMULAS = 100000;
+static const char* SNAPSHOT_PATH = "snapshot_benchmark.snap";
+
+using benchmark_clock = std::chrono::steady_clock;
+
+/* elapsed_ms: Milliseconds since start */
+static double elapsed_ms(benchmark_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(benchmark_clock::now() - start).count();
+}
+
+/* variable_name: Spells a number in base-26 letters (a, b, ..., z, ba, bb, ...), since names cannot hold digits */
+static std::string variable_name(size_t number) {
+	std::string name;
+	do {
+		name.insert(name.begin(), static_cast<char>('a' + number % 26));
+		number /= 26;
+	} while (number != 0);
+	return "v" + name;
+}
+
+/* count_mismatches: Compares every variable of the two sessions bit for bit */
+static size_t count_mismatches(Session& expected, Session& actual, const std::vector<std::string>& names) {
+	size_t mismatches = 0;
+	for (const std::string& name : names) {
+		SymbolTable& a = expected.get_symbols();
+		SymbolTable& b = actual.get_symbols();
+		if (b.find(name) == NO_SYMBOL) {
+			mismatches++;
+			continue;
+		}
+		double x = a.get_value(a.find(name));
+		double y = b.get_value(b.find(name));
+		if (std::memcmp(&x, &y, sizeof(double)) != 0) {
+			mismatches++;
+		}
+	}
+	return mismatches;
+}
+
+int main() {
+	SessionOptions options;
+	options.reactive = true;
+
+	// Each formula reads two earlier ones, so the graph is wide; a chain would make defining it quadratic (cycle checks)
+	std::vector<std::string> names;
+	std::vector<std::string> lines;
+	names.push_back(variable_name(0));
+	lines.push_back(names[0] + " = 1.5");
+	for (size_t i = 1; i < FORMULAS; i++) {
+		names.push_back(variable_name(i));
+		lines.push_back(names[i] + " = " + names[i / 2] + " * 0.5 + sqrt(" + names[i / 3] + " + " + std::to_string(i % 7) + ")");
+	}
+
+	Session defined(options);
+	auto start = benchmark_clock::now();
+	for (const std::string& line : lines) {
+		defined.execute(line);
+	}
+	double define_ms = elapsed_ms(start);
+
+	start = benchmark_clock::now();
+	SnapshotStats saved = defined.save(SNAPSHOT_PATH);
+	double save_ms = elapsed_ms(start);
+
+	Session loaded(options);
+	start = benchmark_clock::now();
+	SnapshotStats restored = loaded.load(SNAPSHOT_PATH);
+	double load_ms = elapsed_ms(start);
+
+	std::printf("%zu formulas, snapshot of %zu bytes (%.1f bytes per formula, %zu cached expressions)\n",
+		saved.formulas, saved.bytes, static_cast<double>(saved.bytes) / saved.formulas, saved.expressions);
+	std::printf("define from text %10.1f ms\n", define_ms);
+	std::printf("save             %10.1f ms\n", save_ms);
+	std::printf("load             %10.1f ms  (%.0fx faster than defining, %zu formulas restored)\n",
+		load_ms, define_ms / load_ms, restored.formulas);
+
+	size_t mismatches = count_mismatches(defined, loaded, names);
+
+	// The restored formulas must react like the original ones
+	start = benchmark_clock::now();
+	defined.execute(names[0] + " = 2.25");
+	double update_ms = elapsed_ms(start);
+	loaded.execute(names[0] + " = 2.25");
+	mismatches += count_mismatches(defined, loaded, names);
+
+	std::printf("update of %s    %10.1f ms  (recomputes every formula)\n", names[0].c_str(), update_ms);
+	std::printf("%zu mismatches\n", mismatches);
+
+	std::remove(SNAPSHOT_PATH);
+	return mismatches == 0 ? 0 : 1;
+}
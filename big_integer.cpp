@@ -0,0 +1,619 @@
+#include "Big_integer.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <stdexcept>
+
+using Limbs = std::vector<std::uint32_t>;
+
+const std::uint64_t LIMB_BASE = std::uint64_t(1) << 32;
+const std::uint32_t DECIMAL_CHUNK = 1000000000;   // 10^9, the largest power of ten in one limb.
+const int DECIMAL_CHUNK_DIGITS = 9;
+
+/* trim_limbs: Drops leading zero limbs */
+static void trim_limbs(Limbs& limbs) {
+	while (!limbs.empty() && limbs.back() == 0) {
+		limbs.pop_back();
+	}
+}
+
+/* compare_magnitudes: -1, 0 or 1 as a is smaller than, equal to or larger than b (both trimmed) */
+static int compare_magnitudes(const Limbs& a, const Limbs& b) {
+	if (a.size() != b.size()) {
+		return a.size() < b.size() ? -1 : 1;
+	}
+	for (size_t i = a.size(); i-- > 0;) {
+		if (a[i] != b[i]) {
+			return a[i] < b[i] ? -1 : 1;
+		}
+	}
+	return 0;
+}
+
+/* add_magnitudes: a + b */
+static Limbs add_magnitudes(const std::uint32_t* a, size_t a_size, const std::uint32_t* b, size_t b_size) {
+	if (a_size < b_size) {
+		std::swap(a, b);
+		std::swap(a_size, b_size);
+	}
+
+	Limbs sum(a_size + 1);
+	std::uint64_t carry = 0;
+	for (size_t i = 0; i < a_size; i++) {
+		std::uint64_t total = std::uint64_t(a[i]) + (i < b_size ? b[i] : 0) + carry;
+		sum[i] = static_cast<std::uint32_t>(total);
+		carry = total >> 32;
+	}
+	sum[a_size] = static_cast<std::uint32_t>(carry);
+	trim_limbs(sum);
+	return sum;
+}
+
+/* subtract_magnitudes: a - b, where a >= b */
+static Limbs subtract_magnitudes(const Limbs& a, const Limbs& b) {
+	Limbs difference(a.size());
+	std::int64_t borrow = 0;
+	for (size_t i = 0; i < a.size(); i++) {
+		std::int64_t total = std::int64_t(a[i]) - (i < b.size() ? b[i] : 0) - borrow;
+		difference[i] = static_cast<std::uint32_t>(total);
+		borrow = total < 0 ? 1 : 0;
+	}
+	trim_limbs(difference);
+	return difference;
+}
+
+/* add_into: Adds value into target starting at a limb offset; target must be wide enough for the sum */
+static void add_into(Limbs& target, const Limbs& value, size_t offset) {
+	std::uint64_t carry = 0;
+	size_t i = 0;
+	for (; i < value.size(); i++) {
+		std::uint64_t total = std::uint64_t(target[offset + i]) + value[i] + carry;
+		target[offset + i] = static_cast<std::uint32_t>(total);
+		carry = total >> 32;
+	}
+	for (; carry != 0; i++) {
+		std::uint64_t total = std::uint64_t(target[offset + i]) + carry;
+		target[offset + i] = static_cast<std::uint32_t>(total);
+		carry = total >> 32;
+	}
+}
+
+/* subtract_into: Subtracts value from target, where target >= value */
+static void subtract_into(Limbs& target, const Limbs& value) {
+	std::int64_t borrow = 0;
+	size_t i = 0;
+	for (; i < value.size(); i++) {
+		std::int64_t total = std::int64_t(target[i]) - value[i] - borrow;
+		target[i] = static_cast<std::uint32_t>(total);
+		borrow = total < 0 ? 1 : 0;
+	}
+	for (; borrow != 0; i++) {
+		std::int64_t total = std::int64_t(target[i]) - borrow;
+		target[i] = static_cast<std::uint32_t>(total);
+		borrow = total < 0 ? 1 : 0;
+	}
+}
+
+/* multiply_schoolbook: a * b one limb at a time, for short operands */
+static Limbs multiply_schoolbook(const std::uint32_t* a, size_t a_size, const std::uint32_t* b, size_t b_size) {
+	Limbs product(a_size + b_size, 0);
+	for (size_t i = 0; i < a_size; i++) {
+		if (a[i] == 0) continue;
+
+		std::uint64_t carry = 0;
+		for (size_t j = 0; j < b_size; j++) {
+			std::uint64_t total = std::uint64_t(a[i]) * b[j] + product[i + j] + carry;
+			product[i + j] = static_cast<std::uint32_t>(total);
+			carry = total >> 32;
+		}
+		product[i + b_size] = static_cast<std::uint32_t>(carry);
+	}
+	return product;
+}
+
+/* multiply_magnitudes: a * b; splits both operands in halves (Karatsuba) while they are long enough */
+static Limbs multiply_magnitudes(const std::uint32_t* a, size_t a_size, const std::uint32_t* b, size_t b_size) {
+	if (a_size < b_size) {
+		std::swap(a, b);
+		std::swap(a_size, b_size);
+	}
+
+	if (b_size < KARATSUBA_THRESHOLD) {
+		Limbs product = multiply_schoolbook(a, a_size, b, b_size);
+		trim_limbs(product);
+		return product;
+	}
+
+	Limbs product(a_size + b_size + 1, 0);
+
+	if (b_size <= a_size / 2) {  // Lopsided: b times each b-sized piece of a, so both halves of every split stay useful
+		for (size_t offset = 0; offset < a_size; offset += b_size) {
+			add_into(product, multiply_magnitudes(a + offset, std::min(b_size, a_size - offset), b, b_size), offset);
+		}
+		trim_limbs(product);
+		return product;
+	}
+
+	// a = a1 * B^half + a0 and b = b1 * B^half + b0, then a * b = z2 * B^(2 half) + z1 * B^half + z0
+	// with z1 = (a0 + a1)(b0 + b1) - z0 - z2
+	size_t half = a_size / 2;
+	size_t a_low = std::min(half, a_size);
+	size_t b_low = std::min(half, b_size);
+
+	Limbs z0 = multiply_magnitudes(a, a_low, b, b_low);
+	Limbs z2 = multiply_magnitudes(a + a_low, a_size - a_low, b + b_low, b_size - b_low);
+	Limbs a_sum = add_magnitudes(a, a_low, a + a_low, a_size - a_low);
+	Limbs b_sum = add_magnitudes(b, b_low, b + b_low, b_size - b_low);
+	Limbs z1 = multiply_magnitudes(a_sum.data(), a_sum.size(), b_sum.data(), b_sum.size());
+	z1.resize(std::max({ z1.size(), z0.size(), z2.size() }), 0);
+	subtract_into(z1, z0);
+	subtract_into(z1, z2);
+	trim_limbs(z1);
+
+	add_into(product, z0, 0);
+	add_into(product, z1, half);
+	add_into(product, z2, 2 * half);
+	trim_limbs(product);
+	return product;
+}
+
+/* divide_limbs_small: Divides a magnitude by one limb in place and returns the remainder */
+static std::uint32_t divide_limbs_small(Limbs& limbs, std::uint32_t divisor) {
+	std::uint64_t remainder = 0;
+	for (size_t i = limbs.size(); i-- > 0;) {
+		std::uint64_t current = (remainder << 32) | limbs[i];
+		limbs[i] = static_cast<std::uint32_t>(current / divisor);
+		remainder = current % divisor;
+	}
+	trim_limbs(limbs);
+	return static_cast<std::uint32_t>(remainder);
+}
+
+/* divide_magnitudes: Knuth's algorithm D; u = quotient * v + remainder, v non-zero */
+static void divide_magnitudes(const Limbs& u, const Limbs& v, Limbs& quotient, Limbs& remainder) {
+	if (compare_magnitudes(u, v) < 0) {
+		quotient.clear();
+		remainder = u;
+		return;
+	}
+
+	if (v.size() == 1) {
+		quotient = u;
+		std::uint32_t rest = divide_limbs_small(quotient, v[0]);
+		remainder.assign(rest ? 1 : 0, rest);
+		return;
+	}
+
+	// Normalizes so the top limb of the divisor has its high bit set, which keeps each estimated digit at most 2 off
+	size_t n = v.size();
+	size_t m = u.size() - n;
+	int shift = std::countl_zero(v[n - 1]);
+
+	Limbs vn(n);
+	for (size_t i = n - 1; i > 0; i--) {
+		vn[i] = (v[i] << shift) | (shift ? v[i - 1] >> (32 - shift) : 0);
+	}
+	vn[0] = v[0] << shift;
+
+	Limbs un(u.size() + 1);
+	un[u.size()] = shift ? u[u.size() - 1] >> (32 - shift) : 0;
+	for (size_t i = u.size() - 1; i > 0; i--) {
+		un[i] = (u[i] << shift) | (shift ? u[i - 1] >> (32 - shift) : 0);
+	}
+	un[0] = u[0] << shift;
+
+	quotient.assign(m + 1, 0);
+	for (size_t j = m + 1; j-- > 0;) {
+		// Estimates the next quotient limb from the top two limbs, then corrects it with the third
+		std::uint64_t top = (std::uint64_t(un[j + n]) << 32) | un[j + n - 1];
+		std::uint64_t estimate = top / vn[n - 1];
+		std::uint64_t rest = top % vn[n - 1];
+		while (estimate >= LIMB_BASE || estimate * vn[n - 2] > ((rest << 32) | un[j + n - 2])) {
+			estimate--;
+			rest += vn[n - 1];
+			if (rest >= LIMB_BASE) break;
+		}
+
+		// Subtracts estimate * vn from the current window of un
+		std::int64_t borrow = 0;
+		std::uint64_t carry = 0;
+		for (size_t i = 0; i < n; i++) {
+			std::uint64_t product = estimate * vn[i] + carry;
+			carry = product >> 32;
+			std::int64_t total = std::int64_t(un[i + j]) - std::int64_t(product & 0xFFFFFFFF) - borrow;
+			un[i + j] = static_cast<std::uint32_t>(total);
+			borrow = total < 0 ? 1 : 0;
+		}
+		std::int64_t total = std::int64_t(un[j + n]) - std::int64_t(carry) - borrow;
+		un[j + n] = static_cast<std::uint32_t>(total);
+
+		if (total < 0) {  // The estimate was one too large: adds the divisor back
+			estimate--;
+			std::uint64_t add_carry = 0;
+			for (size_t i = 0; i < n; i++) {
+				std::uint64_t sum = std::uint64_t(un[i + j]) + vn[i] + add_carry;
+				un[i + j] = static_cast<std::uint32_t>(sum);
+				add_carry = sum >> 32;
+			}
+			un[j + n] += static_cast<std::uint32_t>(add_carry);
+		}
+		quotient[j] = static_cast<std::uint32_t>(estimate);
+	}
+	trim_limbs(quotient);
+
+	remainder.assign(n, 0);
+	for (size_t i = 0; i < n; i++) {
+		remainder[i] = (un[i] >> shift) | (shift ? un[i + 1] << (32 - shift) : 0);
+	}
+	trim_limbs(remainder);
+}
+
+/* constructor */
+BigInteger::BigInteger() : negative(false) {}
+
+BigInteger::BigInteger(std::int64_t value) : negative(value < 0) {
+	// Negating through unsigned arithmetic also covers INT64_MIN
+	std::uint64_t magnitude = value < 0 ? 0 - static_cast<std::uint64_t>(value) : static_cast<std::uint64_t>(value);
+	while (magnitude != 0) {
+		limbs.push_back(static_cast<std::uint32_t>(magnitude));
+		magnitude >>= 32;
+	}
+}
+
+/* from_unsigned: The value of an unsigned 64-bit integer */
+BigInteger BigInteger::from_unsigned(std::uint64_t value) {
+	BigInteger result;
+	while (value != 0) {
+		result.limbs.push_back(static_cast<std::uint32_t>(value));
+		value >>= 32;
+	}
+	return result;
+}
+
+/* parse: Reads the digits nine at a time, multiplying in place by 10^9 */
+BigInteger BigInteger::parse(std::string_view text) {
+	bool is_negative = !text.empty() && text[0] == '-';
+	if (is_negative) {
+		text.remove_prefix(1);
+	}
+	if (text.empty()) {
+		throw std::runtime_error("Invalid integer: empty");
+	}
+
+	BigInteger result;
+	size_t position = 0;
+	while (position < text.size()) {
+		size_t length = std::min<size_t>(DECIMAL_CHUNK_DIGITS, text.size() - position);
+		std::uint32_t chunk = 0;
+		std::uint32_t scale = 1;
+		for (size_t i = 0; i < length; i++) {
+			char c = text[position + i];
+			if (c < '0' || c > '9') {
+				throw std::runtime_error("Invalid integer: " + std::string(text));
+			}
+			chunk = chunk * 10 + static_cast<std::uint32_t>(c - '0');
+			scale *= 10;
+		}
+		position += length;
+
+		std::uint64_t carry = chunk;
+		for (std::uint32_t& limb : result.limbs) {
+			std::uint64_t total = std::uint64_t(limb) * scale + carry;
+			limb = static_cast<std::uint32_t>(total);
+			carry = total >> 32;
+		}
+		if (carry != 0) {
+			result.limbs.push_back(static_cast<std::uint32_t>(carry));
+		}
+	}
+
+	result.negative = is_negative;
+	result.trim();
+	return result;
+}
+
+/* trim: Drops leading zero limbs and keeps zero positive */
+void BigInteger::trim() {
+	trim_limbs(limbs);
+	if (limbs.empty()) {
+		negative = false;
+	}
+}
+
+/* is_zero: Reports whether the value is zero */
+bool BigInteger::is_zero() const {
+	return limbs.empty();
+}
+
+/* is_negative: Reports whether the value is below zero */
+bool BigInteger::is_negative() const {
+	return negative;
+}
+
+/* sign: -1, 0 or 1 */
+int BigInteger::sign() const {
+	return limbs.empty() ? 0 : negative ? -1 : 1;
+}
+
+/* bit_length: Bits of the magnitude */
+size_t BigInteger::bit_length() const {
+	if (limbs.empty()) {
+		return 0;
+	}
+	return limbs.size() * 32 - std::countl_zero(limbs.back());
+}
+
+/* trailing_zero_bits: Zero bits below the lowest set bit */
+size_t BigInteger::trailing_zero_bits() const {
+	for (size_t i = 0; i < limbs.size(); i++) {
+		if (limbs[i] != 0) {
+			return i * 32 + std::countr_zero(limbs[i]);
+		}
+	}
+	return 0;
+}
+
+/* fits_int64: Reports whether the magnitude is at most INT64_MAX */
+bool BigInteger::fits_int64() const {
+	return limbs.size() < 2 || (limbs.size() == 2 && limbs[1] < 0x80000000u);
+}
+
+/* to_int64: The value as a built-in integer */
+std::int64_t BigInteger::to_int64() const {
+	std::uint64_t magnitude = 0;
+	for (size_t i = limbs.size(); i-- > 0;) {
+		magnitude = (magnitude << 32) | limbs[i];
+	}
+	std::int64_t value = static_cast<std::int64_t>(magnitude);
+	return negative ? -value : value;
+}
+
+/* to_double: The top 64 bits, scaled by the bits dropped below them */
+double BigInteger::to_double() const {
+	size_t bits = bit_length();
+	size_t dropped = bits > 64 ? bits - 64 : 0;
+	BigInteger top = shifted_right(dropped);
+
+	std::uint64_t magnitude = 0;
+	for (size_t i = top.limbs.size(); i-- > 0;) {
+		magnitude = (magnitude << 32) | top.limbs[i];
+	}
+
+	double value = std::ldexp(static_cast<double>(magnitude), static_cast<int>(std::min<size_t>(dropped, 100000)));
+	return negative ? -value : value;
+}
+
+/* to_string: Peels off nine decimal digits at a time from the low end */
+std::string BigInteger::to_string() const {
+	if (limbs.empty()) {
+		return "0";
+	}
+
+	Limbs rest = limbs;
+	std::vector<std::uint32_t> chunks;
+	while (!rest.empty()) {
+		chunks.push_back(divide_limbs_small(rest, DECIMAL_CHUNK));
+	}
+
+	std::string text = negative ? "-" : "";
+	text += std::to_string(chunks.back());
+	for (size_t i = chunks.size() - 1; i-- > 0;) {
+		std::string chunk = std::to_string(chunks[i]);
+		text.append(DECIMAL_CHUNK_DIGITS - chunk.size(), '0');
+		text += chunk;
+	}
+	return text;
+}
+
+/* operator-: The value with its sign flipped */
+BigInteger BigInteger::operator-() const {
+	BigInteger result = *this;
+	result.negative = !negative && !limbs.empty();
+	return result;
+}
+
+/* abs: The magnitude */
+BigInteger BigInteger::abs() const {
+	BigInteger result = *this;
+	result.negative = false;
+	return result;
+}
+
+/* shifted_left: The magnitude times 2^bits */
+BigInteger BigInteger::shifted_left(size_t bits) const {
+	if (limbs.empty()) {
+		return *this;
+	}
+
+	size_t whole = bits / 32;
+	unsigned part = bits % 32;
+	BigInteger result;
+	result.negative = negative;
+	result.limbs.assign(limbs.size() + whole + 1, 0);
+	for (size_t i = 0; i < limbs.size(); i++) {
+		std::uint64_t moved = std::uint64_t(limbs[i]) << part;
+		result.limbs[i + whole] |= static_cast<std::uint32_t>(moved);
+		result.limbs[i + whole + 1] = static_cast<std::uint32_t>(moved >> 32);
+	}
+	result.trim();
+	return result;
+}
+
+/* shifted_right: The magnitude divided by 2^bits, rounded down */
+BigInteger BigInteger::shifted_right(size_t bits) const {
+	size_t whole = bits / 32;
+	unsigned part = bits % 32;
+	BigInteger result;
+	if (whole >= limbs.size()) {
+		return result;
+	}
+
+	result.negative = negative;
+	result.limbs.assign(limbs.size() - whole, 0);
+	for (size_t i = 0; i < result.limbs.size(); i++) {
+		std::uint64_t window = limbs[i + whole];
+		if (i + whole + 1 < limbs.size()) {
+			window |= std::uint64_t(limbs[i + whole + 1]) << 32;
+		}
+		result.limbs[i] = static_cast<std::uint32_t>(window >> part);
+	}
+	result.trim();
+	return result;
+}
+
+/* operator+: Adds the magnitudes for equal signs, otherwise subtracts the smaller from the larger */
+BigInteger operator+(const BigInteger& a, const BigInteger& b) {
+	BigInteger result;
+	if (a.negative == b.negative) {
+		result.limbs = add_magnitudes(a.limbs.data(), a.limbs.size(), b.limbs.data(), b.limbs.size());
+		result.negative = a.negative;
+	}
+	else if (compare_magnitudes(a.limbs, b.limbs) >= 0) {
+		result.limbs = subtract_magnitudes(a.limbs, b.limbs);
+		result.negative = a.negative;
+	}
+	else {
+		result.limbs = subtract_magnitudes(b.limbs, a.limbs);
+		result.negative = b.negative;
+	}
+	result.trim();
+	return result;
+}
+
+BigInteger operator-(const BigInteger& a, const BigInteger& b) {
+	return a + (-b);
+}
+
+BigInteger operator*(const BigInteger& a, const BigInteger& b) {
+	BigInteger result;
+	if (a.limbs.empty() || b.limbs.empty()) {
+		return result;
+	}
+	result.limbs = multiply_magnitudes(a.limbs.data(), a.limbs.size(), b.limbs.data(), b.limbs.size());
+	result.negative = a.negative != b.negative;
+	result.trim();
+	return result;
+}
+
+BigInteger operator/(const BigInteger& a, const BigInteger& b) {
+	BigInteger quotient;
+	BigInteger remainder;
+	BigInteger::divide(a, b, quotient, remainder);
+	return quotient;
+}
+
+BigInteger operator%(const BigInteger& a, const BigInteger& b) {
+	BigInteger quotient;
+	BigInteger remainder;
+	BigInteger::divide(a, b, quotient, remainder);
+	return remainder;
+}
+
+bool operator==(const BigInteger& a, const BigInteger& b) {
+	return a.negative == b.negative && a.limbs == b.limbs;
+}
+
+bool operator!=(const BigInteger& a, const BigInteger& b) {
+	return !(a == b);
+}
+
+bool operator<(const BigInteger& a, const BigInteger& b) {
+	if (a.negative != b.negative) {
+		return a.negative;
+	}
+	int order = compare_magnitudes(a.limbs, b.limbs);
+	return a.negative ? order > 0 : order < 0;
+}
+
+/* divide: Divides the magnitudes, then gives the quotient the combined sign and the remainder the sign of a */
+void BigInteger::divide(const BigInteger& a, const BigInteger& b, BigInteger& quotient, BigInteger& remainder) {
+	if (b.limbs.empty()) {
+		throw std::runtime_error("Division by zero");
+	}
+
+	Limbs q;
+	Limbs r;
+	divide_magnitudes(a.limbs, b.limbs, q, r);
+	quotient.limbs = std::move(q);
+	quotient.negative = a.negative != b.negative;
+	quotient.trim();
+	remainder.limbs = std::move(r);
+	remainder.negative = a.negative;
+	remainder.trim();
+}
+
+/* divide_small: Divides the magnitude by one limb in place */
+std::uint32_t BigInteger::divide_small(std::uint32_t divisor) {
+	if (divisor == 0) {
+		throw std::runtime_error("Division by zero");
+	}
+	std::uint32_t remainder = divide_limbs_small(limbs, divisor);
+	trim();
+	return remainder;
+}
+
+/* power: Squares the base once per bit of the exponent, from the top bit down */
+BigInteger BigInteger::power(const BigInteger& base, std::uint64_t exponent) {
+	BigInteger result(1);
+	if (exponent == 0) {
+		return result;
+	}
+	for (int bit = 63 - std::countl_zero(exponent); bit >= 0; bit--) {
+		result = result * result;
+		if ((exponent >> bit) & 1) {
+			result = result * base;
+		}
+	}
+	return result;
+}
+
+/* sqrt: Newton's iteration from a power of two above the root, which decreases until it reaches it */
+BigInteger BigInteger::sqrt(const BigInteger& value) {
+	if (value.negative) {
+		throw std::runtime_error("Invalid input for square root");
+	}
+	if (value.limbs.empty()) {
+		return value;
+	}
+
+	BigInteger root = BigInteger(1).shifted_left((value.bit_length() + 1) / 2);
+	while (true) {
+		BigInteger next = (root + value / root).shifted_right(1);
+		if (!(next < root)) {
+			return root;
+		}
+		root = std::move(next);
+	}
+}
+
+/* gcd: Euclid's algorithm, finished with built-in integers once both values fit in 64 bits */
+BigInteger BigInteger::gcd(const BigInteger& a, const BigInteger& b) {
+	BigInteger x = a.abs();
+	BigInteger y = b.abs();
+
+	while (!y.is_zero() && y.limbs.size() > 2) {
+		BigInteger rest = x % y;
+		x = std::move(y);
+		y = std::move(rest);
+	}
+	if (y.is_zero()) {
+		return x;
+	}
+
+	// x may still be long while y is not: one more step brings both into 64 bits
+	BigInteger rest = x % y;
+	std::uint64_t small_x = 0;
+	std::uint64_t small_y = 0;
+	for (size_t i = y.limbs.size(); i-- > 0;) {
+		small_x = (small_x << 32) | y.limbs[i];
+	}
+	for (size_t i = rest.limbs.size(); i-- > 0;) {
+		small_y = (small_y << 32) | rest.limbs[i];
+	}
+	while (small_y != 0) {
+		std::uint64_t next = small_x % small_y;
+		small_x = small_y;
+		small_y = next;
+	}
+	return from_unsigned(small_x);
+}
@@ -0,0 +1,543 @@
+#include "Compiled_expression.h"
+#include "Native_expression.h"
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <type_traits>
+#include <utility>
+
+/* Stacks and value arrays up to this size live on the machine stack instead of the heap */
+static const size_t LOCAL_STACK_SIZE = 64;
+
+/* Marks a shared node that has not been compiled yet */
+static const std::uint32_t NO_TEMP = 0xFFFFFFFFu;
+
+/* constructor: Compiles the tree once, so later evaluations only run the bytecode */
+CompiledExpression::CompiledExpression(const ExpressionTree& tree, NodeIndex root) : max_stack_depth(0), temp_count(0), native_function(nullptr) {
+	node_temps.assign(tree.size(), NO_TEMP);
+	compile(tree, root);
+	node_temps = std::vector<std::uint32_t>();  // Only needed while compiling
+	name_slots = std::unordered_map<std::string_view, std::uint32_t>();
+}
+
+/* constructor: Takes the program as it was compiled elsewhere */
+CompiledExpression::CompiledExpression(const Instruction* code, size_t code_size, const double* constants, size_t constant_count,
+	std::vector<std::string> variable_names, std::vector<SymbolId> variable_symbols, size_t max_stack_depth, size_t temp_count)
+	: code(code, code + code_size), constants(constants, constants + constant_count), variable_names(std::move(variable_names)),
+	  variable_symbols(std::move(variable_symbols)), max_stack_depth(max_stack_depth), temp_count(temp_count), native_function(nullptr) {}
+
+/* slot_for: Returns the slot of a variable, giving new names the next free slot. The names point into the tree,
+			which outlives the compilation. */
+std::uint32_t CompiledExpression::slot_for(const Token& token) {
+	auto [slot, inserted] = name_slots.try_emplace(token.getValue(), static_cast<std::uint32_t>(variable_names.size()));
+	if (inserted) {
+		variable_names.push_back(std::string(token.getValue()));
+		variable_symbols.push_back(token.getSlot());
+	}
+	return slot->second;
+}
+
+/* compile: Emits the tree in post-order with an explicit stack of pending nodes, so its depth is only
+			limited by memory. A shared node is emitted once; later uses load its temporary. Operands come
+			in the evaluator's order: the divisor of a division before its dividend. */
+void CompiledExpression::compile(const ExpressionTree& tree, NodeIndex root) {
+
+	/* A node being compiled: how many of its operands are emitted, and the stack height before it runs. */
+	struct Frame {
+		NodeIndex index;
+		std::uint32_t stage;
+		std::uint32_t operands;
+		size_t depth;
+	};
+	std::vector<Frame> frames = { { root, 0, 0, 0 } };
+
+	while (!frames.empty()) {
+		Frame& frame = frames.back();
+		NodeIndex index = frame.index;
+
+		if (frame.stage == 0) {
+			if (index != NO_NODE && tree[index].shared && node_temps[index] != NO_TEMP) {  // Emitted earlier in the program, so its value is ready
+				max_stack_depth = std::max(max_stack_depth, frame.depth + 1);
+				code.push_back({ OpCode::LoadTemp, node_temps[index] });
+				frames.pop_back();
+				continue;
+			}
+
+			max_stack_depth = std::max(max_stack_depth, frame.depth + 1);
+			std::uint32_t failure;
+			if (!check_node(tree, index, frame.operands, failure)) {  // Fails when the run gets here, as in the evaluator
+				code.push_back({ OpCode::Fail, failure });
+				frames.pop_back();
+				continue;
+			}
+		}
+
+		if (frame.stage < frame.operands) {  // The first operand runs at the node's height, the second one above it
+			const ExpressionNode& node = tree[index];
+			bool divisor_first = node.token.getType() == TokenType::Division;
+			if (divisor_first && frame.stage == 1) {
+				code.push_back({ OpCode::CheckDivisor, 0 });  // A zero divisor fails before the dividend runs
+			}
+			NodeIndex operand = (frame.stage == 0) != divisor_first ? node.left : node.right;
+			size_t depth = frame.depth + frame.stage;
+
+			frame.stage++;
+			frames.push_back({ operand, 0, 0, depth });
+			continue;
+		}
+
+		emit_operation(tree, tree[index]);
+		if (tree[index].shared) {
+			node_temps[index] = static_cast<std::uint32_t>(temp_count++);
+			code.push_back({ OpCode::StoreTemp, node_temps[index] });
+		}
+		frames.pop_back();
+	}
+}
+
+/* check_node: Finds the malformed nodes the evaluator rejects and counts the operands of the others */
+bool CompiledExpression::check_node(const ExpressionTree& tree, NodeIndex index, std::uint32_t& operands, std::uint32_t& failure) {
+
+	if (index == NO_NODE) {  // Mirrors the evaluator's check for a missing node
+		failure = NO_NODE_TYPE;
+		return false;
+	}
+
+	const ExpressionNode& node = tree[index];
+	failure = static_cast<std::uint32_t>(node.token.getType());
+	switch (node.token.getType()) {
+
+		case TokenType::Number:
+		case TokenType::Variable:
+			operands = 0;
+			return true;
+
+		case TokenType::Sqrt:
+		case TokenType::Negation:
+			operands = 1;
+			return true;
+
+		case TokenType::IntegerPower:  // The exponent is the right child, a Number node
+			operands = 1;
+			return node.right != NO_NODE;
+
+		case TokenType::Addition:
+		case TokenType::Subtraction:
+		case TokenType::Multiplication:
+		case TokenType::Division:
+			operands = 2;
+			return node.left != NO_NODE && node.right != NO_NODE;
+
+		case TokenType::Exponents:
+			operands = 2;
+			return true;
+
+		default:  // Assignments are not compiled; like unknown tokens they fail in the evaluator's words
+			return false;
+	}
+}
+
+/* emit_operation: Emits the instruction of a node whose operands are already on the stack */
+void CompiledExpression::emit_operation(const ExpressionTree& tree, const ExpressionNode& node) {
+	switch (node.token.getType()) {
+
+		case TokenType::Number:
+			constants.push_back(node.token.getNumber());  // Decoded once, by the Tokenizer
+			code.push_back({ OpCode::PushConstant, static_cast<std::uint32_t>(constants.size() - 1) });
+			break;
+
+		case TokenType::Variable:
+			code.push_back({ OpCode::PushVariable, slot_for(node.token) });
+			break;
+
+		case TokenType::Sqrt:
+			code.push_back({ OpCode::Sqrt, 0 });
+			break;
+
+		case TokenType::Negation:
+			code.push_back({ OpCode::Negate, 0 });
+			break;
+
+		case TokenType::IntegerPower: {
+			int exponent = static_cast<int>(tree[node.right].token.getNumber());
+			code.push_back({ OpCode::PowerInteger, static_cast<std::uint32_t>(exponent) });
+			break;
+		}
+
+		case TokenType::Addition:
+			code.push_back({ OpCode::Add, 0 });
+			break;
+
+		case TokenType::Subtraction:
+			code.push_back({ OpCode::Subtract, 0 });
+			break;
+
+		case TokenType::Multiplication:
+			code.push_back({ OpCode::Multiply, 0 });
+			break;
+
+		case TokenType::Division:
+			code.push_back({ OpCode::DivideSwapped, 0 });
+			break;
+
+		default:  // Exponents; check_node turned everything else into Fail
+			code.push_back({ OpCode::Power, 0 });
+			break;
+	}
+}
+
+/* run: Runs the bytecode with values[i] as the value of slot i, every operation going through the traits of the
+		scalar type. Stops at the first operation that fails and returns its status */
+template <typename Scalar, bool Checked>
+RowStatus CompiledExpression::run(const Scalar* values, Scalar& result, std::uint32_t& operand, const std::uint8_t* defined) const {
+	using Traits = ScalarTraits<Scalar>;
+
+	if constexpr (std::is_same_v<Scalar, double> && !Checked) {
+		if (native_function) {
+			double value = native_function(values);
+			if (!std::isnan(value)) {  // NaN: the bytecode below tells an error from a NaN result
+				result = value;
+				return RowStatus::Ok;
+			}
+		}
+	}
+
+	Scalar local_stack[LOCAL_STACK_SIZE];
+	local_stack[0] = Scalar();  // Every program pushes at least one value; this only keeps compilers quiet
+	std::vector<Scalar> heap_stack;
+	Scalar* stack = local_stack;
+
+	if (max_stack_depth > LOCAL_STACK_SIZE) {  // Only very deeply nested expressions need the heap
+		heap_stack.resize(max_stack_depth);
+		stack = heap_stack.data();
+	}
+
+	Scalar local_temps[LOCAL_STACK_SIZE];
+	std::vector<Scalar> heap_temps;
+	Scalar* temps = local_temps;
+
+	if (temp_count > LOCAL_STACK_SIZE) {
+		heap_temps.resize(temp_count);
+		temps = heap_temps.data();
+	}
+
+	size_t top = 0;  // Number of values currently on the stack
+	for (const Instruction& instruction : code) {
+		switch (instruction.op) {
+
+			case OpCode::PushConstant:
+				stack[top++] = Traits::from_double(constants[instruction.operand]);
+				break;
+
+			case OpCode::PushVariable:
+				if constexpr (Checked) {
+					if (!defined[instruction.operand]) {
+						operand = instruction.operand;
+						return RowStatus::UndefinedVariable;
+					}
+				}
+				stack[top++] = values[instruction.operand];
+				break;
+
+			case OpCode::Add:
+				top--;
+				stack[top - 1] = stack[top - 1] + stack[top];
+				break;
+
+			case OpCode::Subtract:
+				top--;
+				stack[top - 1] = stack[top - 1] - stack[top];
+				break;
+
+			case OpCode::Multiply:
+				top--;
+				stack[top - 1] = stack[top - 1] * stack[top];
+				break;
+
+			case OpCode::Divide: {
+				top--;
+				RowStatus status = Traits::divide(stack[top - 1], stack[top], stack[top - 1]);
+				if (status != RowStatus::Ok) {  // Division by zero, by the rules of the type
+					return status;
+				}
+				break;
+			}
+
+			case OpCode::CheckDivisor: {
+				RowStatus status = Traits::check_divisor(stack[top - 1]);
+				if (status != RowStatus::Ok) {
+					return status;
+				}
+				break;
+			}
+
+			case OpCode::DivideSwapped: {
+				top--;
+				RowStatus status = Traits::divide(stack[top], stack[top - 1], stack[top - 1]);
+				if (status != RowStatus::Ok) {
+					return status;
+				}
+				break;
+			}
+
+			case OpCode::Power:
+				top--;
+				stack[top - 1] = Traits::power(stack[top - 1], stack[top]);
+				break;
+
+			case OpCode::Sqrt: {
+				RowStatus status = Traits::sqrt(stack[top - 1], stack[top - 1]);
+				if (status != RowStatus::Ok) {  // A negative input, unless the type has a root for it
+					return status;
+				}
+				break;
+			}
+
+			case OpCode::Negate:
+				stack[top - 1] = -stack[top - 1];
+				break;
+
+			case OpCode::PowerInteger:
+				stack[top - 1] = Traits::power_integer(stack[top - 1], static_cast<std::int32_t>(instruction.operand));
+				break;
+
+			case OpCode::StoreTemp:
+				temps[instruction.operand] = stack[top - 1];
+				break;
+
+			case OpCode::LoadTemp:
+				stack[top++] = temps[instruction.operand];
+				break;
+
+			case OpCode::Fail:
+				operand = instruction.operand;
+				return RowStatus::InvalidTree;
+		}
+	}
+
+	result = stack[0];
+	return RowStatus::Ok;
+}
+
+/* invalid_node_name: The operation an "Invalid nodes for ... operation" message names, or nullptr */
+static const char* invalid_node_name(std::uint32_t type) {
+	switch (type) {
+		case static_cast<std::uint32_t>(TokenType::Addition): return "addition";
+		case static_cast<std::uint32_t>(TokenType::Subtraction): return "subtraction";
+		case static_cast<std::uint32_t>(TokenType::Multiplication): return "multiplication";
+		case static_cast<std::uint32_t>(TokenType::Division): return "division";
+		default: return nullptr;
+	}
+}
+
+/* run_error: Builds the Error of a failed run, with the variable name or the operation the evaluator reports */
+Error CompiledExpression::run_error(RowStatus status, std::uint32_t operand) const {
+	switch (status) {
+		case RowStatus::DivisionByZero:
+			return Error(ErrorCode::DivisionByZero, 0);
+		case RowStatus::NegativeSqrt:
+			return Error(ErrorCode::NegativeSqrt, 0);
+		case RowStatus::UndefinedVariable:
+			return Error(ErrorCode::UndefinedVariable, 0, variable_names[operand]);
+		default: {
+			const char* name = invalid_node_name(operand);
+			return Error(ErrorCode::InvalidTree, 0, name ? std::string_view(name) : std::string_view());
+		}
+	}
+}
+
+/* run_with: Gathers the value of every slot from the symbol table, then runs the bytecode. A variable without a
+			 value only fails once the run reaches it, so an earlier error in the program is reported first */
+template <typename Scalar>
+Error CompiledExpression::run_with(const SymbolTable& symbols, Scalar& result) const {
+	Scalar local_values[LOCAL_STACK_SIZE];
+	std::vector<Scalar> heap_values;
+	Scalar* values = local_values;
+
+	if (variable_names.size() > LOCAL_STACK_SIZE) {
+		heap_values.resize(variable_names.size());
+		values = heap_values.data();
+	}
+
+	std::vector<std::uint8_t> defined;  // Only filled once a variable turns out to have no value
+	for (size_t i = 0; i < variable_names.size(); i++) {
+		SymbolId id = variable_symbols[i] != NO_SYMBOL ? variable_symbols[i] : symbols.find(variable_names[i]);
+
+		if (!symbols.is_defined(id)) {
+			if (defined.empty()) {
+				defined.assign(variable_names.size(), 1);
+			}
+			defined[i] = 0;
+			values[i] = ScalarTraits<Scalar>::not_a_number();
+			continue;
+		}
+		values[i] = ScalarTraits<Scalar>::from_double(symbols.get_value(id));
+	}
+
+	std::uint32_t operand = 0;
+	RowStatus status = defined.empty() ? run<Scalar>(values, result, operand) : run<Scalar, true>(values, result, operand, defined.data());
+	return status == RowStatus::Ok ? Error() : run_error(status, operand);
+}
+
+/* evaluate_as: Runs the bytecode, throwing the error of a failed run */
+template <typename Scalar>
+Scalar CompiledExpression::evaluate_as(const Scalar* values) const {
+	Scalar result;
+	std::uint32_t operand = 0;
+	RowStatus status = run<Scalar>(values, result, operand);
+	if (status != RowStatus::Ok) {
+		run_error(status, operand).raise();
+	}
+	return result;
+}
+
+/* evaluate_as: Runs the bytecode with the values of the symbol table, throwing the error of a failed run */
+template <typename Scalar>
+Scalar CompiledExpression::evaluate_as(const SymbolTable& symbols) const {
+	Scalar result;
+	Error error = run_with<Scalar>(symbols, result);
+	if (error.get_code() != ErrorCode::None) {
+		error.raise();
+	}
+	return result;
+}
+
+/* try_evaluate_as: Runs the bytecode, returning the error of a failed run */
+template <typename Scalar>
+Result<Scalar> CompiledExpression::try_evaluate_as(const Scalar* values) const {
+	Scalar result;
+	std::uint32_t operand = 0;
+	RowStatus status = run<Scalar>(values, result, operand);
+	if (status != RowStatus::Ok) {
+		return Result<Scalar>(run_error(status, operand));
+	}
+	return Result<Scalar>(result);
+}
+
+/* try_evaluate_as: Runs the bytecode with the values of the symbol table, returning the error of a failed run */
+template <typename Scalar>
+Result<Scalar> CompiledExpression::try_evaluate_as(const SymbolTable& symbols) const {
+	Scalar result;
+	Error error = run_with<Scalar>(symbols, result);
+	if (error.get_code() != ErrorCode::None) {
+		return Result<Scalar>(error);
+	}
+	return Result<Scalar>(result);
+}
+
+template float CompiledExpression::evaluate_as<float>(const float*) const;
+template double CompiledExpression::evaluate_as<double>(const double*) const;
+template long double CompiledExpression::evaluate_as<long double>(const long double*) const;
+template std::complex<double> CompiledExpression::evaluate_as<std::complex<double>>(const std::complex<double>*) const;
+template Interval CompiledExpression::evaluate_as<Interval>(const Interval*) const;
+
+template float CompiledExpression::evaluate_as<float>(const SymbolTable&) const;
+template double CompiledExpression::evaluate_as<double>(const SymbolTable&) const;
+template long double CompiledExpression::evaluate_as<long double>(const SymbolTable&) const;
+template std::complex<double> CompiledExpression::evaluate_as<std::complex<double>>(const SymbolTable&) const;
+template Interval CompiledExpression::evaluate_as<Interval>(const SymbolTable&) const;
+
+template Result<float> CompiledExpression::try_evaluate_as<float>(const float*) const;
+template Result<double> CompiledExpression::try_evaluate_as<double>(const double*) const;
+template Result<long double> CompiledExpression::try_evaluate_as<long double>(const long double*) const;
+template Result<std::complex<double>> CompiledExpression::try_evaluate_as<std::complex<double>>(const std::complex<double>*) const;
+template Result<Interval> CompiledExpression::try_evaluate_as<Interval>(const Interval*) const;
+
+template Result<float> CompiledExpression::try_evaluate_as<float>(const SymbolTable&) const;
+template Result<double> CompiledExpression::try_evaluate_as<double>(const SymbolTable&) const;
+template Result<long double> CompiledExpression::try_evaluate_as<long double>(const SymbolTable&) const;
+template Result<std::complex<double>> CompiledExpression::try_evaluate_as<std::complex<double>>(const SymbolTable&) const;
+template Result<Interval> CompiledExpression::try_evaluate_as<Interval>(const SymbolTable&) const;
+
+/* evaluate: Runs the bytecode in double */
+double CompiledExpression::evaluate(const double* values) const {
+	return evaluate_as<double>(values);
+}
+
+/* evaluate: Runs the bytecode in double with the values held by the symbol table */
+double CompiledExpression::evaluate(const SymbolTable& symbols) const {
+	return evaluate_as<double>(symbols);
+}
+
+/* try_evaluate: Runs the bytecode in double, returning the error instead of throwing it */
+Result<double> CompiledExpression::try_evaluate(const double* values) const {
+	return try_evaluate_as<double>(values);
+}
+
+/* try_evaluate: Same, with the values held by the symbol table */
+Result<double> CompiledExpression::try_evaluate(const SymbolTable& symbols) const {
+	return try_evaluate_as<double>(symbols);
+}
+
+/* bind: Copies the bytecode and gives each variable the slot of its name in the other table */
+std::shared_ptr<const CompiledExpression> CompiledExpression::bind(SymbolTable& symbols) const {
+	std::shared_ptr<CompiledExpression> copy = std::make_shared<CompiledExpression>(code.data(), code.size(), constants.data(),
+		constants.size(), variable_names, variable_symbols, max_stack_depth, temp_count);
+
+	for (size_t i = 0; i < variable_names.size(); i++) {
+		copy->variable_symbols[i] = symbols.intern(variable_names[i]);
+	}
+	copy->native = native;  // Slots keep their order, so the same code serves the copy
+	copy->native_function = native_function;
+	return copy;
+}
+
+/* attach_native: Translates the bytecode once; the native form only points back at this program */
+bool CompiledExpression::attach_native() {
+	std::shared_ptr<const NativeExpression> generated = std::make_shared<const NativeExpression>(*this);
+	if (!generated->is_native()) {
+		return false;
+	}
+	native = std::move(generated);
+	native_function = native->get_function();
+	return true;
+}
+
+/* is_native: Checks for an entry point */
+bool CompiledExpression::is_native() const {
+	return native_function != nullptr;
+}
+
+/* get_variable_names: Returns the variable names in slot order */
+const std::vector<std::string>& CompiledExpression::get_variable_names() const {
+	return variable_names;
+}
+
+/* get_code: Returns the compiled instructions */
+const std::vector<Instruction>& CompiledExpression::get_code() const {
+	return code;
+}
+
+/* get_constants: Returns the pre-decoded number literals */
+const std::vector<double>& CompiledExpression::get_constants() const {
+	return constants;
+}
+
+/* get_max_stack_depth: Returns the stack height the program needs */
+size_t CompiledExpression::get_max_stack_depth() const {
+	return max_stack_depth;
+}
+
+/* get_temp_count: Returns the number of temporaries the program uses */
+size_t CompiledExpression::get_temp_count() const {
+	return temp_count;
+}
+
+/* get_memory_usage: Adds up the object and the storage behind its containers */
+size_t CompiledExpression::get_memory_usage() const {
+	size_t bytes = sizeof(CompiledExpression)
+		+ code.capacity() * sizeof(Instruction)
+		+ constants.capacity() * sizeof(double)
+		+ variable_names.capacity() * sizeof(std::string)
+		+ variable_symbols.capacity() * sizeof(SymbolId);
+
+	for (const std::string& name : variable_names) {
+		if (name.capacity() >= sizeof(std::string)) {  // Short names live inside the string object
+			bytes += name.capacity() + 1;
+		}
+	}
+	if (native) {
+		bytes += native->get_code_size();
+	}
+	return bytes;
+}
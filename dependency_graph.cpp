@@ -0,0 +1,256 @@
+#include "Dependency_graph.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+/* same_value: Compares two values bit for bit, so -0 and 0 differ and NaN matches itself */
+static bool same_value(double a, double b) {
+	return std::memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+/* constructor */
+DependencyGraph::DependencyGraph(SymbolTable& symbols) : symbols(symbols), traversal(0), recomputed(0) {}
+
+/* reserve_slots: Keeps every per-slot vector as long as the symbol table */
+void DependencyGraph::reserve_slots() {
+	size_t count = symbols.size();
+
+	if (formulas.size() < count) {
+		formulas.resize(count);
+		dependents.resize(count);
+		changed_flags.resize(count, 0);
+		dirty.resize(count, 0);
+		visited.resize(count, 0);
+	}
+}
+
+/* begin_traversal: Bumps the traversal number instead of clearing the visited marks */
+void DependencyGraph::begin_traversal() {
+	if (++traversal == 0) {  // Wrapped around: old marks could look current
+		std::fill(visited.begin(), visited.end(), 0);
+		traversal = 1;
+	}
+}
+
+/* check_cycle: Searches the inputs, and what they read in turn, for the target itself */
+void DependencyGraph::check_cycle(SymbolId target, const std::vector<SymbolId>& inputs) {
+	begin_traversal();
+	std::vector<std::pair<SymbolId, size_t>> path;  // Current search path with the next input to try at each step
+
+	for (SymbolId input : inputs) {
+		path.assign(1, { input, 0 });
+
+		while (!path.empty()) {
+			SymbolId node = path.back().first;
+
+			if (node == target) {
+				std::string message = "Circular dependency: " + symbols.get_name(target);
+				for (const auto& step : path) {
+					message += " -> " + symbols.get_name(step.first);
+				}
+				throw std::runtime_error(message);
+			}
+
+			const std::vector<SymbolId>& reads = formulas[node].inputs;
+			if (path.back().second == 0) {
+				visited[node] = traversal;
+			}
+
+			if (path.back().second < reads.size()) {
+				SymbolId next = reads[path.back().second++];
+				if (next == target || visited[next] != traversal) {
+					path.push_back({ next, 0 });
+				}
+			}
+			else {
+				path.pop_back();
+			}
+		}
+	}
+}
+
+/* collect_dependents: Depth-first post-order over the dependents, reversed into a topological order */
+void DependencyGraph::collect_dependents(SymbolId source) {
+	begin_traversal();
+	order.clear();
+
+	std::vector<std::pair<SymbolId, size_t>> stack;
+	stack.push_back({ source, 0 });
+	visited[source] = traversal;
+
+	while (!stack.empty()) {
+		SymbolId node = stack.back().first;
+		const std::vector<SymbolId>& readers = dependents[node];
+
+		if (stack.back().second < readers.size()) {
+			SymbolId next = readers[stack.back().second++];
+			if (visited[next] != traversal) {
+				visited[next] = traversal;
+				stack.push_back({ next, 0 });
+			}
+		}
+		else {
+			order.push_back(node);  // Every reader of node is already listed
+			stack.pop_back();
+		}
+	}
+
+	std::reverse(order.begin(), order.end());  // Source first, each slot before its readers
+}
+
+/* mark_changed: Flags a slot for the current update and for take_changed */
+void DependencyGraph::mark_changed(SymbolId id) {
+	dirty[id] = 1;
+
+	if (!changed_flags[id]) {
+		changed_flags[id] = 1;
+		changed.push_back(id);
+	}
+}
+
+/* propagate: Recomputes, in topological order, each dependent that reads a changed value */
+void DependencyGraph::propagate(SymbolId source) {
+	collect_dependents(source);
+
+	for (size_t i = 1; i < order.size(); i++) {  // order[0] is the source itself
+		SymbolId node = order[i];
+		Formula& formula = formulas[node];
+
+		bool stale = false;
+		for (SymbolId input : formula.inputs) {
+			if (dirty[input]) {
+				stale = true;
+				break;
+			}
+		}
+		if (!stale) {  // Nothing it reads has changed, so neither has it
+			continue;
+		}
+
+		recomputed++;
+		bool was_defined = symbols.is_defined(node);
+		double old_value = symbols.get_value(node);
+
+		try {
+			double value = formula.program->evaluate(symbols);
+			formula.error.clear();
+
+			if (!was_defined || !same_value(value, old_value)) {
+				symbols.set_value(node, value);
+				mark_changed(node);
+			}
+		}
+		catch (const std::exception& e) {  // The variable stays in the graph, undefined until its inputs allow it again
+			formula.error = e.what();
+
+			if (was_defined) {
+				symbols.clear_value(node);
+				mark_changed(node);
+			}
+		}
+	}
+
+	for (SymbolId node : order) {
+		dirty[node] = 0;
+	}
+}
+
+/* define: Installs a formula for the target and brings every dependent up to date. A formula that fails is kept
+		  like one that failed during an update: target becomes undefined until a change of its inputs fixes it. */
+Result<double> DependencyGraph::define(SymbolId target, std::shared_ptr<const CompiledExpression> program) {
+	std::vector<SymbolId> inputs;
+	for (const std::string& name : program->get_variable_names()) {
+		inputs.push_back(symbols.intern(name));
+	}
+	reserve_slots();
+
+	check_cycle(target, inputs);
+	Result<double> value = program->try_evaluate(symbols);
+
+	for (SymbolId input : formulas[target].inputs) {
+		std::vector<SymbolId>& readers = dependents[input];
+		readers.erase(std::remove(readers.begin(), readers.end(), target), readers.end());
+	}
+	for (SymbolId input : inputs) {
+		dependents[input].push_back(target);
+	}
+	formulas[target] = { std::move(program), std::move(inputs), value ? std::string() : value.error().message() };
+
+	recomputed = 1;
+	bool was_defined = symbols.is_defined(target);
+	double old_value = symbols.get_value(target);
+
+	if (!value) {
+		if (was_defined) {
+			symbols.clear_value(target);
+			mark_changed(target);
+			propagate(target);
+		}
+	}
+	else if (!was_defined || !same_value(value.value(), old_value)) {
+		symbols.set_value(target, value.value());
+		mark_changed(target);
+		propagate(target);
+	}
+	return value;
+}
+
+/* restore: Rewires target to the formula's inputs like define, but keeps the stored value as it is */
+void DependencyGraph::restore(SymbolId target, std::shared_ptr<const CompiledExpression> program, std::vector<SymbolId> inputs) {
+	reserve_slots();
+
+	for (SymbolId input : formulas[target].inputs) {
+		std::vector<SymbolId>& readers = dependents[input];
+		readers.erase(std::remove(readers.begin(), readers.end(), target), readers.end());
+	}
+	for (SymbolId input : inputs) {
+		dependents[input].push_back(target);
+	}
+	formulas[target] = { std::move(program), std::move(inputs), std::string() };
+}
+
+/* refresh: Treats source as changed and brings its dependents up to date */
+void DependencyGraph::refresh(SymbolId source) {
+	reserve_slots();
+	mark_changed(source);
+	propagate(source);
+}
+
+/* get_formula: Returns the compiled formula of a slot */
+std::shared_ptr<const CompiledExpression> DependencyGraph::get_formula(SymbolId id) const {
+	return id < formulas.size() ? formulas[id].program : nullptr;
+}
+
+/* has_formulas: Looks for any slot holding a formula */
+bool DependencyGraph::has_formulas() const {
+	return std::any_of(formulas.begin(), formulas.end(), [](const Formula& formula) { return formula.program != nullptr; });
+}
+
+/* get_inputs: Returns the variables a slot's formula reads */
+const std::vector<SymbolId>& DependencyGraph::get_inputs(SymbolId id) const {
+	static const std::vector<SymbolId> none;
+	return id < formulas.size() ? formulas[id].inputs : none;
+}
+
+/* get_error: Returns the last evaluation error of a slot */
+const std::string& DependencyGraph::get_error(SymbolId id) const {
+	static const std::string none;
+	return id < formulas.size() ? formulas[id].error : none;
+}
+
+/* get_recomputed: Returns how many formulas the last definition evaluated */
+size_t DependencyGraph::get_recomputed() const {
+	return recomputed;
+}
+
+/* take_changed: Hands out the changed slots and starts a new list */
+std::vector<SymbolId> DependencyGraph::take_changed() {
+	std::vector<SymbolId> result;
+	result.swap(changed);
+
+	for (SymbolId id : result) {
+		changed_flags[id] = 0;
+	}
+	return result;
+}
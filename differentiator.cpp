@@ -0,0 +1,387 @@
+#include "Differentiator.h"
+#include "Compiled_expression.h"
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+static const std::uint32_t NO_ENTRY = 0xFFFFFFFFu;   // Tape position of a missing operand or an unrecorded node
+
+static const char* SQRT_AT_ZERO = "Square root is not differentiable at 0";
+static const char* POWER_AT_ZERO_BASE = "Power is not differentiable at a zero base";
+static const char* POWER_OF_NON_POSITIVE_BASE = "Power with a varying exponent is not differentiable at a non-positive base";
+
+/* is_binary: Checks if a node computes its value from two operands */
+static bool is_binary(TokenType type) {
+	return type == TokenType::Addition || type == TokenType::Subtraction || type == TokenType::Multiplication ||
+		   type == TokenType::Division || type == TokenType::Exponents;
+}
+
+/* check_operands: Rejects malformed operator nodes with the same messages as the Evaluator */
+static void check_operands(const ExpressionNode& node) {
+	bool missing = node.left == NO_NODE || node.right == NO_NODE;
+
+	switch (node.token.getType()) {
+		case TokenType::Addition:
+			if (missing) throw std::runtime_error("Invalid nodes for addition operation");
+			break;
+		case TokenType::Subtraction:
+			if (missing) throw std::runtime_error("Invalid nodes for subtraction operation");
+			break;
+		case TokenType::Multiplication:
+			if (missing) throw std::runtime_error("Invalid nodes for multiplication operation");
+			break;
+		case TokenType::Division:
+			if (missing) throw std::runtime_error("Invalid nodes for division operation");
+			break;
+		case TokenType::IntegerPower:
+			if (node.right == NO_NODE) throw std::runtime_error("Invalid expression tree");
+			break;
+		case TokenType::Equal:
+			throw std::runtime_error("Cannot differentiate an assignment");
+		default:
+			break;
+	}
+}
+
+/* check_divisor: The Evaluator checks the divisor before it evaluates the dividend */
+static void check_divisor(double divisor) {
+	if (divisor == 0) {
+		throw std::runtime_error("Division by zero");
+	}
+}
+
+/* constructor */
+Differentiator::Differentiator(const SymbolTable& symbols) : symbols(symbols), derivative_error(nullptr) {}
+
+/* variable_value: Resolves the slot of a variable leaf like the Evaluator and returns its value */
+double Differentiator::variable_value(const ExpressionNode& node, SymbolId& slot) const {
+	slot = node.token.getSlot() != NO_SYMBOL ? node.token.getSlot() : symbols.find(std::string(node.token.getValue()));
+
+	if (!symbols.is_defined(slot)) {
+		throw std::runtime_error("Variable not defined: " + std::string(node.token.getValue()));
+	}
+	return symbols.get_value(slot);
+}
+
+/* apply: Computes one operation and its derivatives with respect to each operand */
+double Differentiator::apply(const ExpressionTree& tree, const ExpressionNode& node, double left, double right, LocalPartials& partials) {
+	partials = { 0.0, 0.0, nullptr, nullptr };
+
+	switch (node.token.getType()) {
+
+		case TokenType::Addition:
+			partials.left = 1.0;
+			partials.right = 1.0;
+			return left + right;
+
+		case TokenType::Subtraction:
+			partials.left = 1.0;
+			partials.right = -1.0;
+			return left - right;
+
+		case TokenType::Multiplication:
+			partials.left = right;
+			partials.right = left;
+			return left * right;
+
+		case TokenType::Division: {
+			double value = left / right;
+			partials.left = 1.0 / right;
+			partials.right = -value / right;
+			return value;
+		}
+
+		case TokenType::Exponents: {  // d(a^b) = b a^(b-1) da + a^b ln(a) db
+			double value = std::pow(left, right);
+
+			if (left == 0 && right < 1 && right != 0) {
+				partials.left_error = POWER_AT_ZERO_BASE;
+			}
+			else {
+				partials.left = right == 0 ? 0.0 : right * std::pow(left, right - 1);
+			}
+
+			if (left > 0) {
+				partials.right = value * std::log(left);
+			}
+			else if (left == 0 && right > 0) {  // 0^b stays 0 around any positive b
+				partials.right = 0.0;
+			}
+			else {
+				partials.right_error = POWER_OF_NON_POSITIVE_BASE;
+			}
+			return value;
+		}
+
+		case TokenType::Sqrt: {
+			if (left < 0) {  // Ensures the value is a non-negative number
+				throw std::runtime_error("Invalid input for square root");
+			}
+			double value = std::sqrt(left);
+
+			if (value == 0) {
+				partials.left_error = SQRT_AT_ZERO;
+			}
+			else {
+				partials.left = 0.5 / value;
+			}
+			return value;
+		}
+
+		case TokenType::Negation:
+			partials.left = -1.0;
+			return -left;
+
+		case TokenType::IntegerPower: {  // Only produced by the Optimizer; the exponent is a Number node on the right
+			int exponent = static_cast<int>(tree[node.right].token.getNumber());
+
+			if (left == 0 && exponent < 0) {
+				partials.left_error = POWER_AT_ZERO_BASE;
+			}
+			else {
+				partials.left = exponent == 0 ? 0.0 : exponent * power_by_squaring(left, exponent - 1);
+			}
+			return power_by_squaring(left, exponent);
+		}
+
+		default:
+			throw std::runtime_error("Unknown token type in the evaluator");
+	}
+}
+
+/* forward_node: Evaluates the operands on dual numbers, then combines them with the local derivatives.
+				 Pending nodes and operand values live on explicit stacks, not on the call stack. */
+Dual Differentiator::forward_node(const ExpressionTree& tree, NodeIndex root, SymbolId variable) {
+	frames.clear();
+	duals.clear();
+	frames.push_back({ root, 0 });
+
+	while (!frames.empty()) {
+		NodeFrame& frame = frames.back();
+		NodeIndex index = frame.index;
+
+		if (index == NO_NODE) {
+			throw std::runtime_error("Invalid expression tree");
+		}
+
+		const ExpressionNode& node = tree[index];
+		TokenType type = node.token.getType();
+
+		if (type == TokenType::Number) {
+			duals.push_back({ node.token.getNumber(), 0.0 });
+			frames.pop_back();
+			continue;
+		}
+		if (type == TokenType::Variable) {
+			SymbolId slot;
+			double value = variable_value(node, slot);
+			duals.push_back({ value, slot == variable ? 1.0 : 0.0 });
+			frames.pop_back();
+			continue;
+		}
+
+		if (frame.stage == 0) {
+			check_operands(node);
+		}
+		NodeIndex operand;
+		if (next_operand(node, frame.stage, duals.empty() ? 0.0 : duals.back().value, operand)) {
+			frame.stage++;
+			frames.push_back({ operand, 0 });
+			continue;
+		}
+		frames.pop_back();
+
+		Dual left = { 0.0, 0.0 };
+		Dual right = { 0.0, 0.0 };
+
+		if (type == TokenType::Division) {  // The divisor was evaluated first
+			left = duals.back();
+			duals.pop_back();
+			right = duals.back();
+			duals.pop_back();
+		}
+		else {
+			if (is_binary(type)) {
+				right = duals.back();
+				duals.pop_back();
+			}
+			left = duals.back();
+			duals.pop_back();
+		}
+
+		LocalPartials partials;
+		double value = apply(tree, node, left.value, right.value, partials);
+		double derivative = 0.0;
+
+		// Operands that do not change contribute nothing, even where their local derivative is infinite.
+		// A missing derivative is only reported once the whole value is known, so value errors come first.
+		if (left.derivative != 0) {
+			if (partials.left_error && !derivative_error) {
+				derivative_error = partials.left_error;
+			}
+			derivative += partials.left * left.derivative;
+		}
+		if (right.derivative != 0) {
+			if (partials.right_error && !derivative_error) {
+				derivative_error = partials.right_error;
+			}
+			derivative += partials.right * right.derivative;
+		}
+		duals.push_back({ value, derivative });
+	}
+	return duals.back();
+}
+
+/* next_operand: The operand an operator node evaluates after `stage` of them; the divisor comes before the
+				 dividend, and is checked (newest is its value) before the dividend runs */
+bool Differentiator::next_operand(const ExpressionNode& node, std::uint32_t stage, double newest, NodeIndex& operand) {
+	TokenType type = node.token.getType();
+
+	if (type == TokenType::Division) {
+		if (stage == 1) {
+			check_divisor(newest);
+		}
+		operand = stage == 0 ? node.right : node.left;
+		return stage < 2;
+	}
+
+	operand = stage == 0 ? node.left : node.right;
+	return stage < (is_binary(type) ? 2u : 1u);
+}
+
+/* derivative: Forward-mode pass seeded with d(variable) = 1 */
+Dual Differentiator::derivative(const ExpressionTree& tree, NodeIndex root, SymbolId variable) {
+	derivative_error = nullptr;
+	Dual result = forward_node(tree, root, variable);
+
+	if (derivative_error) {
+		throw std::runtime_error(derivative_error);
+	}
+	return result;
+}
+
+/* record_node: Evaluates the operands first, so every entry comes after the entries it reads.
+				Pending nodes and operand positions live on explicit stacks, not on the call stack. */
+std::uint32_t Differentiator::record_node(const ExpressionTree& tree, NodeIndex root) {
+	frames.clear();
+	positions.clear();
+	frames.push_back({ root, 0 });
+
+	while (!frames.empty()) {
+		NodeFrame& frame = frames.back();
+		NodeIndex index = frame.index;
+
+		if (index == NO_NODE) {
+			throw std::runtime_error("Invalid expression tree");
+		}
+		if (recorded[index] != NO_ENTRY) {  // A node shared in a DAG is recorded once and its adjoints add up
+			positions.push_back(recorded[index]);
+			frames.pop_back();
+			continue;
+		}
+
+		const ExpressionNode& node = tree[index];
+		TokenType type = node.token.getType();
+		TapeEntry entry = { NO_ENTRY, NO_ENTRY, NO_SYMBOL, false, { 0.0, 0.0, nullptr, nullptr } };
+		double value;
+
+		if (type == TokenType::Number) {
+			value = node.token.getNumber();
+		}
+		else if (type == TokenType::Variable) {
+			value = variable_value(node, entry.variable);
+			entry.varying = true;
+		}
+		else {
+			if (frame.stage == 0) {
+				check_operands(node);
+			}
+			NodeIndex operand;
+			if (next_operand(node, frame.stage, positions.empty() ? 0.0 : values[positions.back()], operand)) {
+				frame.stage++;
+				frames.push_back({ operand, 0 });
+				continue;
+			}
+
+			if (type == TokenType::Division) {  // The divisor was recorded first
+				entry.left = positions.back();
+				positions.pop_back();
+				entry.right = positions.back();
+				positions.pop_back();
+			}
+			else {
+				if (is_binary(type)) {
+					entry.right = positions.back();
+					positions.pop_back();
+				}
+				entry.left = positions.back();
+				positions.pop_back();
+			}
+
+			double left = values[entry.left];
+			double right = entry.right != NO_ENTRY ? values[entry.right] : 0.0;
+			value = apply(tree, node, left, right, entry.partials);
+			entry.varying = tape[entry.left].varying || (entry.right != NO_ENTRY && tape[entry.right].varying);
+		}
+
+		tape.push_back(entry);
+		values.push_back(value);
+		recorded[index] = static_cast<std::uint32_t>(tape.size() - 1);
+		positions.push_back(recorded[index]);
+		frames.pop_back();
+	}
+	return positions.back();
+}
+
+/* gradient: Records the tape, then propagates adjoints from the result back to the variables */
+Gradient Differentiator::gradient(const ExpressionTree& tree, NodeIndex root) {
+	tape.clear();
+	values.clear();
+	recorded.assign(tree.size(), NO_ENTRY);
+
+	Gradient result;
+	std::uint32_t top = record_node(tree, root);
+	result.value = values[top];
+
+	adjoints.assign(tape.size(), 0.0);
+	adjoints[top] = 1.0;
+
+	for (size_t i = tape.size(); i-- > 0;) {
+		const TapeEntry& entry = tape[i];
+		double adjoint = adjoints[i];
+
+		if (adjoint == 0) {
+			continue;
+		}
+		if (entry.left != NO_ENTRY && tape[entry.left].varying) {  // Constant operands need no adjoint
+			if (entry.partials.left_error) {
+				throw std::runtime_error(entry.partials.left_error);
+			}
+			adjoints[entry.left] += adjoint * entry.partials.left;
+		}
+		if (entry.right != NO_ENTRY && tape[entry.right].varying) {
+			if (entry.partials.right_error) {
+				throw std::runtime_error(entry.partials.right_error);
+			}
+			adjoints[entry.right] += adjoint * entry.partials.right;
+		}
+	}
+
+	// A variable used several times has several leaves; their adjoints add up
+	for (size_t i = 0; i < tape.size(); i++) {
+		if (tape[i].variable == NO_SYMBOL) {
+			continue;
+		}
+
+		size_t position = 0;
+		while (position < result.variables.size() && result.variables[position] != tape[i].variable) {
+			position++;
+		}
+		if (position == result.variables.size()) {
+			result.variables.push_back(tape[i].variable);
+			result.partials.push_back(0.0);
+		}
+		result.partials[position] += adjoints[i];
+	}
+	return result;
+}
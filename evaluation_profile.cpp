@@ -0,0 +1,129 @@
+#include "Evaluation_profile.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+/* constructor */
+EvaluationProfile::EvaluationProfile() : evaluations(0) {}
+
+/* prepare: Grows the per-node records to cover the tree */
+void EvaluationProfile::prepare(size_t node_count) {
+	if (nodes.size() < node_count) {
+		nodes.resize(node_count, NodeProfile{ 0, 0, 0, 0, false });
+	}
+}
+
+/* node: Returns the measurements of one node */
+NodeProfile& EvaluationProfile::node(NodeIndex index) {
+	return nodes[index];
+}
+
+const NodeProfile& EvaluationProfile::node(NodeIndex index) const {
+	return nodes[index];
+}
+
+/* add_evaluation: Counts one more profiled evaluation */
+void EvaluationProfile::add_evaluation() {
+	evaluations++;
+}
+
+/* get_evaluations: Returns the number of profiled evaluations */
+std::uint64_t EvaluationProfile::get_evaluations() const {
+	return evaluations;
+}
+
+/* timer_overhead_ns: The smallest gap between two clock reads, measured once */
+std::uint64_t EvaluationProfile::timer_overhead_ns() {
+	static const std::uint64_t overhead = []() {
+		using clock = std::chrono::steady_clock;
+		std::uint64_t smallest = ~std::uint64_t(0);
+
+		for (int i = 0; i < 1000; i++) {
+			auto first = clock::now();
+			auto second = clock::now();
+			smallest = std::min<std::uint64_t>(smallest, std::chrono::duration_cast<std::chrono::nanoseconds>(second - first).count());
+		}
+		return smallest;
+	}();
+	return overhead;
+}
+
+/* node_label: The token text, or the value of a literal made up by the Optimizer */
+std::string EvaluationProfile::node_label(const ExpressionTree& tree, NodeIndex index) {
+	const Token& token = tree[index].token;
+	std::string label(token.getValue());
+
+	if (label.empty() && token.getType() == TokenType::Number) {
+		char text[32];
+		std::snprintf(text, sizeof(text), "%.17g", token.getNumber());
+		label = text;
+	}
+	return label;
+}
+
+/* format_node: One line for this node, then its children one level deeper */
+void EvaluationProfile::format_node(const ExpressionTree& tree, NodeIndex index, size_t depth, std::uint64_t root_ns, std::vector<bool>& listed, std::string& out) const {
+	const NodeProfile& profile = nodes[index];
+	std::string label = std::string(depth * 2, ' ') + node_label(tree, index);
+
+	// A node with several parents is detailed at its first place only
+	if (listed[index]) {
+		out += label + "  (shared, see above)\n";
+		return;
+	}
+	listed[index] = true;
+
+	double runs = evaluations ? static_cast<double>(evaluations) : 1.0;
+	char line[256];
+	std::snprintf(line, sizeof(line), "%-32s %10.3f %10.3f %10.3f %6.1f%%  %s%s\n", label.c_str(),
+		profile.visits / runs, profile.total_ns / runs / 1e3, profile.self_ns / runs / 1e3,
+		100.0 * profile.self_ns / std::max<std::uint64_t>(root_ns, 1),
+		profile.uses_pow ? "[pow] " : "", profile.memo_hits ? "[shared]" : "");
+	out += line;
+
+	if (tree[index].left != NO_NODE) {
+		format_node(tree, tree[index].left, depth + 1, root_ns, listed, out);
+	}
+	if (tree[index].right != NO_NODE) {
+		format_node(tree, tree[index].right, depth + 1, root_ns, listed, out);
+	}
+}
+
+/* format_tree: Header, then one line per node; the self share is relative to the whole evaluation */
+std::string EvaluationProfile::format_tree(const ExpressionTree& tree, NodeIndex root) const {
+	char line[256];
+	std::snprintf(line, sizeof(line), "%-32s %10s %10s %10s %7s\n", "node", "visits", "total us", "self us", "self");
+	std::string out = line;
+
+	std::vector<bool> listed(tree.size(), false);
+	format_node(tree, root, 0, nodes[root].total_ns, listed, out);
+	return out;
+}
+
+/* fold_node: A stack line for every node that spent time of its own, then its children */
+void EvaluationProfile::fold_node(const ExpressionTree& tree, NodeIndex index, const std::string& stack, std::vector<bool>& listed, std::string& out) const {
+	const NodeProfile& profile = nodes[index];
+	listed[index] = true;
+
+	// Frames carry the node number so that equal labels in different places stay apart
+	std::string frame = node_label(tree, index) + "#" + std::to_string(index);
+	std::string path = stack.empty() ? frame : stack + ";" + frame;
+
+	if (profile.self_ns != 0) {
+		out += path + " " + std::to_string(profile.self_ns) + "\n";
+	}
+
+	for (NodeIndex child : { tree[index].left, tree[index].right }) {
+		if (child != NO_NODE && !listed[child]) {  // Counted once, under its first parent
+			fold_node(tree, child, path, listed, out);
+		}
+	}
+}
+
+/* format_folded: Folded stacks of the whole tree */
+std::string EvaluationProfile::format_folded(const ExpressionTree& tree, NodeIndex root) const {
+	std::string out;
+	std::vector<bool> listed(tree.size(), false);
+	fold_node(tree, root, "", listed, out);
+	return out;
+}
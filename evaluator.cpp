@@ -1,99 +1,376 @@
 #include "Evaluator.h" 
+#include "Compiled_expression.h"
+#include "Evaluation_profile.h"
 #include <stdexcept>
 #include <cmath> 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 
 /* evalute: Evaluates a given expression tree representing a mathematical equation*/
-double Evaluator::evaluate(const ExpressionNodePtr& root) {
+double Evaluator::evaluate(const ExpressionTree& tree, NodeIndex root) {
+	begin_evaluation(tree);
+	double value = run<false>(tree, root);
+	if (failure.get_code() != ErrorCode::None) {
+		failure.raise();
+	}
+	return value;
+}
 
-	
-	if (!root) {  //Checks for a null root node, which indicates an invalid expression
-		throw std::runtime_error("Invalid expression tree");
+/* try_evaluate: Evaluates the tree, returning the first error as a value */
+Result<double> Evaluator::try_evaluate(const ExpressionTree& tree, NodeIndex root) {
+	begin_evaluation(tree);
+	double value = run<false>(tree, root);
+	if (failure.get_code() != ErrorCode::None) {
+		return Result<double>(failure);
 	}
+	return Result<double>(value);
+}
 
-	switch (root->token.getType()) {  //Determine the operation or value represented by the current node
+/* fail: Records why the evaluation stops; run checks for it after every node */
+bool Evaluator::fail(ErrorCode code, std::string_view detail) {
+	failure = Error(code, 0, detail);
+	return false;
+}
 
-		case TokenType::Number: {
-			return std::stod(root->token.getValue()); 
+/* evaluate_profiled: Evaluates the tree through the measuring instantiation of run */
+double Evaluator::evaluate_profiled(const ExpressionTree& tree, NodeIndex root, EvaluationProfile& target) {
+	begin_evaluation(tree);
+	target.prepare(tree.size());
+	target.add_evaluation();
+
+	// Starts from a clean state, even if the previous profiled evaluation threw halfway
+	profile = &target;
+	timers.clear();
+	children_ns = 0;
+	children_timed = 0;
+
+	double value = run<true>(tree, root);
+	if (failure.get_code() != ErrorCode::None) {
+		failure.raise();
+	}
+	return value;
+}
+
+/* begin_evaluation: Sizes the memo for the tree and starts a new evaluation stamp */
+void Evaluator::begin_evaluation(const ExpressionTree& tree) {
+
+	if (memo.size() < tree.size()) {
+		memo.resize(tree.size());
+		memo_stamp.resize(tree.size(), 0);
+	}
+
+	failure = Error();
+	if (++stamp == 0) {  // The stamp wrapped around: forget every remembered value
+		std::fill(memo_stamp.begin(), memo_stamp.end(), 0);
+		stamp = 1;
+	}
+}
+
+/* run: Evaluates the tree in post-order with an explicit stack of nodes, so its depth is only limited by memory.
+		A node stays on the stack while its operands are evaluated; their values wait on the operand stack. */
+template <bool Profiled>
+double Evaluator::run(const ExpressionTree& tree, NodeIndex root) {
+	frames.clear();
+	operands.clear();
+	frames.push_back({ root, 0 });
+
+	while (!frames.empty()) {
+		NodeFrame& frame = frames.back();
+		NodeIndex index = frame.index;
+
+		if (index == NO_NODE) {  //Checks for a missing node, which indicates an invalid expression
+			fail(ErrorCode::InvalidTree);
+			return 0;
 		}
+		const ExpressionNode& node = tree[index];
 
-		case TokenType::Addition: {
-			if (!root->left || !root->right) {
-				throw std::runtime_error("Invalid nodes for addition operation");
+		if (frame.stage == 0) {
+			if (governor) {
+				governor->add_steps(1);
+			}
+			if constexpr (Profiled) {
+				profile->node(index).visits++;
 			}
 
-			return evaluate(root->left) + evaluate(root->right); 
-		}
+			if (node.shared && memo_stamp[index] == stamp) {  // A shared node already computed in this evaluation
+				if constexpr (Profiled) {
+					profile->node(index).memo_hits++;
+				}
+				operands.push_back(memo[index]);
+				frames.pop_back();
+				continue;
+			}
 
-		case TokenType::Subtraction: {
-			if (!root->left || !root->right) {
-				throw std::runtime_error("Invalid nodes for subtraction operation");
+			if constexpr (Profiled) {
+				start_timer(index, node);
 			}
+		}
 
-			return evaluate(root->left) - evaluate(root->right);
+		NodeIndex operand;
+		if (next_operand(tree, node, frame.stage, operand)) {
+			frame.stage++;
+			frames.push_back({ operand, 0 });
+			continue;
+		}
+		if (failure.get_code() != ErrorCode::None) {
+			return 0;
 		}
 
+		double value = compute_node(tree, node);
+		if (failure.get_code() != ErrorCode::None) {
+			return 0;
+		}
+		if (node.shared) {
+			memo[index] = value;
+			memo_stamp[index] = stamp;
+		}
+		if constexpr (Profiled) {
+			stop_timer(index);
+		}
+
+		operands.push_back(value);
+		frames.pop_back();
+	}
+
+	return operands.back();
+}
+
+/* next_operand: Picks the operand to evaluate after `stage` of them are done, checking the node on the way */
+bool Evaluator::next_operand(const ExpressionTree& tree, const ExpressionNode& node, std::uint32_t stage, NodeIndex& operand) {
+
+	switch (node.token.getType()) {
+
+		case TokenType::Number:
+		case TokenType::Variable: {
+			return false;
+		}
+
+		case TokenType::Addition:
+		case TokenType::Subtraction:
 		case TokenType::Multiplication: {
-			if (!root->left || !root->right) {
-				throw std::runtime_error("Invalid nodes for multiplication operation");
+			if (stage == 0 && (node.left == NO_NODE || node.right == NO_NODE)) {
+				const char* name = node.token.getType() == TokenType::Addition ? "addition" :
+					node.token.getType() == TokenType::Subtraction ? "subtraction" : "multiplication";
+				return fail(ErrorCode::InvalidTree, name);
 			}
+			operand = stage == 0 ? node.left : node.right;
+			return stage < 2;
+		}
 
-			return evaluate(root->left) * evaluate(root->right);
+		case TokenType::Division: {  // The divisor comes first, so a zero divisor is reported before the dividend runs
+
+			if (stage == 0 && (node.left == NO_NODE || node.right == NO_NODE)) {
+				return fail(ErrorCode::InvalidTree, "division");
+			}
+
+			if (stage == 1 && operands.back() == 0) {  // Ensures division by zero doesn't occur
+				return fail(ErrorCode::DivisionByZero);
+			}
+
+			operand = stage == 0 ? node.right : node.left;
+			return stage < 2;
 		}
 
-		case TokenType::Division: {
+		case TokenType::Sqrt:
+		case TokenType::Negation: {
+			operand = node.left;
+			return stage == 0;
+		}
+
+		case TokenType::IntegerPower: {  // Only produced by the Optimizer; the exponent is a Number node on the right
 
-			if (!root->left || !root->right) {
-				throw std::runtime_error("Invalid nodes for division operation");
+			if (node.right == NO_NODE) {
+				return fail(ErrorCode::InvalidTree);
 			}
 
-			double divisor = evaluate(root->right);  // Stores the divisor value
+			operand = node.left;
+			return stage == 0;
+		}
+
+		case TokenType::Exponents: {
+			operand = stage == 0 ? node.left : node.right;
+			return stage < 2;
+		}
+
+		case TokenType::Equal: {  // Assignment built by Parser::parse_assignment: evaluates the right-hand side only
 
-			if (divisor == 0) {  // Ensures division by zero doesn't occur
-				throw std::runtime_error("Division by zero");
+			if (node.left == NO_NODE || node.right == NO_NODE || tree[node.left].token.getType() != TokenType::Variable) {
+				return fail(ErrorCode::InvalidAssignment);
 			}
 
-			return evaluate(root->left) / divisor;  // Return the quotient of the left child divided by the right child
+			operand = node.right;
+			return stage == 0;
+		}
+
+		default: {  // Stops at an unexpected token type
+			return fail(ErrorCode::InvalidTree);
+		}
+	}
+}
+
+/* compute_node: Applies the operation of a node to the values of its operands, taken off the operand stack */
+double Evaluator::compute_node(const ExpressionTree& tree, const ExpressionNode& node) {
+
+	switch (node.token.getType()) {  //Determine the operation or value represented by the current node
+
+		case TokenType::Number: {
+			return node.token.getNumber(); 
+		}
+
+		case TokenType::Addition: {
+			double right_value = pop_operand();
+			return pop_operand() + right_value;
+		}
+
+		case TokenType::Subtraction: {
+			double right_value = pop_operand();
+			return pop_operand() - right_value;
+		}
+
+		case TokenType::Multiplication: {
+			double right_value = pop_operand();
+			return pop_operand() * right_value;
+		}
+
+		case TokenType::Division: {
+			double dividend = pop_operand();  // Evaluated after the divisor, so it is on top
+			double divisor = pop_operand();
+			return dividend / divisor;  // Return the quotient of the left child divided by the right child
 		}
 
 		case TokenType::Sqrt: {
 
-			double value = evaluate(root->left); // Stores the value under the square root
+			double value = pop_operand(); // Stores the value under the square root
 
 			if (value < 0) { // Ensures the value is a non-negative number 
-				throw std::runtime_error("Invalid input for square root");
+				fail(ErrorCode::NegativeSqrt);
+				return 0;
 			}
 
 			return std::sqrt(value); 
 		}
 
+		case TokenType::Negation: {
+			return -pop_operand();
+		}
+
+		case TokenType::IntegerPower: {
+			int exponent = static_cast<int>(tree[node.right].token.getNumber());
+			return power_by_squaring(pop_operand(), exponent);
+		}
+
 		case TokenType::Exponents: {
 
-			double left_value = evaluate(root->left);  // Stores the base of the exponent
-			double right_value = evaluate(root->right);  // Stores the exponent value
+			double right_value = pop_operand();  // Stores the exponent value
+			double left_value = pop_operand();  // Stores the base of the exponent
 
 			return std::pow(left_value, right_value); 
 		}
 
+		case TokenType::Equal: {  // Stores and yields the right-hand side
+			double value = pop_operand();
+			symbols.set_value(symbols.intern(tree[node.left].token.getValue()), value);
+			return value;
+		}
+
 		case TokenType::Variable: {
 			
-			if (variables.find(root->token.getValue()) != variables.end()) {  // Checks if the variable has a defined value in our map
-				return variables[root->token.getValue()]; 
+			SymbolId slot = resolve_slot(node.token);
+			if (symbols.is_defined(slot)) {  // Checks if the variable has been assigned a value
+				return symbols.get_value(slot); 
 			}
 			else {
-				throw std::runtime_error("Variable not defined: " + root->token.getValue());  // If not defined throws error
+				fail(ErrorCode::UndefinedVariable, node.token.getValue());  // If not defined, the evaluation stops
+				return 0;
 			}
 		}
 
-		default: {  // Throws error if it encounters an unexpected token type
-			throw std::runtime_error("Unknown token type in the evaluator");
+		default: {  // Rejected by next_operand before any operand runs
+			fail(ErrorCode::InvalidTree);
+			return 0;
 		}
 	}
+}
 
-	return 0.0; 
+/* pop_operand: Takes the newest operand value off the operand stack */
+double Evaluator::pop_operand() {
+	double value = operands.back();
+	operands.pop_back();
+	return value;
 }
 
-/* setVariable: Sets (or updates) the value of the variable in the map*/
+/* start_timer: Starts measuring a node, giving its operands fresh accumulators */
+void Evaluator::start_timer(NodeIndex index, const ExpressionNode& node) {
+	ProfileTimer timer;
+	timer.children_ns = children_ns;
+	timer.children_timed = children_timed;
+	children_ns = 0;
+	children_timed = 0;
+
+	profile->node(index).uses_pow = node.token.getType() == TokenType::Exponents;
+	timer.start = std::chrono::steady_clock::now();
+	timers.push_back(timer);
+}
+
+/* stop_timer: Adds the node's time to the profile, less the clock reads made while it ran, then restores its parent's accumulators */
+void Evaluator::stop_timer(NodeIndex index) {
+	std::uint64_t raw = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - timers.back().start).count();
+	NodeProfile& record = profile->node(index);
+
+	// Every node timed underneath read the clock twice inside this interval, and this node once
+	std::uint64_t overhead = EvaluationProfile::timer_overhead_ns() * (1 + 2 * children_timed);
+	std::uint64_t total = raw > overhead ? raw - overhead : 0;
+	record.total_ns += total;
+	record.self_ns += total > children_ns ? total - children_ns : 0;
+
+	std::uint64_t timed_below = children_timed;
+	children_ns = timers.back().children_ns + total;
+	children_timed = timers.back().children_timed + timed_below + 1;
+	timers.pop_back();
+}
+
+/* evaluate_batch: Compiles the expression once and evaluates it over every row of the given columns */
+size_t Evaluator::evaluate_batch(const ExpressionTree& tree, NodeIndex root,
+	const std::unordered_map<std::string, const double*>& columns,
+	size_t rows, double* output, RowStatus* status) {
+
+	CompiledExpression program(tree, root);
+
+	std::vector<BatchColumn> inputs;
+	for (const std::string& name : program.get_variable_names()) {
+		auto column = columns.find(name);
+		SymbolId slot = symbols.find(name);
+
+		if (column != columns.end()) {
+			inputs.push_back({ column->second, 0.0 });
+		}
+		else if (symbols.is_defined(slot)) {  // Falls back to the session value for every row
+			inputs.push_back({ nullptr, symbols.get_value(slot) });
+		}
+		else {
+			throw std::runtime_error("Variable not defined: " + name);
+		}
+	}
+
+	BatchEvaluator batch(program);
+	return batch.evaluate(inputs, rows, output, status);
+}
+
+/* set_governor: Counts the nodes visited from now on against the budget of the line */
+void Evaluator::set_governor(ResourceGovernor* governor) {
+	this->governor = governor;
+}
+
+/* setVariable: Sets (or updates) the value of the variable in the symbol table*/
 void Evaluator::setVariable(const std::string& name, double value) {
-	variables[name] = value; 
+	symbols.set_value(symbols.intern(name), value); 
+}
+
+/* resolve_slot: Uses the slot assigned at tokenize time, falling back to a lookup by name */
+SymbolId Evaluator::resolve_slot(const Token& token) const {
+	if (token.getSlot() != NO_SYMBOL) {
+		return token.getSlot();
+	}
+	return symbols.find(token.getValue());
 }
\ No newline at end of file
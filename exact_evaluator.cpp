@@ -0,0 +1,162 @@
+#include "Exact_evaluator.h"
+#include <stdexcept>
+#include <string>
+
+/* constructor */
+ExactEvaluator::ExactEvaluator(const SymbolTable& symbols, const ExactVariables& variables, const ExactOptions& options)
+	: symbols(symbols), variables(variables), options(options) {}
+
+/* evaluate: Post-order walk with an explicit stack of nodes; operand values wait on the operand stack */
+ExactNumber ExactEvaluator::evaluate(const ExpressionTree& tree, NodeIndex root) {
+	frames.clear();
+	operands.clear();
+	frames.push_back({ root, 0 });
+
+	while (!frames.empty()) {
+		NodeFrame& frame = frames.back();
+		if (frame.index == NO_NODE) {
+			throw std::runtime_error("Invalid expression tree");
+		}
+		const ExpressionNode& node = tree[frame.index];
+
+		NodeIndex operand;
+		if (next_operand(node, frame.stage, operand)) {
+			frame.stage++;
+			frames.push_back({ operand, 0 });
+			continue;
+		}
+
+		ExactNumber value = compute_node(node);
+		operands.push_back(std::move(value));
+		frames.pop_back();
+	}
+
+	return pop_operand();
+}
+
+/* next_operand: Picks the operand to evaluate after `stage` of them are done, checking the node on the way */
+bool ExactEvaluator::next_operand(const ExpressionNode& node, std::uint32_t stage, NodeIndex& operand) {
+
+	switch (node.token.getType()) {
+
+		case TokenType::Number:
+		case TokenType::Variable: {
+			return false;
+		}
+
+		case TokenType::Addition:
+		case TokenType::Subtraction:
+		case TokenType::Multiplication: {
+			if (stage == 0 && (node.left == NO_NODE || node.right == NO_NODE)) {
+				const char* name = node.token.getType() == TokenType::Addition ? "addition" :
+					node.token.getType() == TokenType::Subtraction ? "subtraction" : "multiplication";
+				throw std::runtime_error(std::string("Invalid nodes for ") + name + " operation");
+			}
+			operand = stage == 0 ? node.left : node.right;
+			return stage < 2;
+		}
+
+		case TokenType::Division: {  // The divisor comes first, as in the Evaluator
+
+			if (stage == 0 && (node.left == NO_NODE || node.right == NO_NODE)) {
+				throw std::runtime_error("Invalid nodes for division operation");
+			}
+
+			if (stage == 1 && operands.back().sign() == 0 && operands.back().to_double() == 0) {
+				throw std::runtime_error("Division by zero");
+			}
+
+			operand = stage == 0 ? node.right : node.left;
+			return stage < 2;
+		}
+
+		case TokenType::Sqrt:
+		case TokenType::Negation: {
+			operand = node.left;
+			return stage == 0;
+		}
+
+		case TokenType::Exponents:
+		case TokenType::IntegerPower: {  // The exponent of an IntegerPower is a Number node, evaluated like any operand
+			operand = stage == 0 ? node.left : node.right;
+			return stage < 2;
+		}
+
+		default: {
+			throw std::runtime_error("Unknown token type in the evaluator");
+		}
+	}
+}
+
+/* compute_node: Applies the operation of a node to the values of its operands, taken off the operand stack */
+ExactNumber ExactEvaluator::compute_node(const ExpressionNode& node) {
+
+	switch (node.token.getType()) {
+
+		case TokenType::Number: {  // Literals made up by the Optimizer have no text: their double is taken exactly
+			std::string_view text = node.token.getValue();
+			return text.empty() ? ExactNumber::from_double(node.token.getNumber()) : ExactNumber::from_decimal(text);
+		}
+
+		case TokenType::Variable: {
+			return variable_value(node.token);
+		}
+
+		case TokenType::Addition: {
+			ExactNumber right_value = pop_operand();
+			return ExactNumber::add(pop_operand(), right_value);
+		}
+
+		case TokenType::Subtraction: {
+			ExactNumber right_value = pop_operand();
+			return ExactNumber::subtract(pop_operand(), right_value);
+		}
+
+		case TokenType::Multiplication: {
+			ExactNumber right_value = pop_operand();
+			return ExactNumber::multiply(pop_operand(), right_value);
+		}
+
+		case TokenType::Division: {
+			ExactNumber dividend = pop_operand();  // Evaluated after the divisor, so it is on top
+			ExactNumber divisor = pop_operand();
+			return ExactNumber::divide(dividend, divisor);
+		}
+
+		case TokenType::Sqrt: {
+			return ExactNumber::sqrt(pop_operand(), options);
+		}
+
+		case TokenType::Negation: {
+			return ExactNumber::negate(pop_operand());
+		}
+
+		default: {  // Exponents and IntegerPower
+			ExactNumber exponent = pop_operand();
+			return ExactNumber::power(pop_operand(), exponent, options);
+		}
+	}
+}
+
+/* pop_operand: Takes the newest operand value off the operand stack */
+ExactNumber ExactEvaluator::pop_operand() {
+	ExactNumber value = std::move(operands.back());
+	operands.pop_back();
+	return value;
+}
+
+/* variable_value: The exact value kept for the slot while it is current, otherwise the exact value of its double */
+ExactNumber ExactEvaluator::variable_value(const Token& token) const {
+	SymbolId slot = token.getSlot() != NO_SYMBOL ? token.getSlot() : symbols.find(token.getValue());
+
+	if (!symbols.is_defined(slot)) {
+		throw std::runtime_error("Variable not defined: " + std::string(token.getValue()));
+	}
+
+	double value = symbols.get_value(slot);
+	auto exact = variables.find(slot);
+	if (exact != variables.end() && exact->second.stored == value) {
+		return exact->second.value;
+	}
+	return ExactNumber::from_double(value);
+}
@@ -0,0 +1,544 @@
+#include "Exact_number.h"
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <climits>
+#include <cmath>
+#include <stdexcept>
+
+const std::int64_t SMALL_DOUBLE_LIMIT = std::int64_t(1) << 53;   // Integers below this convert to double exactly.
+const std::int64_t MAX_DECIMAL_EXPONENT = 100000;                // Largest exponent a literal may carry.
+
+/* checked_add: a + b, or false when the sum leaves [-INT64_MAX, INT64_MAX] */
+static bool checked_add(std::int64_t a, std::int64_t b, std::int64_t& result) {
+#if defined(__GNUC__) || defined(__clang__)
+	if (__builtin_add_overflow(a, b, &result)) return false;
+#else
+	if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b)) return false;
+	result = a + b;
+#endif
+	return result != INT64_MIN;
+}
+
+/* checked_multiply: a * b, or false when the product leaves [-INT64_MAX, INT64_MAX]; neither operand may be INT64_MIN */
+static bool checked_multiply(std::int64_t a, std::int64_t b, std::int64_t& result) {
+#if defined(__GNUC__) || defined(__clang__)
+	if (__builtin_mul_overflow(a, b, &result)) return false;
+#else
+	if (a != 0 && b != 0 && (a < 0 ? -a : a) > INT64_MAX / (b < 0 ? -b : b)) return false;
+	result = a * b;
+#endif
+	return result != INT64_MIN;
+}
+
+/* checked_power: base^exponent by repeated squaring, or false as soon as a step overflows */
+static bool checked_power(std::int64_t base, std::uint64_t exponent, std::int64_t& result) {
+	result = 1;
+	while (exponent != 0) {
+		if ((exponent & 1) && !checked_multiply(result, base, result)) return false;
+		exponent >>= 1;
+		if (exponent != 0 && !checked_multiply(base, base, base)) return false;
+	}
+	return true;
+}
+
+/* gcd64: Euclid's algorithm on magnitudes */
+static std::int64_t gcd64(std::int64_t a, std::int64_t b) {
+	a = a < 0 ? -a : a;
+	b = b < 0 ? -b : b;
+	while (b != 0) {
+		std::int64_t rest = a % b;
+		a = b;
+		b = rest;
+	}
+	return a;
+}
+
+/* sqrt64: The integer square root of a non-negative value, corrected after the double estimate */
+static std::int64_t sqrt64(std::int64_t value) {
+	std::uint64_t root = static_cast<std::uint64_t>(std::sqrt(static_cast<double>(value)));
+	while (root * root > static_cast<std::uint64_t>(value)) root--;
+	while ((root + 1) * (root + 1) <= static_cast<std::uint64_t>(value)) root++;
+	return static_cast<std::int64_t>(root);
+}
+
+/* is_one: Reports whether a BigInteger is 1, the usual denominator */
+static bool is_one(const BigInteger& value) {
+	return value.fits_int64() && value.to_int64() == 1;
+}
+
+/* common_factor: gcd(a, b), skipping the division when either side is 1 */
+static BigInteger common_factor(const BigInteger& a, const BigInteger& b) {
+	if (is_one(a) || is_one(b)) {
+		return BigInteger(1);
+	}
+	return BigInteger::gcd(a, b);
+}
+
+/* format_double: The shortest text that reads back as the same double */
+static std::string format_double(double value) {
+	char text[32];
+	auto result = std::to_chars(text, text + sizeof(text), value);
+	return std::string(text, result.ptr);
+}
+
+/* constructor */
+ExactNumber::ExactNumber() : kind(Kind::Small), exact(true), numerator(0), denominator(1), approximation(0) {}
+
+/* small_fraction: Moves the sign to the numerator and divides out the common factor */
+ExactNumber ExactNumber::small_fraction(std::int64_t numerator, std::int64_t denominator, bool exact) {
+	if (denominator < 0) {
+		numerator = -numerator;
+		denominator = -denominator;
+	}
+
+	ExactNumber result;
+	std::int64_t factor = denominator == 1 ? 1 : gcd64(numerator, denominator);
+	result.numerator = numerator / factor;
+	result.denominator = denominator / factor;
+	result.exact = exact;
+	return result;
+}
+
+/* big_fraction: Moves the sign to the numerator, divides out the common factor and picks the smallest form */
+ExactNumber ExactNumber::big_fraction(BigInteger numerator, BigInteger denominator, bool exact) {
+	if (denominator.is_zero()) {
+		throw std::runtime_error("Division by zero");
+	}
+	if (denominator.is_negative()) {
+		numerator = -numerator;
+		denominator = -denominator;
+	}
+
+	BigInteger factor = common_factor(numerator, denominator);
+	if (!is_one(factor) && !factor.is_zero()) {
+		numerator = numerator / factor;
+		denominator = denominator / factor;
+	}
+
+	ExactNumber result;
+	result.exact = exact;
+	if (numerator.fits_int64() && denominator.fits_int64()) {
+		result.numerator = numerator.to_int64();
+		result.denominator = denominator.to_int64();
+		return result;
+	}
+	result.kind = Kind::Big;
+	result.big_numerator = std::move(numerator);
+	result.big_denominator = std::move(denominator);
+	return result;
+}
+
+/* get_numerator: The numerator as a BigInteger */
+BigInteger ExactNumber::get_numerator() const {
+	return kind == Kind::Big ? big_numerator : BigInteger(numerator);
+}
+
+/* get_denominator: The denominator as a BigInteger */
+BigInteger ExactNumber::get_denominator() const {
+	return kind == Kind::Big ? big_denominator : BigInteger(denominator);
+}
+
+/* integer: An exact integer */
+ExactNumber ExactNumber::integer(std::int64_t value) {
+	if (value == INT64_MIN) {  // Kept out of the small form, where negating it would overflow
+		return big_fraction(BigInteger(value), BigInteger(1), true);
+	}
+	return small_fraction(value, 1, true);
+}
+
+/* fraction: An exact fraction in lowest terms */
+ExactNumber ExactNumber::fraction(const BigInteger& numerator, const BigInteger& denominator) {
+	return big_fraction(numerator, denominator, true);
+}
+
+/* from_decimal: Collects the digits without the point, then scales them by the power of ten the point and the exponent give */
+ExactNumber ExactNumber::from_decimal(std::string_view text) {
+	size_t position = 0;
+	bool is_negative = !text.empty() && text[0] == '-';
+	if (is_negative) {
+		position++;
+	}
+
+	std::string digits;
+	std::int64_t places = 0;
+	bool point = false;
+	for (; position < text.size(); position++) {
+		char c = text[position];
+		if (c >= '0' && c <= '9') {
+			if (!digits.empty() || c != '0') {
+				digits += c;
+			}
+			places += point ? 1 : 0;
+		}
+		else if (c == '.' && !point) {
+			point = true;
+		}
+		else {
+			break;
+		}
+	}
+	bool any_digit = position > (is_negative ? 1u : 0u) + (point ? 1u : 0u);
+
+	std::int64_t exponent = 0;
+	if (any_digit && position < text.size() && (text[position] == 'e' || text[position] == 'E')) {
+		position++;
+		bool negative_exponent = position < text.size() && text[position] == '-';
+		if (position < text.size() && (text[position] == '-' || text[position] == '+')) {
+			position++;
+		}
+		size_t start = position;
+		for (; position < text.size() && text[position] >= '0' && text[position] <= '9'; position++) {
+			exponent = std::min(exponent * 10 + (text[position] - '0'), MAX_DECIMAL_EXPONENT + 1);
+		}
+		if (position == start) {
+			any_digit = false;
+		}
+		exponent = negative_exponent ? -exponent : exponent;
+	}
+
+	if (!any_digit || position != text.size()) {
+		throw std::runtime_error("Invalid number: " + std::string(text));
+	}
+	if (exponent > MAX_DECIMAL_EXPONENT || exponent < -MAX_DECIMAL_EXPONENT) {
+		throw std::runtime_error("Number out of range: " + std::string(text));
+	}
+	if (digits.empty()) {
+		return ExactNumber();
+	}
+
+	// value = digits * 10^scale
+	std::int64_t scale = exponent - places;
+	if (digits.size() + static_cast<size_t>(std::max<std::int64_t>(scale, 0)) <= 18 && scale >= -18) {
+		std::int64_t value = 0;
+		std::int64_t power = 1;
+		for (char c : digits) value = value * 10 + (c - '0');
+		for (std::int64_t i = 0; i < (scale < 0 ? -scale : scale); i++) power *= 10;
+		value = is_negative ? -value : value;
+		return scale >= 0 ? small_fraction(value * power, 1, true) : small_fraction(value, power, true);
+	}
+
+	BigInteger value = BigInteger::parse(digits);
+	value = is_negative ? -value : value;
+	BigInteger power = BigInteger::power(BigInteger(10), static_cast<std::uint64_t>(scale < 0 ? -scale : scale));
+	return scale >= 0 ? big_fraction(value * power, BigInteger(1), true) : big_fraction(value, power, true);
+}
+
+/* from_double: Splits the double into a 53-bit integer and a power of two */
+ExactNumber ExactNumber::from_double(double value) {
+	if (!std::isfinite(value)) {
+		return approximate(value);
+	}
+	if (value == 0) {
+		return ExactNumber();
+	}
+
+	int exponent = 0;
+	std::int64_t mantissa = static_cast<std::int64_t>(std::ldexp(std::frexp(value, &exponent), 53));
+	exponent -= 53;
+
+	if (exponent >= 0) {
+		return big_fraction(BigInteger(mantissa).shifted_left(exponent), BigInteger(1), true);
+	}
+	int common = std::min(std::countr_zero(static_cast<std::uint64_t>(mantissa < 0 ? -mantissa : mantissa)), -exponent);
+	mantissa >>= common;
+	exponent += common;
+	if (-exponent <= 62) {
+		return small_fraction(mantissa, std::int64_t(1) << -exponent, true);
+	}
+	return big_fraction(BigInteger(mantissa), BigInteger(1).shifted_left(-exponent), true);
+}
+
+/* approximate: A double */
+ExactNumber ExactNumber::approximate(double value) {
+	ExactNumber result;
+	result.kind = Kind::Double;
+	result.exact = false;
+	result.approximation = value;
+	return result;
+}
+
+/* is_exact: Reports whether no approximation went into the value */
+bool ExactNumber::is_exact() const {
+	return exact;
+}
+
+/* is_rational: Reports whether the value is a fraction */
+bool ExactNumber::is_rational() const {
+	return kind != Kind::Double;
+}
+
+/* is_integer: Reports whether the value is a fraction with denominator 1 */
+bool ExactNumber::is_integer() const {
+	switch (kind) {
+		case Kind::Small: return denominator == 1;
+		case Kind::Big: return is_one(big_denominator);
+		default: return false;
+	}
+}
+
+/* sign: -1, 0 or 1 */
+int ExactNumber::sign() const {
+	switch (kind) {
+		case Kind::Small: return (numerator > 0) - (numerator < 0);
+		case Kind::Big: return big_numerator.sign();
+		default: return (approximation > 0) - (approximation < 0);
+	}
+}
+
+/* to_double: Divides directly when both parts convert exactly, otherwise takes a 64-bit quotient and scales it */
+double ExactNumber::to_double() const {
+	if (kind == Kind::Double) {
+		return approximation;
+	}
+	if (kind == Kind::Small && numerator < SMALL_DOUBLE_LIMIT && numerator > -SMALL_DOUBLE_LIMIT && denominator < SMALL_DOUBLE_LIMIT) {
+		return static_cast<double>(numerator) / static_cast<double>(denominator);
+	}
+
+	BigInteger top = get_numerator();
+	BigInteger bottom = get_denominator();
+	if (is_one(bottom)) {
+		return top.to_double();
+	}
+
+	// Shifts so the quotient has about 64 bits, enough for every bit of the double
+	long long shift = 64 + static_cast<long long>(bottom.bit_length()) - static_cast<long long>(top.bit_length());
+	BigInteger quotient = shift >= 0 ? top.shifted_left(static_cast<size_t>(shift)) / bottom : top / bottom.shifted_left(static_cast<size_t>(-shift));
+	return std::ldexp(quotient.to_double(), static_cast<int>(std::clamp<long long>(-shift, INT_MIN / 2, INT_MAX / 2)));
+}
+
+/* terminating_places: A fraction ends in decimal exactly when its denominator is 2^a * 5^b, after max(a, b) places */
+bool ExactNumber::terminating_places(size_t& places) const {
+	if (kind == Kind::Small) {
+		std::int64_t rest = denominator;
+		size_t twos = std::countr_zero(static_cast<std::uint64_t>(rest));
+		size_t fives = 0;
+		rest >>= twos;
+		for (; rest % 5 == 0; fives++) rest /= 5;
+		places = std::max(twos, fives);
+		return rest == 1;
+	}
+
+	size_t twos = big_denominator.trailing_zero_bits();
+	BigInteger rest = big_denominator.shifted_right(twos);
+	size_t fives = 0;
+	while (!is_one(rest)) {
+		BigInteger next = rest;
+		if (next.divide_small(5) != 0) {
+			return false;
+		}
+		rest = std::move(next);
+		fives++;
+	}
+	places = std::max(twos, fives);
+	return true;
+}
+
+/* format_decimal: Scales the fraction by 10^places, truncates and puts the point back */
+std::string ExactNumber::format_decimal(size_t places) const {
+	BigInteger scaled = get_numerator().abs() * BigInteger::power(BigInteger(10), places) / get_denominator();
+	std::string digits = scaled.to_string();
+	if (digits.size() <= places) {
+		digits.insert(0, places + 1 - digits.size(), '0');
+	}
+	if (places > 0) {
+		digits.insert(digits.size() - places, 1, '.');
+	}
+	return (sign() < 0 && !scaled.is_zero() ? "-" : "") + digits;
+}
+
+/* to_string: Picks the shortest faithful form of the value */
+std::string ExactNumber::to_string(size_t places) const {
+	if (kind == Kind::Double) {
+		return format_double(approximation);
+	}
+	if (is_integer()) {
+		return get_numerator().to_string();
+	}
+
+	size_t needed = 0;
+	bool terminates = terminating_places(needed);
+	if (exact) {
+		return terminates ? format_decimal(needed) : get_numerator().to_string() + "/" + get_denominator().to_string();
+	}
+	if (places == 0) {
+		return format_double(to_double());
+	}
+	return format_decimal(terminates ? std::min(needed, places) : places);
+}
+
+/* negate: The value with its sign flipped */
+ExactNumber ExactNumber::negate(const ExactNumber& value) {
+	ExactNumber result = value;
+	switch (value.kind) {
+		case Kind::Small: result.numerator = -value.numerator; break;
+		case Kind::Big: result.big_numerator = -value.big_numerator; break;
+		default: result.approximation = -value.approximation; break;
+	}
+	return result;
+}
+
+/* add: a/b + c/d over the least common denominator in 64 bits, otherwise over b*d with BigIntegers */
+ExactNumber ExactNumber::add(const ExactNumber& a, const ExactNumber& b) {
+	if (a.kind == Kind::Double || b.kind == Kind::Double) {
+		return approximate(a.to_double() + b.to_double());
+	}
+	bool is_exact = a.exact && b.exact;
+
+	if (a.kind == Kind::Small && b.kind == Kind::Small) {
+		std::int64_t sum;
+		if (a.denominator == 1 && b.denominator == 1) {
+			if (checked_add(a.numerator, b.numerator, sum)) {
+				return small_fraction(sum, 1, is_exact);
+			}
+		}
+		else {
+			std::int64_t factor = gcd64(a.denominator, b.denominator);
+			std::int64_t left, right, common;
+			if (checked_multiply(a.numerator, b.denominator / factor, left) && checked_multiply(b.numerator, a.denominator / factor, right) &&
+				checked_add(left, right, sum) && checked_multiply(a.denominator / factor, b.denominator, common)) {
+				return small_fraction(sum, common, is_exact);
+			}
+		}
+	}
+
+	if (a.is_integer() && b.is_integer()) {
+		return big_fraction(a.get_numerator() + b.get_numerator(), BigInteger(1), is_exact);
+	}
+	BigInteger a_denominator = a.get_denominator();
+	BigInteger b_denominator = b.get_denominator();
+	return big_fraction(a.get_numerator() * b_denominator + b.get_numerator() * a_denominator, a_denominator * b_denominator, is_exact);
+}
+
+/* subtract: a + (-b) */
+ExactNumber ExactNumber::subtract(const ExactNumber& a, const ExactNumber& b) {
+	return add(a, negate(b));
+}
+
+/* multiply: Cancels across (a/b)(c/d) first, so the product is already in lowest terms */
+ExactNumber ExactNumber::multiply(const ExactNumber& a, const ExactNumber& b) {
+	if (a.kind == Kind::Double || b.kind == Kind::Double) {
+		return approximate(a.to_double() * b.to_double());
+	}
+	bool is_exact = a.exact && b.exact;
+
+	if (a.kind == Kind::Small && b.kind == Kind::Small) {
+		std::int64_t left_factor = gcd64(a.numerator, b.denominator);
+		std::int64_t right_factor = gcd64(b.numerator, a.denominator);
+		left_factor = left_factor ? left_factor : 1;
+		right_factor = right_factor ? right_factor : 1;
+
+		std::int64_t top, bottom;
+		if (checked_multiply(a.numerator / left_factor, b.numerator / right_factor, top) &&
+			checked_multiply(a.denominator / right_factor, b.denominator / left_factor, bottom)) {
+			return small_fraction(top, bottom, is_exact);
+		}
+	}
+
+	if (a.is_integer() && b.is_integer()) {
+		return big_fraction(a.get_numerator() * b.get_numerator(), BigInteger(1), is_exact);
+	}
+	BigInteger a_numerator = a.get_numerator();
+	BigInteger b_numerator = b.get_numerator();
+	BigInteger a_denominator = a.get_denominator();
+	BigInteger b_denominator = b.get_denominator();
+	BigInteger left_factor = common_factor(a_numerator, b_denominator);
+	BigInteger right_factor = common_factor(b_numerator, a_denominator);
+	if (!left_factor.is_zero() && !is_one(left_factor)) {
+		a_numerator = a_numerator / left_factor;
+		b_denominator = b_denominator / left_factor;
+	}
+	if (!right_factor.is_zero() && !is_one(right_factor)) {
+		b_numerator = b_numerator / right_factor;
+		a_denominator = a_denominator / right_factor;
+	}
+	return big_fraction(a_numerator * b_numerator, a_denominator * b_denominator, is_exact);
+}
+
+/* divide: a times the reciprocal of b */
+ExactNumber ExactNumber::divide(const ExactNumber& a, const ExactNumber& b) {
+	if (b.sign() == 0 && (b.kind != Kind::Double || b.approximation == 0)) {
+		throw std::runtime_error("Division by zero");
+	}
+	if (a.kind == Kind::Double || b.kind == Kind::Double) {
+		return approximate(a.to_double() / b.to_double());
+	}
+
+	ExactNumber reciprocal = b.kind == Kind::Small ? small_fraction(b.denominator, b.numerator, b.exact)
+		: big_fraction(b.big_denominator, b.big_numerator, b.exact);
+	return multiply(a, reciprocal);
+}
+
+/* power: Raises numerator and denominator separately, which keeps the fraction in lowest terms */
+ExactNumber ExactNumber::power(const ExactNumber& base, const ExactNumber& exponent, const ExactOptions& options) {
+	if (base.kind == Kind::Double || !exponent.is_integer()) {
+		return approximate(std::pow(base.to_double(), exponent.to_double()));
+	}
+	bool is_exact = base.exact && exponent.exact;
+	BigInteger count = exponent.get_numerator();
+
+	if (count.is_zero()) {
+		return small_fraction(1, 1, is_exact);
+	}
+	if (base.sign() == 0) {  // 0 to a negative power has no exact value; the double gives infinity
+		return count.is_negative() ? approximate(std::pow(0.0, exponent.to_double())) : small_fraction(0, 1, is_exact);
+	}
+	if (base.is_integer() && base.get_numerator().abs().bit_length() == 1) {  // 1 and -1 stay small for any exponent
+		bool odd = count.trailing_zero_bits() == 0;
+		return small_fraction(base.sign() < 0 && odd ? -1 : 1, 1, is_exact);
+	}
+
+	// Refuses results larger than max_bits before spending the time to compute them
+	size_t bits = std::max(base.get_numerator().bit_length(), base.get_denominator().bit_length());
+	std::uint64_t times = count.fits_int64() ? static_cast<std::uint64_t>(count.abs().to_int64()) : ~std::uint64_t(0);
+	if (!count.fits_int64() || times > options.max_bits / bits) {
+		return approximate(std::pow(base.to_double(), exponent.to_double()));
+	}
+
+	if (base.kind == Kind::Small) {
+		std::int64_t top, bottom;
+		if (checked_power(base.numerator, times, top) && checked_power(base.denominator, times, bottom)) {
+			return count.is_negative() ? small_fraction(bottom, top, is_exact) : small_fraction(top, bottom, is_exact);
+		}
+	}
+
+	BigInteger top = BigInteger::power(base.get_numerator(), times);
+	BigInteger bottom = BigInteger::power(base.get_denominator(), times);
+	if (count.is_negative()) {
+		std::swap(top, bottom);
+	}
+	return big_fraction(std::move(top), std::move(bottom), is_exact);
+}
+
+/* sqrt: Exact when both parts are perfect squares, otherwise a double or sqrt(p q 10^2k) / (q 10^k) cut to k places */
+ExactNumber ExactNumber::sqrt(const ExactNumber& value, const ExactOptions& options) {
+	if (value.sign() < 0) {
+		throw std::runtime_error("Invalid input for square root");
+	}
+	if (value.kind == Kind::Double) {
+		return approximate(std::sqrt(value.approximation));
+	}
+
+	if (value.kind == Kind::Small) {
+		std::int64_t top = sqrt64(value.numerator);
+		std::int64_t bottom = sqrt64(value.denominator);
+		if (top * top == value.numerator && bottom * bottom == value.denominator) {
+			return small_fraction(top, bottom, value.exact);
+		}
+	}
+	else {
+		BigInteger top = BigInteger::sqrt(value.big_numerator);
+		BigInteger bottom = BigInteger::sqrt(value.big_denominator);
+		if (top * top == value.big_numerator && bottom * bottom == value.big_denominator) {
+			return big_fraction(std::move(top), std::move(bottom), value.exact);
+		}
+	}
+
+	if (options.precision == 0) {
+		return approximate(std::sqrt(value.to_double()));
+	}
+	BigInteger scale = BigInteger::power(BigInteger(10), options.precision);
+	BigInteger bottom = value.get_denominator();
+	BigInteger root = BigInteger::sqrt(value.get_numerator() * bottom * scale * scale);
+	return big_fraction(std::move(root), bottom * scale, false);
+}
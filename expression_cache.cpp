@@ -0,0 +1,162 @@
+#include "Expression_cache.h"
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <mutex>
+#include <tuple>
+
+/* Rough bookkeeping cost of an entry beyond its key and program (map node, bucket slot, control block) */
+static const size_t ENTRY_OVERHEAD = 128;
+
+/* is_word_char: Characters that form numbers and names; whitespace between two of them is significant */
+static bool is_word_char(char c) {
+	return std::isalnum(static_cast<unsigned char>(c)) || c == '.';
+}
+
+/* Stripe of the counters the calling thread adds to */
+static std::atomic<size_t> next_stripe(0);
+static thread_local size_t stripe = next_stripe.fetch_add(1, std::memory_order_relaxed);
+
+/* constructor: A cache of fewer entries than shards uses one shard per entry, so the limit still holds */
+ExpressionCache::ExpressionCache(size_t max_entries, size_t max_bytes)
+	: clock(0), bytes(0), shard_count(std::max<size_t>(1, std::min(SHARD_COUNT, max_entries))),
+	  max_entries(max_entries / shard_count), max_bytes(max_bytes) {}
+
+/* shard_for: Picks the shard from the hash of the key */
+ExpressionCache::Shard& ExpressionCache::shard_for(const std::string& key) {
+	return shards[std::hash<std::string>()(key) % shard_count];
+}
+
+/* thread_counters: Spreads the threads over the stripes so they rarely write the same counters */
+ExpressionCache::Counters& ExpressionCache::thread_counters() {
+	return counters[stripe % COUNTER_STRIPES];
+}
+
+/* normalize: Removes whitespace, keeping a single space only where it separates two words */
+std::string ExpressionCache::normalize(const std::string& expression) {
+	std::string key;
+	key.reserve(expression.size());
+	bool pending_space = false;
+
+	for (char c : expression) {
+		if (std::isspace(static_cast<unsigned char>(c))) {
+			pending_space = !key.empty();
+			continue;
+		}
+		if (pending_space && is_word_char(c) && is_word_char(key.back())) {  // "2 3" is not "23"
+			key.push_back(' ');
+		}
+		else if (pending_space && (c == '+' || c == '-') && (key.back() == 'e' || key.back() == 'E')) {  // "2e + 3" is not "2e+3"
+			key.push_back(' ');
+		}
+		pending_space = false;
+		key.push_back(c);
+	}
+	return key;
+}
+
+/* find: Looks the key up under a shared lock and flags a hit as referenced unless it already is */
+std::shared_ptr<const CompiledExpression> ExpressionCache::find(const std::string& key) {
+	Shard& shard = shard_for(key);
+	std::shared_ptr<const CompiledExpression> program;
+	{
+		std::shared_lock<std::shared_mutex> lock(shard.mutex);
+		auto it = shard.index.find(key);
+
+		if (it != shard.index.end()) {
+			Entry& entry = *it->second;
+			if (!entry.referenced.load(std::memory_order_relaxed)) {  // A hot entry is only read
+				entry.referenced.store(true, std::memory_order_relaxed);
+			}
+			program = entry.program;
+		}
+	}
+
+	Counters& counted = thread_counters();
+	(program ? counted.hits : counted.misses).fetch_add(1, std::memory_order_relaxed);
+	return program;
+}
+
+/* insert: Adds (or replaces) an entry at the back of its shard's queue */
+void ExpressionCache::insert(const std::string& key, std::shared_ptr<const CompiledExpression> program) {
+	Shard& shard = shard_for(key);
+	size_t size = ENTRY_OVERHEAD + 2 * key.size() + program->get_memory_usage();
+	std::uint64_t now = clock.fetch_add(1, std::memory_order_relaxed) + 1;
+	{
+		std::unique_lock<std::shared_mutex> lock(shard.mutex);
+		auto it = shard.index.find(key);
+		if (it != shard.index.end()) {  // Another thread compiled the same expression first
+			Entry& entry = *it->second;
+			bytes.fetch_sub(entry.bytes, std::memory_order_relaxed);
+			entry.program = std::move(program);
+			entry.bytes = size;
+			entry.stamp = now;
+			shard.queue.splice(shard.queue.end(), shard.queue, it->second);
+		}
+		else {
+			shard.queue.emplace_back(key, std::move(program), size, now);
+			shard.index.emplace(key, std::prev(shard.queue.end()));
+		}
+
+		bytes.fetch_add(size, std::memory_order_relaxed);
+		evict(shard);
+	}
+
+	// The memory held by other shards counts too; they are locked one at a time
+	for (size_t i = 0; i < shard_count && bytes.load(std::memory_order_relaxed) > max_bytes; i++) {
+		std::unique_lock<std::shared_mutex> lock(shards[i].mutex);
+		evict(shards[i]);
+	}
+}
+
+/* evict: Drops the oldest entries, moving those hit since they were queued to the back once instead */
+void ExpressionCache::evict(Shard& shard) {
+	while (!shard.queue.empty() && (shard.index.size() > max_entries || bytes.load(std::memory_order_relaxed) > max_bytes)) {
+		Entry& oldest = shard.queue.front();
+		if (oldest.referenced.load(std::memory_order_relaxed)) {  // Second chance
+			oldest.referenced.store(false, std::memory_order_relaxed);
+			oldest.stamp = clock.load(std::memory_order_relaxed);
+			shard.queue.splice(shard.queue.end(), shard.queue, shard.queue.begin());
+			continue;
+		}
+		bytes.fetch_sub(oldest.bytes, std::memory_order_relaxed);
+		shard.evictions++;
+		shard.index.erase(oldest.key);
+		shard.queue.pop_front();
+	}
+}
+
+/* get_entries: Copies the keys and programs of every shard, latest queued first */
+std::vector<std::pair<std::string, std::shared_ptr<const CompiledExpression>>> ExpressionCache::get_entries() const {
+	std::vector<std::tuple<std::uint64_t, std::string, std::shared_ptr<const CompiledExpression>>> stamped;
+	for (size_t i = 0; i < shard_count; i++) {
+		std::shared_lock<std::shared_mutex> lock(shards[i].mutex);
+		for (const Entry& entry : shards[i].queue) {
+			stamped.emplace_back(entry.stamp, entry.key, entry.program);
+		}
+	}
+	std::stable_sort(stamped.begin(), stamped.end(), [](const auto& a, const auto& b) { return std::get<0>(a) > std::get<0>(b); });
+
+	std::vector<std::pair<std::string, std::shared_ptr<const CompiledExpression>>> result;
+	result.reserve(stamped.size());
+	for (auto& entry : stamped) {
+		result.emplace_back(std::move(std::get<1>(entry)), std::move(std::get<2>(entry)));
+	}
+	return result;
+}
+
+/* get_stats: Adds up the counters of the stripes and the sizes of the shards */
+CacheStats ExpressionCache::get_stats() const {
+	CacheStats stats = { 0, 0, 0, 0, 0 };
+	for (const Counters& counted : counters) {
+		stats.hits += counted.hits.load(std::memory_order_relaxed);
+		stats.misses += counted.misses.load(std::memory_order_relaxed);
+	}
+	for (size_t i = 0; i < shard_count; i++) {
+		std::shared_lock<std::shared_mutex> lock(shards[i].mutex);
+		stats.evictions += shards[i].evictions;
+		stats.entries += shards[i].index.size();
+	}
+	stats.bytes = bytes.load(std::memory_order_relaxed);
+	return stats;
+}
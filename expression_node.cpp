@@ -1,8 +1,50 @@
 #include "Expression_node.h"
 
 /*
-	Initializes the token, left, and right data members using an initializer list
+	Initializes the token, left, right, parent and shared data members using an initializer list
 		Accepts a single argument
 			- Token (instance of the Token Class)
 */
-ExpressionNode::ExpressionNode(const Token& token) : token(token), left(nullptr), right(nullptr), parent(nullptr) {}; 
\ No newline at end of file
+ExpressionNode::ExpressionNode(const Token& token) : token(token), left(NO_NODE), right(NO_NODE), parent(NO_NODE), shared(false) {};
+
+/* add_node: Appends a new node to the arena and returns its index */
+NodeIndex ExpressionTree::add_node(const Token& token) {
+	nodes.emplace_back(token);
+	return static_cast<NodeIndex>(nodes.size() - 1);
+}
+
+/* add_root: Records the root node of a parsed expression */
+void ExpressionTree::add_root(NodeIndex index) {
+	roots.push_back(index);
+}
+
+/* operator[]: Returns the node stored at the given index */
+ExpressionNode& ExpressionTree::operator[](NodeIndex index) {
+	return nodes[index];
+}
+
+/* operator[]: Returns the node stored at the given index */
+const ExpressionNode& ExpressionTree::operator[](NodeIndex index) const {
+	return nodes[index];
+}
+
+/* get_roots: Returns the root of every parsed expression */
+const std::vector<NodeIndex>& ExpressionTree::get_roots() const {
+	return roots;
+}
+
+/* root: Returns the root of the last parsed expression */
+NodeIndex ExpressionTree::root() const {
+	return roots.empty() ? NO_NODE : roots.back();
+}
+
+/* size: Returns the number of nodes held by the arena */
+size_t ExpressionTree::size() const {
+	return nodes.size();
+}
+
+/* clear: Drops every node in one go, keeping the allocated capacity for reuse */
+void ExpressionTree::clear() {
+	nodes.clear();
+	roots.clear();
+}
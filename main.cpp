@@ -1,96 +1,619 @@
 #include <iostream>
+#include <cstdio>
+#include <cstdlib>
 #include <string>
-#include <unordered_map>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "Utility.h"
+#include "Session.h"
 #include "Tokenizer.h"
 #include "Parser.h"
+#include "Optimizer.h"
+#include "Subexpression_eliminator.h"
+#include "Differentiator.h"
+#include "Solver.h"
 #include "Evaluator.h"
-#include "Token.h"
-#include "Utility.h"
+#include "Evaluation_profile.h"
+#include "Native_expression.h"
+#include "Batch_runner.h"
+#include "Server.h"
+#include "Metrics.h"
 
 // Constants
 const std::string CMD_HELP = "help";
 const std::string CMD_EXIT = "exit";
+const std::string CMD_STATS = "stats";
+const std::string CMD_OPTIMIZE = "optimize ";
+const std::string CMD_GRAD = "grad ";
+const std::string CMD_SOLVE = "solve ";
+const std::string CMD_PROFILE = "profile ";
+const std::string PROFILE_FOLDED = "folded ";
+const std::string CMD_EXACT = "exact ";
+const std::string CMD_MODE = "mode";
+const std::string CMD_SAVE = "save ";
+const std::string CMD_LOAD = "load ";
+const int PROFILE_RUNS = 1000;
+const size_t PROFILE_MAX_DEPTH = 1000;
+const double SOLVE_DEFAULT_LOW = -100;
+const double SOLVE_DEFAULT_HIGH = 100;
+const std::string ARG_BATCH = "--batch";
+const std::string ARG_THREADS = "--threads";
+const std::string ARG_FAST_MATH = "--fast-math";
+const std::string ARG_REACTIVE = "--reactive";
+const std::string ARG_JIT = "--jit";
+const std::string ARG_METRICS = "--metrics";
+const std::string ARG_PRECISION = "--precision";
+const std::string ARG_SCALAR = "--scalar";
+const std::string ARG_LOAD = "--load";
+const std::string ARG_SERVE = "--serve";
+const std::string ARG_MAX_NODES = "--max-nodes";
+const std::string ARG_MAX_DEPTH = "--max-depth";
+const std::string ARG_MAX_STEPS = "--max-steps";
+const std::string ARG_TIMEOUT = "--timeout";
 
-void evaluateExpression(const std::string& expression, std::unordered_map<std::string, double>& variables) {
-    // Tokenize the expression
-    Tokenizer tokenizer(expression);
-    auto tokens = tokenizer.tokenize();
+void printChanged(const std::string& assigned, Session& session) {
+    const SymbolTable& symbols = session.get_symbols();
+    DependencyGraph& dependencies = session.get_dependencies();
 
-    // Convert tokens into an abstract syntax tree (AST)
-    Parser parser(tokens);
-    auto ast_list = parser.parse();
+    for (SymbolId id : dependencies.take_changed()) {
+        if (symbols.get_name(id) == assigned) continue;
 
-    // Evaluate the AST and print the result
-    Evaluator evaluator(variables);
-    double result = evaluator.evaluate(ast_list.back());
-    std::cout << result << std::endl;
+        if (symbols.is_defined(id)) {
+            std::cout << "  " << symbols.get_name(id) << " = " << symbols.get_value(id) << std::endl;
+        }
+        else {
+            std::cout << "  " << symbols.get_name(id) << ": " << dependencies.get_error(id) << std::endl;
+        }
+    }
 }
 
-void assignVariable(const std::string& input, std::unordered_map<std::string, double>& variables, Utility& utilities) {
-    // Split the input into variable name and expression
-    auto extraction = utilities.extract_variable_and_expression(input);
-    std::string variable_name = extraction.first;
-    std::string expression = extraction.second;
+void evaluateLine(const std::string& input, Session& session) {
+    // Expressions in another scalar type print that type's value; assignments always store a double
+    if (session.get_scalar_type() != ScalarType::Double && input.find('=') == std::string::npos) {
+        std::cout << session.evaluate_text(input) << std::endl;
+        return;
+    }
+
+    Result<LineResult> line = session.try_execute(input);
+
+    // In reactive mode a formula that fails is kept, and the variables reading it are listed after its error
+    if (!line && session.is_reactive()) {
+        std::cout << "Error: " << line.error().message() << std::endl;
+        printChanged(Utility().extract_variable_and_expression(input).first, session);
+        return;
+    }
+    LineResult result = std::move(line).value_or_throw();
+
+    // Assignments are silent; expressions print their value
+    if (!result.is_assignment) {
+        std::cout << result.value << std::endl;
+        return;
+    }
+
+    // In reactive mode, show every other variable the assignment recomputed
+    if (session.is_reactive()) {
+        printChanged(result.variable, session);
+    }
+}
 
-    // Tokenize the expression
+void printOptimization(const std::string& expression, const Session& session) {
     Tokenizer tokenizer(expression);
-    auto tokens = tokenizer.tokenize();
+    Parser parser(tokenizer);
+    ExpressionTree tree = parser.parse();
+
+    Optimizer optimizer(session.is_fast_math());
+    ExpressionTree optimized = optimizer.optimize(tree);
+    const OptimizerStats& stats = optimizer.get_stats();
+
+    SubexpressionEliminator eliminator;
+    ExpressionTree merged = eliminator.eliminate(optimized);
+
+    // Shows the tree the parser built next to the one that actually gets evaluated
+    std::cout << "Before: " << parser.visualize_tree(tree, tree.root()) << std::endl;
+    std::cout << "After:  " << parser.visualize_tree(optimized, optimized.root()) << std::endl;
+    std::cout << "(" << stats.folded << " folded, " << stats.simplified << " simplified, "
+              << stats.strength_reduced << " strength-reduced, "
+              << eliminator.get_deduplicated() << " deduplicated, "
+              << merged.size() << " nodes evaluated)" << std::endl;
+}
+
+void printGradient(const std::string& expression, Session& session) {
+    SymbolTable& symbols = session.get_symbols();
+    Tokenizer tokenizer(expression, symbols);
+    Parser parser(tokenizer);
+    ExpressionTree tree = parser.parse();
+
+    // One forward and one backward pass give every partial derivative
+    Differentiator differentiator(symbols);
+    Gradient gradient = differentiator.gradient(tree, tree.root());
+
+    std::cout << gradient.value << std::endl;
+    for (size_t i = 0; i < gradient.variables.size(); i++) {
+        std::cout << "  d/d" << symbols.get_name(gradient.variables[i]) << " = " << gradient.partials[i] << std::endl;
+    }
+}
+
+double parseBound(const std::string& text) {
+    Utility utilities;
+    std::string bound = utilities.trim_string(text);
+    char* end = nullptr;
+    double value = std::strtod(bound.c_str(), &end);
+
+    if (bound.empty() || *end != '\0') {
+        throw std::runtime_error("Invalid interval bound: " + bound);
+    }
+    return value;
+}
+
+std::string findUnknown(const std::string& equation, const SymbolTable& symbols) {
+    // Without 'for', the unknown is the one variable that has no value yet
+    std::string text = equation;
+    std::replace(text.begin(), text.end(), '=', ' ');  // Only the variable names matter here
+    Tokenizer tokenizer(text);
+    std::string unknown;
+
+    for (Token token = tokenizer.next_token(); token.getType() != TokenType::End; token = tokenizer.next_token()) {
+        if (token.getType() != TokenType::Variable) continue;
+
+        std::string name(token.getValue());
+        if (symbols.is_defined(symbols.find(name)) || name == unknown) continue;
+        if (!unknown.empty()) {
+            throw std::runtime_error("Several undefined variables, name the unknown with 'for': " + unknown + ", " + name);
+        }
+        unknown = name;
+    }
+
+    if (unknown.empty()) {
+        throw std::runtime_error("No undefined variable to solve for, name the unknown with 'for'");
+    }
+    return unknown;
+}
+
+void printSolution(const std::string& command, Session& session) {
+    Utility utilities;
+    std::string equation = command;
+    std::string unknown;
+    double low = SOLVE_DEFAULT_LOW;
+    double high = SOLVE_DEFAULT_HIGH;
+
+    // solve <equation> [for <variable>] [in <low>, <high>]
+    size_t in = equation.rfind(" in ");
+    if (in != std::string::npos) {
+        std::string bounds = equation.substr(in + 4);
+        bounds.erase(std::remove(bounds.begin(), bounds.end(), '['), bounds.end());
+        bounds.erase(std::remove(bounds.begin(), bounds.end(), ']'), bounds.end());
+
+        size_t comma = bounds.find(',');
+        if (comma == std::string::npos) {
+            throw std::runtime_error("Invalid interval, expected: in <low>, <high>");
+        }
+        low = parseBound(bounds.substr(0, comma));
+        high = parseBound(bounds.substr(comma + 1));
+        equation.erase(in);
+    }
+
+    size_t forPosition = equation.rfind(" for ");
+    if (forPosition != std::string::npos) {
+        unknown = utilities.trim_string(equation.substr(forPosition + 5));
+        equation.erase(forPosition);
+    }
+    else {
+        unknown = findUnknown(equation, session.get_symbols());
+    }
+
+    // The solve runs within the same budget as any other line
+    ResourceGovernor governor(session.get_limits());
+    Solver solver(session.get_symbols());
+    solver.set_governor(&governor);
+    std::vector<double> roots = solver.solve(equation, unknown, low, high);
+    const std::vector<std::pair<double, double>>& intervals = solver.get_intervals();
+    const SolverStats& stats = solver.get_stats();
+
+    if (roots.empty() && intervals.empty()) {
+        std::cout << "No solution for " << unknown << " in [" << low << ", " << high << "]" << std::endl;
+    }
+    else if (roots.empty() && intervals.size() == 1 && intervals[0].first == low && intervals[0].second == high) {
+        std::cout << "Every " << unknown << " in [" << low << ", " << high << "] is a solution" << std::endl;
+    }
+    else {
+        // Roots and ranges of solutions, in increasing order
+        size_t next = 0;
+        for (double root : roots) {
+            for (; next < intervals.size() && intervals[next].first < root; next++) {
+                std::cout << unknown << " in [" << intervals[next].first << ", " << intervals[next].second << "]" << std::endl;
+            }
+            std::cout << unknown << " = " << root << std::endl;
+        }
+        for (; next < intervals.size(); next++) {
+            std::cout << unknown << " in [" << intervals[next].first << ", " << intervals[next].second << "]" << std::endl;
+        }
+    }
+    std::cout << "(" << stats.scan_evaluations + stats.newton_evaluations + stats.brent_evaluations << " evaluations: "
+              << stats.scan_evaluations << " scanning, " << stats.newton_evaluations << " Newton, "
+              << stats.brent_evaluations << " Brent)" << std::endl;
+}
+
+void printProfile(const std::string& command, Session& session) {
+    Utility utilities;
+    std::string expression = utilities.trim_string(command);
+    bool folded = expression.compare(0, PROFILE_FOLDED.size(), PROFILE_FOLDED) == 0;
+    if (folded) {
+        expression = expression.substr(PROFILE_FOLDED.size());
+    }
+
+    // Profiles the tree the session would evaluate, after optimization and merging
+    SymbolTable& symbols = session.get_symbols();
+    ResourceGovernor governor(session.get_limits());
+    Tokenizer tokenizer(expression, symbols);
+    tokenizer.set_governor(&governor);
+    Parser parser(tokenizer);
+    parser.set_governor(&governor);
+    ExpressionTree tree = parser.parse();
+    if (parser.get_depth() > PROFILE_MAX_DEPTH) {  // The reports print a line per node, indented by its depth
+        throw std::runtime_error("Expression is nested too deeply to profile (more than " + std::to_string(PROFILE_MAX_DEPTH) + " levels)");
+    }
+    Optimizer optimizer(session.is_fast_math());
+    SubexpressionEliminator eliminator;
+    ExpressionTree merged = eliminator.eliminate(optimizer.optimize(tree));
+
+    // Repeats the evaluation so that nodes too fast for one clock reading still add up
+    Evaluator evaluator(symbols);
+    evaluator.set_governor(&governor);
+    EvaluationProfile profile;
+    double value = 0;
+    for (int i = 0; i < PROFILE_RUNS; i++) {
+        value = evaluator.evaluate_profiled(merged, merged.root(), profile);
+    }
+
+    if (folded) {
+        std::cout << profile.format_folded(merged, merged.root());
+        return;
+    }
+    std::cout << value << std::endl;
+    std::cout << profile.format_tree(merged, merged.root());
+    std::cout << "(" << PROFILE_RUNS << " evaluations, times per evaluation, "
+              << EvaluationProfile::timer_overhead_ns() << " ns timer overhead removed per node)" << std::endl;
+}
+
+void printExact(const std::string& line, Session& session) {
+    ExactLineResult result = session.execute_exact(line);
+
+    // Like ordinary lines, assignments are silent
+    if (!result.is_assignment) {
+        std::cout << result.value.to_string(session.get_exact_options().precision) << std::endl;
+    }
+}
+
+void setMode(const std::string& name, Session& session) {
+    // "mode" alone shows the current type
+    if (!name.empty()) {
+        ScalarType type;
+        if (!parse_scalar_type(name, type)) {
+            throw std::runtime_error("Unknown mode: " + name + " (float, double, long double, complex or interval)");
+        }
+        session.set_scalar_type(type);
+    }
+    std::cout << "mode: " << scalar_type_name(session.get_scalar_type()) << std::endl;
+}
+
+void saveSnapshot(const std::string& path, const Session& session) {
+    SnapshotStats stats = session.save(path);
+    std::cout << "Saved " << stats.variables << " variables, " << stats.formulas << " formulas, "
+              << stats.expressions << " expressions (" << stats.bytes << " bytes)" << std::endl;
+}
+
+void loadSnapshot(const std::string& path, Session& session) {
+    SnapshotStats stats = session.load(path);
+
+    // Formulas of the session that read a loaded variable were recomputed; the list is not needed here
+    if (session.is_reactive()) {
+        session.get_dependencies().take_changed();
+    }
+    std::cout << "Loaded " << stats.variables << " variables, " << stats.formulas << " formulas, "
+              << stats.expressions << " expressions (" << stats.bytes << " bytes)" << std::endl;
+}
+
+void printStats(const Session& session) {
+    if (!Metrics::is_enabled()) {
+        std::cout << "Metrics were compiled out (CALC_NO_METRICS)." << std::endl;
+    }
+    else {
+        std::cout << Metrics::format_table(Metrics::snapshot());
+    }
 
-    // Convert tokens into an abstract syntax tree (AST)
-    Parser parser(tokens);
-    auto ast_list = parser.parse();
+    CacheStats cache = session.get_cache_stats();
+    std::cout << "cache: " << cache.hits << " hits, " << cache.misses << " misses, " << cache.evictions << " evictions, "
+              << cache.entries << " entries" << std::endl;
+}
 
-    // Evaluate the AST and assign the result to the variable
-    Evaluator evaluator(variables);
-    double value = evaluator.evaluate(ast_list.back());
-    variables[variable_name] = value;
-    //std::cout << variable_name << " = " << value << std::endl;
+int writeMetrics(const std::string& path) {
+    // "-" sends the dump to standard error, keeping standard output for results
+    std::string json = Metrics::format_json(Metrics::snapshot());
+    std::FILE* output = path == "-" ? stderr : std::fopen(path.c_str(), "w");
+
+    if (!output) {
+        std::fprintf(stderr, "Error: cannot write %s\n", path.c_str());
+        return 2;
+    }
+    std::fputs(json.c_str(), output);
+    if (output != stderr) {
+        std::fclose(output);
+    }
+    return 0;
 }
 
+// Ctrl+C at the prompt exits; while a line runs it only cancels that line
+CancellationToken interruptToken;
+std::atomic<bool> lineRunning(false);
+
+void interruptLine(int signal) {
+    if (lineRunning.load()) {
+        interruptToken.cancel();
+        return;
+    }
+    std::signal(signal, SIG_DFL);
+    std::raise(signal);
+}
 
-int main() {
+int runInteractive(const SessionOptions& options, const std::string& snapshotPath) {
     Utility utilities;
 
-    // Holds variable names and their values for lookup and assignment
-    std::unordered_map<std::string, double> variables;
+    // Holds the variables for lookup and assignment; every line watches the interrupt token
+    SessionOptions lineOptions = options;
+    lineOptions.limits.cancel = &interruptToken;
+    Session session(lineOptions);
+    if (!snapshotPath.empty()) {
+        try {
+            loadSnapshot(snapshotPath, session);
+        }
+        catch (const std::runtime_error& e) {
+            std::fprintf(stderr, "Error: %s\n", e.what());
+            return 2;
+        }
+    }
 
     // Welcome the user to the application
     utilities.print_welcome_message();
+    std::signal(SIGINT, interruptLine);
 
     // Main loop to keep reading input until user decides to exit
     while (true) {
-        std::string input = utilities.prompt_input();
+        lineRunning = false;
+        std::string line = utilities.prompt_input();
 
-        // Convert input to lowercase for easier comparison
+        // Convert input to lowercase for easier comparison; file names keep their case
+        std::string input = line;
         std::transform(input.begin(), input.end(), input.begin(), ::tolower);
 
         if (input == CMD_HELP) {
             utilities.print_help();
             continue;
         }
+        if (input == CMD_STATS) {
+            printStats(session);
+            continue;
+        }
         if (input == CMD_EXIT) {
             std::cout << "Goodbye!" << std::endl;
             break;
         }
         if (input.empty()) continue;
 
-        // Replace variables in the input with their current values
-        input = utilities.substitute_variables(input, variables);
-
+        interruptToken.reset();
+        lineRunning = true;
         try {
-            if (input.find('=') != std::string::npos) {
-                assignVariable(input, variables, utilities);
+            if (input.compare(0, CMD_SAVE.size(), CMD_SAVE) == 0) {
+                saveSnapshot(utilities.trim_string(line.substr(CMD_SAVE.size())), session);
+                continue;
+            }
+            if (input.compare(0, CMD_LOAD.size(), CMD_LOAD) == 0) {
+                loadSnapshot(utilities.trim_string(line.substr(CMD_LOAD.size())), session);
+                continue;
+            }
+            if (input.compare(0, CMD_OPTIMIZE.size(), CMD_OPTIMIZE) == 0) {
+                printOptimization(input.substr(CMD_OPTIMIZE.size()), session);
+                continue;
             }
-            else {
-                evaluateExpression(input, variables);
+            if (input.compare(0, CMD_GRAD.size(), CMD_GRAD) == 0) {
+                printGradient(input.substr(CMD_GRAD.size()), session);
+                continue;
             }
+            if (input.compare(0, CMD_SOLVE.size(), CMD_SOLVE) == 0) {
+                printSolution(input.substr(CMD_SOLVE.size()), session);
+                continue;
+            }
+            if (input.compare(0, CMD_EXACT.size(), CMD_EXACT) == 0) {
+                printExact(input.substr(CMD_EXACT.size()), session);
+                continue;
+            }
+            if (input.compare(0, CMD_PROFILE.size(), CMD_PROFILE) == 0) {
+                printProfile(input.substr(CMD_PROFILE.size()), session);
+                continue;
+            }
+            if (input == CMD_MODE || input.compare(0, CMD_MODE.size() + 1, CMD_MODE + " ") == 0) {
+                setMode(input.size() > CMD_MODE.size() ? input.substr(CMD_MODE.size() + 1) : "", session);
+                continue;
+            }
+            evaluateLine(input, session);
         }
         catch (const std::runtime_error& e) {
             std::cout << "Error: " << e.what() << std::endl;
         }
     }
+    lineRunning = false;
+    return 0;
+}
+
+int runBatch(const std::string& path, size_t threads, const SessionOptions& options, const std::string& snapshotPath) {
+    // Reads from stdin unless a file is given
+    std::FILE* input = stdin;
+    if (!path.empty() && path != "-") {
+        input = std::fopen(path.c_str(), "rb");
+        if (!input) {
+            std::fprintf(stderr, "Error: cannot open %s\n", path.c_str());
+            return 2;
+        }
+    }
+
+    Session session(options);
+    if (!snapshotPath.empty()) {
+        // Standard output carries the results, so the load is only reported when it fails
+        try {
+            session.load(snapshotPath);
+        }
+        catch (const std::runtime_error& e) {
+            std::fprintf(stderr, "Error: %s\n", e.what());
+            if (input != stdin) {
+                std::fclose(input);
+            }
+            return 2;
+        }
+    }
+    BatchRunner runner(session, stdout, stderr, threads);
+    BatchSummary summary = runner.run(input);
+    runner.print_summary(summary);
+
+    if (input != stdin) {
+        std::fclose(input);
+    }
+
+    // A non-zero exit code tells pipelines that at least one line failed
+    return summary.failed == 0 ? 0 : 1;
+}
+
+// The running server, for the signal handler
+Server* activeServer = nullptr;
+
+void stopServer(int) {
+    if (activeServer) {
+        activeServer->stop();
+    }
+}
+
+int runServer(const std::string& address, size_t threads, const SessionOptions& options) {
+    ServerOptions serverOptions;
+    serverOptions.address = address;
+    serverOptions.threads = threads == 0 ? 1 : threads;
+    serverOptions.session = options;
+
+    try {
+        Server server(serverOptions);
+        std::fprintf(stderr, "listening on %s (%zu event loop%s)\n", server.get_address().c_str(), serverOptions.threads,
+            serverOptions.threads == 1 ? "" : "s");
+
+        // Ctrl+C and kill shut the server down cleanly, removing its socket file
+        activeServer = &server;
+        std::signal(SIGINT, stopServer);
+        std::signal(SIGTERM, stopServer);
+        server.run();
+        activeServer = nullptr;
+
+        ServerStats stats = server.get_stats();
+        std::fprintf(stderr, "server: %zu connections, %zu requests, %zu failed (%zu over limits)\n", stats.connections, stats.requests,
+            stats.failed, stats.limited);
+    }
+    catch (const std::runtime_error& e) {
+        std::fprintf(stderr, "Error: %s\n", e.what());
+        return 2;
+    }
     return 0;
 }
 
+int main(int argc, char* argv[]) {
+    bool batch = false;
+    SessionOptions options;
+    bool valid = true;
+    std::string path;
+    std::string metricsPath;
+    std::string snapshotPath;
+    std::string serveAddress;
+    size_t threads = std::thread::hardware_concurrency();
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == ARG_BATCH) {
+            batch = true;
+        }
+        else if (arg == ARG_FAST_MATH) {
+            options.fast_math = true;
+        }
+        else if (arg == ARG_REACTIVE) {
+            options.reactive = true;
+        }
+        else if (arg == ARG_JIT) {
+            options.jit = true;
+        }
+        else if (arg == ARG_METRICS && i + 1 < argc) {
+            metricsPath = argv[++i];
+        }
+        else if (arg == ARG_PRECISION && i + 1 < argc) {
+            options.exact.precision = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (arg == ARG_SCALAR && i + 1 < argc) {
+            valid = parse_scalar_type(argv[++i], options.scalar) && valid;
+        }
+        else if (arg == ARG_SERVE && i + 1 < argc) {
+            serveAddress = argv[++i];
+        }
+        else if (arg == ARG_LOAD && i + 1 < argc) {
+            snapshotPath = argv[++i];
+        }
+        else if (arg == ARG_MAX_NODES && i + 1 < argc) {
+            options.limits.max_nodes = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (arg == ARG_MAX_DEPTH && i + 1 < argc) {
+            options.limits.max_depth = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (arg == ARG_MAX_STEPS && i + 1 < argc) {
+            options.limits.max_steps = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (arg == ARG_TIMEOUT && i + 1 < argc) {
+            options.limits.timeout = std::chrono::milliseconds(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == ARG_THREADS && i + 1 < argc) {
+            threads = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (batch && path.empty() && (arg == "-" || arg[0] != '-')) {
+            path = arg;
+        }
+        else {
+            valid = false;
+        }
+    }
+
+    // Server connections each start with an empty session
+    if (!serveAddress.empty() && (batch || !snapshotPath.empty())) {
+        valid = false;
+    }
+
+    if (!valid) {
+        std::fprintf(stderr, "Usage: %s [--fast-math] [--reactive] [--jit] [--precision digits] [--scalar type] [--load snapshot] [--metrics file]\n    [--max-nodes N] [--max-depth N] [--max-steps N] [--timeout ms] [--batch [file] | --serve address] [--threads N]\n", argv[0]);
+        return 2;
+    }
+
+    // Native code is optional; without it the same programs are interpreted
+    if (options.jit && !NativeExpression::is_supported()) {
+        std::fprintf(stderr, "--jit: native code is not supported by this build or machine, evaluating with the interpreter\n");
+    }
 
+    int status;
+    if (!serveAddress.empty()) {
+        // One event loop per core unless told otherwise
+        status = runServer(serveAddress, threads, options);
+    }
+    else {
+        status = batch ? runBatch(path, threads, options, snapshotPath) : runInteractive(options, snapshotPath);
+    }
+
+    // The per-stage metrics of the whole run, as JSON
+    if (!metricsPath.empty() && writeMetrics(metricsPath) != 0 && status == 0) {
+        status = 2;
+    }
+    return status;
+}
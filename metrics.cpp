@@ -0,0 +1,224 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+
+static const char* STAGE_NAMES[STAGE_COUNT] = { "line", "lookup", "parse", "optimize", "eliminate", "compile", "evaluate" };
+
+/* stage_name: Returns the printed name of a stage */
+const char* Metrics::stage_name(Stage stage) {
+	return STAGE_NAMES[static_cast<size_t>(stage)];
+}
+
+#ifndef CALC_NO_METRICS
+
+// Latencies below 16 ns get a bucket each; above, every power of two is split into 8 buckets
+static const size_t EXACT_BUCKETS = 16;
+static const size_t BUCKET_COUNT = EXACT_BUCKETS + (64 - 4) * 8;
+
+/* Counters written by one thread only. Other threads read them for snapshots. */
+struct ThreadMetrics {
+	std::atomic<std::uint64_t> calls[STAGE_COUNT];
+	std::atomic<std::uint64_t> total_ns[STAGE_COUNT];
+	std::atomic<std::uint64_t> max_ns[STAGE_COUNT];
+	std::atomic<std::uint64_t> allocations[STAGE_COUNT];
+	std::atomic<std::uint64_t> bytes[STAGE_COUNT];
+	std::atomic<std::uint64_t> buckets[STAGE_COUNT][BUCKET_COUNT];
+};
+
+/* Counters of every thread that has recorded something. Never freed, so recording
+   and the dump at exit stay valid whatever order static objects are destroyed in. */
+struct MetricsRegistry {
+	std::mutex mutex;
+	std::vector<std::unique_ptr<ThreadMetrics>> threads;
+};
+
+static MetricsRegistry& registry() {
+	static MetricsRegistry* instance = new MetricsRegistry();
+	return *instance;
+}
+
+static thread_local ThreadMetrics* local_metrics = nullptr;
+
+/* thread_metrics: Returns the counters of the calling thread, registering them on first use */
+static ThreadMetrics& thread_metrics() {
+	if (!local_metrics) {
+		std::unique_ptr<ThreadMetrics> created(new ThreadMetrics());
+		std::lock_guard<std::mutex> lock(registry().mutex);
+		local_metrics = created.get();
+		registry().threads.push_back(std::move(created));
+	}
+	return *local_metrics;
+}
+
+/* add: Only the owning thread writes a counter, so a relaxed load and store is enough */
+static void add(std::atomic<std::uint64_t>& counter, std::uint64_t amount) {
+	counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+/* bucket_of: Histogram bucket of a latency */
+static size_t bucket_of(std::uint64_t ns) {
+	if (ns < EXACT_BUCKETS) {
+		return static_cast<size_t>(ns);
+	}
+	unsigned top = static_cast<unsigned>(std::bit_width(ns)) - 1;  // At least 4
+	return EXACT_BUCKETS + (top - 4) * 8 + static_cast<size_t>((ns >> (top - 3)) & 7);
+}
+
+/* bucket_middle: Middle of the latencies a bucket holds */
+static std::uint64_t bucket_middle(size_t bucket) {
+	if (bucket < EXACT_BUCKETS) {
+		return bucket;
+	}
+	unsigned top = static_cast<unsigned>((bucket - EXACT_BUCKETS) / 8) + 4;
+	std::uint64_t low = (8 + (bucket - EXACT_BUCKETS) % 8) << (top - 3);
+	return low + ((std::uint64_t(1) << (top - 3)) >> 1);
+}
+
+/* percentile: Latency below which the given fraction of the calls fell */
+static std::uint64_t percentile(const std::vector<std::uint64_t>& histogram, std::uint64_t calls, double fraction) {
+	std::uint64_t rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(fraction * calls)));  // Nearest rank
+	std::uint64_t seen = 0;
+
+	for (size_t bucket = 0; bucket < histogram.size(); bucket++) {
+		seen += histogram[bucket];
+		if (seen >= rank) {
+			return bucket_middle(bucket);
+		}
+	}
+	return 0;
+}
+
+/* record: Adds one call of a stage to the calling thread's counters */
+void Metrics::record(Stage stage, std::uint64_t ns, std::uint64_t allocations, std::uint64_t bytes) {
+	ThreadMetrics& metrics = thread_metrics();
+	size_t index = static_cast<size_t>(stage);
+
+	add(metrics.calls[index], 1);
+	add(metrics.total_ns[index], ns);
+	add(metrics.allocations[index], allocations);
+	add(metrics.bytes[index], bytes);
+	add(metrics.buckets[index][bucket_of(ns)], 1);
+	if (ns > metrics.max_ns[index].load(std::memory_order_relaxed)) {
+		metrics.max_ns[index].store(ns, std::memory_order_relaxed);
+	}
+}
+
+/* snapshot: Adds the counters of every thread, then derives the percentiles from the merged histograms */
+std::vector<StageMetrics> Metrics::snapshot() {
+	std::vector<StageMetrics> stages(STAGE_COUNT);
+	std::vector<std::vector<std::uint64_t>> histograms(STAGE_COUNT, std::vector<std::uint64_t>(BUCKET_COUNT));
+
+	{
+		std::lock_guard<std::mutex> lock(registry().mutex);
+		for (const std::unique_ptr<ThreadMetrics>& metrics : registry().threads) {
+			for (size_t i = 0; i < STAGE_COUNT; i++) {
+				stages[i].calls += metrics->calls[i].load(std::memory_order_relaxed);
+				stages[i].total_ns += metrics->total_ns[i].load(std::memory_order_relaxed);
+				stages[i].max_ns = std::max<std::uint64_t>(stages[i].max_ns, metrics->max_ns[i].load(std::memory_order_relaxed));
+				stages[i].allocations += metrics->allocations[i].load(std::memory_order_relaxed);
+				stages[i].bytes += metrics->bytes[i].load(std::memory_order_relaxed);
+
+				for (size_t bucket = 0; bucket < BUCKET_COUNT; bucket++) {
+					histograms[i][bucket] += metrics->buckets[i][bucket].load(std::memory_order_relaxed);
+				}
+			}
+		}
+	}
+
+	for (size_t i = 0; i < STAGE_COUNT; i++) {
+		stages[i].name = STAGE_NAMES[i];
+		if (stages[i].calls != 0) {
+			stages[i].p50_ns = std::min(percentile(histograms[i], stages[i].calls, 0.50), stages[i].max_ns);
+			stages[i].p99_ns = std::min(percentile(histograms[i], stages[i].calls, 0.99), stages[i].max_ns);
+		}
+	}
+	return stages;
+}
+
+/* reset: Zeroes the counters of every thread */
+void Metrics::reset() {
+	std::lock_guard<std::mutex> lock(registry().mutex);
+
+	for (const std::unique_ptr<ThreadMetrics>& metrics : registry().threads) {
+		for (size_t i = 0; i < STAGE_COUNT; i++) {
+			metrics->calls[i].store(0, std::memory_order_relaxed);
+			metrics->total_ns[i].store(0, std::memory_order_relaxed);
+			metrics->max_ns[i].store(0, std::memory_order_relaxed);
+			metrics->allocations[i].store(0, std::memory_order_relaxed);
+			metrics->bytes[i].store(0, std::memory_order_relaxed);
+			for (size_t bucket = 0; bucket < BUCKET_COUNT; bucket++) {
+				metrics->buckets[i][bucket].store(0, std::memory_order_relaxed);
+			}
+		}
+	}
+}
+
+/* is_enabled: Metrics were compiled in */
+bool Metrics::is_enabled() {
+	return true;
+}
+
+#else
+
+void Metrics::record(Stage, std::uint64_t, std::uint64_t, std::uint64_t) {}
+
+/* snapshot: Without metrics every stage reports zeros */
+std::vector<StageMetrics> Metrics::snapshot() {
+	std::vector<StageMetrics> stages(STAGE_COUNT);
+	for (size_t i = 0; i < STAGE_COUNT; i++) {
+		stages[i].name = STAGE_NAMES[i];
+	}
+	return stages;
+}
+
+void Metrics::reset() {}
+
+/* is_enabled: Built with CALC_NO_METRICS */
+bool Metrics::is_enabled() {
+	return false;
+}
+
+#endif
+
+/* format_table: One line per stage, times in microseconds and allocations averaged per call */
+std::string Metrics::format_table(const std::vector<StageMetrics>& stages) {
+	std::string table;
+	char line[160];
+
+	std::snprintf(line, sizeof(line), "%-10s %10s %12s %10s %10s %10s %12s %12s\n",
+		"stage", "calls", "total ms", "p50 us", "p99 us", "max us", "allocs/call", "bytes/call");
+	table += line;
+
+	for (const StageMetrics& stage : stages) {
+		double calls = stage.calls ? static_cast<double>(stage.calls) : 1.0;
+		std::snprintf(line, sizeof(line), "%-10s %10llu %12.3f %10.3f %10.3f %10.3f %12.1f %12.1f\n",
+			stage.name, static_cast<unsigned long long>(stage.calls), stage.total_ns / 1e6,
+			stage.p50_ns / 1e3, stage.p99_ns / 1e3, stage.max_ns / 1e3, stage.allocations / calls, stage.bytes / calls);
+		table += line;
+	}
+	return table;
+}
+
+/* format_json: Raw counters in nanoseconds, one stage per line */
+std::string Metrics::format_json(const std::vector<StageMetrics>& stages) {
+	std::string json = std::string("{\n  \"enabled\": ") + (is_enabled() ? "true" : "false") + ",\n  \"stages\": [\n";
+	char line[320];
+
+	for (size_t i = 0; i < stages.size(); i++) {
+		const StageMetrics& stage = stages[i];
+		std::snprintf(line, sizeof(line),
+			"    {\"stage\": \"%s\", \"calls\": %llu, \"total_ns\": %llu, \"p50_ns\": %llu, \"p99_ns\": %llu, "
+			"\"max_ns\": %llu, \"allocations\": %llu, \"bytes\": %llu}%s\n",
+			stage.name, static_cast<unsigned long long>(stage.calls), static_cast<unsigned long long>(stage.total_ns),
+			static_cast<unsigned long long>(stage.p50_ns), static_cast<unsigned long long>(stage.p99_ns),
+			static_cast<unsigned long long>(stage.max_ns), static_cast<unsigned long long>(stage.allocations),
+			static_cast<unsigned long long>(stage.bytes), i + 1 < stages.size() ? "," : "");
+		json += line;
+	}
+	return json + "  ]\n}\n";
+}
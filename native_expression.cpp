@@ -0,0 +1,418 @@
+#include "Native_expression.h"
+#include <cmath>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <utility>
+
+/* Building with CALC_NO_JIT leaves every program interpreted */
+#if (defined(__x86_64__) || defined(_M_X64)) && !defined(CALC_NO_JIT)
+#define CALC_NATIVE_X64 1
+#else
+#define CALC_NATIVE_X64 0
+#endif
+
+#if CALC_NATIVE_X64 && defined(_WIN32)
+#include <windows.h>
+#elif CALC_NATIVE_X64
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/* Largest stack frame the generated code may use; bigger programs stay interpreted */
+static const size_t MAX_FRAME_BYTES = 4096;
+
+#if defined(_WIN32)
+static const std::uint32_t SHADOW_SPACE = 32;   // Home area a Windows x64 callee may use
+#else
+static const std::uint32_t SHADOW_SPACE = 0;
+#endif
+
+/* call_pow: Gives the generated code a plain function to call for a general power */
+static double call_pow(double base, double exponent) {
+	return std::pow(base, exponent);
+}
+
+/* Bit pattern of a double, as embedded in a mov instruction */
+static std::uint64_t bits_of(double value) {
+	std::uint64_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+/*------Machine code emission--------------------------------------------------
+	Only xmm0, xmm1, rax and rbx are used. rbx is callee-saved and holds the
+	values pointer across calls to pow.
+----------------------------------------------------------------------------*/
+
+/* Appends x86-64 instructions to a byte buffer */
+class CodeBuffer {
+public:
+	std::vector<std::uint8_t> bytes;
+	std::vector<size_t> error_jumps;   // Positions of rel32 fields that must point at the error exit.
+
+	void emit(std::initializer_list<std::uint8_t> code) {
+		bytes.insert(bytes.end(), code);
+	}
+
+	void emit32(std::uint32_t value) {
+		for (int i = 0; i < 4; i++) {
+			bytes.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+		}
+	}
+
+	void emit64(std::uint64_t value) {
+		for (int i = 0; i < 8; i++) {
+			bytes.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+		}
+	}
+
+	/* movsd xmm0, [rsp + offset] */
+	void load_frame(std::uint32_t offset) {
+		emit({ 0xF2, 0x0F, 0x10, 0x84, 0x24 });
+		emit32(offset);
+	}
+
+	/* movsd [rsp + offset], xmm0 */
+	void store_frame(std::uint32_t offset) {
+		emit({ 0xF2, 0x0F, 0x11, 0x84, 0x24 });
+		emit32(offset);
+	}
+
+	/* movsd xmm0, [rbx + offset] */
+	void load_value(std::uint32_t offset) {
+		emit({ 0xF2, 0x0F, 0x10, 0x83 });
+		emit32(offset);
+	}
+
+	/* mov rax, bits; movq xmm0 (or xmm1), rax */
+	void load_constant(double value, int xmm) {
+		emit({ 0x48, 0xB8 });
+		emit64(bits_of(value));
+		emit({ 0x66, 0x48, 0x0F, 0x6E, static_cast<std::uint8_t>(xmm == 0 ? 0xC0 : 0xC8) });
+	}
+
+	/* movapd xmm1, xmm0 */
+	void copy_to_xmm1() {
+		emit({ 0x66, 0x0F, 0x28, 0xC8 });
+	}
+
+	/* movapd xmm0, xmm1 */
+	void copy_to_xmm0() {
+		emit({ 0x66, 0x0F, 0x28, 0xC1 });
+	}
+
+	/* divsd xmm0, [rsp + offset] */
+	void divide_by_frame(std::uint32_t offset) {
+		emit({ 0xF2, 0x0F, 0x5E, 0x84, 0x24 });
+		emit32(offset);
+	}
+
+	/* <op>sd xmm0, xmm1, for the opcode byte of addsd, subsd, mulsd or divsd */
+	void arithmetic(std::uint8_t opcode) {
+		emit({ 0xF2, 0x0F, opcode, 0xC1 });
+	}
+
+	/* xorpd xmm1, xmm1 */
+	void zero_xmm1() {
+		emit({ 0x66, 0x0F, 0x57, 0xC9 });
+	}
+
+	/* mov rax, function; call rax */
+	void call(const void* function) {
+		std::uint64_t address;
+		std::memcpy(&address, &function, sizeof(address));
+		emit({ 0x48, 0xB8 });
+		emit64(address);
+		emit({ 0xFF, 0xD0 });
+	}
+
+	/* j<cc> error, for the second opcode byte of a near conditional jump */
+	void jump_to_error(std::uint8_t condition) {
+		emit({ 0x0F, condition });
+		error_jumps.push_back(bytes.size());
+		emit32(0);
+	}
+
+	/* Points every recorded jump at the current position */
+	void bind_error_exit() {
+		for (size_t at : error_jumps) {
+			std::uint32_t distance = static_cast<std::uint32_t>(bytes.size() - (at + 4));
+			std::memcpy(&bytes[at], &distance, sizeof(distance));
+		}
+	}
+};
+
+static const std::uint8_t OP_ADDSD = 0x58;
+static const std::uint8_t OP_MULSD = 0x59;
+static const std::uint8_t OP_SUBSD = 0x5C;
+static const std::uint8_t OP_DIVSD = 0x5E;
+static const std::uint8_t JUMP_IF_EQUAL = 0x84;   // je: taken on ZF, which ucomisd also sets for NaN
+static const std::uint8_t JUMP_IF_BELOW = 0x82;   // jb: taken on CF, which ucomisd also sets for NaN
+
+/* constructor */
+NativeExpression::NativeExpression(std::shared_ptr<const CompiledExpression> program, bool enabled)
+	: NativeExpression(*program, enabled) {
+	owner = std::move(program);
+}
+
+/* constructor: Generates the code without taking ownership of the program */
+NativeExpression::NativeExpression(const CompiledExpression& program, bool enabled)
+	: program(&program), memory(nullptr), memory_size(0), code_size(0), function(nullptr) {
+
+	if (enabled && is_supported()) {
+		std::vector<std::uint8_t> code = generate();
+
+		if (!code.empty() && install(code)) {
+			code_size = code.size();
+		}
+	}
+}
+
+/* destructor */
+NativeExpression::~NativeExpression() {
+#if CALC_NATIVE_X64 && defined(_WIN32)
+	if (memory) {
+		VirtualFree(memory, 0, MEM_RELEASE);
+	}
+#elif CALC_NATIVE_X64
+	if (memory) {
+		munmap(memory, memory_size);
+	}
+#endif
+}
+
+/* is_supported: Native code is only generated for x86-64 */
+bool NativeExpression::is_supported() {
+	return CALC_NATIVE_X64 != 0;
+}
+
+/* is_native: Checks whether the code was generated and installed */
+bool NativeExpression::is_native() const {
+	return function != nullptr;
+}
+
+/* get_function: Returns the entry point of the generated code */
+NativeFunction NativeExpression::get_function() const {
+	return function;
+}
+
+/* get_code_size: Returns the length of the generated code */
+size_t NativeExpression::get_code_size() const {
+	return code_size;
+}
+
+/* evaluate: Runs the native code, deferring to the interpreter for NaN results and when there is no native code */
+double NativeExpression::evaluate(const double* values) const {
+	if (function) {
+		double result = function(values);
+		if (!std::isnan(result)) {
+			return result;
+		}
+	}
+	return program->evaluate(values);  // Produces the exact NaN or throws the error the native code ran into
+}
+
+/* generate: Translates the bytecode one instruction at a time, tracking the stack height */
+std::vector<std::uint8_t> NativeExpression::generate() const {
+	const std::vector<Instruction>& code = program->get_code();
+	const std::vector<double>& constants = program->get_constants();
+	size_t depth = program->get_max_stack_depth();
+	size_t temps = program->get_temp_count();
+
+	size_t frame = SHADOW_SPACE + 8 * (depth + temps);
+	frame = (frame + 15) & ~static_cast<size_t>(15);   // Keeps rsp 16-byte aligned for calls
+	if (code.empty() || frame > MAX_FRAME_BYTES) {
+		return std::vector<std::uint8_t>();
+	}
+
+	auto slot = [](size_t index) { return static_cast<std::uint32_t>(SHADOW_SPACE + 8 * index); };
+	auto temp = [&](size_t index) { return static_cast<std::uint32_t>(SHADOW_SPACE + 8 * (depth + index)); };
+
+	CodeBuffer out;
+
+	// Prologue: push rbx; mov rbx, <values>; sub rsp, frame
+	out.emit({ 0x53 });
+#if defined(_WIN32)
+	out.emit({ 0x48, 0x89, 0xCB });   // values arrive in rcx
+#else
+	out.emit({ 0x48, 0x89, 0xFB });   // values arrive in rdi
+#endif
+	out.emit({ 0x48, 0x81, 0xEC });
+	out.emit32(static_cast<std::uint32_t>(frame));
+
+	size_t top = 0;  // Values on the stack; the topmost lives in xmm0, the others in their frame slots
+	for (const Instruction& instruction : code) {
+		switch (instruction.op) {
+
+			case OpCode::PushConstant:
+			case OpCode::PushVariable:
+			case OpCode::LoadTemp:
+				if (top > 0) {
+					out.store_frame(slot(top - 1));
+				}
+				if (instruction.op == OpCode::PushConstant) {
+					out.load_constant(constants[instruction.operand], 0);
+				}
+				else if (instruction.op == OpCode::PushVariable) {
+					out.load_value(static_cast<std::uint32_t>(8 * instruction.operand));
+				}
+				else {
+					out.load_frame(temp(instruction.operand));
+				}
+				top++;
+				break;
+
+			case OpCode::Add:
+			case OpCode::Subtract:
+			case OpCode::Multiply:
+				out.copy_to_xmm1();
+				out.load_frame(slot(top - 2));
+				out.arithmetic(instruction.op == OpCode::Add ? OP_ADDSD : instruction.op == OpCode::Subtract ? OP_SUBSD : OP_MULSD);
+				top--;
+				break;
+
+			case OpCode::Divide:
+				out.copy_to_xmm1();
+				out.emit({ 0x66, 0x0F, 0x57, 0xC0 });   // xorpd xmm0, xmm0
+				out.emit({ 0x66, 0x0F, 0x2E, 0xC8 });   // ucomisd xmm1, xmm0
+				out.jump_to_error(JUMP_IF_EQUAL);
+				out.load_frame(slot(top - 2));
+				out.arithmetic(OP_DIVSD);
+				top--;
+				break;
+
+			case OpCode::CheckDivisor:
+				out.zero_xmm1();
+				out.emit({ 0x66, 0x0F, 0x2E, 0xC1 });   // ucomisd xmm0, xmm1
+				out.jump_to_error(JUMP_IF_EQUAL);
+				break;
+
+			case OpCode::DivideSwapped:  // The dividend is in xmm0, the divisor (already checked) below it
+				out.divide_by_frame(slot(top - 2));
+				top--;
+				break;
+
+			case OpCode::Power:
+				out.copy_to_xmm1();
+				out.load_frame(slot(top - 2));
+				out.call(reinterpret_cast<const void*>(&call_pow));
+				top--;
+				break;
+
+			case OpCode::Sqrt:
+				out.zero_xmm1();
+				out.emit({ 0x66, 0x0F, 0x2E, 0xC1 });   // ucomisd xmm0, xmm1
+				out.jump_to_error(JUMP_IF_BELOW);
+				out.emit({ 0xF2, 0x0F, 0x51, 0xC0 });   // sqrtsd xmm0, xmm0
+				break;
+
+			case OpCode::Negate:
+				out.load_constant(-0.0, 1);
+				out.emit({ 0x66, 0x0F, 0x57, 0xC1 });   // xorpd xmm0, xmm1
+				break;
+
+			case OpCode::PowerInteger: {  // Same steps as power_by_squaring: xmm0 is the base, xmm1 the result
+				std::int32_t exponent = static_cast<std::int32_t>(instruction.operand);
+				unsigned remaining = exponent < 0 ? 0u - static_cast<unsigned>(exponent) : static_cast<unsigned>(exponent);
+				bool has_result = false;  // While false the result is still 1.0, and 1.0 * base is exactly base
+
+				while (remaining != 0) {
+					if (remaining & 1u) {
+						if (has_result) {
+							out.emit({ 0xF2, 0x0F, 0x59, 0xC8 });   // mulsd xmm1, xmm0
+						}
+						else {
+							out.copy_to_xmm1();
+							has_result = true;
+						}
+					}
+					remaining >>= 1;
+					if (remaining != 0) {
+						out.emit({ 0xF2, 0x0F, 0x59, 0xC0 });   // mulsd xmm0, xmm0
+					}
+				}
+
+				if (!has_result) {
+					out.load_constant(1.0, 0);
+				}
+				else if (exponent < 0) {
+					out.load_constant(1.0, 0);
+					out.arithmetic(OP_DIVSD);
+				}
+				else {
+					out.copy_to_xmm0();
+				}
+				break;
+			}
+
+			case OpCode::StoreTemp:
+				out.store_frame(temp(instruction.operand));
+				break;
+
+			case OpCode::Fail:  // A malformed tree: the interpreter reports it
+				return std::vector<std::uint8_t>();
+		}
+	}
+
+	// Epilogue: add rsp, frame; pop rbx; ret
+	size_t done = out.bytes.size();
+	out.emit({ 0x48, 0x81, 0xC4 });
+	out.emit32(static_cast<std::uint32_t>(frame));
+	out.emit({ 0x5B, 0xC3 });
+
+	// Error exit: return NaN through the same epilogue
+	out.bind_error_exit();
+	out.load_constant(std::numeric_limits<double>::quiet_NaN(), 0);
+	out.emit({ 0xE9 });
+	out.emit32(static_cast<std::uint32_t>(done - (out.bytes.size() + 4)));
+
+	return std::move(out.bytes);
+}
+
+/* install: Maps writable pages, copies the code in, then flips them to executable */
+bool NativeExpression::install(const std::vector<std::uint8_t>& code) {
+#if CALC_NATIVE_X64 && defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	size_t page = info.dwPageSize;
+	size_t size = (code.size() + page - 1) / page * page;
+
+	void* pages = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	if (!pages) {
+		return false;
+	}
+	std::memcpy(pages, code.data(), code.size());
+
+	DWORD previous;
+	if (!VirtualProtect(pages, size, PAGE_EXECUTE_READ, &previous)) {
+		VirtualFree(pages, 0, MEM_RELEASE);
+		return false;
+	}
+	FlushInstructionCache(GetCurrentProcess(), pages, size);
+#elif CALC_NATIVE_X64
+	size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	size_t size = (code.size() + page - 1) / page * page;
+
+	void* pages = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (pages == MAP_FAILED) {
+		return false;
+	}
+	std::memcpy(pages, code.data(), code.size());
+
+	if (mprotect(pages, size, PROT_READ | PROT_EXEC) != 0) {  // Hardened systems may refuse executable memory
+		munmap(pages, size);
+		return false;
+	}
+#else
+	(void)code;
+	return false;
+#endif
+
+#if CALC_NATIVE_X64
+	memory = pages;
+	memory_size = size;
+	function = reinterpret_cast<NativeFunction>(pages);
+	return true;
+#endif
+}
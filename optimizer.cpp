@@ -0,0 +1,240 @@
+#include "Optimizer.h"
+#include "Compiled_expression.h"
+#include <cmath>
+#include <string>
+
+/* constructor */
+Optimizer::Optimizer(bool fast_math) : fast_math(fast_math), stats{ 0, 0, 0 } {}
+
+/* optimize: Rebuilds every root of the tree with its rewrites applied */
+ExpressionTree Optimizer::optimize(const ExpressionTree& tree) {
+	output.clear();
+	stats = { 0, 0, 0 };
+
+	for (NodeIndex root : tree.get_roots()) {
+		output.add_root(optimize_node(tree, root));
+	}
+	return std::move(output);
+}
+
+/* make_node: Adds a node to the output arena, attaches its children and points them back at it */
+NodeIndex Optimizer::make_node(const Token& token, NodeIndex left, NodeIndex right) {
+	NodeIndex node = output.add_node(token);
+	output[node].left = left;
+	output[node].right = right;
+
+	if (left != NO_NODE) {
+		output[left].parent = node;
+	}
+	if (right != NO_NODE) {
+		output[right].parent = node;
+	}
+	return node;
+}
+
+/* make_number: Adds a literal holding exactly the given value */
+NodeIndex Optimizer::make_number(double value) {
+	return output.add_node(Token::number(value));
+}
+
+/* make_negation: Negates an output node, folding literals and cancelling a double negation */
+NodeIndex Optimizer::make_negation(NodeIndex operand) {
+	double value;
+	if (is_number(operand, value)) {
+		stats.folded++;
+		return make_number(-value);
+	}
+	if (output[operand].token.getType() == TokenType::Negation) {  // -(-x) is x
+		stats.simplified++;
+		NodeIndex inner = output[operand].left;
+		output[inner].parent = NO_NODE;
+		return inner;
+	}
+	return make_node(Token(TokenType::Negation, "neg"), operand, NO_NODE);
+}
+
+/* is_number: Reads the value of a literal node */
+bool Optimizer::is_number(NodeIndex index, double& value) const {
+	if (index == NO_NODE || output[index].token.getType() != TokenType::Number) {
+		return false;
+	}
+	value = output[index].token.getNumber();
+	return true;
+}
+
+/* optimize_node: Optimizes the children first, then rewrites the node itself. The walk keeps its
+				  pending nodes and the optimized children on explicit stacks, not on the call stack. */
+NodeIndex Optimizer::optimize_node(const ExpressionTree& tree, NodeIndex root) {
+	frames.clear();
+	results.clear();
+	frames.push_back({ root, 0 });
+
+	while (!frames.empty()) {
+		NodeFrame& frame = frames.back();
+		NodeIndex index = frame.index;
+
+		if (index == NO_NODE) {
+			results.push_back(NO_NODE);
+			frames.pop_back();
+		}
+		else if (frame.stage < 2) {  // Left child first, then right
+			NodeIndex child = frame.stage == 0 ? tree[index].left : tree[index].right;
+			frame.stage++;
+			frames.push_back({ child, 0 });
+		}
+		else {
+			NodeIndex right = results.back();
+			results.pop_back();
+			results.back() = rewrite_node(tree[index].token, results.back(), right);
+			frames.pop_back();
+		}
+	}
+	return results.back();
+}
+
+/* rewrite_node: Folds or simplifies a node whose children are already optimized, or copies it */
+NodeIndex Optimizer::rewrite_node(const Token& token, NodeIndex left, NodeIndex right) {
+
+	// Nodes missing an operand are copied as they are, so evaluating them still reports the error
+	const bool binary = left != NO_NODE && right != NO_NODE;
+	double a = 0.0;
+	double b = 0.0;
+	const bool constant_left = is_number(left, a);
+	const bool constant_right = is_number(right, b);
+
+	switch (token.getType()) {
+
+		case TokenType::Addition: {
+			if (binary && constant_left && constant_right) {
+				stats.folded++;
+				return make_number(a + b);
+			}
+			if (fast_math && binary && constant_right && b == 0) {  // -0 + 0 is +0, hence fast-math only
+				stats.simplified++;
+				return left;
+			}
+			if (fast_math && binary && constant_left && a == 0) {
+				stats.simplified++;
+				return right;
+			}
+			break;
+		}
+
+		case TokenType::Subtraction: {
+			if (binary && constant_left && constant_right) {
+				stats.folded++;
+				return make_number(a - b);
+			}
+			if (binary && constant_right && b == 0 && !std::signbit(b)) {  // x - (+0) is x, even for x = -0
+				stats.simplified++;
+				return left;
+			}
+			if (fast_math && binary && constant_left && a == 0) {
+				stats.simplified++;
+				return make_negation(right);
+			}
+			break;
+		}
+
+		case TokenType::Multiplication: {
+			if (binary && constant_left && constant_right) {
+				stats.folded++;
+				return make_number(a * b);
+			}
+			if (binary && (constant_left || constant_right)) {
+				NodeIndex other = constant_left ? right : left;
+				double factor = constant_left ? a : b;
+
+				if (factor == -1) {  // The Parser's unary minus; -1 * x is exactly -x
+					stats.simplified++;
+					return make_negation(other);
+				}
+				if (factor == 1) {
+					stats.simplified++;
+					return other;
+				}
+			}
+			break;
+		}
+
+		case TokenType::Division: {
+			if (!binary || !constant_right || b == 0) {  // A zero divisor must still raise its error
+				break;
+			}
+			if (constant_left) {
+				stats.folded++;
+				return make_number(a / b);
+			}
+			if (b == 1) {
+				stats.simplified++;
+				return left;
+			}
+			if (b == -1) {
+				stats.simplified++;
+				return make_negation(left);
+			}
+			break;
+		}
+
+		case TokenType::Sqrt: {
+			if (constant_left && !(a < 0)) {  // Same test as the evaluator, so NaN folds to NaN
+				stats.folded++;
+				return make_number(std::sqrt(a));
+			}
+			break;
+		}
+
+		case TokenType::Exponents: {
+			if (!binary || !constant_right) {
+				break;
+			}
+			if (constant_left) {
+				stats.folded++;
+				return make_number(std::pow(a, b));
+			}
+			if (b == 1) {
+				stats.simplified++;
+				return left;
+			}
+			if (b == 2) {  // x * x is the correctly rounded square, which is also what pow returns
+				stats.strength_reduced++;
+				return make_node(Token(TokenType::IntegerPower, "ipow"), left, make_number(2));
+			}
+			if (fast_math && b == 0) {
+				stats.simplified++;
+				return make_number(1);
+			}
+			if (fast_math && std::floor(b) == b && std::fabs(b) <= MAX_SQUARING_EXPONENT) {
+				stats.strength_reduced++;
+				return make_node(Token(TokenType::IntegerPower, "ipow"), left, make_number(b));
+			}
+			break;
+		}
+
+		case TokenType::Negation: {
+			if (left != NO_NODE) {
+				return make_negation(left);
+			}
+			break;
+		}
+
+		case TokenType::IntegerPower: {
+			if (constant_left && constant_right) {
+				stats.folded++;
+				return make_number(power_by_squaring(a, static_cast<int>(b)));
+			}
+			break;
+		}
+
+		default: {
+			break;
+		}
+	}
+
+	return make_node(token, left, right);
+}
+
+/* get_stats: Returns the rewrite counters */
+const OptimizerStats& Optimizer::get_stats() const {
+	return stats;
+}
@@ -1,259 +1,421 @@
 #include "Parser.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
 #include <stdexcept>
 #include <iostream>
 
-/* constructor: Initializes with a list of tokens and a set position to 0 */
-Parser::Parser(const std::vector<Token>& tokens) : tokens(tokens), position(0) {};
+/* constructor: Initializes with the tokenizer to pull tokens from */
+Parser::Parser(Tokenizer& tokenizer) : Parser(tokenizer, MAX_PARSE_DEPTH) {}
+
+/* constructor: Same, with a depth limit */
+Parser::Parser(Tokenizer& tokenizer, size_t max_depth)
+	: tokenizer(tokenizer), current(TokenType::End, std::string_view()), max_depth(max_depth), deepest(0), governor(nullptr) {}
+
+/* parse: Parses the tokens and constructs an arena holding one expression tree per statement */
+ExpressionTree Parser::parse() {
+	ExpressionTree result;
+	parse(result);
+	return result;
+}
+
+/* parse: Parses the tokens into the given arena, keeping its capacity */
+void Parser::parse(ExpressionTree& out) {
+	try_parse(out).throw_if_failed();
+}
+
+/* try_parse: Parses the tokens into the given arena, reporting malformed input as an Error instead of throwing */
+Result<void> Parser::try_parse(ExpressionTree& out) {
+	tree = std::move(out);
+	tree.clear();
+	deepest = 0;
+
+	bool parsed = read_statements();
+	if (!parsed) {  // Whatever was built so far is of no use
+		tree.clear();
+	}
+	out = std::move(tree);
+
+	if (!parsed) {
+		return Result<void>(error);
+	}
+	return Result<void>();
+}
+
+/* read_statements: Reads every statement of the input as one root of the arena */
+bool Parser::read_statements() {
+	current = tokenizer.scan_token();
+	if (current.getType() == TokenType::Error) {
+		error = tokenizer.get_error();
+		return false;
+	}
 
-/* parse: Parses the list of tokens and constructs a list of expression trees */
-std::vector<ExpressionNodePtr> Parser::parse() {
-	std::vector<ExpressionNodePtr> results;
-	
 	if (!is_primary(current_token()) && current_token().getType() != TokenType::Subtraction) {  // Checks for invalid tokens at start
-		throw std::runtime_error("Unexpected token at the start: " + current_token().getValue());
+		return fail(ErrorCode::UnexpectedStart, current_token());
 	}
 
-	check_parentheses_balance(); 
+	if (!check_parentheses_balance()) {
+		return false;
+	}
 
-	while (position < tokens.size()) { 
-		ExpressionNodePtr result; 
+	while (current_token().getType() != TokenType::End) { 
+		NodeIndex result; 
 
 		if (peek(TokenType::Equal)) {   // Checks if the next token in the stream matches the "Equal" token
-			result = parse_assignment();  //If there is an '=', we're dealing with an assignment statement 
+			if (!parse_assignment(result)) {  //If there is an '=', we're dealing with an assignment statement 
+				return false;
+			}
 		}
 		else {
-			result = parse_expression();  //If there is not an '=', we're dealing with an standard expression 
+			Operand expression;
+			if (!parse_expression(expression)) {  //If there is not an '=', we're dealing with an standard expression 
+				return false;
+			}
+			result = expression.node;
 		}
-		results.push_back(result); 
+		tree.add_root(result); 
 	}
+	return true;
+}
 
-	if (position != tokens.size()) {  // Ensure all tokens were processed
-		throw std::runtime_error("Unexpected token at the end of input");
-	}
+/* fail: Records an error found at a token; returns false so callers can pass the failure on */
+bool Parser::fail(ErrorCode code, const Token& token) {
+	error = Error(code, position_of(token), token.getValue());
+	return false;
+}
+
+/* position_of: Offset of a token in the expression text, or the end of the text for the End token and made-up tokens */
+size_t Parser::position_of(const Token& token) const {
+	std::string_view text = tokenizer.get_expression();
+	const char* start = token.getValue().data();
 
-	return results;
+	if (start && start >= text.data() && start < text.data() + text.size()) {
+		return static_cast<size_t>(start - text.data());
+	}
+	return text.size();
 }
 
-/* advance: Advances the position by one */
-void Parser::advance() {
-	if (position < tokens.size()) {
-		position++;
+/* advance: Pulls the next token from the tokenizer */
+bool Parser::advance() {
+	if (current.getType() == TokenType::End) {
+		return fail(ErrorCode::UnexpectedEnd, current);
 	}
-	else {
-		throw std::runtime_error("Unexpected end of input");
+
+	current = tokenizer.scan_token();
+	if (current.getType() == TokenType::Error) {
+		error = tokenizer.get_error();
+		return false;
 	}
+	return true;
 }
 
 /* current_token: Returns the current token being processed*/
-Token Parser::current_token() const {
-	if (position < tokens.size()) {
-		return tokens[position];
-	}
-	return Token(TokenType::CloseParenthesis, "");
+const Token& Parser::current_token() const {
+	return current;
 }
 
-/* parse_primary: Parses primary tokens such as numbers, parentheses, square roots, and negations*/
-ExpressionNodePtr Parser::parse_primary() {
-	Token token = current_token();
-	advance();
+/* Operator and operand stacks of parse_expression. Each thread keeps its own and every parse reuses them,
+   so parsing stops allocating once they have grown to the deepest input seen. */
+struct Parser::ParseStacks {
+	std::vector<Pending> pending;    // Operators, prefixes and parentheses not applied yet.
+	std::vector<Operand> operands;   // Subtrees waiting for their operator.
+};
+
+/* thread_stacks: The calling thread's stacks */
+Parser::ParseStacks& Parser::thread_stacks() {
+	static thread_local ParseStacks stacks;
+	return stacks;
+}
 
-	if (token.getType() == TokenType::Number) {
-		return std::make_shared<ExpressionNode>(token);
-	}
-	else  if (token.getType() == TokenType::OpenParenthesis) {
-		auto node = parse_expression();
+/* make_node: Adds a node to the arena, attaches its children and points them back at it */
+bool Parser::make_node(const Token& token, Operand left, Operand right, Operand& out) {
+	std::uint32_t depth = 1 + std::max(left.depth, right.depth);
 
-		if (current_token().getType() != TokenType::CloseParenthesis) {
-			throw std::runtime_error("Expected ')' but found: " + current_token().getValue());
-		}
-		advance();
-		return node;
-	}
-	else if (token.getType() == TokenType::Sqrt) {
-		return parse_sqrt();
+	if (depth > max_depth) {  // Every later pass walks the tree, so the limit is enforced while it is built
+		char limit[24];
+		std::to_chars_result written = std::to_chars(limit, limit + sizeof(limit), max_depth);
+		error = Error(ErrorCode::NestedTooDeeply, position_of(token), std::string_view(limit, written.ptr - limit));
+		return false;
 	}
-	else if (token.getType() == TokenType::Subtraction) {
-		auto node = std::make_shared<ExpressionNode>(token); 
-		node->left = parse_primary(); 
-		node->left->parent = node; 
-		return node; 
+	deepest = std::max<size_t>(deepest, depth);
+	if (governor) {
+		governor->add_node();
 	}
-	else if (token.getType() == TokenType::Variable) {				
-		return std::make_shared<ExpressionNode>(token); 
+
+	NodeIndex node = tree.add_node(token);
+	tree[node].left = left.node;
+	tree[node].right = right.node;
+
+	if (left.node != NO_NODE) {
+		tree[left.node].parent = node;
 	}
-	else {
-		throw std::runtime_error("Unexpected token: " + token.getValue());
+	if (right.node != NO_NODE) {
+		tree[right.node].parent = node;
 	}
-
-	return nullptr; 
+	out = { node, depth };
+	return true;
 }
 
-/* Parses additive and subtractive operations */
-ExpressionNodePtr Parser::parse_expression() {
-	auto left = parse_term(); 
+/* precedence: Binding strength of the binary operators, loosest first */
+int Parser::precedence(TokenType type) {
+	switch (type) {
+		case TokenType::Addition:
+		case TokenType::Subtraction:
+			return 1;
+		case TokenType::Multiplication:
+		case TokenType::Division:
+			return 2;
+		default:  // Exponents
+			return 3;
+	}
+}
 
-	while (current_token().getType() == TokenType::Addition || current_token().getType() == TokenType::Subtraction) {
-		Token t = current_token(); 
-		advance(); 
+/* parse_expression: Alternates between reading an operand and reading the operator after it */
+bool Parser::parse_expression(Operand& out) {
+	ParseStacks& stacks = thread_stacks();
+	stacks.pending.clear();
+	stacks.operands.clear();
+	bool factor_start = true;  // Whether the next operand starts a factor, where '-' means -1 * operand
 
-		auto right = parse_term(); 
+	while (true) {
 
-		if (!left || !right) {
-			throw std::runtime_error("Invalid binary operation");
+		// Operand: stacks prefixes and opening parentheses until a number or a variable arrives
+		Token token = current_token();
+		if (!advance()) {
+			return false;
 		}
 
-		auto node = std::make_shared<ExpressionNode>(t); 
-		node->left = left; 
-		node->right = right; 
-		node->parent = node; 
-		right->parent = node; 
-		left = node; 
-	}
-	return left; 
-}
-
-/* parse_term: Parses multiplicative operations */
-ExpressionNodePtr Parser::parse_term() {
-	
-	auto left = parse_factor();
-	while (current_token().getType() == TokenType::Multiplication || current_token().getType() == TokenType::Division ||
-		   is_primary(current_token())) {  // Handles implicit multiplication (Example: 2x, 2(3+5), etc..) 
+		if (token.getType() == TokenType::Subtraction) {
+			stacks.pending.push_back({ factor_start ? PendingKind::Negate : PendingKind::Minus, 0, token });
+			factor_start = false;
+			continue;
+		}
+		factor_start = false;
 
-		Token t = Token(TokenType::Multiplication, "*");
+		if (token.getType() == TokenType::OpenParenthesis) {
+			stacks.pending.push_back({ PendingKind::Group, 0, token });
+			factor_start = true;
+			continue;
+		}
+		if (token.getType() == TokenType::Sqrt) {
+			stacks.pending.push_back({ PendingKind::Sqrt, 0, token });
+			continue;
+		}
+		if (token.getType() != TokenType::Number && token.getType() != TokenType::Variable) {
+			return fail(ErrorCode::UnexpectedToken, token);
+		}
+		if (governor) {
+			governor->add_node();
+		}
+		stacks.operands.push_back({ tree.add_node(token), 0 });
+
+		// Operator: closes the parentheses that end here, then reads the binary operator that follows
+		while (true) {
+			if (!apply_prefixes(stacks)) {
+				return false;
+			}
+
+			TokenType type = current_token().getType();
+			if (type == TokenType::Addition || type == TokenType::Subtraction || type == TokenType::Multiplication ||
+				type == TokenType::Division || type == TokenType::Exponents || is_primary(current_token())) {
+				break;
+			}
+
+			if (!reduce(stacks, 0, false)) {
+				return false;
+			}
+			if (stacks.pending.empty()) {  // Nothing left open: the expression ends before this token
+				out = stacks.operands.back();
+				return true;
+			}
+
+			if (type != TokenType::CloseParenthesis) {
+				return fail(ErrorCode::ExpectedParenthesis, current_token());
+			}
+			if (!advance()) {
+				return false;
+			}
+			stacks.pending.pop_back();  // The parenthesized expression is now an operand of what came before it
+		}
 
+		Token op = Token(TokenType::Multiplication, "*");  // Handles implicit multiplication (Example: 2x, 2(3+5), etc..)
 		if (!is_primary(current_token())) {
-			t = current_token(); 
-			advance(); 
+			op = current_token();
+			if (!advance()) {
+				return false;
+			}
 		}
 
-		auto right = parse_factor(); 
-
-		if (!left || !right) {  
-			throw std::runtime_error("Invalid binary operation");
+		int level = precedence(op.getType());
+		if (!reduce(stacks, level, op.getType() == TokenType::Exponents)) {
+			return false;
 		}
-
-		auto node = std::make_shared<ExpressionNode>(t);
-		node->left = left;
-		node->right = right;
-		left->parent = node;
-		right->parent = node;
-		left = node;
+		stacks.pending.push_back({ PendingKind::Binary, level, op });
+		factor_start = true;
 	}
-	return left; 
 }
 
-/* parse_sqrt: Parses square root operations */
-ExpressionNodePtr Parser::parse_sqrt() {
-	auto node = std::make_shared<ExpressionNode>(Token(TokenType::Sqrt, "sqrt")); 
-	node->left = parse_primary(); 
-	node->left->parent = node; 
-	return node; 
+/* apply_prefixes: Wraps the newest operand in the '-' and sqrt prefixes written in front of it, innermost first */
+bool Parser::apply_prefixes(ParseStacks& stacks) {
+	const Operand none = { NO_NODE, 0 };
+
+	while (!stacks.pending.empty() && stacks.pending.back().kind != PendingKind::Binary && stacks.pending.back().kind != PendingKind::Group) {
+		Pending prefix = stacks.pending.back();
+		stacks.pending.pop_back();
+		Operand operand = stacks.operands.back();
+		bool built;
+
+		if (prefix.kind == PendingKind::Negate) {
+			if (governor) {
+				governor->add_node();
+			}
+			Operand minus_one = { tree.add_node(Token::number(-1.0, "-1")), 0 };
+			built = make_node(Token(TokenType::Multiplication, "*"), minus_one, operand, stacks.operands.back());
+		}
+		else if (prefix.kind == PendingKind::Sqrt) {
+			built = make_node(Token(TokenType::Sqrt, "sqrt"), operand, none, stacks.operands.back());
+		}
+		else {
+			built = make_node(prefix.token, operand, none, stacks.operands.back());
+		}
+		if (!built) {
+			return false;
+		}
+	}
+	return true;
 }
 
-/* parse_factor: Parses exponentation*/
-ExpressionNodePtr Parser::parse_factor() {
-	auto left = parse_unary();
-
-	while (current_token().getType() == TokenType::Exponents) {
-		Token t = current_token();
-		advance();
+/* reduce: Pops the binary operators that bind tighter than the next one and builds their nodes */
+bool Parser::reduce(ParseStacks& stacks, int level, bool right_associative) {
+	while (!stacks.pending.empty() && stacks.pending.back().kind == PendingKind::Binary &&
+		   (stacks.pending.back().precedence > level || (stacks.pending.back().precedence == level && !right_associative))) {
+		Operand right = stacks.operands.back();
+		stacks.operands.pop_back();
+		Operand left = stacks.operands.back();
 
-		auto right = parse_factor(); //Recursively call parse_factor to ensure the correct right-associativity of exponentiation
-
-		if (!left || !right) { 
-			throw std::runtime_error("Invalid binary operation in exponentation");
+		if (!make_node(stacks.pending.back().token, left, right, stacks.operands.back())) {
+			return false;
 		}
-
-		auto node = std::make_shared<ExpressionNode>(t); 
-		node->left = left; 
-		node->right = right; 
-		left->parent = node; 
-		right->parent = node; 
-		return node; 
+		stacks.pending.pop_back();
 	}
-	return left; 
+	return true;
 }
 
 /* parse_assignment: Parses assignment expressions, by handling the assignment operations ensuring the correct order
 				of operations when evaluating the LHS and the RHS*/
-ExpressionNodePtr Parser::parse_assignment() {
-	auto left = parse_expression(); 
+bool Parser::parse_assignment(NodeIndex& out) {
+	Operand left;
+	if (!parse_expression(left)) {
+		return false;
+	}
 
 	if (current_token().getType() == TokenType::Equal) {
 
-		if (left->token.getType() != TokenType::Variable) {
-			throw std::runtime_error("Invalid left-hand side in assignment.");
+		if (tree[left.node].token.getType() != TokenType::Variable) {
+			return fail(ErrorCode::InvalidAssignment, tree[left.node].token);
+		}
+		if (!advance()) {
+			return false;
 		}
-		advance();
-
-		auto right = parse_expression();
-
-		auto node = std::make_shared<ExpressionNode>(Token(TokenType::Equal, "="));
-		node->left = left;
-		node->right = right;
-		left->parent = node;
-		right->parent = node;
 
-		return node;
+		Operand right;
+		Operand assignment;
+		if (!parse_expression(right) || !make_node(Token(TokenType::Equal, "="), left, right, assignment)) {
+			return false;
+		}
+		out = assignment.node;
+		return true;
 	}
-	return left; 
+	out = left.node;
+	return true;
 	
 }
 
-/* parse_unary: Parses unary operations (negation) */
-ExpressionNodePtr Parser::parse_unary() {
-	if (current_token().getType() == TokenType::Subtraction) {
-		advance(); 
-
-		auto operand = parse_primary(); 
-		if (!operand) {
-			throw std::runtime_error("Invalid unary operation: missing operand after '-'");
+/* visualize_tree: Converts the expression tree into a visual string representation, "op (left, right)" */
+std::string Parser::visualize_tree(const ExpressionTree& tree, NodeIndex node) {
+	std::string result;
+	std::vector<NodeFrame> frames = { { node, 0 } };
+
+	while (!frames.empty()) {
+		NodeFrame& frame = frames.back();
+		NodeIndex index = frame.index;
+
+		if (index == NO_NODE || (frame.stage == 0 && tree[index].left == NO_NODE && tree[index].right == NO_NODE)) {
+			if (index != NO_NODE) {
+				result += label(tree, index);
+			}
+			frames.pop_back();
+			continue;
 		}
 
-		auto node = std::make_shared<ExpressionNode>(Token(TokenType::Multiplication, "*")); 
-		node->left = std::make_shared<ExpressionNode>(Token(TokenType::Number, "-1")); 
-		node->right = operand; 
-		node->left->parent = node; 
-		node->right->parent = node; 
-
-		return node; 
+		if (frame.stage == 0) {
+			result += label(tree, index) + " (";
+			frame.stage = 1;
+			frames.push_back({ tree[index].left, 0 });
+		}
+		else if (frame.stage == 1) {
+			result += ", ";
+			frame.stage = 2;
+			frames.push_back({ tree[index].right, 0 });
+		}
+		else {
+			result += ")";
+			frames.pop_back();
+		}
 	}
-	return parse_primary(); 
+	return result; 
 }
 
-/* visualize_tree: Converts the expression tree into a visual string representation */
-std::string Parser::visualize_tree(ExpressionNodePtr node) {
-	if (!node) return ""; 
+/* label: The text of a node's token, or the value of a literal made up by the Optimizer */
+std::string Parser::label(const ExpressionTree& tree, NodeIndex node) {
+	const Token& token = tree[node].token;
+	std::string result(token.getValue());
 
-	std::string result = node->token.getValue(); 
+	if (result.empty() && token.getType() == TokenType::Number) {  // Literals made up by the Optimizer carry only their value
+		char text[32];
+		std::snprintf(text, sizeof(text), "%.17g", token.getNumber());
+		result = text;
+	}
+	return result;
+}
 
-	if (node->left || node->right) {
-		result += " (" + visualize_tree(node->left) + ", " + visualize_tree(node->right) + ")"; 
-	}	
+/* set_governor: Takes the budget of the line; its depth limit applies when it is the lower one */
+void Parser::set_governor(ResourceGovernor* governor) {
+	this->governor = governor;
+	if (governor) {
+		max_depth = std::min(max_depth, governor->get_limits().max_depth);
+	}
+}
 
-	return result; 
+/* get_depth: Operator levels of the deepest tree of the last parse */
+size_t Parser::get_depth() const {
+	return deepest;
 }
 
-/* check_parentheses: Checks for balanced parentheses in a list of tokens */
-void Parser::check_parentheses_balance() {
+/* check_parentheses: Checks for balanced parentheses in the expression text */
+bool Parser::check_parentheses_balance() {
+	std::string_view text = tokenizer.get_expression();
 	int count = 0; 
 
-	for (const auto& token : tokens) {
-		if (token.getType() == TokenType::OpenParenthesis) {
+	for (size_t i = 0; i < text.size(); i++) {  // Parentheses are single characters, so the raw text is enough
+		if (text[i] == '(') {
 			count++; 
 		}
-		else if (token.getType() == TokenType::CloseParenthesis) {
+		else if (text[i] == ')') {
 			count--; 
 		}
 
 		if (count < 0) {
-			throw std::runtime_error("Expected ')' before matching '('");
+			error = Error(ErrorCode::UnopenedParenthesis, i);
+			return false;
 		}
 	}
 
 	if (count != 0) {
-		throw std::runtime_error("Mismatched parentheses");
+		error = Error(ErrorCode::MismatchedParentheses, text.size());
+		return false;
 	}
+	return true;
 }
 
 /* is_primary: Checks if a token represents a primary expression*/
@@ -264,10 +426,5 @@ bool Parser::is_primary(const Token& token) {
 
 /* peak: Peeks ahead to see if the next token in the list matches the given type without advancing the parser*/
 bool Parser::peek(TokenType type) const {
-	if (position < tokens.size()) {
-		return tokens[position].getType() == type; 
-	}
-	else {
-		return false; 
-	}
+	return current.getType() == type; 
 }
\ No newline at end of file
@@ -0,0 +1,87 @@
+#include "Resource_governor.h"
+
+/* limit_kind_name: Printed name of each limit */
+const char* limit_kind_name(LimitKind kind) {
+	switch (kind) {
+		case LimitKind::Nodes: return "nodes";
+		case LimitKind::Depth: return "depth";
+		case LimitKind::Steps: return "steps";
+		case LimitKind::Deadline: return "deadline";
+		default: return "cancelled";
+	}
+}
+
+/* constructor */
+LimitExceeded::LimitExceeded(LimitKind kind, const std::string& message) : std::runtime_error(message), kind(kind) {}
+
+/* get_kind: Returns the limit that was hit */
+LimitKind LimitExceeded::get_kind() const {
+	return kind;
+}
+
+/* constructor */
+CancellationToken::CancellationToken() : cancelled(false) {}
+
+/* cancel: Raises the flag; a lock-free atomic store, so signal handlers may call it */
+void CancellationToken::cancel() {
+	cancelled.store(true, std::memory_order_relaxed);
+}
+
+/* reset: Lowers the flag */
+void CancellationToken::reset() {
+	cancelled.store(false, std::memory_order_relaxed);
+}
+
+/* is_cancelled: Reads the flag */
+bool CancellationToken::is_cancelled() const {
+	return cancelled.load(std::memory_order_relaxed);
+}
+
+/* any: Checks for a limit other than the defaults */
+bool ResourceLimits::any() const {
+	return max_nodes != NO_LIMIT || max_depth != NO_LIMIT || max_steps != NO_LIMIT || timeout.count() > 0 || cancel != nullptr;
+}
+
+/* constructor: The deadline counts from here */
+ResourceGovernor::ResourceGovernor(const ResourceLimits& limits)
+	: limits(limits), deadline(), nodes(0), steps(0), unchecked(0) {
+	if (limits.timeout.count() > 0) {
+		deadline = std::chrono::steady_clock::now() + limits.timeout;
+	}
+}
+
+/* fail: Builds the message of the limit that was hit */
+void ResourceGovernor::fail(LimitKind kind) const {
+	switch (kind) {
+		case LimitKind::Nodes:
+			throw LimitExceeded(kind, "Limit exceeded: expression has more than " + std::to_string(limits.max_nodes) + " nodes");
+		case LimitKind::Steps:
+			throw LimitExceeded(kind, "Limit exceeded: evaluation takes more than " + std::to_string(limits.max_steps) + " steps");
+		case LimitKind::Deadline:
+			throw LimitExceeded(kind, "Limit exceeded: evaluation took longer than " + std::to_string(limits.timeout.count()) + " ms");
+		default:
+			throw LimitExceeded(LimitKind::Cancelled, "Evaluation cancelled");
+	}
+}
+
+/* check: The slow part of the bookkeeping, run every CHECK_INTERVAL units of work */
+void ResourceGovernor::check() {
+	unchecked = 0;
+
+	if (limits.cancel && limits.cancel->is_cancelled()) {
+		fail(LimitKind::Cancelled);
+	}
+	if (limits.timeout.count() > 0 && std::chrono::steady_clock::now() >= deadline) {
+		fail(LimitKind::Deadline);
+	}
+}
+
+/* get_limits: Returns the limits in force */
+const ResourceLimits& ResourceGovernor::get_limits() const {
+	return limits;
+}
+
+/* get_steps: Returns the evaluation work counted so far */
+size_t ResourceGovernor::get_steps() const {
+	return steps;
+}
@@ -0,0 +1,104 @@
+#include "Result.h"
+#include "Resource_governor.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+/* constructor: Copies a short detail into the buffer and a long one into its own string, so no message is cut */
+Error::Error(ErrorCode code, size_t position, std::string_view detail)
+	: code(code), detail_size(0), position(static_cast<std::uint32_t>(std::min<size_t>(position, std::numeric_limits<std::uint32_t>::max()))), detail() {
+	if (detail.size() <= DETAIL_CAPACITY) {
+		std::memcpy(this->detail, detail.data(), detail.size());
+		detail_size = static_cast<std::uint8_t>(detail.size());
+	}
+	else {
+		overflow = std::make_shared<const std::string>(detail);
+	}
+}
+
+/* message: Builds the message in a new string */
+std::string Error::message() const {
+	std::string text;
+	append_message(text);
+	return text;
+}
+
+/* append_message: Writes the text of each error code, with its detail where the message has one */
+void Error::append_message(std::string& out) const {
+	switch (code) {
+		case ErrorCode::None:
+			break;
+		case ErrorCode::InvalidCharacter:
+			out += "Invalid character encountered: ";
+			out += get_detail();
+			break;
+		case ErrorCode::NumberOutOfRange:
+			out += "Number out of range: ";
+			out += get_detail();
+			break;
+		case ErrorCode::InvalidOperator:
+			out += "Invalid operator encountered";
+			break;
+		case ErrorCode::InvalidParenthesis:
+			out += "Invalid parenthesis character encountered";
+			break;
+		case ErrorCode::UnexpectedStart:
+			out += "Unexpected token at the start: ";
+			out += get_detail();
+			break;
+		case ErrorCode::UnexpectedToken:
+			out += "Unexpected token: ";
+			out += get_detail();
+			break;
+		case ErrorCode::UnexpectedEnd:
+			out += "Unexpected end of input";
+			break;
+		case ErrorCode::ExpectedParenthesis:
+			out += "Expected ')' but found: ";
+			out += get_detail();
+			break;
+		case ErrorCode::UnopenedParenthesis:
+			out += "Expected ')' before matching '('";
+			break;
+		case ErrorCode::MismatchedParentheses:
+			out += "Mismatched parentheses";
+			break;
+		case ErrorCode::InvalidAssignment:
+			out += "Invalid left-hand side in assignment.";
+			break;
+		case ErrorCode::NestedTooDeeply:
+			out += "Expression is nested too deeply (more than ";
+			out += get_detail();
+			out += " levels)";
+			break;
+		case ErrorCode::DivisionByZero:
+			out += "Division by zero";
+			break;
+		case ErrorCode::NegativeSqrt:
+			out += "Invalid input for square root";
+			break;
+		case ErrorCode::UndefinedVariable:
+			out += "Variable not defined: ";
+			out += get_detail();
+			break;
+		case ErrorCode::InvalidTree:
+			if (get_detail().empty()) {
+				out += "Invalid expression tree";
+			}
+			else {
+				out += "Invalid nodes for ";
+				out += get_detail();
+				out += " operation";
+			}
+			break;
+	}
+}
+
+/* raise: The depth limit is a LimitExceeded, like the limits of a ResourceGovernor */
+void Error::raise() const {
+	if (is_limit()) {
+		throw LimitExceeded(LimitKind::Depth, message());
+	}
+	throw std::runtime_error(message());
+}
@@ -0,0 +1,297 @@
+#include "Scalar_traits.h"
+#include <algorithm>
+#include <charconv>
+
+static const double INFINITE = std::numeric_limits<double>::infinity();
+
+/* row_status_message: Maps a row status to the matching evaluator error text */
+const char* row_status_message(RowStatus status) {
+	switch (status) {
+		case RowStatus::DivisionByZero:
+			return "Division by zero";
+		case RowStatus::NegativeSqrt:
+			return "Invalid input for square root";
+		case RowStatus::UndefinedVariable:
+			return "Variable not defined";
+		case RowStatus::InvalidTree:
+			return "Invalid expression tree";
+		default:
+			return "";
+	}
+}
+
+/* scalar_type_name: The name used by the mode command and --scalar */
+const char* scalar_type_name(ScalarType type) {
+	switch (type) {
+		case ScalarType::Float: return "float";
+		case ScalarType::Double: return "double";
+		case ScalarType::LongDouble: return "long double";
+		case ScalarType::Complex: return "complex";
+		default: return "interval";
+	}
+}
+
+/* parse_scalar_type: Finds the type with the given name */
+bool parse_scalar_type(const std::string& name, ScalarType& type) {
+	for (ScalarType candidate : { ScalarType::Float, ScalarType::Double, ScalarType::LongDouble, ScalarType::Complex, ScalarType::Interval }) {
+		if (name == scalar_type_name(candidate)) {
+			type = candidate;
+			return true;
+		}
+	}
+	if (name == "long") {
+		type = ScalarType::LongDouble;
+		return true;
+	}
+	return false;
+}
+
+/* format_shortest: The shortest text that reads back as the same value */
+template <typename Real>
+static std::string format_shortest(Real value) {
+	char text[64];
+	auto result = std::to_chars(text, text + sizeof(text), value);
+	return std::string(text, result.ptr);
+}
+
+std::string ScalarTraits<float>::format(float value) {
+	return format_shortest(value);
+}
+
+std::string ScalarTraits<double>::format(double value) {
+	return format_shortest(value);
+}
+
+std::string ScalarTraits<long double>::format(long double value) {
+	return format_shortest(value);
+}
+
+/*------Complex numbers--------------------------------------------------------*/
+
+/* without_negative_zero: Turns an imaginary part of -0 into +0, so real negative numbers sit above the branch cut */
+static std::complex<double> without_negative_zero(const std::complex<double>& value) {
+	return value.imag() == 0 ? std::complex<double>(value.real(), 0.0) : value;
+}
+
+/* sqrt: The principal square root, so sqrt(-4) is 2i */
+RowStatus ScalarTraits<std::complex<double>>::sqrt(const Complex& a, Complex& out) {
+	out = std::sqrt(without_negative_zero(a));
+	return RowStatus::Ok;
+}
+
+/* power: Integer and real powers the way the real types compute them, the principal value otherwise */
+std::complex<double> ScalarTraits<std::complex<double>>::power(const Complex& a, const Complex& b) {
+	int exponent;
+	if (as_small_integer(b, exponent)) {  // Exact for (-2)^3, where exp(3 log(-2)) leaves an imaginary residue
+		return power_by_squaring(a, exponent);
+	}
+	if (a.imag() == 0 && b.imag() == 0 && a.real() >= 0) {
+		return Complex(std::pow(a.real(), b.real()), 0.0);
+	}
+	return std::pow(without_negative_zero(a), b);
+}
+
+/* format: "a + bi", leaving out a zero part */
+std::string ScalarTraits<std::complex<double>>::format(const Complex& value) {
+	if (value.imag() == 0) {
+		return format_shortest(value.real());
+	}
+	std::string text;
+	if (value.real() != 0) {
+		text = format_shortest(value.real());
+		text += value.imag() < 0 ? " - " : " + ";
+	}
+	else if (value.imag() < 0) {
+		text = "-";
+	}
+	text += format_shortest(std::fabs(value.imag()));
+	text += 'i';
+	return text;
+}
+
+/*------Intervals--------------------------------------------------------------
+	Each bound is the rounded result, moved one step outward only when the
+	rounding went inward. Whether it did is known exactly from the rounding
+	error, which is itself a double (TwoSum for sums, fma for products,
+	quotients and square roots), so exact results stay points: 1 + 1 is
+	[2, 2].
+----------------------------------------------------------------------------*/
+
+static double step_down(double value) {
+	return std::nextafter(value, -INFINITE);
+}
+
+static double step_up(double value) {
+	return std::nextafter(value, INFINITE);
+}
+
+/* add_bound: a + b rounded down or up */
+static double add_bound(double a, double b, bool upper) {
+	double sum = a + b;
+	double b_part = sum - a;
+	double error = (a - (sum - b_part)) + (b - b_part);  // Exact value minus sum (NaN once infinite)
+	if (upper) {
+		return error > 0 ? step_up(sum) : sum;
+	}
+	return error < 0 ? step_down(sum) : sum;
+}
+
+/* multiply_bound: a * b rounded down or up */
+static double multiply_bound(double a, double b, bool upper) {
+	double product = a * b;
+	if (product != product) {  // 0 * infinity: the bound contributes nothing
+		return upper ? -INFINITE : INFINITE;
+	}
+	double error = std::fma(a, b, -product);
+	if (upper) {
+		return error > 0 ? step_up(product) : product;
+	}
+	return error < 0 ? step_down(product) : product;
+}
+
+/* divide_bound: a / b rounded down or up (b not zero) */
+static double divide_bound(double a, double b, bool upper) {
+	double quotient = a / b;
+	double remainder = std::fma(-quotient, b, a);  // a - quotient * b, exactly
+	double direction = b > 0 ? remainder : -remainder;  // Sign of the exact quotient minus quotient
+	if (upper) {
+		return direction > 0 ? step_up(quotient) : quotient;
+	}
+	return direction < 0 ? step_down(quotient) : quotient;
+}
+
+/* power_bound: x^n by repeated squaring, every step rounded the same way so the result bounds the exact power */
+static double power_bound(double x, unsigned n, bool upper) {
+	bool negative = x < 0 && (n & 1u);
+	bool magnitude_upper = negative ? !upper : upper;
+	double base = std::fabs(x);
+	double result = 1.0;
+
+	while (n != 0) {
+		if (n & 1u) {
+			result = multiply_bound(result, base, magnitude_upper);
+		}
+		n >>= 1;
+		if (n != 0) {
+			base = multiply_bound(base, base, magnitude_upper);
+		}
+	}
+	return negative ? -result : result;
+}
+
+Interval operator+(const Interval& a, const Interval& b) {
+	return { add_bound(a.low, b.low, false), add_bound(a.high, b.high, true) };
+}
+
+Interval operator-(const Interval& a, const Interval& b) {
+	return { add_bound(a.low, -b.high, false), add_bound(a.high, -b.low, true) };
+}
+
+Interval operator-(const Interval& a) {
+	return { -a.high, -a.low };
+}
+
+/* operator*: The extremes are among the four products of the bounds */
+Interval operator*(const Interval& a, const Interval& b) {
+	Interval result = { INFINITE, -INFINITE };
+	for (double x : { a.low, a.high }) {
+		for (double y : { b.low, b.high }) {
+			result.low = std::min(result.low, multiply_bound(x, y, false));
+			result.high = std::max(result.high, multiply_bound(x, y, true));
+		}
+	}
+	return result;
+}
+
+/* divide: The four quotients of the bounds, unless the divisor could be zero */
+RowStatus ScalarTraits<Interval>::divide(const Interval& a, const Interval& b, Interval& out) {
+	if (check_divisor(b) != RowStatus::Ok) {
+		return RowStatus::DivisionByZero;
+	}
+
+	Interval result = { INFINITE, -INFINITE };  // out may be a or b
+	for (double x : { a.low, a.high }) {
+		for (double y : { b.low, b.high }) {
+			result.low = std::min(result.low, divide_bound(x, y, false));
+			result.high = std::max(result.high, divide_bound(x, y, true));
+		}
+	}
+	out = result;
+	return RowStatus::Ok;
+}
+
+/* sqrt: Rounds each root outward using its exact residual; a part below zero is left out */
+RowStatus ScalarTraits<Interval>::sqrt(const Interval& a, Interval& out) {
+	if (a.high < 0) {
+		return RowStatus::NegativeSqrt;
+	}
+
+	double low_input = std::max(a.low, 0.0);
+	double high_input = a.high;
+	double low = std::sqrt(low_input);
+	double high = std::sqrt(high_input);
+	out.low = std::fma(-low, low, low_input) < 0 ? step_down(low) : low;
+	out.high = std::fma(-high, high, high_input) > 0 ? step_up(high) : high;
+	return RowStatus::Ok;
+}
+
+/* power_integer: Monotonic pieces of x^n; an even power of an interval around zero starts at zero */
+Interval ScalarTraits<Interval>::power_integer(const Interval& a, int exponent) {
+	unsigned n = exponent < 0 ? 0u - static_cast<unsigned>(exponent) : static_cast<unsigned>(exponent);
+	Interval result;
+
+	if (n == 0) {
+		result = { 1.0, 1.0 };
+	}
+	else if ((n & 1u) || a.low >= 0) {
+		result = { power_bound(a.low, n, false), power_bound(a.high, n, true) };
+	}
+	else if (a.high <= 0) {
+		result = { power_bound(a.high, n, false), power_bound(a.low, n, true) };
+	}
+	else {
+		result = { 0.0, std::max(power_bound(a.low, n, true), power_bound(a.high, n, true)) };
+	}
+
+	if (exponent >= 0) {
+		return result;
+	}
+	Interval reciprocal;
+	if (divide({ 1.0, 1.0 }, result, reciprocal) != RowStatus::Ok) {  // 1/x around zero covers the whole line
+		return { -INFINITE, INFINITE };
+	}
+	return reciprocal;
+}
+
+/* power: x^y is monotonic in each argument for x >= 0, so the extremes are at the corners; std::pow
+		  is within an ulp, so each corner is widened by two */
+Interval ScalarTraits<Interval>::power(const Interval& a, const Interval& b) {
+	int exponent;
+	if (as_small_integer(b, exponent)) {
+		return power_integer(a, exponent);
+	}
+	if (!(a.low >= 0)) {  // A negative base has no real power for most exponents
+		return not_a_number();
+	}
+
+	Interval result = { INFINITE, -INFINITE };
+	for (double x : { a.low, a.high }) {
+		for (double y : { b.low, b.high }) {
+			double corner = std::pow(x, y);
+			result.low = std::min(result.low, step_down(step_down(corner)));
+			result.high = std::max(result.high, step_up(step_up(corner)));
+		}
+	}
+	result.low = std::max(result.low, 0.0);
+	return result;
+}
+
+/* format: "[low, high]" */
+std::string ScalarTraits<Interval>::format(const Interval& value) {
+	std::string text = "[";
+	text += format_shortest(value.low);
+	text += ", ";
+	text += format_shortest(value.high);
+	text += ']';
+	return text;
+}
@@ -0,0 +1,413 @@
+#include "Server.h"
+#include <cctype>
+#include <charconv>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__linux__)
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* normalize_request: Copies a line without its '\r', lowercased like the interactive prompt; returns false for blank lines */
+static bool normalize_request(const char* text, size_t length, std::string& line) {
+	if (length > 0 && text[length - 1] == '\r') {
+		length--;
+	}
+
+	line.assign(text, length);
+	for (char& c : line) {
+		c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+	}
+
+	return line.find_first_not_of(" \t") != std::string::npos;
+}
+
+/* How a request ended. */
+enum class Outcome {
+	Answered,
+	Failed,
+	Limited    // Failed by running out of its budget.
+};
+
+/* append_failure: Appends the response line of a request that failed and tells how it failed */
+static Outcome append_failure(std::string& output, const Error& error) {
+	output.append("error: ");
+	error.append_message(output);
+	output.push_back('\n');
+	return error.is_limit() ? Outcome::Limited : Outcome::Failed;
+}
+
+/* answer: Runs one request in the connection's session and appends its response line */
+static Outcome answer(Session& session, const std::string& line, std::string& output) {
+	// Malformed requests come back as an Error; only limits and formula cycles are thrown
+	try {
+		if (session.get_scalar_type() != ScalarType::Double && line.find('=') == std::string::npos) {
+			Result<std::string> value = session.try_evaluate_text(line);
+			if (!value) {
+				return append_failure(output, value.error());
+			}
+			output.append(value.value());
+		}
+		else {
+			Result<LineResult> result = session.try_execute(line);
+			if (!result) {
+				return append_failure(output, result.error());
+			}
+			if (result.value().is_assignment) {
+				output.append(result.value().variable);
+				output.append(" = ");
+			}
+			output.append(ScalarTraits<double>::format(result.value().value));  // Shortest text that reads back as the same double
+		}
+		output.push_back('\n');
+		return Outcome::Answered;
+	}
+	catch (const LimitExceeded& e) {
+		output.append("error: ");
+		output.append(e.what());
+		output.push_back('\n');
+		return Outcome::Limited;
+	}
+	catch (const std::exception& e) {
+		output.append("error: ");
+		output.append(e.what());
+		output.push_back('\n');
+		return Outcome::Failed;
+	}
+}
+
+/* One client: its socket, its session and the bytes waiting in each direction. */
+struct Connection {
+	int fd;
+	Session session;
+	std::string input;            // Received bytes after the last complete line.
+	std::string output;           // Responses not sent yet.
+	size_t sent = 0;              // Bytes of output already sent.
+	bool closing = false;         // Nothing more is read (the client shut down its side); close once everything is answered and sent.
+	std::uint32_t events = EPOLLIN | EPOLLRDHUP;  // Events the socket is registered for.
+
+	Connection(int fd, const SessionOptions& options, std::shared_ptr<ExpressionCache> cache)
+		: fd(fd), session(options, std::move(cache)) {}
+};
+
+/* fail: Throws the error of a failed system call */
+static void fail(const std::string& what) {
+	throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+/* constructor: Parses the address, then creates, binds and listens on the socket */
+Server::Server(const ServerOptions& options)
+	: options(options), listen_fd(-1), stop_fd(-1), cache(std::make_shared<ExpressionCache>()),
+	  connections(0), requests(0), failed(0), limited(0) {
+
+	const std::string& address = options.address;
+
+	if (address.compare(0, 5, "unix:") == 0) {
+		socket_path = address.substr(5);
+		sockaddr_un local = {};
+		local.sun_family = AF_UNIX;
+		if (socket_path.empty() || socket_path.size() >= sizeof(local.sun_path)) {
+			throw std::runtime_error("Invalid Unix socket path: " + socket_path);
+		}
+		std::memcpy(local.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+		// A socket file left behind by an earlier server would make bind fail
+		struct stat status;
+		if (stat(socket_path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode)) {
+			unlink(socket_path.c_str());
+		}
+
+		listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (listen_fd < 0) fail("socket");
+		if (bind(listen_fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0) {
+			close(listen_fd);
+			fail("Cannot listen on " + address);
+		}
+		bound_address = address;
+	}
+	else {
+		size_t colon = address.rfind(':');
+		std::string host = colon == std::string::npos ? "127.0.0.1" : address.substr(0, colon);
+		std::string port_text = colon == std::string::npos ? address : address.substr(colon + 1);
+
+		unsigned port = 0;
+		std::from_chars_result parsed = std::from_chars(port_text.data(), port_text.data() + port_text.size(), port);
+		sockaddr_in local = {};
+		local.sin_family = AF_INET;
+		local.sin_port = htons(static_cast<std::uint16_t>(port));
+		if (port_text.empty() || parsed.ec != std::errc() || parsed.ptr != port_text.data() + port_text.size() || port > 65535 ||
+			inet_pton(AF_INET, host.c_str(), &local.sin_addr) != 1) {
+			throw std::runtime_error("Invalid server address: " + address + " (expected unix:<path>, <host>:<port> or <port>)");
+		}
+
+		listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (listen_fd < 0) fail("socket");
+		int reuse = 1;
+		setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+		if (bind(listen_fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) != 0) {
+			close(listen_fd);
+			fail("Cannot listen on " + address);
+		}
+
+		socklen_t length = sizeof(local);
+		getsockname(listen_fd, reinterpret_cast<sockaddr*>(&local), &length);
+		bound_address = host + ":" + std::to_string(ntohs(local.sin_port));
+	}
+
+	if (listen(listen_fd, SOMAXCONN) != 0) {
+		close(listen_fd);
+		fail("listen");
+	}
+	stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (stop_fd < 0) {
+		close(listen_fd);
+		fail("eventfd");
+	}
+}
+
+/* destructor */
+Server::~Server() {
+	close(listen_fd);
+	close(stop_fd);
+	if (!socket_path.empty()) {
+		unlink(socket_path.c_str());
+	}
+}
+
+/* run: Runs one loop on the calling thread and the others on their own */
+void Server::run() {
+	std::vector<std::thread> loops;
+	for (size_t i = 1; i < options.threads; i++) {
+		loops.emplace_back(&Server::run_loop, this);
+	}
+	run_loop();
+	for (std::thread& loop : loops) {
+		loop.join();
+	}
+}
+
+/* stop: Signals the eventfd; it is never read, so it stays readable for every loop */
+void Server::stop() {
+	std::uint64_t one = 1;
+	ssize_t written = write(stop_fd, &one, sizeof(one));
+	(void)written;
+}
+
+/* run_loop: Waits for sockets to become ready and serves them, until the stop eventfd fires */
+void Server::run_loop() {
+	int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd < 0) fail("epoll_create1");
+
+	std::unordered_map<int, std::unique_ptr<Connection>> open;
+	std::vector<char> buffer(64 << 10);
+	std::string line;
+
+	epoll_event event = {};
+	event.events = EPOLLIN | EPOLLEXCLUSIVE;  // One loop is woken per new connection
+	event.data.fd = listen_fd;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+	event.events = EPOLLIN;
+	event.data.fd = stop_fd;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stop_fd, &event);
+
+	// Reads while the client is sending and its responses are not piling up; writes while responses are pending
+	auto update_interest = [&](Connection& connection) {
+		size_t pending = connection.output.size() - connection.sent;
+		std::uint32_t wanted = 0;
+		if (!connection.closing && pending < MAX_PENDING_OUTPUT) {
+			wanted |= EPOLLIN | EPOLLRDHUP;
+		}
+		if (pending != 0) {
+			wanted |= EPOLLOUT;
+		}
+		if (wanted == connection.events) {
+			return;
+		}
+		connection.events = wanted;
+
+		epoll_event change = {};
+		change.events = wanted;
+		change.data.fd = connection.fd;
+		epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection.fd, &change);
+	};
+
+	// Sends as much pending output as the socket takes; returns false if the connection broke
+	auto flush = [](Connection& connection) {
+		while (connection.sent < connection.output.size()) {
+			ssize_t written = send(connection.fd, connection.output.data() + connection.sent,
+				connection.output.size() - connection.sent, MSG_NOSIGNAL);
+			if (written < 0) {
+				return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+			}
+			connection.sent += static_cast<size_t>(written);
+		}
+		connection.output.clear();
+		connection.sent = 0;
+		return true;
+	};
+
+	// Answers every complete line received so far, unless too many responses are pending
+	auto process = [&](Connection& connection) {
+		size_t start = 0;
+		while (connection.output.size() - connection.sent < MAX_PENDING_OUTPUT) {
+			size_t end = connection.input.find('\n', start);
+			if (end == std::string::npos) {
+				break;
+			}
+			if (!normalize_request(connection.input.data() + start, end - start, line)) {
+				connection.output.push_back('\n');
+			}
+			else {
+				Outcome outcome = answer(connection.session, line, connection.output);
+				if (outcome != Outcome::Answered) {
+					failed.fetch_add(1, std::memory_order_relaxed);
+				}
+				if (outcome == Outcome::Limited) {
+					limited.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+			requests.fetch_add(1, std::memory_order_relaxed);
+			start = end + 1;
+		}
+		connection.input.erase(0, start);
+	};
+
+	auto close_connection = [&](int fd) {
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+		close(fd);
+		open.erase(fd);
+	};
+
+	std::vector<epoll_event> events(256);
+	bool running = true;
+	while (running) {
+		int ready = epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), -1);
+		if (ready < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+
+		for (int i = 0; i < ready; i++) {
+			int fd = events[i].data.fd;
+
+			if (fd == stop_fd) {
+				running = false;
+				break;
+			}
+
+			if (fd == listen_fd) {
+				// Another loop may have taken the connection already; EAGAIN just means nothing is left
+				int client;
+				while ((client = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+					int no_delay = 1;  // Fails harmlessly on Unix sockets
+					setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+					epoll_event added = {};
+					added.events = EPOLLIN | EPOLLRDHUP;
+					added.data.fd = client;
+					epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client, &added);
+					open.emplace(client, std::make_unique<Connection>(client, options.session, cache));
+					connections.fetch_add(1, std::memory_order_relaxed);
+				}
+				continue;
+			}
+
+			auto found = open.find(fd);
+			if (found == open.end()) {
+				continue;
+			}
+			Connection& connection = *found->second;
+			std::uint32_t flags = events[i].events;
+
+			if (flags & EPOLLERR) {
+				close_connection(fd);
+				continue;
+			}
+
+			if ((flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) && (connection.events & EPOLLIN)) {
+				// Reads a bounded amount per wake-up so one busy client cannot starve the others
+				for (int reads = 0; reads < 16; reads++) {
+					ssize_t received = recv(fd, buffer.data(), buffer.size(), 0);
+					if (received > 0) {
+						connection.input.append(buffer.data(), static_cast<size_t>(received));
+						continue;
+					}
+					if (received == 0) {
+						connection.closing = true;
+					}
+					else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+						connection.closing = true;
+						connection.input.clear();
+					}
+					break;
+				}
+				if (connection.closing && !connection.input.empty() && connection.input.back() != '\n') {
+					connection.input.push_back('\n');  // The last request may lack its newline
+				}
+			}
+
+			// Lines held back while responses piled up are answered as soon as those are sent
+			bool broken = false;
+			do {
+				process(connection);
+				if (connection.input.size() > MAX_LINE && connection.input.find('\n') == std::string::npos) {
+					connection.output.append("error: Request line too long\n");
+					connection.input.clear();
+					connection.closing = true;
+				}
+				broken = !flush(connection);
+			} while (!broken && connection.output.empty() && connection.input.find('\n') != std::string::npos);
+
+			if (broken || (connection.closing && connection.output.empty())) {  // Broken, or everything it sent is answered
+				close_connection(fd);
+				continue;
+			}
+			update_interest(connection);
+		}
+	}
+
+	for (auto& entry : open) {
+		close(entry.first);
+	}
+	close(epoll_fd);
+}
+
+#else
+
+/* constructor: Server mode relies on epoll */
+Server::Server(const ServerOptions& options)
+	: options(options), listen_fd(-1), stop_fd(-1), connections(0), requests(0), failed(0), limited(0) {
+	throw std::runtime_error("Server mode needs epoll and is only available on Linux");
+}
+
+Server::~Server() {}
+
+void Server::run() {}
+
+void Server::stop() {}
+
+void Server::run_loop() {}
+
+#endif
+
+/* get_address: Returns the address the server listens on */
+const std::string& Server::get_address() const {
+	return bound_address;
+}
+
+/* get_stats: Reads the counters */
+ServerStats Server::get_stats() const {
+	return { connections.load(std::memory_order_relaxed), requests.load(std::memory_order_relaxed),
+		failed.load(std::memory_order_relaxed), limited.load(std::memory_order_relaxed) };
+}
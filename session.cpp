@@ -0,0 +1,402 @@
+#include "Session.h"
+#include "Tokenizer.h"
+#include "Parser.h"
+#include "Optimizer.h"
+#include "Subexpression_eliminator.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+/* constructor */
+Session::Session(const SessionOptions& options) : options(options), dependencies(symbols) {}
+
+/* constructor: Also takes the cache shared with other sessions */
+Session::Session(const SessionOptions& options, std::shared_ptr<ExpressionCache> shared_cache)
+	: options(options), dependencies(symbols), shared_cache(std::move(shared_cache)) {}
+
+/* start_budget: Creates the governor of a line when the session has limits, and returns it (or nullptr) */
+static ResourceGovernor* start_budget(std::optional<ResourceGovernor>& budget, const ResourceLimits& limits) {
+	if (!limits.any()) {
+		return nullptr;
+	}
+	budget.emplace(limits);
+	return &*budget;
+}
+
+/* charge: Counts the instructions of a program about to run as steps of the line */
+static void charge(ResourceGovernor* governor, const CompiledExpression& program) {
+	if (governor) {
+		governor->add_steps(program.get_code().size());
+	}
+}
+
+/* execute: Runs a line, throwing its error */
+LineResult Session::execute(const std::string& input) {
+	return try_execute(input).value_or_throw();
+}
+
+/* try_execute: Dispatches a line to the assignment or expression path */
+Result<LineResult> Session::try_execute(const std::string& input) {
+	CALC_MEASURE_STAGE(Stage::Line);
+
+	std::optional<ResourceGovernor> budget;
+	ResourceGovernor* governor = start_budget(budget, options.limits);
+
+	if (input.find('=') != std::string::npos) {
+		return assign_variable(input, governor);
+	}
+
+	Result<double> value = evaluate_expression(input, governor);
+	if (!value) {
+		return Result<LineResult>(value.error());
+	}
+	return Result<LineResult>({ false, "", value.value() });
+}
+
+/* compile_tree: Parses a token stream, optimizes the resulting tree (unless asked not to), merges its repeated
+				subtrees and compiles it, to native code as well when asked to */
+static CompileResult compile_tree(Tokenizer& tokenizer, ResourceGovernor* governor, bool fast_math, bool jit, bool optimize = true) {
+	ExpressionTree tree;
+	ExpressionTree optimized;
+	ExpressionTree merged;
+
+	{
+		CALC_MEASURE_STAGE(Stage::Parse);
+
+		// Convert tokens into an abstract syntax tree (AST)
+		tokenizer.set_governor(governor);
+		Parser parser(tokenizer);
+		parser.set_governor(governor);
+		Result<void> parsed = parser.try_parse(tree);
+		if (!parsed) {
+			return CompileResult(parsed.error());
+		}
+	}
+	if (optimize) {
+		CALC_MEASURE_STAGE(Stage::Optimize);
+		Optimizer optimizer(fast_math);
+		optimized = optimizer.optimize(tree);
+	}
+	else {
+		optimized = std::move(tree);
+	}
+	{
+		CALC_MEASURE_STAGE(Stage::Eliminate);
+
+		// Repeated subexpressions are computed once and reused through temporaries
+		SubexpressionEliminator eliminator;
+		merged = eliminator.eliminate(optimized);
+	}
+
+	CALC_MEASURE_STAGE(Stage::Compile);
+	std::shared_ptr<CompiledExpression> program = std::make_shared<CompiledExpression>(merged, merged.root());
+	if (jit) {
+		program->attach_native();  // Stays interpreted where that fails
+	}
+	return CompileResult(std::move(program));
+}
+
+/* lookup: Normalizes an expression and looks it up in the cache, leaving the key for a miss to insert */
+static std::shared_ptr<const CompiledExpression> lookup(ExpressionCache& cache, const std::string& expression, std::string& key) {
+	CALC_MEASURE_STAGE(Stage::Lookup);
+	key = ExpressionCache::normalize(expression);
+	return cache.find(key);
+}
+
+/* compile: Looks the expression up in the cache, or tokenizes, parses and compiles it */
+CompileResult Session::compile(const std::string& expression, ResourceGovernor* governor) {
+	std::string key;
+	std::shared_ptr<const CompiledExpression> program = lookup(cache, expression, key);
+
+	if (!program && shared_cache) {
+		// Another session may have compiled it already; the shared form names its variables without slots
+		std::shared_ptr<const CompiledExpression> shared = shared_cache->find(key);
+		if (!shared) {
+			Tokenizer tokenizer(key);
+			CompileResult compiled = compile_tree(tokenizer, governor, options.fast_math, options.jit);
+			if (!compiled) {
+				return compiled;
+			}
+			shared = compiled.value();
+			shared_cache->insert(key, shared);
+		}
+		program = shared->bind(symbols);
+		cache.insert(key, program);
+	}
+	else if (!program) {
+		// The key tokenizes exactly like the original text, so it is what gets compiled
+		Tokenizer tokenizer(key, symbols);
+		CompileResult compiled = compile_tree(tokenizer, governor, options.fast_math, options.jit);
+		if (!compiled) {
+			return compiled;
+		}
+		program = compiled.value();
+		cache.insert(key, program);
+	}
+	return CompileResult(program);
+}
+
+/* compile_readonly: Like compile, but only looks variable names up instead of interning them */
+CompileResult Session::compile_readonly(const std::string& expression, ResourceGovernor* governor) const {
+	std::string key;
+	std::shared_ptr<const CompiledExpression> program = lookup(cache, expression, key);
+
+	if (!program) {
+		// Names unknown at this point get no slot and are looked up by name when evaluated
+		Tokenizer tokenizer(key, symbols);
+		CompileResult compiled = compile_tree(tokenizer, governor, options.fast_math, options.jit);
+		if (compiled) {
+			cache.insert(key, compiled.value());
+		}
+		return compiled;
+	}
+	return CompileResult(program);
+}
+
+/* compile_unfolded: Like compile_readonly, without the optimizer, so constants reach the scalar type as written */
+CompileResult Session::compile_unfolded(const std::string& expression, ResourceGovernor* governor) const {
+	std::string key;
+	std::shared_ptr<const CompiledExpression> program = lookup(unfolded_cache, expression, key);
+
+	if (!program) {
+		Tokenizer tokenizer(key, symbols);
+		CompileResult compiled = compile_tree(tokenizer, governor, options.fast_math, false, false);
+		if (compiled) {
+			unfolded_cache.insert(key, compiled.value());
+		}
+		return compiled;
+	}
+	return CompileResult(program);
+}
+
+/* evaluate_expression: Evaluates the compiled form of an expression line */
+Result<double> Session::evaluate_expression(const std::string& expression, ResourceGovernor* governor) {
+	CompileResult program = compile(expression, governor);
+	if (!program) {
+		return Result<double>(program.error());
+	}
+	charge(governor, *program.value());
+
+	CALC_MEASURE_STAGE(Stage::Evaluate);
+	return program.value()->try_evaluate(symbols);
+}
+
+/* assign_variable: Evaluates the right-hand side of an assignment and stores it in the variable's slot */
+Result<LineResult> Session::assign_variable(const std::string& input, ResourceGovernor* governor) {
+	// Split the input into variable name and expression
+	auto extraction = utilities.extract_variable_and_expression(input);
+	std::string variable_name = extraction.first;
+	std::string expression = extraction.second;
+
+	if (variable_name.empty() || !std::all_of(variable_name.begin(), variable_name.end(), ::isalpha)) {
+		return Result<LineResult>(Error(ErrorCode::InvalidAssignment, 0));
+	}
+
+	if (options.reactive) {  // Keep the formula so the variable follows its inputs
+		CompileResult program = compile(expression, governor);
+		if (!program) {
+			return Result<LineResult>(program.error());
+		}
+		charge(governor, *program.value());
+		Result<double> value = dependencies.define(symbols.intern(variable_name), program.value());
+		if (!value) {  // The formula is kept, and the variable stays undefined until its inputs allow it
+			return Result<LineResult>(value.error());
+		}
+		return Result<LineResult>({ true, variable_name, value.value() });
+	}
+
+	Result<double> value = evaluate_expression(expression, governor);
+	if (!value) {
+		return Result<LineResult>(value.error());
+	}
+	symbols.set_value(symbols.intern(variable_name), value.value());
+	return Result<LineResult>({ true, variable_name, value.value() });
+}
+
+/* execute_exact: Parses the line and evaluates the tree as it was written, then stores an assignment twice:
+				 the double for ordinary lines and the exact value for later exact ones */
+ExactLineResult Session::execute_exact(const std::string& input) {
+	CALC_MEASURE_STAGE(Stage::Line);
+
+	std::optional<ResourceGovernor> budget;
+	ResourceGovernor* governor = start_budget(budget, options.limits);
+
+	std::string expression = input;
+	std::string variable_name;
+	bool is_assignment = input.find('=') != std::string::npos;
+	if (is_assignment) {
+		auto extraction = utilities.extract_variable_and_expression(input);
+		variable_name = extraction.first;
+		expression = extraction.second;
+
+		if (variable_name.empty() || !std::all_of(variable_name.begin(), variable_name.end(), ::isalpha)) {
+			throw std::runtime_error("Invalid left-hand side in assignment.");
+		}
+	}
+
+	ExpressionTree tree;
+	{
+		CALC_MEASURE_STAGE(Stage::Parse);
+		Tokenizer tokenizer(expression, symbols);
+		tokenizer.allow_wide_numbers(true);  // The exact evaluator reads literals from their text
+		tokenizer.set_governor(governor);
+		Parser parser(tokenizer);
+		parser.set_governor(governor);
+		parser.parse(tree);
+	}
+	if (governor) {
+		governor->add_steps(tree.size());
+	}
+
+	ExactNumber value;
+	{
+		CALC_MEASURE_STAGE(Stage::Evaluate);
+		ExactEvaluator evaluator(symbols, exact_values, options.exact);
+		value = evaluator.evaluate(tree, tree.root());
+	}
+
+	if (!is_assignment) {
+		return { false, "", value };
+	}
+
+	SymbolId slot = symbols.intern(variable_name);
+	if (options.reactive) {  // The formula is recomputed in doubles when its inputs change, which retires the exact value
+		dependencies.define(slot, compile(expression, nullptr).value_or_throw()).value_or_throw();  // Already parsed within the budget above
+	}
+	else {
+		symbols.set_value(slot, value.to_double());
+	}
+	exact_values[slot] = { value, symbols.get_value(slot) };
+	return { true, variable_name, value };
+}
+
+/* evaluate_readonly: Evaluates an expression, throwing its error */
+double Session::evaluate_readonly(const std::string& expression) const {
+	return try_evaluate_readonly(expression).value_or_throw();
+}
+
+/* try_evaluate_readonly: Evaluates an expression against a read-only view of the session's variables */
+Result<double> Session::try_evaluate_readonly(const std::string& expression) const {
+	CALC_MEASURE_STAGE(Stage::Line);
+
+	std::optional<ResourceGovernor> budget;
+	ResourceGovernor* governor = start_budget(budget, options.limits);
+
+	// The compiled form only reads the symbol table, and the cache does its own locking
+	CompileResult program = compile_readonly(expression, governor);
+	if (!program) {
+		return Result<double>(program.error());
+	}
+	charge(governor, *program.value());
+
+	CALC_MEASURE_STAGE(Stage::Evaluate);
+	return program.value()->try_evaluate(symbols);
+}
+
+/* format_value: Evaluates a program in one scalar type and formats the result */
+template <typename Scalar>
+static Result<std::string> format_value(const CompiledExpression& program, const SymbolTable& symbols) {
+	Result<Scalar> value = program.try_evaluate_as<Scalar>(symbols);
+	if (!value) {
+		return Result<std::string>(value.error());
+	}
+	return Result<std::string>(ScalarTraits<Scalar>::format(value.value()));
+}
+
+/* evaluate_text: Evaluates and formats an expression, throwing its error */
+std::string Session::evaluate_text(const std::string& expression) const {
+	return try_evaluate_text(expression).value_or_throw();
+}
+
+/* try_evaluate_text: Evaluates an expression in the session's scalar type, reading the variables as doubles */
+Result<std::string> Session::try_evaluate_text(const std::string& expression) const {
+	CALC_MEASURE_STAGE(Stage::Line);
+
+	std::optional<ResourceGovernor> budget;
+	ResourceGovernor* governor = start_budget(budget, options.limits);
+
+	bool folded = options.scalar == ScalarType::Double;
+	CompileResult program = folded ? compile_readonly(expression, governor) : compile_unfolded(expression, governor);
+	if (!program) {
+		return Result<std::string>(program.error());
+	}
+	charge(governor, *program.value());
+	CALC_MEASURE_STAGE(Stage::Evaluate);
+
+	switch (options.scalar) {
+		case ScalarType::Double: return format_value<double>(*program.value(), symbols);
+		case ScalarType::Float: return format_value<float>(*program.value(), symbols);
+		case ScalarType::LongDouble: return format_value<long double>(*program.value(), symbols);
+		case ScalarType::Complex: return format_value<std::complex<double>>(*program.value(), symbols);
+		default: return format_value<Interval>(*program.value(), symbols);
+	}
+}
+
+/* get_symbols: Returns the session's variables */
+SymbolTable& Session::get_symbols() {
+	return symbols;
+}
+
+/* get_cache_stats: Returns the counters of the expression caches, added together */
+CacheStats Session::get_cache_stats() const {
+	CacheStats stats = cache.get_stats();
+	CacheStats unfolded = unfolded_cache.get_stats();
+	stats.hits += unfolded.hits;
+	stats.misses += unfolded.misses;
+	stats.evictions += unfolded.evictions;
+	stats.entries += unfolded.entries;
+	stats.bytes += unfolded.bytes;
+	return stats;
+}
+
+/* save: Writes the session to a snapshot file */
+SnapshotStats Session::save(const std::string& path) const {
+	return Snapshot::save(path, symbols, dependencies, cache, options.fast_math);
+}
+
+/* load: Reads a snapshot file into the session; formulas only make sense in reactive mode */
+SnapshotStats Session::load(const std::string& path) {
+	return Snapshot::load(path, symbols, options.reactive ? &dependencies : nullptr, cache, options.fast_math);
+}
+
+/* is_fast_math: Reports whether the optimizer may apply rewrites that are not bit-exact */
+bool Session::is_fast_math() const {
+	return options.fast_math;
+}
+
+/* is_jit: Reports whether compiled expressions get native code */
+bool Session::is_jit() const {
+	return options.jit;
+}
+
+/* is_reactive: Reports whether assignments are kept as formulas */
+bool Session::is_reactive() const {
+	return options.reactive;
+}
+
+/* set_scalar_type: Changes the type evaluate_text computes in */
+void Session::set_scalar_type(ScalarType type) {
+	options.scalar = type;
+}
+
+/* get_scalar_type: Returns the type evaluate_text computes in */
+ScalarType Session::get_scalar_type() const {
+	return options.scalar;
+}
+
+/* get_limits: Returns the budget of every line */
+const ResourceLimits& Session::get_limits() const {
+	return options.limits;
+}
+
+/* get_exact_options: Returns the options of exact lines */
+const ExactOptions& Session::get_exact_options() const {
+	return options.exact;
+}
+
+/* get_dependencies: Returns the dependency graph of the session's variables */
+DependencyGraph& Session::get_dependencies() {
+	return dependencies;
+}
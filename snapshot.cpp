@@ -0,0 +1,772 @@
+#include "Snapshot.h"
+#include <bit>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <io.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(std::endian::native == std::endian::little, "Snapshots are stored little-endian");
+
+/* Marks a symbol without a formula */
+static const std::uint32_t NO_PROGRAM = 0xFFFFFFFFu;
+
+static const char MAGIC[8] = { 'C', 'A', 'L', 'C', 'S', 'N', 'A', 'P' };
+
+/* Header flag: the programs were compiled by the fast-math optimizer */
+static const std::uint32_t FLAG_FAST_MATH = 1;
+
+/* Start of the file: identifies it and sizes every section. */
+struct SnapshotHeader {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t header_size;
+	std::uint64_t file_size;
+	std::uint64_t checksum;            // XXH64 of every byte after the header.
+	std::uint32_t symbol_count;
+	std::uint32_t program_count;
+	std::uint32_t expression_count;
+	std::uint32_t flags;
+	std::uint64_t instruction_count;
+	std::uint64_t constant_count;
+	std::uint64_t slot_count;
+	std::uint64_t string_bytes;
+};
+
+/* A variable: its value, its name in the string section and its formula, if any. */
+struct SymbolRecord {
+	double value;
+	std::uint64_t name_offset;
+	std::uint32_t name_length;
+	std::uint32_t formula;             // Program number, or NO_PROGRAM.
+	std::uint32_t defined;
+	std::uint32_t reserved;
+};
+
+/* A compiled expression: its ranges in the instruction, constant and slot sections. */
+struct ProgramRecord {
+	std::uint64_t first_instruction;
+	std::uint64_t first_constant;
+	std::uint64_t first_slot;
+	std::uint32_t instruction_count;
+	std::uint32_t constant_count;
+	std::uint32_t slot_count;
+	std::uint32_t max_stack_depth;
+	std::uint32_t temp_count;
+	std::uint32_t reserved;
+};
+
+/* A cache entry: its key in the string section and its program. */
+struct ExpressionRecord {
+	std::uint64_t key_offset;
+	std::uint32_t key_length;
+	std::uint32_t program;
+};
+
+static_assert(sizeof(SnapshotHeader) == 80 && sizeof(SymbolRecord) == 32 && sizeof(ProgramRecord) == 48 &&
+	sizeof(ExpressionRecord) == 16, "Snapshot records must have no hidden padding");
+static_assert(sizeof(Instruction) == 8 && offsetof(Instruction, operand) == 4 && std::is_trivially_copyable_v<Instruction>,
+	"Instructions are stored exactly as they are laid out in memory");
+
+/* align: Rounds a section size up to the next multiple of 8 bytes */
+static std::uint64_t align(std::uint64_t size) {
+	return (size + 7) & ~std::uint64_t(7);
+}
+
+/*------Checksum (XXH64)------------------------------------------------------*/
+
+static const std::uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+static const std::uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+static const std::uint64_t PRIME3 = 0x165667B19E3779F9ull;
+static const std::uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+static const std::uint64_t PRIME5 = 0x27D4EB2F165667C5ull;
+
+static std::uint64_t read64(const unsigned char* p) {
+	std::uint64_t value;
+	std::memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static std::uint32_t read32(const unsigned char* p) {
+	std::uint32_t value;
+	std::memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static std::uint64_t xxh_round(std::uint64_t accumulator, std::uint64_t input) {
+	accumulator += input * PRIME2;
+	return std::rotl(accumulator, 31) * PRIME1;
+}
+
+static std::uint64_t xxh_merge(std::uint64_t hash, std::uint64_t accumulator) {
+	hash ^= xxh_round(0, accumulator);
+	return hash * PRIME1 + PRIME4;
+}
+
+/* checksum: XXH64 with seed 0; four independent lanes keep it at several GB/s */
+static std::uint64_t checksum(const unsigned char* data, size_t length) {
+	const unsigned char* p = data;
+	const unsigned char* end = data + length;
+	std::uint64_t hash;
+
+	if (length >= 32) {
+		std::uint64_t v1 = PRIME1 + PRIME2;
+		std::uint64_t v2 = PRIME2;
+		std::uint64_t v3 = 0;
+		std::uint64_t v4 = 0 - PRIME1;
+
+		for (; end - p >= 32; p += 32) {
+			v1 = xxh_round(v1, read64(p));
+			v2 = xxh_round(v2, read64(p + 8));
+			v3 = xxh_round(v3, read64(p + 16));
+			v4 = xxh_round(v4, read64(p + 24));
+		}
+		hash = std::rotl(v1, 1) + std::rotl(v2, 7) + std::rotl(v3, 12) + std::rotl(v4, 18);
+		hash = xxh_merge(hash, v1);
+		hash = xxh_merge(hash, v2);
+		hash = xxh_merge(hash, v3);
+		hash = xxh_merge(hash, v4);
+	}
+	else {
+		hash = PRIME5;
+	}
+
+	hash += length;
+	for (; end - p >= 8; p += 8) {
+		hash ^= xxh_round(0, read64(p));
+		hash = std::rotl(hash, 27) * PRIME1 + PRIME4;
+	}
+	if (end - p >= 4) {
+		hash ^= std::uint64_t(read32(p)) * PRIME1;
+		hash = std::rotl(hash, 23) * PRIME2 + PRIME3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		hash ^= *p * PRIME5;
+		hash = std::rotl(hash, 11) * PRIME1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= PRIME2;
+	hash ^= hash >> 29;
+	hash *= PRIME3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+/*------Writing---------------------------------------------------------------*/
+
+/* Collects the records of a snapshot before they are laid out in the file. */
+struct SnapshotBuilder {
+	const SymbolTable& symbols;
+	std::vector<SymbolRecord> symbol_records;
+	std::unordered_map<std::string, std::uint32_t> extra_symbols;  // Names some program reads that the table never interned
+	std::vector<ProgramRecord> programs;
+	std::unordered_map<const CompiledExpression*, std::uint32_t> program_numbers;
+	std::vector<ExpressionRecord> expressions;
+	std::vector<Instruction> instructions;
+	std::vector<double> constants;
+	std::vector<std::uint32_t> slots;
+	std::string strings;
+
+	explicit SnapshotBuilder(const SymbolTable& symbols) : symbols(symbols) {}
+
+	/* add_string: Appends text to the string section and returns its offset */
+	std::uint64_t add_string(const std::string& text) {
+		std::uint64_t offset = strings.size();
+		strings += text;
+		return offset;
+	}
+
+	/* symbol_number: The record of a name; symbols of the table keep their slot number */
+	std::uint32_t symbol_number(const std::string& name) {
+		SymbolId id = symbols.find(name);
+		if (id != NO_SYMBOL) {
+			return id;
+		}
+
+		auto extra = extra_symbols.find(name);
+		if (extra != extra_symbols.end()) {
+			return extra->second;
+		}
+		std::uint32_t number = static_cast<std::uint32_t>(symbol_records.size());
+		symbol_records.push_back({ 0.0, add_string(name), static_cast<std::uint32_t>(name.size()), NO_PROGRAM, 0, 0 });
+		extra_symbols.emplace(name, number);
+		return number;
+	}
+
+	/* add_program: Stores a program once, however many formulas and cache entries share it. inputs, when
+					given, are the slots of its variables, which spares looking their names up */
+	std::uint32_t add_program(const CompiledExpression& program, const std::vector<SymbolId>* inputs) {
+		auto known = program_numbers.find(&program);
+		if (known != program_numbers.end()) {
+			return known->second;
+		}
+
+		ProgramRecord record = {};
+		record.first_instruction = instructions.size();
+		record.first_constant = constants.size();
+		record.first_slot = slots.size();
+		record.instruction_count = static_cast<std::uint32_t>(program.get_code().size());
+		record.constant_count = static_cast<std::uint32_t>(program.get_constants().size());
+		record.slot_count = static_cast<std::uint32_t>(program.get_variable_names().size());
+		record.max_stack_depth = static_cast<std::uint32_t>(program.get_max_stack_depth());
+		record.temp_count = static_cast<std::uint32_t>(program.get_temp_count());
+
+		for (const Instruction& instruction : program.get_code()) {
+			Instruction stored;
+			std::memset(&stored, 0, sizeof(stored));  // Padding bytes go into the checksum, so they must be zero
+			stored.op = instruction.op;
+			stored.operand = instruction.operand;
+			instructions.push_back(stored);
+		}
+		constants.insert(constants.end(), program.get_constants().begin(), program.get_constants().end());
+		if (inputs) {
+			slots.insert(slots.end(), inputs->begin(), inputs->end());
+		}
+		else {
+			for (const std::string& name : program.get_variable_names()) {
+				slots.push_back(symbol_number(name));
+			}
+		}
+
+		std::uint32_t number = static_cast<std::uint32_t>(programs.size());
+		programs.push_back(record);
+		program_numbers.emplace(&program, number);
+		return number;
+	}
+};
+
+/* append_section: Copies an array into the file image and pads it to 8 bytes */
+template <typename Record>
+static void append_section(std::vector<unsigned char>& image, const Record* records, size_t count) {
+	size_t bytes = count * sizeof(Record);
+	size_t start = image.size();
+	image.resize(start + align(bytes), 0);
+	if (bytes != 0) {
+		std::memcpy(image.data() + start, records, bytes);
+	}
+}
+
+#if !defined(_WIN32)
+/* sync_directory: Flushes the directory holding path, so a rename into it survives a crash. File systems
+				   that cannot sync a directory (EINVAL) already make the rename durable. */
+static bool sync_directory(const std::string& path) {
+	size_t slash = path.find_last_of('/');
+	std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+
+	int descriptor = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+	if (descriptor < 0) {
+		return false;
+	}
+	bool synced = fsync(descriptor) == 0 || errno == EINVAL;
+	return close(descriptor) == 0 && synced;
+}
+#endif
+
+/* write_atomically: Writes the image to a temporary file next to path, flushes it to disk, renames it over path
+					 and flushes the directory holding the new name */
+static void write_atomically(const std::string& path, const std::vector<unsigned char>& image) {
+#if defined(_WIN32)
+	std::string temporary = path + ".tmp" + std::to_string(_getpid());
+#else
+	std::string temporary = path + ".tmp" + std::to_string(getpid());
+#endif
+
+	std::FILE* file = std::fopen(temporary.c_str(), "wb");
+	if (!file) {
+		throw std::runtime_error("Cannot write snapshot: " + path);
+	}
+
+	bool written = std::fwrite(image.data(), 1, image.size(), file) == image.size() && std::fflush(file) == 0;
+#if defined(_WIN32)
+	written = written && _commit(_fileno(file)) == 0;
+#else
+	written = written && fsync(fileno(file)) == 0;  // The data must be on disk before the rename makes it visible
+#endif
+	written = std::fclose(file) == 0 && written;
+
+#if defined(_WIN32)
+	written = written && MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+	written = written && std::rename(temporary.c_str(), path.c_str()) == 0;
+	written = written && sync_directory(path);
+#endif
+
+	if (!written) {
+		std::remove(temporary.c_str());
+		throw std::runtime_error("Cannot write snapshot: " + path);
+	}
+}
+
+/* save: Gathers the session into records, lays them out behind the header and writes the file */
+SnapshotStats Snapshot::save(const std::string& path, const SymbolTable& symbols, const DependencyGraph& dependencies,
+	const ExpressionCache& cache, bool fast_math) {
+
+	SnapshotBuilder builder(symbols);
+	size_t formulas = 0;
+	builder.symbol_records.reserve(symbols.size());
+	builder.program_numbers.reserve(symbols.size());
+
+	for (SymbolId id = 0; id < symbols.size(); id++) {  // Record number = slot number
+		const std::string& name = symbols.get_name(id);
+		bool defined = symbols.is_defined(id);
+		builder.symbol_records.push_back({ defined ? symbols.get_value(id) : 0.0, builder.add_string(name),
+			static_cast<std::uint32_t>(name.size()), NO_PROGRAM, defined ? 1u : 0u, 0 });
+	}
+
+	for (SymbolId id = 0; id < symbols.size(); id++) {
+		std::shared_ptr<const CompiledExpression> formula = dependencies.get_formula(id);
+		if (formula) {
+			std::uint32_t program = builder.add_program(*formula, &dependencies.get_inputs(id));
+			builder.symbol_records[id].formula = program;
+			formulas++;
+		}
+	}
+
+	for (const auto& entry : cache.get_entries()) {
+		std::uint32_t program = builder.add_program(*entry.second, nullptr);
+		builder.expressions.push_back({ builder.add_string(entry.first), static_cast<std::uint32_t>(entry.first.size()), program });
+	}
+
+	SnapshotHeader header = {};
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.header_size = sizeof(SnapshotHeader);
+	header.symbol_count = static_cast<std::uint32_t>(builder.symbol_records.size());
+	header.program_count = static_cast<std::uint32_t>(builder.programs.size());
+	header.expression_count = static_cast<std::uint32_t>(builder.expressions.size());
+	header.flags = fast_math ? FLAG_FAST_MATH : 0;
+	header.instruction_count = builder.instructions.size();
+	header.constant_count = builder.constants.size();
+	header.slot_count = builder.slots.size();
+	header.string_bytes = builder.strings.size();
+
+	std::vector<unsigned char> image(sizeof(SnapshotHeader));
+	image.reserve(sizeof(SnapshotHeader) + align(builder.symbol_records.size() * sizeof(SymbolRecord)) +
+		align(builder.programs.size() * sizeof(ProgramRecord)) + align(builder.expressions.size() * sizeof(ExpressionRecord)) +
+		align(builder.instructions.size() * sizeof(Instruction)) + align(builder.constants.size() * sizeof(double)) +
+		align(builder.slots.size() * sizeof(std::uint32_t)) + align(builder.strings.size()));
+	append_section(image, builder.symbol_records.data(), builder.symbol_records.size());
+	append_section(image, builder.programs.data(), builder.programs.size());
+	append_section(image, builder.expressions.data(), builder.expressions.size());
+	append_section(image, builder.instructions.data(), builder.instructions.size());
+	append_section(image, builder.constants.data(), builder.constants.size());
+	append_section(image, builder.slots.data(), builder.slots.size());
+	append_section(image, builder.strings.data(), builder.strings.size());
+
+	header.file_size = image.size();
+	header.checksum = checksum(image.data() + sizeof(SnapshotHeader), image.size() - sizeof(SnapshotHeader));
+	std::memcpy(image.data(), &header, sizeof(header));
+
+	write_atomically(path, image);
+	return { symbols.size(), formulas, builder.expressions.size(), image.size() };
+}
+
+/*------Reading---------------------------------------------------------------*/
+
+/* A read-only mapping of a whole file, released when it goes out of scope. */
+class MappedFile {
+private:
+	const unsigned char* bytes = nullptr;
+	size_t length = 0;
+#if defined(_WIN32)
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+#endif
+
+public:
+	explicit MappedFile(const std::string& path) {
+#if defined(_WIN32)
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		LARGE_INTEGER size;
+		if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size)) {
+			release();
+			throw std::runtime_error("Cannot open snapshot: " + path);
+		}
+		length = static_cast<size_t>(size.QuadPart);
+		if (length != 0) {  // An empty file cannot be mapped; the size check rejects it
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+			if (!view) {
+				release();
+				throw std::runtime_error("Cannot map snapshot: " + path);
+			}
+			bytes = static_cast<const unsigned char*>(view);
+		}
+#else
+		int descriptor = open(path.c_str(), O_RDONLY);
+		struct stat status;
+		if (descriptor < 0 || fstat(descriptor, &status) != 0) {
+			if (descriptor >= 0) {
+				close(descriptor);
+			}
+			throw std::runtime_error("Cannot open snapshot: " + path);
+		}
+		length = static_cast<size_t>(status.st_size);
+		if (length != 0) {
+			void* view = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+			if (view == MAP_FAILED) {
+				close(descriptor);
+				throw std::runtime_error("Cannot map snapshot: " + path);
+			}
+			bytes = static_cast<const unsigned char*>(view);
+		}
+		close(descriptor);  // The mapping stays valid without the descriptor
+#endif
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile() {
+		release();
+	}
+
+	void release() {
+#if defined(_WIN32)
+		if (bytes) UnmapViewOfFile(bytes);
+		if (mapping) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+		mapping = nullptr;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (bytes) munmap(const_cast<unsigned char*>(bytes), length);
+#endif
+		bytes = nullptr;
+	}
+
+	const unsigned char* data() const {
+		return bytes;
+	}
+
+	size_t size() const {
+		return length;
+	}
+};
+
+/* fits: Reports whether [offset, offset + count) lies within a section of the given size */
+static bool fits(std::uint64_t offset, std::uint64_t count, std::uint64_t size) {
+	return offset <= size && count <= size - offset;
+}
+
+/* valid_bytecode: Replays the stack effect of every instruction, so a program accepted here cannot read or
+				   write outside its stack, temporaries, constants or slots */
+static bool valid_bytecode(const ProgramRecord& record, const Instruction* code) {
+	if (record.instruction_count == 0 || record.max_stack_depth > record.instruction_count ||
+		record.temp_count > record.instruction_count) {
+		return false;
+	}
+
+	std::uint64_t depth = 0;
+	for (std::uint32_t i = 0; i < record.instruction_count; i++) {
+		const Instruction& instruction = code[i];
+		switch (instruction.op) {
+			case OpCode::PushConstant:
+				if (instruction.operand >= record.constant_count) return false;
+				depth++;
+				break;
+			case OpCode::PushVariable:
+				if (instruction.operand >= record.slot_count) return false;
+				depth++;
+				break;
+			case OpCode::LoadTemp:
+				if (instruction.operand >= record.temp_count) return false;
+				depth++;
+				break;
+			case OpCode::StoreTemp:
+				if (instruction.operand >= record.temp_count || depth < 1) return false;
+				break;
+			case OpCode::Fail:
+				depth++;
+				break;
+			case OpCode::Add:
+			case OpCode::Subtract:
+			case OpCode::Multiply:
+			case OpCode::Divide:
+			case OpCode::DivideSwapped:
+			case OpCode::Power:
+				if (depth < 2) return false;
+				depth--;
+				break;
+			case OpCode::Sqrt:
+			case OpCode::Negate:
+			case OpCode::PowerInteger:
+			case OpCode::CheckDivisor:
+				if (depth < 1) return false;
+				break;
+			default:
+				return false;
+		}
+		if (depth > record.max_stack_depth) {
+			return false;
+		}
+	}
+	return depth == 1;
+}
+
+/* find_formula_cycle: Lays the file's formulas over those already in the session, the way load would install them,
+   and sorts the result topologically. Returns the first cycle found ("a -> b -> a"), or an empty string. */
+static std::string find_formula_cycle(const SnapshotHeader& header, const SymbolRecord* symbol_records, const ProgramRecord* programs,
+	const std::uint32_t* slots, const char* strings, const SymbolTable& symbols, const DependencyGraph& dependencies) {
+	// Variables of the session keep their slot; names new to the session are numbered after them
+	std::vector<std::string> new_names;
+	std::unordered_map<std::string, std::uint32_t> new_ids;
+	std::vector<std::uint32_t> node_of(header.symbol_count);
+	for (std::uint32_t i = 0; i < header.symbol_count; i++) {
+		std::string name(strings + symbol_records[i].name_offset, symbol_records[i].name_length);
+		SymbolId id = symbols.find(name);
+		if (id == NO_SYMBOL) {
+			auto inserted = new_ids.emplace(name, static_cast<std::uint32_t>(symbols.size() + new_names.size()));
+			if (inserted.second) {
+				new_names.push_back(std::move(name));
+			}
+			id = inserted.first->second;
+		}
+		node_of[i] = id;
+	}
+
+	const size_t node_count = symbols.size() + new_names.size();
+	std::vector<std::vector<std::uint32_t>> reads(node_count);
+	if (dependencies.has_formulas()) {
+		for (SymbolId id = 0; id < symbols.size(); id++) {
+			if (dependencies.get_formula(id)) {
+				reads[id] = dependencies.get_inputs(id);
+			}
+		}
+	}
+	for (std::uint32_t i = 0; i < header.symbol_count; i++) {
+		const SymbolRecord& record = symbol_records[i];
+		if (record.formula != NO_PROGRAM) {
+			const ProgramRecord& program = programs[record.formula];
+			std::vector<std::uint32_t>& inputs = reads[node_of[i]];
+			inputs.clear();
+			for (std::uint32_t s = 0; s < program.slot_count; s++) {
+				inputs.push_back(node_of[slots[program.first_slot + s]]);
+			}
+		}
+		else if (record.defined) {  // A plain value replaces the formula
+			reads[node_of[i]].clear();
+		}
+	}
+
+	// Depth-first search: a variable reached again while still on the path closes a cycle
+	auto name_of = [&](std::uint32_t node) -> const std::string& {
+		return node < symbols.size() ? symbols.get_name(node) : new_names[node - symbols.size()];
+	};
+	std::vector<std::uint8_t> state(node_count, 0);  // 0: not seen, 1: on the path, 2: done
+	std::vector<std::pair<std::uint32_t, size_t>> path;
+	for (std::uint32_t start = 0; start < node_count; start++) {
+		if (state[start] != 0 || reads[start].empty()) {
+			continue;
+		}
+		path.assign(1, { start, 0 });
+		state[start] = 1;
+
+		while (!path.empty()) {
+			std::uint32_t node = path.back().first;
+			if (path.back().second == reads[node].size()) {
+				state[node] = 2;
+				path.pop_back();
+				continue;
+			}
+			std::uint32_t next = reads[node][path.back().second++];
+			if (state[next] == 1) {
+				size_t first = 0;
+				while (path[first].first != next) {
+					first++;
+				}
+				std::string cycle;
+				for (size_t step = first; step < path.size(); step++) {
+					cycle.append(name_of(path[step].first)).append(" -> ");
+				}
+				return cycle.append(name_of(next));
+			}
+			if (state[next] == 0) {
+				state[next] = 1;
+				path.push_back({ next, 0 });
+			}
+		}
+	}
+	return std::string();
+}
+
+/* load: Checks the whole file first, so a damaged one changes nothing, then installs its contents */
+SnapshotStats Snapshot::load(const std::string& path, SymbolTable& symbols, DependencyGraph* dependencies, ExpressionCache& cache,
+	bool fast_math) {
+	MappedFile file(path);
+	const unsigned char* data = file.data();
+
+	SnapshotHeader header;
+	if (file.size() < sizeof(header)) {
+		throw std::runtime_error("Not a calculator snapshot: " + path);
+	}
+	std::memcpy(&header, data, sizeof(header));
+	if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+		throw std::runtime_error("Not a calculator snapshot: " + path);
+	}
+	if (header.version < 1 || header.version > VERSION || header.header_size != sizeof(SnapshotHeader)) {
+		throw std::runtime_error("Unsupported snapshot version " + std::to_string(header.version) + ": " + path);
+	}
+
+	// Section sizes follow from the counts; each count is bounded by the file size first so nothing overflows
+	const std::uint64_t size = file.size();
+	if (header.file_size != size || header.instruction_count > size || header.constant_count > size ||
+		header.slot_count > size || header.string_bytes > size) {
+		throw std::runtime_error("Snapshot is truncated or damaged: " + path);
+	}
+	const std::uint64_t symbols_at = sizeof(SnapshotHeader);
+	const std::uint64_t programs_at = symbols_at + align(std::uint64_t(header.symbol_count) * sizeof(SymbolRecord));
+	const std::uint64_t expressions_at = programs_at + align(std::uint64_t(header.program_count) * sizeof(ProgramRecord));
+	const std::uint64_t instructions_at = expressions_at + align(std::uint64_t(header.expression_count) * sizeof(ExpressionRecord));
+	const std::uint64_t constants_at = instructions_at + align(header.instruction_count * sizeof(Instruction));
+	const std::uint64_t slots_at = constants_at + align(header.constant_count * sizeof(double));
+	const std::uint64_t strings_at = slots_at + align(header.slot_count * sizeof(std::uint32_t));
+	if (strings_at + align(header.string_bytes) != size) {
+		throw std::runtime_error("Snapshot is truncated or damaged: " + path);
+	}
+
+	if (checksum(data + sizeof(SnapshotHeader), size - sizeof(SnapshotHeader)) != header.checksum) {
+		throw std::runtime_error("Snapshot checksum mismatch (the file is damaged): " + path);
+	}
+
+	// Every section starts on an 8-byte boundary of a page-aligned mapping, so the records can be read in place
+	const SymbolRecord* symbol_records = reinterpret_cast<const SymbolRecord*>(data + symbols_at);
+	const ProgramRecord* programs = reinterpret_cast<const ProgramRecord*>(data + programs_at);
+	const ExpressionRecord* expressions = reinterpret_cast<const ExpressionRecord*>(data + expressions_at);
+	const Instruction* instructions = reinterpret_cast<const Instruction*>(data + instructions_at);
+	const double* constants = reinterpret_cast<const double*>(data + constants_at);
+	const std::uint32_t* slots = reinterpret_cast<const std::uint32_t*>(data + slots_at);
+	const char* strings = reinterpret_cast<const char*>(data + strings_at);
+
+	const std::runtime_error malformed("Snapshot is malformed: " + path);
+	for (std::uint32_t i = 0; i < header.symbol_count; i++) {
+		const SymbolRecord& record = symbol_records[i];
+		if (!fits(record.name_offset, record.name_length, header.string_bytes) || record.name_length == 0 ||
+			(record.formula != NO_PROGRAM && record.formula >= header.program_count)) {
+			throw malformed;
+		}
+	}
+	for (std::uint32_t i = 0; i < header.program_count; i++) {
+		const ProgramRecord& record = programs[i];
+		if (!fits(record.first_instruction, record.instruction_count, header.instruction_count) ||
+			!fits(record.first_constant, record.constant_count, header.constant_count) ||
+			!fits(record.first_slot, record.slot_count, header.slot_count) ||
+			!valid_bytecode(record, instructions + record.first_instruction)) {
+			throw malformed;
+		}
+		for (std::uint32_t s = 0; s < record.slot_count; s++) {
+			if (slots[record.first_slot + s] >= header.symbol_count) {
+				throw malformed;
+			}
+		}
+	}
+	for (std::uint32_t i = 0; i < header.expression_count; i++) {
+		const ExpressionRecord& record = expressions[i];
+		if (!fits(record.key_offset, record.key_length, header.string_bytes) || record.program >= header.program_count) {
+			throw malformed;
+		}
+	}
+	if (dependencies) {
+		std::string cycle = find_formula_cycle(header, symbol_records, programs, slots, strings, symbols, *dependencies);
+		if (!cycle.empty()) {
+			std::string message("Snapshot has circular formulas (");
+			throw std::runtime_error(message.append(cycle).append("): ").append(path));
+		}
+	}
+
+	// Formulas already in the session that read a variable of the file must see its new value
+	std::vector<std::uint8_t> read_by_formula;
+	if (dependencies && dependencies->has_formulas()) {
+		read_by_formula.resize(symbols.size(), 0);
+		for (SymbolId id = 0; id < symbols.size(); id++) {
+			if (dependencies->get_formula(id)) {
+				for (SymbolId input : dependencies->get_inputs(id)) {
+					read_by_formula[input] = 1;
+				}
+			}
+		}
+	}
+
+	symbols.reserve(symbols.size() + header.symbol_count);
+	std::vector<SymbolId> slot_of(header.symbol_count);
+	for (std::uint32_t i = 0; i < header.symbol_count; i++) {
+		const SymbolRecord& record = symbol_records[i];
+		slot_of[i] = symbols.intern(std::string_view(strings + record.name_offset, record.name_length));
+		if (record.defined) {
+			symbols.set_value(slot_of[i], record.value);
+		}
+		else if (record.formula != NO_PROGRAM && dependencies) {  // A kept formula that failed, so no old value may stay
+			symbols.clear_value(slot_of[i]);
+		}
+	}
+
+	std::vector<std::shared_ptr<const CompiledExpression>> loaded(header.program_count);
+	for (std::uint32_t i = 0; i < header.program_count; i++) {
+		const ProgramRecord& record = programs[i];
+		std::vector<std::string> names(record.slot_count);
+		std::vector<SymbolId> program_slots(record.slot_count);
+
+		for (std::uint32_t s = 0; s < record.slot_count; s++) {
+			program_slots[s] = slot_of[slots[record.first_slot + s]];
+			names[s] = symbols.get_name(program_slots[s]);
+		}
+		loaded[i] = std::make_shared<const CompiledExpression>(instructions + record.first_instruction, record.instruction_count,
+			constants + record.first_constant, record.constant_count, std::move(names), std::move(program_slots),
+			record.max_stack_depth, record.temp_count);
+	}
+
+	size_t formulas = 0;
+	if (dependencies) {
+		for (std::uint32_t i = 0; i < header.symbol_count; i++) {
+			const SymbolRecord& record = symbol_records[i];
+			if (record.formula != NO_PROGRAM) {
+				const ProgramRecord& program = programs[record.formula];
+				std::vector<SymbolId> inputs(program.slot_count);
+				for (std::uint32_t s = 0; s < program.slot_count; s++) {
+					inputs[s] = slot_of[slots[program.first_slot + s]];
+				}
+				dependencies->restore(slot_of[i], loaded[record.formula], std::move(inputs));
+				formulas++;
+			}
+			else if (record.defined && dependencies->get_formula(slot_of[i])) {  // A plain value in the file replaces a formula
+				dependencies->restore(slot_of[i], nullptr, {});
+			}
+		}
+
+		for (std::uint32_t i = 0; i < header.symbol_count; i++) {
+			SymbolId slot = slot_of[i];
+			if (symbol_records[i].defined && slot < read_by_formula.size() && read_by_formula[slot]) {
+				dependencies->refresh(slot);
+			}
+		}
+	}
+
+	size_t cached = 0;
+	if (((header.flags & FLAG_FAST_MATH) != 0) == fast_math) {
+		for (std::uint32_t i = header.expression_count; i-- > 0;) {  // Oldest first, so the most recent entry ends up most recent
+			const ExpressionRecord& record = expressions[i];
+			cache.insert(std::string(strings + record.key_offset, record.key_length), loaded[record.program]);
+		}
+		cached = header.expression_count;
+	}
+
+	return { header.symbol_count, formulas, cached, static_cast<size_t>(size) };
+}
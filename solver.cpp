@@ -0,0 +1,402 @@
+#include "Solver.h"
+#include "Batch_evaluator.h"
+#include "Optimizer.h"
+#include "Parser.h"
+#include "Tokenizer.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+static const double NOT_FOUND = std::numeric_limits<double>::quiet_NaN();
+static const size_t SCAN_CHUNK = 4096;   // Scan points evaluated between two checks of the governor.
+static const size_t REFINE_POINTS = 64;  // Intervals the window around a local minimum of |f| is scanned again with.
+static const size_t REFINE_DEPTH = 3;    // Times a window can be refined within a window.
+
+/* opposite_signs: Checks if two values are non-zero and of different signs */
+static bool opposite_signs(double a, double b) {
+	return (a < 0 && b > 0) || (a > 0 && b < 0);
+}
+
+/* trim: Removes the spaces around a piece of the equation */
+static std::string trim(const std::string& text) {
+	size_t first = text.find_first_not_of(' ');
+	size_t last = text.find_last_not_of(' ');
+
+	return first == std::string::npos ? std::string() : text.substr(first, last - first + 1);
+}
+
+/* constructor */
+Solver::Solver(const SymbolTable& symbols, const SolverOptions& options)
+	: symbols(symbols), options(options), stats(), unknown(NO_SYMBOL), unknown_index(0), differentiator(working), governor(nullptr) {}
+
+/* prepare: Rewrites "lhs = rhs" as "(lhs) - (rhs)", then parses, optimizes and compiles it */
+void Solver::prepare(const std::string& text, const std::string& variable) {
+	size_t equal = text.find('=');
+	std::string expression = text;
+
+	if (equal != std::string::npos) {
+		std::string left = trim(text.substr(0, equal));
+		std::string right = trim(text.substr(equal + 1));
+
+		if (left.empty() || right.empty() || right.find('=') != std::string::npos) {
+			throw std::runtime_error("Invalid equation: expected one expression on each side of '='");
+		}
+		expression = "(" + left + ") - (" + right + ")";
+	}
+
+	working = symbols;
+	unknown = working.intern(variable);
+
+	// Node tokens point into the text, which only has to live until the tree is optimized
+	Tokenizer tokenizer(expression, working);
+	Parser parser(tokenizer);
+	tokenizer.set_governor(governor);
+	parser.set_governor(governor);
+	ExpressionTree tree = parser.parse();
+
+	if (tree.get_roots().size() != 1) {
+		throw std::runtime_error("Invalid equation: expected a single expression");
+	}
+
+	Optimizer optimizer;
+	function = optimizer.optimize(tree);
+	compiled.reset(new CompiledExpression(function, function.root()));
+
+	// Every variable but the unknown keeps its value from the symbol table
+	const std::vector<std::string>& names = compiled->get_variable_names();
+	slot_values.assign(names.size(), 0.0);
+	unknown_index = names.size();
+
+	for (size_t i = 0; i < names.size(); i++) {
+		if (names[i] == variable) {
+			unknown_index = i;
+			continue;
+		}
+
+		SymbolId id = working.find(names[i]);
+		if (!working.is_defined(id)) {
+			throw std::runtime_error("Variable not defined: " + names[i]);
+		}
+		slot_values[i] = working.get_value(id);
+	}
+
+	if (unknown_index == names.size()) {
+		throw std::runtime_error("The equation does not depend on " + variable);
+	}
+}
+
+/* value_at: Evaluates the compiled f, reporting a point of its domain as NaN */
+double Solver::value_at(double x) {
+	slot_values[unknown_index] = x;
+	if (governor) {
+		governor->add_steps(compiled->get_code().size());
+	}
+
+	try {
+		return compiled->evaluate(slot_values.data());
+	}
+	catch (const LimitExceeded&) {
+		throw;
+	}
+	catch (const std::runtime_error&) {
+		return NOT_FOUND;
+	}
+}
+
+/* tolerance_at: Relative accuracy, but never finer than the spacing of doubles near x */
+double Solver::tolerance_at(double x) const {
+	return options.tolerance * std::max(1.0, std::fabs(x)) + 2 * DBL_EPSILON * std::fabs(x);
+}
+
+/* newton_bracketed: Newton steps that keep the bracket around the root up to date, so Brent can take over at any point */
+double Solver::newton_bracketed(double a, double b, double fa, double fb) {
+	double x = 0.5 * (a + b);
+	double previous = std::numeric_limits<double>::infinity();
+
+	for (size_t i = 0; i < options.max_iterations; i++) {
+		working.set_value(unknown, x);
+		stats.newton_evaluations++;
+
+		if (governor) {
+			governor->add_steps(function.size());
+		}
+
+		Dual d;
+		try {
+			d = differentiator.derivative(function, function.root(), unknown);
+		}
+		catch (const std::runtime_error&) {
+			break;
+		}
+
+		if (d.value == 0) {
+			return x;
+		}
+		if (opposite_signs(d.value, fa)) {
+			b = x;
+			fb = d.value;
+		}
+		else {
+			a = x;
+			fa = d.value;
+		}
+
+		double magnitude = std::fabs(d.value);
+		if (d.derivative == 0 || !std::isfinite(d.derivative) || magnitude > 0.5 * previous) {
+			break;
+		}
+		previous = magnitude;
+
+		double step = d.value / d.derivative;
+		double next = x - step;
+
+		if (!(next > std::min(a, b) && next < std::max(a, b))) {  // Also rejects a NaN step
+			break;
+		}
+		x = next;
+
+		if (std::fabs(step) <= tolerance_at(x)) {
+			return x;
+		}
+	}
+
+	stats.fallbacks++;
+	return brent(a, b, fa, fb);
+}
+
+/* newton_touching: Without a bracket, a root is only accepted if Newton settles on it inside the window */
+double Solver::newton_touching(double x, double low, double high) {
+	for (size_t i = 0; i < options.max_iterations; i++) {
+		working.set_value(unknown, x);
+		stats.newton_evaluations++;
+
+		if (governor) {
+			governor->add_steps(function.size());
+		}
+
+		Dual d;
+		try {
+			d = differentiator.derivative(function, function.root(), unknown);
+		}
+		catch (const std::runtime_error&) {
+			return NOT_FOUND;
+		}
+
+		if (d.value == 0) {
+			return x;
+		}
+		if (d.derivative == 0 || !std::isfinite(d.derivative)) {
+			return NOT_FOUND;
+		}
+
+		double step = d.value / d.derivative;
+		x -= step;
+
+		if (!(x >= low && x <= high)) {
+			return NOT_FOUND;
+		}
+		if (std::fabs(step) <= tolerance_at(x)) {
+			return x;
+		}
+	}
+	return NOT_FOUND;
+}
+
+/* brent: Brent's method. b is the best estimate so far, a the previous one, and c keeps f(c) opposite to f(b) */
+double Solver::brent(double a, double b, double fa, double fb) {
+	double c = a;
+	double fc = fa;
+	double d = b - a;
+	double e = d;
+
+	for (size_t i = 0; i < options.max_iterations; i++) {
+		if (!opposite_signs(fb, fc)) {
+			c = a;
+			fc = fa;
+			d = b - a;
+			e = d;
+		}
+		if (std::fabs(fc) < std::fabs(fb)) {
+			a = b;
+			b = c;
+			c = a;
+			fa = fb;
+			fb = fc;
+			fc = fa;
+		}
+
+		double tolerance = 0.5 * tolerance_at(b);
+		double middle = 0.5 * (c - b);
+
+		if (std::fabs(middle) <= tolerance || fb == 0) {
+			return b;
+		}
+
+		if (std::fabs(e) >= tolerance && std::fabs(fa) > std::fabs(fb)) {  // Tries interpolation first
+			double s = fb / fa;
+			double p;
+			double q;
+
+			if (a == c) {  // Secant
+				p = 2 * middle * s;
+				q = 1 - s;
+			}
+			else {  // Inverse quadratic
+				double r = fb / fc;
+				q = fa / fc;
+				p = s * (2 * middle * q * (q - r) - (b - a) * (r - 1));
+				q = (q - 1) * (r - 1) * (s - 1);
+			}
+			if (p > 0) {
+				q = -q;
+			}
+			p = std::fabs(p);
+
+			if (2 * p < std::min(3 * middle * q - std::fabs(tolerance * q), std::fabs(e * q))) {
+				e = d;
+				d = p / q;
+			}
+			else {  // Interpolation would converge too slowly, so bisect
+				d = middle;
+				e = d;
+			}
+		}
+		else {
+			d = middle;
+			e = d;
+		}
+
+		a = b;
+		fa = fb;
+		b += std::fabs(d) > tolerance ? d : std::copysign(tolerance, middle);
+		stats.brent_evaluations++;
+		fb = value_at(b);
+
+		if (std::isnan(fb)) {  // The bracket holds a point where f is undefined
+			return NOT_FOUND;
+		}
+	}
+	return NOT_FOUND;
+}
+
+/* scan: Evaluates f at count + 1 evenly spaced points of [low, high] and refines every bracket and touching point
+		 it finds. A local minimum of |f| may hide two roots closer than the spacing, so its window is scanned
+		 again, finer, before Newton looks for a root that only touches zero. */
+void Solver::scan(double low, double high, size_t count, size_t depth, std::vector<double>& roots) {
+	size_t points = std::max<size_t>(count, 1) + 1;
+	std::vector<double> xs(points);
+	std::vector<double> fs(points);
+
+	for (size_t i = 0; i < points; i++) {
+		xs[i] = i + 1 == points ? high : low + (high - low) * (static_cast<double>(i) / (points - 1));
+	}
+
+	// The scan is one batch: rows where f is undefined come back as NaN instead of throwing
+	std::vector<BatchColumn> columns(slot_values.size());
+	for (size_t i = 0; i < columns.size(); i++) {
+		columns[i] = { i == unknown_index ? xs.data() : nullptr, slot_values[i] };
+	}
+	std::vector<RowStatus> status(points);
+	BatchEvaluator batch(*compiled);
+
+	// Under a governor the batch is cut into chunks, so a deadline or a cancellation stops a long scan
+	size_t chunk = governor ? SCAN_CHUNK : points;
+	for (size_t first = 0; first < points; first += chunk) {
+		size_t rows = std::min(chunk, points - first);
+		if (governor) {
+			governor->add_steps(rows * compiled->get_code().size());
+		}
+		columns[unknown_index].rows = xs.data() + first;
+		batch.evaluate(columns, rows, fs.data() + first, status.data() + first);
+	}
+	stats.scan_evaluations += points;
+
+	for (size_t i = 0; i < points; i++) {
+		if (fs[i] == 0) {
+			// Neighbouring exact zeros (t - t, or sqrt(t^2) - t for t >= 0) form a range of solutions, not separate roots
+			size_t last = i;
+			while (last + 1 < points && fs[last + 1] == 0) {
+				last++;
+			}
+			if (last > i) {
+				intervals.push_back({ xs[i], xs[last] });
+			}
+			else {
+				roots.push_back(xs[i]);
+			}
+			i = last;
+			continue;
+		}
+
+		if (i + 1 < points && opposite_signs(fs[i], fs[i + 1])) {
+			stats.brackets++;
+			double root = options.newton ? newton_bracketed(xs[i], xs[i + 1], fs[i], fs[i + 1])
+										 : brent(xs[i], xs[i + 1], fs[i], fs[i + 1]);
+
+			// Near a pole |f| grows instead of vanishing, beyond its value at either end
+			if (!std::isnan(root)) {
+				stats.scan_evaluations++;
+				if (std::fabs(value_at(root)) <= std::min(std::fabs(fs[i]), std::fabs(fs[i + 1]))) {
+					roots.push_back(root);
+				}
+			}
+			continue;
+		}
+
+		// A local minimum of |f| that does not change sign may be a root that only touches zero, or two close roots
+		if (i > 0 && i + 1 < points && !std::isnan(fs[i]) &&
+			!opposite_signs(fs[i - 1], fs[i]) && !opposite_signs(fs[i], fs[i + 1]) &&
+			std::fabs(fs[i]) < std::fabs(fs[i - 1]) && std::fabs(fs[i]) < std::fabs(fs[i + 1])) {
+			if (depth < REFINE_DEPTH) {
+				scan(xs[i - 1], xs[i + 1], REFINE_POINTS, depth + 1, roots);
+				continue;
+			}
+			double root = newton_touching(xs[i], xs[i - 1], xs[i + 1]);
+			if (!std::isnan(root)) {
+				roots.push_back(root);
+			}
+		}
+	}
+}
+
+/* solve: Scans the interval for brackets and touching points, then keeps each root once */
+std::vector<double> Solver::solve(const std::string& equation, const std::string& variable, double low, double high) {
+	if (!(low < high) || !std::isfinite(low) || !std::isfinite(high)) {
+		throw std::runtime_error("Invalid interval: the lower bound must be below the upper bound");
+	}
+
+	stats = SolverStats();
+	prepare(equation, variable);
+
+	std::vector<double> roots;
+	intervals.clear();
+	scan(low, high, options.scan_points, 0, roots);
+
+	// Neighbouring searches can settle on the same root
+	std::sort(roots.begin(), roots.end());
+	std::sort(intervals.begin(), intervals.end());
+	std::vector<double> distinct;
+	for (double root : roots) {
+		if (distinct.empty() || root - distinct.back() > 4 * tolerance_at(root)) {
+			distinct.push_back(root);
+		}
+	}
+	return distinct;
+}
+
+/* get_intervals: Returns the ranges of zeros found by the last solve */
+const std::vector<std::pair<double, double>>& Solver::get_intervals() const {
+	return intervals;
+}
+
+/* set_governor: Counts the work of the next solves against the budget of the line */
+void Solver::set_governor(ResourceGovernor* governor) {
+	this->governor = governor;
+}
+
+/* get_stats: Returns the work done by the last solve */
+const SolverStats& Solver::get_stats() const {
+	return stats;
+}
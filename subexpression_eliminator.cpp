@@ -0,0 +1,128 @@
+#include "Subexpression_eliminator.h"
+#include <cstring>
+#include <functional>
+
+/* operator==: Two keys match when the type, text, number and children are identical */
+bool SubexpressionEliminator::NodeKey::operator==(const NodeKey& other) const {
+	return type == other.type && left == other.left && right == other.right && bits == other.bits && value == other.value;
+}
+
+/* operator(): Combines the hashes of the key's fields */
+size_t SubexpressionEliminator::NodeKeyHash::operator()(const NodeKey& key) const {
+	size_t hash = std::hash<std::string_view>()(key.value);
+	hash = hash * 31 + std::hash<std::uint64_t>()(key.bits);
+	hash = hash * 31 + static_cast<size_t>(key.type);
+	hash = hash * 31 + key.left;
+	hash = hash * 31 + key.right;
+	return hash;
+}
+
+/* constructor */
+SubexpressionEliminator::SubexpressionEliminator() : deduplicated(0) {}
+
+/* eliminate: Rebuilds every root bottom-up, reusing nodes that already exist */
+ExpressionTree SubexpressionEliminator::eliminate(const ExpressionTree& tree) {
+	output.clear();
+	nodes.clear();
+	merged.assign(tree.size(), NO_NODE);
+	deduplicated = 0;
+
+	for (NodeIndex root : tree.get_roots()) {
+		output.add_root(merge_node(tree, root));
+	}
+
+	mark_shared_nodes();
+	return std::move(output);
+}
+
+/* merge_node: Merges the children first, so equal subtrees produce equal keys. The walk keeps its
+			   pending nodes and the merged children on explicit stacks, not on the call stack. */
+NodeIndex SubexpressionEliminator::merge_node(const ExpressionTree& tree, NodeIndex root) {
+	frames.clear();
+	results.clear();
+	frames.push_back({ root, 0 });
+
+	while (!frames.empty()) {
+		NodeFrame& frame = frames.back();
+		NodeIndex index = frame.index;
+
+		if (index == NO_NODE || merged[index] != NO_NODE) {  // The input is already a DAG and this node was visited through another parent
+			results.push_back(index == NO_NODE ? NO_NODE : merged[index]);
+			frames.pop_back();
+		}
+		else if (frame.stage < 2) {  // Left child first, then right
+			NodeIndex child = frame.stage == 0 ? tree[index].left : tree[index].right;
+			frame.stage++;
+			frames.push_back({ child, 0 });
+		}
+		else {
+			NodeIndex right = results.back();
+			results.pop_back();
+			results.back() = merge_operation(tree, index, results.back(), right);
+			frames.pop_back();
+		}
+	}
+	return results.back();
+}
+
+/* merge_operation: Reuses an existing node equal to this one, or adds it to the output */
+NodeIndex SubexpressionEliminator::merge_operation(const ExpressionTree& tree, NodeIndex index, NodeIndex left, NodeIndex right) {
+	const ExpressionNode& node = tree[index];
+	NodeKey key = { node.token.getType(), node.token.getValue(), 0, left, right };
+	if (node.token.getType() == TokenType::Number) {  // Literals match by value, so "2" and "2.0" merge
+		double number = node.token.getNumber();
+		key.value = std::string_view();
+		std::memcpy(&key.bits, &number, sizeof(number));
+	}
+	auto existing = nodes.find(key);
+
+	if (existing != nodes.end()) {
+		deduplicated++;
+		merged[index] = existing->second;
+		return existing->second;
+	}
+
+	NodeIndex created = output.add_node(node.token);
+	output[created].left = left;
+	output[created].right = right;
+
+	if (left != NO_NODE && output[left].parent == NO_NODE) {  // A shared child keeps its first parent
+		output[left].parent = created;
+	}
+	if (right != NO_NODE && output[right].parent == NO_NODE) {
+		output[right].parent = created;
+	}
+
+	nodes.emplace(std::move(key), created);
+	merged[index] = created;
+	return created;
+}
+
+/* mark_shared_nodes: Counts the parents of every node and flags operators with more than one */
+void SubexpressionEliminator::mark_shared_nodes() {
+	std::vector<std::uint32_t> parents(output.size(), 0);
+
+	for (NodeIndex i = 0; i < output.size(); i++) {
+		if (output[i].left != NO_NODE) {
+			parents[output[i].left]++;
+		}
+		if (output[i].right != NO_NODE) {
+			parents[output[i].right]++;
+		}
+	}
+	for (NodeIndex root : output.get_roots()) {
+		if (root != NO_NODE) {
+			parents[root]++;
+		}
+	}
+
+	for (NodeIndex i = 0; i < output.size(); i++) {
+		TokenType type = output[i].token.getType();
+		output[i].shared = parents[i] > 1 && type != TokenType::Number && type != TokenType::Variable;
+	}
+}
+
+/* get_deduplicated: Returns the number of merged nodes */
+size_t SubexpressionEliminator::get_deduplicated() const {
+	return deduplicated;
+}
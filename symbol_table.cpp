@@ -0,0 +1,68 @@
+#include "Symbol_table.h"
+
+/* intern: Returns the slot of a name, appending a new undefined slot for names seen the first time */
+SymbolId SymbolTable::intern(std::string_view name) {
+	auto it = ids.find(name);
+
+	if (it != ids.end()) {
+		return it->second;
+	}
+
+	SymbolId id = static_cast<SymbolId>(names.size());
+	ids.emplace(std::string(name), id);
+	names.emplace_back(name);
+	values.push_back(0.0);
+	defined.push_back(0);
+	return id;
+}
+
+/* reserve: Sizes the map and the slot arrays for count names */
+void SymbolTable::reserve(size_t count) {
+	ids.reserve(count);
+	names.reserve(count);
+	values.reserve(count);
+	defined.reserve(count);
+}
+
+/* find: Looks up the slot of a name without creating one */
+SymbolId SymbolTable::find(std::string_view name) const {
+	auto it = ids.find(name);
+	return it == ids.end() ? NO_SYMBOL : it->second;
+}
+
+/* get_name: Returns the name interned in a slot */
+const std::string& SymbolTable::get_name(SymbolId id) const {
+	return names[id];
+}
+
+/* is_defined: Checks if a value has been assigned to the slot */
+bool SymbolTable::is_defined(SymbolId id) const {
+	return id < defined.size() && defined[id] != 0;
+}
+
+/* get_value: Returns the value stored in a slot */
+double SymbolTable::get_value(SymbolId id) const {
+	return values[id];
+}
+
+/* set_value: Stores a value in a slot and marks it as defined */
+void SymbolTable::set_value(SymbolId id, double value) {
+	values[id] = value;
+	defined[id] = 1;
+}
+
+/* clear_value: Forgets the value of a slot */
+void SymbolTable::clear_value(SymbolId id) {
+	values[id] = 0.0;
+	defined[id] = 0;
+}
+
+/* get_values: Returns the flat value array */
+const double* SymbolTable::get_values() const {
+	return values.data();
+}
+
+/* size: Returns how many names have been interned */
+size_t SymbolTable::size() const {
+	return names.size();
+}
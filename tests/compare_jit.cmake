@@ -0,0 +1,36 @@
+# Runs the same lines through the calculator with and without --jit, at the prompt and in batch
+# mode, and fails unless the output is identical.
+#   cmake -DCALCULATOR=<calculator> -DINPUT=<lines> -DWORK_DIR=<scratch directory> -P compare_jit.cmake
+
+file(READ ${INPUT} lines)
+file(WRITE ${WORK_DIR}/jit_prompt_input.txt "${lines}exit\n")
+
+foreach(mode interpreted native)
+  if(mode STREQUAL "native")
+    set(flag --jit)
+  else()
+    set(flag "")
+  endif()
+
+  execute_process(COMMAND ${CALCULATOR} ${flag}
+    INPUT_FILE ${WORK_DIR}/jit_prompt_input.txt
+    OUTPUT_VARIABLE prompt_${mode} ERROR_VARIABLE prompt_errors_${mode} TIMEOUT 60)
+  execute_process(COMMAND ${CALCULATOR} ${flag} --batch ${INPUT} --threads 1
+    OUTPUT_VARIABLE batch_${mode} ERROR_VARIABLE batch_errors_${mode} TIMEOUT 60)
+
+  # The summary lines report timings and the cache footprint, which includes the machine code
+  string(REGEX REPLACE "(batch|cache): [^\n]*\n" "" batch_errors_${mode} "${batch_errors_${mode}}")
+  string(REGEX REPLACE "--jit: [^\n]*\n" "" prompt_errors_${mode} "${prompt_errors_${mode}}")
+  string(REGEX REPLACE "--jit: [^\n]*\n" "" batch_errors_${mode} "${batch_errors_${mode}}")
+endforeach()
+
+foreach(stream prompt prompt_errors batch batch_errors)
+  if(NOT "${${stream}_interpreted}" STREQUAL "${${stream}_native}")
+    message(FATAL_ERROR "${stream} differs with --jit:\n--- interpreted\n${${stream}_interpreted}\n--- native\n${${stream}_native}")
+  endif()
+endforeach()
+
+string(FIND "${prompt_native}" "14.4586" found)
+if(found EQUAL -1)
+  message(FATAL_ERROR "The prompt did not evaluate the lines:\n${prompt_native}")
+endif()
@@ -0,0 +1,275 @@
+/*------error_parity_test.cpp--------------------------------------------------
+	Checks that the compiled form of an expression reports exactly what the
+	Evaluator, the reference implementation, reports: the same value, or the
+	same error message when the line fails.
+
+	Random expressions over defined variables (x = 2, y = 0, z = -3), an
+	undefined one (w), zeros, negative square roots and divisions are
+	parsed once, then run through:
+		- Evaluator::try_evaluate on the tree as parsed (the reference).
+		- CompiledExpression::try_evaluate on the same tree, interpreted and
+		  with native code (where the machine supports it).
+		- Both again on the tree the sessions compile, after the Optimizer
+		  and the SubexpressionEliminator.
+		- BatchEvaluator on one row, whose status must give the same message.
+		- Session::try_execute and Session::try_evaluate_readonly, with and
+		  without --jit, which is what the prompt, batch mode and the server
+		  print.
+	A few hand-built malformed trees check that structural errors also come
+	in the Evaluator's order.
+
+	Prints every mismatch and exits with 1 if there is any. Run as the
+	error_parity test of CMakeLists.txt (ctest).
+----------------------------------------------------------------------------*/
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "Batch_evaluator.h"
+#include "Compiled_expression.h"
+#include "Evaluator.h"
+#include "Optimizer.h"
+#include "Parser.h"
+#include "Session.h"
+#include "Subexpression_eliminator.h"
+#include "Tokenizer.h"
+
+static const size_t EXPRESSIONS = 20000;
+static const int MAX_DEPTH = 5;
+
+static size_t mismatches = 0;
+
+/* Outcome of one evaluation: its value, or the message of its error. */
+struct Outcome {
+	bool ok;
+	double value;
+	std::string message;
+};
+
+/* outcome: Turns a result into an Outcome */
+static Outcome outcome(const Result<double>& result) {
+	if (result) {
+		return { true, result.value(), std::string() };
+	}
+	return { false, 0, result.error().message() };
+}
+
+/* same: Two outcomes match when both fail with the same message, or give the same bits (any NaN matches any NaN).
+   With a tolerance, values may also differ by that many units relative to their size. */
+static bool same(const Outcome& a, const Outcome& b, double tolerance = 0) {
+	if (a.ok != b.ok) {
+		return false;
+	}
+	if (!a.ok) {
+		return a.message == b.message;
+	}
+	if (std::isnan(a.value) || std::isnan(b.value)) {
+		return std::isnan(a.value) && std::isnan(b.value);
+	}
+	if (std::memcmp(&a.value, &b.value, sizeof(double)) == 0) {
+		return true;
+	}
+	return std::abs(a.value - b.value) <= tolerance * std::abs(a.value);
+}
+
+/* describe: Prints an outcome for a mismatch report */
+static std::string describe(const Outcome& a) {
+	return a.ok ? std::to_string(a.value) : "error \"" + a.message + "\"";
+}
+
+/* expect: Records a mismatch between the reference and another path */
+static void expect(const std::string& expression, const char* path, const Outcome& reference, const Outcome& actual,
+	double tolerance = 0) {
+	if (!same(reference, actual, tolerance)) {
+		mismatches++;
+		if (mismatches <= 20) {
+			std::printf("%s\n  evaluator: %s\n  %s: %s\n", expression.c_str(), describe(reference).c_str(), path, describe(actual).c_str());
+		}
+	}
+}
+
+/* random_expression: Builds an expression text of at most the given depth */
+static std::string random_expression(std::mt19937& random, int depth) {
+	static const char* atoms[] = { "0", "-0", "1", "2", "0.5", "7", "x", "y", "z", "w", "2x", "-y" };
+	static const char* operators[] = { " + ", " - ", "*", "/", "/", "^" };
+
+	int choice = depth <= 0 ? 0 : static_cast<int>(random() % 6);
+	switch (choice) {
+		case 0:
+		case 1:
+			return atoms[random() % (sizeof(atoms) / sizeof(atoms[0]))];
+		case 2:
+			return std::string("sqrt(").append(random_expression(random, depth - 1)).append(")");
+		case 3:
+			return std::string("(").append(random_expression(random, depth - 1)).append(")");
+		default: {
+			std::string text = random_expression(random, depth - 1);
+			text.append(operators[random() % (sizeof(operators) / sizeof(operators[0]))]);
+			return text.append(random_expression(random, depth - 1));
+		}
+	}
+}
+
+/* batch_outcome: Runs the program on a single row and turns its status into an Outcome */
+static Outcome batch_outcome(const CompiledExpression& program, const SymbolTable& symbols) {
+	std::vector<BatchColumn> columns;
+	for (const std::string& name : program.get_variable_names()) {
+		columns.push_back({ nullptr, symbols.get_value(symbols.find(name)) });
+	}
+	double output;
+	RowStatus status;
+	BatchEvaluator(program).evaluate(columns, 1, &output, &status);
+	if (status != RowStatus::Ok) {
+		return { false, 0, row_status_message(status) };
+	}
+	return { true, output, std::string() };
+}
+
+/* check_compiled: Compares every compiled path on one tree with the reference */
+static void check_compiled(const std::string& expression, const char* stage, const ExpressionTree& tree, SymbolTable& symbols,
+	const Outcome& reference) {
+	CompiledExpression program(tree, tree.root());
+	std::string path = std::string(stage) + " bytecode";
+	expect(expression, path.c_str(), reference, outcome(program.try_evaluate(symbols)));
+
+	bool defined = true;
+	for (const std::string& name : program.get_variable_names()) {
+		defined = defined && symbols.is_defined(symbols.find(name));
+	}
+	if (defined) {  // Batch columns always have values; its integer powers may differ in the last bits (see Batch_evaluator.h)
+		path = std::string(stage) + " batch";
+		expect(expression, path.c_str(), reference, batch_outcome(program, symbols), 1e-14);
+	}
+
+	if (program.attach_native()) {
+		path = std::string(stage) + " native";
+		expect(expression, path.c_str(), reference, outcome(program.try_evaluate(symbols)));
+	}
+}
+
+/* Sessions holding the same variables as the reference symbol table, without and with --jit. */
+struct Sessions {
+	Session interpreted;
+	Session native;
+
+	Sessions() : interpreted(options(false)), native(options(true)) {
+		for (const char* line : { "x = 2", "y = 0", "z = -3" }) {
+			interpreted.try_execute(line);
+			native.try_execute(line);
+		}
+	}
+
+	static SessionOptions options(bool jit) {
+		SessionOptions options;
+		options.jit = jit;
+		return options;
+	}
+};
+
+/* line_outcome: Turns the result of a session line into an Outcome */
+static Outcome line_outcome(const Result<LineResult>& result) {
+	if (result) {
+		return { true, result.value().value, std::string() };
+	}
+	return { false, 0, result.error().message() };
+}
+
+/* check_sessions: Compares what the sessions report for a line with the reference */
+static void check_sessions(const std::string& expression, Sessions& sessions, const Outcome& reference) {
+	expect(expression, "session", reference, line_outcome(sessions.interpreted.try_execute(expression)));
+	expect(expression, "read-only session", reference, outcome(sessions.interpreted.try_evaluate_readonly(expression)));
+	expect(expression, "session --jit", reference, line_outcome(sessions.native.try_execute(expression)));
+	expect(expression, "read-only session --jit", reference, outcome(sessions.native.try_evaluate_readonly(expression)));
+}
+
+/* check_expression: Runs one expression through the reference and every compiled path */
+static void check_expression(const std::string& expression, SymbolTable& symbols, Sessions& sessions) {
+	Tokenizer tokenizer(expression, symbols);
+	Parser parser(tokenizer);
+	ExpressionTree tree;
+	if (!parser.try_parse(tree)) {
+		return;
+	}
+
+	Evaluator evaluator(symbols);
+	Outcome reference = outcome(evaluator.try_evaluate(tree, tree.root()));
+	check_compiled(expression, "parsed", tree, symbols, reference);
+
+	Optimizer optimizer;
+	SubexpressionEliminator eliminator;
+	ExpressionTree merged = eliminator.eliminate(optimizer.optimize(tree));
+	expect(expression, "optimized evaluator", reference, outcome(evaluator.try_evaluate(merged, merged.root())));
+	check_compiled(expression, "optimized", merged, symbols, reference);
+	check_sessions(expression, sessions, reference);
+}
+
+/* node: Adds a node to a hand-built tree */
+static NodeIndex node(ExpressionTree& tree, const Token& token, NodeIndex left = NO_NODE, NodeIndex right = NO_NODE) {
+	NodeIndex index = tree.add_node(token);
+	tree[index].left = left;
+	tree[index].right = right;
+	return index;
+}
+
+/* check_malformed: Trees the Parser never builds, whose errors must still come in the evaluator's order */
+static void check_malformed(SymbolTable& symbols) {
+	std::vector<std::pair<std::string, ExpressionTree>> trees;
+
+	ExpressionTree zero_divisor;  // (1 + ?) / 0: the zero divisor is checked first
+	NodeIndex sum = node(zero_divisor, Token(TokenType::Addition, "+"), node(zero_divisor, Token::number(1)));
+	zero_divisor.add_root(node(zero_divisor, Token(TokenType::Division, "/"), sum, node(zero_divisor, Token::number(0))));
+	trees.push_back({ "(1 + ?) / 0", std::move(zero_divisor) });
+
+	ExpressionTree after_error;  // sqrt(-1) * (? - 1): the square root fails before the malformed node is reached
+	NodeIndex root = node(after_error, Token(TokenType::Sqrt, "sqrt"), node(after_error, Token::number(-1)));
+	NodeIndex difference = node(after_error, Token(TokenType::Subtraction, "-"), NO_NODE, node(after_error, Token::number(1)));
+	after_error.add_root(node(after_error, Token(TokenType::Multiplication, "*"), root, difference));
+	trees.push_back({ "sqrt(-1) * (? - 1)", std::move(after_error) });
+
+	ExpressionTree before_error;  // (? * 2) + w: the malformed node comes before the undefined variable
+	NodeIndex product = node(before_error, Token(TokenType::Multiplication, "*"), NO_NODE, node(before_error, Token::number(2)));
+	NodeIndex w = node(before_error, Token(TokenType::Variable, "w", symbols.intern("w")));
+	before_error.add_root(node(before_error, Token(TokenType::Addition, "+"), product, w));
+	trees.push_back({ "(? * 2) + w", std::move(before_error) });
+
+	for (auto& [expression, tree] : trees) {
+		Evaluator evaluator(symbols);
+		Outcome reference = outcome(evaluator.try_evaluate(tree, tree.root()));
+		check_compiled(expression, "malformed", tree, symbols, reference);
+	}
+}
+
+int main() {
+	SymbolTable symbols;
+	symbols.set_value(symbols.intern("x"), 2);
+	symbols.set_value(symbols.intern("y"), 0);
+	symbols.set_value(symbols.intern("z"), -3);
+
+	Sessions sessions;
+
+	std::mt19937 random(20261018);
+	for (size_t i = 0; i < EXPRESSIONS; i++) {
+		check_expression(random_expression(random, MAX_DEPTH), symbols, sessions);
+	}
+
+	// Lines whose message changed when the sessions moved to compiled expressions
+	check_expression("sqrt(-1)/0", symbols, sessions);
+	check_expression("(-0)/-y*0^sqrt(-7)*z/z", symbols, sessions);
+	check_expression("1/0 + w", symbols, sessions);
+	check_expression("1/y*w", symbols, sessions);
+	const char* expected[][2] = {
+		{ "sqrt(-1)/0", "Division by zero" },
+		{ "(-0)/-y*0^sqrt(-7)*z/z", "Division by zero" },
+		{ "1/0 + w", "Division by zero" },
+	};
+	for (auto& [line, message] : expected) {
+		expect(line, "session", { false, 0, message }, line_outcome(sessions.interpreted.try_execute(line)));
+	}
+	check_malformed(symbols);
+
+	std::printf("%zu mismatches\n", mismatches);
+	return mismatches == 0 ? 0 : 1;
+}
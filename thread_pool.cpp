@@ -0,0 +1,92 @@
+#include "Thread_pool.h"
+
+/* constructor: Creates one queue per worker and starts the workers */
+ThreadPool::ThreadPool(size_t thread_count) : pending(0), next_queue(0), stopping(false) {
+	if (thread_count == 0) {  // hardware_concurrency() may report 0 when it cannot tell
+		thread_count = 1;
+	}
+
+	for (size_t i = 0; i < thread_count; i++) {
+		queues.push_back(std::make_unique<WorkerQueue>());
+	}
+	for (size_t i = 0; i < thread_count; i++) {
+		threads.emplace_back(&ThreadPool::work, this, i);
+	}
+}
+
+/* destructor: Lets the workers drain their queues, then joins them */
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(wake_mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+}
+
+/* submit: Deals the task onto the next worker queue and wakes a worker */
+void ThreadPool::submit(std::function<void()> task) {
+	WorkerQueue& queue = *queues[next_queue.fetch_add(1) % queues.size()];
+	{
+		std::lock_guard<std::mutex> lock(wake_mutex);
+		pending++;  // Counted before it is queued, so a worker can never take it before it is counted
+	}
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(std::move(task));
+	}
+	wake.notify_one();
+}
+
+/* take_task: Pops the oldest task of the worker's own queue, or steals the newest task of another queue */
+bool ThreadPool::take_task(size_t worker, std::function<void()>& task) {
+	{
+		WorkerQueue& own = *queues[worker];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.front());
+			own.tasks.pop_front();
+			return true;
+		}
+	}
+
+	for (size_t offset = 1; offset < queues.size(); offset++) {
+		WorkerQueue& victim = *queues[(worker + offset) % queues.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			task = std::move(victim.tasks.back());
+			victim.tasks.pop_back();
+			return true;
+		}
+	}
+	return false;
+}
+
+/* work: Runs tasks until the pool is stopping and no work is left */
+void ThreadPool::work(size_t worker) {
+	std::function<void()> task;
+
+	while (true) {
+		if (take_task(worker, task)) {
+			pending--;
+			task();
+			task = nullptr;
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(wake_mutex);
+		wake.wait(lock, [this] { return pending > 0 || stopping; });
+
+		if (stopping && pending == 0) {
+			return;
+		}
+	}
+}
+
+/* get_thread_count: Returns how many workers the pool runs */
+size_t ThreadPool::get_thread_count() const {
+	return threads.size();
+}
@@ -1,14 +1,34 @@
 #include "Token.h"
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable<Token>::value, "Tokens are copied freely and must stay plain records");
 
 /* constructor */
-Token::Token(TokenType type, const std::string& value) : type(type), value(value) {}
+Token::Token(TokenType type, std::string_view text, SymbolId slot) : type(type), slot(slot), value(0.0), text(text) {}
+
+/* number: Builds a number literal from an already decoded value */
+Token Token::number(double value, std::string_view text) {
+    Token token(TokenType::Number, text);
+    token.value = value;
+    return token;
+}
 
 /* getType: Returns the type of token */
 TokenType Token::getType() const {
     return type;
 }
 
-/* getValue: Returns the value of the token */
-const std::string& Token::getValue() const {
+/* getValue: Returns the text of the token */
+std::string_view Token::getValue() const {
+    return text;
+}
+
+/* getNumber: Returns the value of a number literal */
+double Token::getNumber() const {
     return value;
-}
\ No newline at end of file
+}
+
+/* getSlot: Returns the symbol table slot of a variable token */
+SymbolId Token::getSlot() const {
+    return slot;
+}
@@ -1,27 +1,63 @@
 #include "Tokenizer.h"
+#include <charconv>
+#include <cmath>
 #include <iostream>
 #include <stdexcept>
 #include <cctype>
 
 /* constructor */
-Tokenizer::Tokenizer(const std::string& expression) : expression(expression), position(0) {}
+Tokenizer::Tokenizer(std::string_view expression) : expression(expression), position(0), symbols(nullptr), lookup(nullptr), wide_numbers(false), governor(nullptr) {}
 
-/* tokenizer: Proccess the input expression and extracts all tokens in the correct order */
-std::vector<Token> Tokenizer::tokenize() {
-    std::vector<Token> tokens;
+/* constructor: Variable tokens will carry their slot in the given symbol table */
+Tokenizer::Tokenizer(std::string_view expression, SymbolTable& symbols)
+    : expression(expression), position(0), symbols(&symbols), lookup(nullptr), wide_numbers(false), governor(nullptr) {}
 
-    Token token = next_token();
-    while (token.getType() != TokenType::End) {
-        tokens.push_back(token);
-        token = next_token();
+/* constructor: Variable tokens will carry their slot if the read-only table already knows the name */
+Tokenizer::Tokenizer(std::string_view expression, const SymbolTable& symbols)
+    : expression(expression), position(0), symbols(nullptr), lookup(&symbols), wide_numbers(false), governor(nullptr) {}
+
+/* allow_wide_numbers: Chooses whether numbers out of the range of a double are an error */
+void Tokenizer::allow_wide_numbers(bool allow) {
+    wide_numbers = allow;
+}
+
+/* set_governor: Counts every token read against the budget of the line */
+void Tokenizer::set_governor(ResourceGovernor* governor) {
+    this->governor = governor;
+}
+
+/* reset: Points the tokenizer at a new expression */
+void Tokenizer::reset(std::string_view expression) {
+    this->expression = expression;
+    position = 0;
+}
+
+/* get_expression: Returns the text being tokenized */
+std::string_view Tokenizer::get_expression() const {
+    return expression;
+}
+
+/* slot_for: Interns the name, or only looks it up when the tokenizer was given a read-only table */
+SymbolId Tokenizer::slot_for(std::string_view name) {
+    if (!symbols && !lookup) {
+        return NO_SYMBOL;
     }
 
-    return tokens;
+    // The table looks the view up directly; only a name seen for the first time is copied into a string
+    if (symbols) {
+        return symbols->intern(name);
+    }
+    return lookup->find(name);
 }
 
 /* current_char: Returns the current character being processed in the expression */
-char Tokenizer::current_char() {
-    return expression[position];
+char Tokenizer::current_char() const {
+    return char_at(position);
+}
+
+/* char_at: Returns a character of the expression, or '\0' past its end */
+char Tokenizer::char_at(size_t index) const {
+    return index < expression.size() ? expression[index] : '\0';
 }
 
 /* advance: Moves to the next character in the expression string */
@@ -29,36 +65,59 @@ void Tokenizer::advance() {
     position++; 
 }
 
-/* next_token: Identifies the next token based on the current position in the expression*/
+/* next_token: Throws the error of an Error token, for callers that let exceptions report bad input */
 Token Tokenizer::next_token() {
+    Token token = scan_token();
+    if (token.getType() == TokenType::Error) {
+        error.raise();
+    }
+    return token;
+}
+
+/* get_error: Returns what the last Error token stands for */
+const Error& Tokenizer::get_error() const {
+    return error;
+}
+
+/* fail: Records the error and hands back an Error token over the offending text */
+Token Tokenizer::fail(ErrorCode code, size_t start, std::string_view text) {
+    error = Error(code, start, text);
+    return Token(TokenType::Error, text);
+}
+
+/* scan_token: Identifies the next token based on the current position in the expression*/
+Token Tokenizer::scan_token() {
+    if (governor) {
+        governor->tick();
+    }
     while (position < expression.size()) {
         char c = current_char(); 
 
-        if (std::isspace(c)) {  // Skips whitespace
+        if (std::isspace(static_cast<unsigned char>(c))) {  // Skips whitespace
             advance(); 
             continue; 
         }
-        else if (std::isdigit(c)) {  // Identify a numeric token
+        else if (std::isdigit(static_cast<unsigned char>(c))) {  // Identify a numeric token
             return read_number(); 
         }
         else if (c == '+' || c == '-' || c == '*' || c == '/'|| c == '^') {  // Identify an operator token
             return read_operator(); 
         }
-        else if (std::isalpha(c)) {
-            std::string name;
+        else if (std::isalpha(static_cast<unsigned char>(c))) {
+            size_t start = position;
 
             // Gather all consecutive alphabetical characters
-            while (std::isalpha(current_char())) {
-                name.push_back(current_char());
+            while (std::isalpha(static_cast<unsigned char>(current_char()))) {
                 advance();
             }
+            std::string_view name = expression.substr(start, position - start);
 
             // Check if it's "sqrt" or a variable
             if (name == "sqrt") {
                 return Token(TokenType::Sqrt, name);
             }
             else {
-                return Token(TokenType::Variable, name);
+                return Token(TokenType::Variable, name, slot_for(name));
             }
         }
 
@@ -66,26 +125,42 @@ Token Tokenizer::next_token() {
             return read_parenthesis(); 
         }
         else {
-            throw std::runtime_error("Invalid character encountered: " + std::string(1, c));
-            advance(); 
-            return Token(TokenType::Error, std::string(1, c)); 
+            return fail(ErrorCode::InvalidCharacter, position, expression.substr(position, 1));
         }
     }
 
-    return Token(TokenType::End, "");   // Return an End token when the end of the expression is reached
+    return Token(TokenType::End, std::string_view());   // Return an End token when the end of the expression is reached
 }
 
-/* read_number: Extracts a numeric token */
+/* read_number: Extracts a numeric token and decodes its value */
 Token Tokenizer::read_number() {
-    std::string number_str; 
+    size_t start = position;
 
-    while (position < expression.size() && (std::isdigit(current_char()) || current_char() == '.')) {  // Accumulate characters that form the number
-        number_str.push_back(current_char()); 
+    while (std::isdigit(static_cast<unsigned char>(current_char())) || current_char() == '.') {  // Accumulate characters that form the number
         advance(); 
     }
 
-    TokenType token_type = TokenType::Number; 
-    return Token(token_type, number_str); 
+    // An exponent only counts when digits follow, so "2e" stays 2 times the variable e
+    char next = char_at(position + 1);
+    size_t digits = (next == '+' || next == '-') ? position + 2 : position + 1;
+    if ((current_char() == 'e' || current_char() == 'E') && std::isdigit(static_cast<unsigned char>(char_at(digits)))) {
+        position = digits;
+        while (std::isdigit(static_cast<unsigned char>(current_char()))) {
+            advance();
+        }
+    }
+
+    std::string_view number_str = expression.substr(start, position - start);
+    double value = 0.0;
+    auto result = std::from_chars(number_str.data(), number_str.data() + number_str.size(), value);
+
+    if (result.ec == std::errc::result_out_of_range) {
+        if (!wide_numbers) {
+            return fail(ErrorCode::NumberOutOfRange, start, number_str);
+        }
+        value = number_str.find("e-") != std::string_view::npos || number_str.find("E-") != std::string_view::npos ? 0.0 : HUGE_VAL;
+    }
+    return Token::number(value, number_str); 
 }
 
 /* read_operator: Extracts an operator token */
@@ -114,44 +189,42 @@ Token Tokenizer::read_operator() {
             token_type = TokenType::Equal; 
             break; 
         default:
-            throw std::runtime_error("Invalid operator encountered");
-            return Token(TokenType::Error, std::string(1, c));
+            return fail(ErrorCode::InvalidOperator, position - 1, expression.substr(position - 1, 1));
     }
-    return Token(token_type, std::string(1, c)); 
+    return Token(token_type, expression.substr(position - 1, 1)); 
 }
 
 /* read_keyword: Extracts a keyword token, such as sqrt */
 Token Tokenizer::read_keyword() {
-    std::string keyword;
+    size_t start = position;
 
-    while (std::isalpha(current_char())) {  // Accumulate characters that form the keyword
-        keyword.push_back(current_char());
+    while (std::isalpha(static_cast<unsigned char>(current_char()))) {  // Accumulate characters that form the keyword
         advance();
     }
 
+    std::string_view keyword = expression.substr(start, position - start);
     if (keyword == "sqrt") {  // sqrt is the only one recognized at this moment
         return Token(TokenType::Sqrt, keyword);
     }
     else {
         throw std::runtime_error("Invalid keyword encountered");
-        return Token(TokenType::Error, keyword);
     }
 }
 
 
 /* read_variable: Extracts a variable token */
 Token Tokenizer::read_variable() {
-    std::string variable_str; 
+    size_t start = position;
 
-    if (!std::isalpha(current_char())) {
+    if (!std::isalpha(static_cast<unsigned char>(current_char()))) {
         throw std::runtime_error("Expected variable to start with a letter");
     }
-    while (position < expression.size() && std::isalnum(current_char())) {
-        variable_str.push_back(current_char()); 
+    while (std::isalnum(static_cast<unsigned char>(current_char()))) {
         advance(); 
     }
  
-    return Token(TokenType::Variable, variable_str);
+    std::string_view variable_str = expression.substr(start, position - start);
+    return Token(TokenType::Variable, variable_str, slot_for(variable_str));
 }
 
 /* read_parenthesis: extracts a parenthesis token */
@@ -168,8 +241,8 @@ Token Tokenizer::read_parenthesis() {
         token_type = TokenType::CloseParenthesis;
     }
     else {
-        throw std::runtime_error("Invalid parenthesis character encountered");
+        return fail(ErrorCode::InvalidParenthesis, position - 1, expression.substr(position - 1, 1));
     }
 
-    return Token(token_type, std::string(1, parenthesis));
+    return Token(token_type, expression.substr(position - 1, 1));
 }
\ No newline at end of file
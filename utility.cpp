@@ -35,6 +35,8 @@ void Utility::print_help() {
     std::cout << "   For instance, declare x first: x = 5 [Enter], then use: 2x + 3\n";
     std::cout << "   Similarly, for multiple variables: x = 2 + 5^2 [Enter], y = sqrt(x) [Enter].\n";
     std::cout << "   After declaring, you can use them together: 2x + y - 8\n";
+    std::cout << "   Start the calculator with --reactive to make variables follow their expressions:\n";
+    std::cout << "   after y = sqrt(x), every new value of x also updates y.\n";
 
     std::cout << "\n3. COMPLEX EXPRESSIONS:\n";
     std::cout << "   Group your expressions using parentheses: (2 + 3) * 4\n";
@@ -44,8 +46,58 @@ void Utility::print_help() {
     std::cout << "   - Ensure you've defined variables before using them in expressions.\n";
     std::cout << "   - Invalid syntax or undeclared variables will lead to errors.\n";
 
-    std::cout << "\n5. EXITING:\n";
-    std::cout << "   Type 'exit' to close the calculator.\n";
+    std::cout << "\n5. OPTIMIZER:\n";
+    std::cout << "   Type 'optimize' followed by an expression to see its tree before and after optimization.\n";
+    std::cout << "   For instance: optimize 2 * 3 + x^2\n";
+    std::cout << "   Start the calculator with --fast-math to allow rewrites that may change the last digit.\n";
+    std::cout << "   Start it with --jit to run compiled expressions as native code (same results, x86-64 only).\n";
+
+    std::cout << "\n6. DERIVATIVES:\n";
+    std::cout << "   Type 'grad' followed by an expression to get its value and its exact derivative\n";
+    std::cout << "   with respect to every variable. For instance, with x = 3 and y = 4:\n";
+    std::cout << "   grad 2x*y + y^2   gives 40, d/dx = 8 and d/dy = 14\n";
+
+    std::cout << "\n7. SOLVING EQUATIONS:\n";
+    std::cout << "   Type 'solve' followed by an equation to find every value of its unknown that satisfies it.\n";
+    std::cout << "   For instance: solve 2x + 3 = sqrt(x) + 10   gives x = 4.56873\n";
+    std::cout << "   The unknown is the one variable without a value; name it with 'for' if needed, and give\n";
+    std::cout << "   the range to search with 'in' (-100 to 100 by default): solve a*y^2 = 2 for y in 0, 10\n";
+
+    std::cout << "\n8. STATISTICS:\n";
+    std::cout << "   Type 'stats' to see how often each stage of the calculator ran, how long it took\n";
+    std::cout << "   (median, 99th percentile and slowest call) and how much memory it allocated.\n";
+    std::cout << "   Start the calculator with --metrics <file> to also save them as JSON when it exits.\n";
+
+    std::cout << "\n9. PROFILING:\n";
+    std::cout << "   Type 'profile' followed by an expression to see where its evaluation spends its time:\n";
+    std::cout << "   every node with its visits, total and own time, and [pow] on powers computed by std::pow.\n";
+    std::cout << "   'profile folded <expression>' prints folded stacks instead, for flame graph tools.\n";
+
+    std::cout << "\n10. EXACT ARITHMETIC:\n";
+    std::cout << "   Type 'exact' followed by an expression or assignment to compute it with exact integers and\n";
+    std::cout << "   fractions: exact 0.1 + 0.2 gives 0.3, exact 3^40 gives 12157665459056928801, exact 1/3 gives 1/3.\n";
+    std::cout << "   Square roots that are not exact fall back to double precision; start the calculator with\n";
+    std::cout << "   --precision <digits> to get that many decimal places instead.\n";
+
+    std::cout << "\n11. NUMBER TYPES:\n";
+    std::cout << "   Type 'mode' followed by float, double, long double, complex or interval to compute expressions\n";
+    std::cout << "   in that type ('mode' alone shows the current one). In complex mode sqrt(-4) gives 2i; in\n";
+    std::cout << "   interval mode 1/3 gives the two doubles around one third. Assignments always store a double.\n";
+    std::cout << "   Start the calculator with --scalar <type> to begin in a type, also in batch mode.\n";
+
+    std::cout << "\n12. SAVING AND LOADING:\n";
+    std::cout << "   Type 'save' followed by a file name to write every variable, every formula (reactive mode)\n";
+    std::cout << "   and the compiled expressions of the cache to a snapshot file; 'load' followed by a file name\n";
+    std::cout << "   reads one back without parsing anything. Start the calculator with --load <file> to begin\n";
+    std::cout << "   from a snapshot, also in batch mode. A damaged file is rejected and changes nothing.\n";
+
+    std::cout << "\n13. LIMITS:\n";
+    std::cout << "   Press Ctrl+C while a line is running to cancel it and get the prompt back. Start the\n";
+    std::cout << "   calculator with --max-nodes N, --max-depth N, --max-steps N or --timeout <ms> to stop any\n";
+    std::cout << "   line that grows too large or runs too long with \"Limit exceeded\", also in batch and server mode.\n";
+
+    std::cout << "\n14. EXITING:\n";
+    std::cout << "   Type 'exit' (or press Ctrl+C at the prompt) to close the calculator.\n";
 
     std::cout << "\nHappy calculating!\n\n";
 
@@ -72,31 +124,6 @@ std::string Utility::trim_string(const std::string& str) {
     return str.substr(first, (last - first + 1));
 }
 
-/* substitue_variables: Substitue variable names with their corresponding values in a given string*/
-std::string Utility::substitute_variables(const std::string& input, const std::unordered_map<std::string, double>& variables) {
-    std::string modified_input = input;
-
-    for (const auto& pair : variables) {
-        const std::string& name = pair.first;
-        const double& value = pair.second;
-
-        size_t pos = 0;
-
-        while ((pos = modified_input.find(name, pos)) != std::string::npos) {  // Check and replace every instance of the variable name
-            bool addMultiplication = pos > 0 && std::isdigit(modified_input[pos - 1]);
-
-            if (addMultiplication) {  // If variable follows a number, insert multiplication
-                modified_input.insert(pos, "*");
-                pos++;
-            }
-
-            modified_input.replace(pos, name.length(), std::to_string(value));  // Replace variable name with its value
-            pos += std::to_string(value).length();
-        }
-    }
-    return modified_input;
-}
-
 /* extract_variable_and_expression: Extract variable name and its corresponding expression from a string*/
 std::pair<std::string, std::string> Utility::extract_variable_and_expression(const std::string& input) {
 